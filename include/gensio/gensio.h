@@ -672,6 +672,56 @@ GENSIO_DLL_PUBLIC
 int gensio_check_keyaddrs_noport(struct gensio_os_funcs *o,
 				 const char *str, const char *key,
 				 int protocol, struct gensio_addr **ai);
+
+/*
+ * Like gensio_os_scan_netaddr(), but successful lookups are kept in
+ * a process-wide cache for the number of seconds in the
+ * "addr-cache-time" default, so scanning the same string again does
+ * not go to the resolver.  getaddrinfo() does not return the DNS
+ * TTL, so set addr-cache-time no longer than the TTLs you use.
+ * It is 0 by default, which disables the cache.
+ */
+GENSIO_DLL_PUBLIC
+int gensio_scan_netaddr_cached(struct gensio_os_funcs *o, const char *str,
+			       bool listen, int protocol,
+			       struct gensio_addr **raddr);
+
+/*
+ * Scan an address like gensio_scan_netaddr_cached(), but do the name
+ * lookup in a worker thread so the caller is not blocked while the
+ * resolver runs.  done is always called from a runner on o, never
+ * from inside this call.  On success addr belongs to the done
+ * function, it must free it.  If rop is not NULL, the operation is
+ * returned there and may be passed to gensio_scan_netaddr_cancel().
+ *
+ * If the os handler does not support threads, the lookup is done in
+ * the runner.
+ */
+struct gensio_netaddr_op;
+typedef void (*gensio_netaddr_done)(struct gensio_os_funcs *o, int err,
+				    struct gensio_addr *addr, void *cb_data);
+GENSIO_DLL_PUBLIC
+int gensio_scan_netaddr_async(struct gensio_os_funcs *o, const char *str,
+			      bool listen, int protocol,
+			      gensio_netaddr_done done, void *cb_data,
+			      struct gensio_netaddr_op **rop);
+
+/*
+ * Cancel an operation from gensio_scan_netaddr_async().  If this
+ * returns 0, the done function will not be called.  If the done
+ * function is currently being called, this returns GE_INUSE.  This
+ * may not be called after the done function has returned.
+ */
+GENSIO_DLL_PUBLIC
+int gensio_scan_netaddr_cancel(struct gensio_netaddr_op *op);
+
+/*
+ * Return the number of lookups in the cache above that were found in
+ * the cache and that had to go to the resolver.
+ */
+GENSIO_DLL_PUBLIC
+void gensio_netaddr_cache_stats(unsigned long *hits, unsigned long *misses);
+
 GENSIO_DLL_PUBLIC
 int gensio_check_keymode(const char *str, const char *key, unsigned int *rmode);
 GENSIO_DLL_PUBLIC
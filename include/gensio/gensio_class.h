@@ -411,6 +411,29 @@ GENSIO_DLL_PUBLIC
 int gensio_pparm_addrs_noport(struct gensio_pparm_info *p,
 			      const char *str, const char *key,
 			      int protocol, struct gensio_addr **ai);
+
+/*
+ * Keep an address scanned from a string up to date for a connecting
+ * gensio.  Call gensio_netaddr_refresh_check() when (re)opening.  If
+ * a lookup started by a previous call has finished with a new
+ * address, it is returned and belongs to the caller.  Otherwise NULL
+ * is returned.  If the address has been held for longer than the
+ * "addr-cache-time" default, a new lookup is started with
+ * gensio_scan_netaddr_async() for the next open to use.  This never
+ * blocks on the resolver.  If addr-cache-time is 0, *rr is set to
+ * NULL and the address is never looked up again.
+ */
+struct gensio_netaddr_refresh;
+GENSIO_DLL_PUBLIC
+int gensio_netaddr_refresh_alloc(struct gensio_os_funcs *o, const char *str,
+				 bool listen, int protocol,
+				 struct gensio_netaddr_refresh **rr);
+GENSIO_DLL_PUBLIC
+struct gensio_addr *gensio_netaddr_refresh_check(
+				struct gensio_netaddr_refresh *r);
+GENSIO_DLL_PUBLIC
+void gensio_netaddr_refresh_free(struct gensio_netaddr_refresh *r);
+
 GENSIO_DLL_PUBLIC
 int gensio_pparm_mode(struct gensio_pparm_info *p,
 		      const char *str, const char *key, unsigned int *rmode);
@@ -99,6 +99,13 @@
 #define GENSIO_CONTROL_OUT_IQ_BALANCE		72u
 #define GENSIO_CONTROL_IN_DC_OFFSET		73u
 #define GENSIO_CONTROL_OUT_DC_OFFSET		74u
+#define GENSIO_CONTROL_PRIORITY			75u
+#define GENSIO_CONTROL_WEIGHT			76u
+#define GENSIO_CONTROL_SESSION_REUSED		77u
+#define GENSIO_CONTROL_SESSION_STATS		78u
+#define GENSIO_CONTROL_RAW_IOD			79u
+#define GENSIO_CONTROL_READBUF			80u
+#define GENSIO_CONTROL_READ_STATS		81u
 
 /* Keep the async control numbers in a different range, just to be safe. */
 #define GENSIO_ACONTROL_SER_BAUD		1000u
@@ -126,4 +133,9 @@
  */
 #define GENSIO_ACC_CONTROL_TCPDNAME	3u
 
+/*
+ * Get the session resumption counts for an ssl accepter.
+ */
+#define GENSIO_ACC_CONTROL_SESSION_STATS	4u
+
 #endif /* GENSIO_CONTROL_H */
@@ -92,6 +92,35 @@ void gensio_fd_ll_handle_incoming(struct gensio_ll *ll,
 GENSIO_DLL_PUBLIC
 void *gensio_fd_ll_get_handler_data(struct gensio_ll *ll);
 
+/*
+ * Let the read buffer grow up to max_read_size bytes while reads keep
+ * filling it.  It shrinks back toward the size given at allocation
+ * when the reads stay small.  If max_read_size is not larger than
+ * that size, the buffer stays fixed, which is the default.
+ */
+GENSIO_DLL_PUBLIC
+void gensio_fd_ll_set_readbuf_max(struct gensio_ll *ll,
+				  gensiods max_read_size);
+
+/*
+ * When a read fills the read buffer and the user takes all the data,
+ * read again right away instead of waiting for the next read ready,
+ * until batch_size bytes have been read.  0, the default, does one
+ * read per read ready.
+ */
+GENSIO_DLL_PUBLIC
+void gensio_fd_ll_set_read_batch(struct gensio_ll *ll, gensiods batch_size);
+
+/*
+ * If sub_open() has to wait for something before it can create the
+ * fd, like a name lookup, it may return GE_INPROGRESS without setting
+ * the iod.  It must then call this when the wait is over, and
+ * sub_open() gets called again if the open is still in progress.
+ * The ll and its handler data are not freed until this is called.
+ */
+GENSIO_DLL_PUBLIC
+void gensio_fd_ll_sub_open_ready(struct gensio_ll *ll);
+
 GENSIO_DLL_PUBLIC
 struct gensio_ll *fd_gensio_ll_alloc(struct gensio_os_funcs *o,
 				     struct gensio_iod *iod,
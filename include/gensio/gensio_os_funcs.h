@@ -102,6 +102,23 @@ struct gensio_opensocks
     int flags;
 };
 
+/*
+ * One datagram for recvmfrom() and sendmto().  For receive, buf and
+ * buflen is the buffer to receive into and addr must have been
+ * allocated with addr_alloc_recvfrom().  For send, sg and sglen is
+ * the data and addr is the destination.  The number of bytes
+ * received or sent is returned in count.
+ */
+struct gensio_msg
+{
+    void *buf;
+    gensiods buflen;
+    const struct gensio_sg *sg;
+    gensiods sglen;
+    struct gensio_addr *addr;
+    gensiods count;
+};
+
 /*
  * Flags for opensock_flags.  For the set function, add the _SET_
  * flags for the options you want to set, and set the option bits for
@@ -120,6 +137,12 @@ struct gensio_opensocks
  * check needs to take into account all addresses.
  */
 #define GENSIO_OPENSOCK_BIND_ALLADDR	(1 << 6)
+/*
+ * Only used when opening listen sockets, set SO_REUSEPORT so several
+ * sockets can listen on the same port and the kernel will distribute
+ * connections between them.  Returns GE_NOTSUP if not available.
+ */
+#define GENSIO_OPENSOCK_REUSEPORT	(1 << 7)
 
 /* For recv and send */
 #define GENSIO_MSG_OOB 1
@@ -325,6 +348,17 @@ struct gensio_winsize {
  */
 #define GENSIO_CONTROL_SET_PROC_DATA	10001
 
+/*
+ * Get the shards of a sharded os handler, see
+ * gensio_unix_funcs_alloc_shard().  data points to an array of
+ * struct gensio_os_funcs pointers and *datalen is the number of
+ * entries in the array.  Up to *datalen shards are stored in the
+ * array and *datalen is set to the total number of shards.  data may
+ * be NULL to just get the number.  Returns GE_NOTSUP if the os handler
+ * is not sharded.
+ */
+#define GENSIO_CONTROL_GET_SHARDS	10002
+
 struct gensio_os_funcs {
     /* For use by the code doing the os function translation. */
     void *user_data;
@@ -857,6 +891,20 @@ struct gensio_os_funcs {
     int (*read_flags)(struct gensio_iod *iod, unsigned char *buf,
 		      unsigned char *flags, gensiods buflen,
 		      gensiods *rcount);
+
+    /*
+     * Receive or send a batch of datagrams in one call, like
+     * recvmmsg() and sendmmsg().  See struct gensio_msg for the
+     * message fields.  The number of messages actually handled is
+     * returned in ndone, this may be less than nmsgs.  For receive
+     * zero means nothing was available.  For send it means the socket
+     * was full.  These are NULL if the OS does not support batching,
+     * use recvfrom and sendto instead.
+     */
+    int (*recvmfrom)(struct gensio_iod *iod, struct gensio_msg *msgs,
+		     unsigned int nmsgs, unsigned int *ndone, int flags);
+    int (*sendmto)(struct gensio_iod *iod, struct gensio_msg *msgs,
+		   unsigned int nmsgs, unsigned int *ndone, int gflags);
 };
 
 /*
@@ -0,0 +1,44 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * File format for the trace gensio's binary mode.
+ *
+ * The file starts with the GENSIO_TRACE_MAGIC bytes, then a sequence
+ * of records.  Each record is a GENSIO_TRACE_HDR_SIZE byte header
+ * followed by the number of data bytes given in the header.  All
+ * header fields are little endian:
+ *
+ *   offset  size  field
+ *    0       4    len, number of data bytes after the header
+ *    4       1    op, one of GENSIO_TRACE_OP_xxx
+ *    5       3    reserved, zero
+ *    8       8    secs, monotonic time of the record
+ *   16       4    nsecs
+ *   20       4    err, a gensio error for the op, or the number of
+ *                 records lost for GENSIO_TRACE_OP_DROPPED
+ *
+ * A file appended to by multiple sessions has the magic only once, at
+ * the beginning.
+ */
+
+#ifndef GENSIO_TRACE_H
+#define GENSIO_TRACE_H
+
+#define GENSIO_TRACE_MAGIC	"GTRACE\0\1"
+#define GENSIO_TRACE_MAGIC_LEN	8
+
+#define GENSIO_TRACE_HDR_SIZE	24
+
+#define GENSIO_TRACE_OP_READ		0
+#define GENSIO_TRACE_OP_WRITE		1
+#define GENSIO_TRACE_OP_B4READ		2
+#define GENSIO_TRACE_OP_B4WRITE		3
+/* The ring was full and records were thrown away. */
+#define GENSIO_TRACE_OP_DROPPED		4
+
+#endif /* GENSIO_TRACE_H */
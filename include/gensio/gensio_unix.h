@@ -32,6 +32,24 @@ GENSIOOSH_DLL_PUBLIC
 int gensio_unix_funcs_alloc(struct selector_s *sel, int wake_sig,
 			    struct gensio_os_funcs **ro);
 
+/*
+ * Allocate a new shard of the given os funcs.  A shard is a full os
+ * funcs with its own selector, so it has its own locks and its own
+ * event loop.  The intent is to run one thread per shard, each
+ * calling service() (or waiting) on its own shard, with each gensio
+ * allocated with a single shard's os funcs so it is always handled by
+ * the same thread.  Network accepters with the "shard" option set
+ * open a listen socket on each shard.
+ *
+ * The os funcs passed in becomes the first shard and each shard
+ * holds a reference to it.  Shards are freed with free_funcs like any
+ * other os funcs.  Use the GENSIO_CONTROL_GET_SHARDS os funcs control
+ * to fetch the shards.
+ */
+GENSIOOSH_DLL_PUBLIC
+int gensio_unix_funcs_alloc_shard(struct gensio_os_funcs *o,
+				  struct gensio_os_funcs **rshard);
+
 #ifdef __cplusplus
 }
 #endif
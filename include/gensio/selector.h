@@ -30,6 +30,17 @@ struct selector_s;
  *
  * Note that this function will block wake_sig in the calling thread, and you
  * must have it blocked on all threads.
+ *
+ * The event mechanism (select, epoll, kevent or io_uring) is normally
+ * chosen at compile time, but it may be overridden by setting the
+ * GENSIO_SELECTOR environment variable to one of "select", "epoll",
+ * "epoll_lt", "kevent", or "io_uring".  "epoll_lt" uses epoll in
+ * level-triggered mode, which avoids an epoll_ctl() call per event.
+ *
+ * Timers are normally kept in a heap.  If the GENSIO_SELECTOR_TIMERS
+ * environment variable is set to "wheel", a hierarchical timer wheel
+ * is used instead, which makes starting and stopping timers O(1) but
+ * rounds timeouts up to the next millisecond.
  */
 typedef struct sel_lock_s sel_lock_t;
 SEL_DLL_PUBLIC
@@ -25,6 +25,20 @@
 
 #define FORCE_INLINE __attribute__((always_inline)) inline
 
+/*
+ * The vector decoder works on this many pairs of states at a time,
+ * with 32-bit path values.  These are GCC vector extensions, so they
+ * turn into whatever the CPU has (SSE2, NEON, etc.).  On x86-64 an
+ * AVX2 version is built too and used if the CPU has it.
+ */
+#define CONVCODE_VLANES 8
+typedef uint32_t convcode_vpath __attribute__ ((vector_size (32)));
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CONVCODE_HAVE_AVX2 1
+#else
+#define CONVCODE_HAVE_AVX2 0
+#endif
+
 #if 0
 /* Convenience for debugging. */
 #include <stdio.h>
@@ -393,9 +407,64 @@ static int convdecode_symbol_u_nt_nr(struct convcode *ce, convcode_symsize symbo
 				     const uint8_t *uncertainty);
 static int convdecode_symbol_nu_nt_nr(struct convcode *ce, convcode_symsize symbol,
 				      const uint8_t *uncertainty);
+typedef int (*convdecode_symbol_func)(struct convcode *ce,
+				      convcode_symsize symbol,
+				      const uint8_t *uncertainty);
+/* The vector versions, indexed by [tmptrel][recursive]. */
+static const convdecode_symbol_func convdecode_symbol_v[2][2];
+#if CONVCODE_HAVE_AVX2
+static const convdecode_symbol_func convdecode_symbol_avx2[2][2];
+#endif
 static int output_bits(struct convcode *ce, struct convcode_outdata *of,
 		       unsigned int bits, unsigned int len);
 
+bool
+convdecode_set_simd(struct convcode *ce, bool val)
+{
+    bool recursive = ce->recursive;
+    bool tmptrel = ce->trelw < ce->num_states;
+
+    /* The vector code does CONVCODE_VLANES pairs of states at a time. */
+    if (ce->num_states < CONVCODE_VLANES * 2)
+	val = false;
+
+    /* Get the proper function for decoding symbols. */
+    if (val) {
+#if CONVCODE_HAVE_AVX2
+	if (__builtin_cpu_supports("avx2"))
+	    ce->decode_symbol = convdecode_symbol_avx2[tmptrel][recursive];
+	else
+#endif
+	    ce->decode_symbol = convdecode_symbol_v[tmptrel][recursive];
+    } else if (recursive) {
+	if (tmptrel) {
+	    if (ce->do_uncertainty)
+		ce->decode_symbol = convdecode_symbol_u_t_r;
+	    else
+		ce->decode_symbol = convdecode_symbol_nu_t_r;
+	} else {
+	    if (ce->do_uncertainty)
+		ce->decode_symbol = convdecode_symbol_u_nt_r;
+	    else
+		ce->decode_symbol = convdecode_symbol_nu_nt_r;
+	}
+    } else {
+	if (tmptrel) {
+	    if (ce->do_uncertainty)
+		ce->decode_symbol = convdecode_symbol_u_t_nr;
+	    else
+		ce->decode_symbol = convdecode_symbol_nu_t_nr;
+	} else {
+	    if (ce->do_uncertainty)
+		ce->decode_symbol = convdecode_symbol_u_nt_nr;
+	    else
+		ce->decode_symbol = convdecode_symbol_nu_nt_nr;
+	}
+    }
+
+    return val;
+}
+
 int
 setup_convcode1(struct convcode *ce, unsigned int k,
 		convcode_state *polynomials, unsigned int num_polynomials,
@@ -423,33 +492,7 @@ setup_convcode1(struct convcode *ce, unsigned int k,
     ce->do_uncertainty = do_uncertainty;
     ce->enc_out.output_bits = output_bits;
     ce->dec_out.output_bits = output_bits;
-
-    /* Get the proper function for decoding symbols. */
-    if (recursive) {
-	if (ce->trelw < ce->num_states) {
-	    if (ce->do_uncertainty)
-		ce->decode_symbol = convdecode_symbol_u_t_r;
-	    else
-		ce->decode_symbol = convdecode_symbol_nu_t_r;
-	} else {
-	    if (ce->do_uncertainty)
-		ce->decode_symbol = convdecode_symbol_u_nt_r;
-	    else
-		ce->decode_symbol = convdecode_symbol_nu_nt_r;
-	}
-    } else {
-	if (ce->trelw < ce->num_states) {
-	    if (ce->do_uncertainty)
-		ce->decode_symbol = convdecode_symbol_u_t_nr;
-	    else
-		ce->decode_symbol = convdecode_symbol_nu_t_nr;
-	} else {
-	    if (ce->do_uncertainty)
-		ce->decode_symbol = convdecode_symbol_u_nt_nr;
-	    else
-		ce->decode_symbol = convdecode_symbol_nu_nt_nr;
-	}
-    }
+    convdecode_set_simd(ce, true);
 
     if (num_polynomials == 2 || num_polynomials == 4 || num_polynomials == 8)
 	ce->optimize_no_span = true;
@@ -1209,9 +1252,134 @@ decode_one_state(struct convcode *ce, unsigned int i, convcode_symsize symbol,
     }
 }
 
-#if DO_SIMD
-typedef unsigned int v4su __attribute__ ((vector_size (16)));
-#endif
+/*
+ * Add the branch values (see hamming_distance()) for a vector of
+ * encoder outputs to v.  base is the value for an all zero output and
+ * delta[i] is what bit i being set adds to that (it may be negative,
+ * that works because it's all unsigned).  Vectors are passed by
+ * reference, passing them by value changes the ABI between the
+ * vector clones.
+ */
+static FORCE_INLINE void
+add_branch_values_v(convcode_vpath *v, const convcode_vpath *conv,
+		    uint32_t base, const uint32_t *delta,
+		    unsigned int num_polys)
+{
+    unsigned int i;
+
+    *v += base;
+    for (i = 0; i < num_polys; i++)
+	*v += -((*conv >> i) & 1) & delta[i];
+}
+
+/*
+ * A vector version of calling decode_one_state() for every state,
+ * giving exactly the same results.  It is done as butterflies: states
+ * j and j + num_states / 2 are the only previous states of 2 * j and
+ * 2 * j + 1, so a vector of j values gives two vectors of new states.
+ * It works for all the modes.  For uncertainty, the branch values are
+ * added up per output bit, and without uncertainty the same thing
+ * with 0 or 1 per bit gives the number of different bits.
+ */
+static FORCE_INLINE void
+decode_states_v(struct convcode *ce, convcode_symsize symbol,
+		unsigned int *prevp, unsigned int *currp, convcode_state *trel,
+		bool do_uncertainty, bool do_recursive,
+		const uint8_t *uncertainty)
+{
+    const convcode_symsize *conv0 = ce->convert[0], *conv1 = ce->convert[1];
+    const convcode_state *next0 = ce->next_state[0];
+    unsigned int i, j, l, half = ce->num_states / 2;
+    uint32_t base = 0, delta[CONVCODE_MAX_POLYNOMIALS];
+
+    for (i = 0; i < ce->num_polys; i++) {
+	unsigned int sbit = (symbol >> i) & 1, v0, v1;
+
+	if (do_uncertainty) {
+	    /* A matching bit costs the uncertainty, else 100% - that. */
+	    v0 = sbit ? ce->uncertainty_100 - uncertainty[i] : uncertainty[i];
+	    v1 = sbit ? uncertainty[i] : ce->uncertainty_100 - uncertainty[i];
+	} else {
+	    v0 = sbit;
+	    v1 = !sbit;
+	}
+	base += v0;
+	delta[i] = v1 - v0;
+    }
+
+    for (j = 0; j < half; j += CONVCODE_VLANES) {
+	convcode_vpath p1, p2, prev1, prev2, sel, v1, v2;
+	convcode_vpath c1e, c2e, c1o, c2o, b1e, b2e, b1o, b2o;
+	convcode_vpath curre, curro, trele, trelo;
+
+	for (l = 0; l < CONVCODE_VLANES; l++)
+	    p1[l] = j + l;
+	p2 = p1 + half;
+	memcpy(&prev1, prevp + j, sizeof(prev1));
+	memcpy(&prev2, prevp + j + half, sizeof(prev2));
+
+	if (do_recursive) {
+	    /* Same as get_prev_bit(), 0 if next_state[0] goes there. */
+	    convcode_vpath n1, n2, a1, a2, ev = p1 << 1, od = ev + 1;
+
+	    for (l = 0; l < CONVCODE_VLANES; l++) {
+		n1[l] = next0[j + l];
+		n2[l] = next0[j + half + l];
+	    }
+	    b1e = (convcode_vpath) (n1 != ev) & 1;
+	    b2e = (convcode_vpath) (n2 != ev) & 1;
+	    b1o = (convcode_vpath) (n1 != od) & 1;
+	    b2o = (convcode_vpath) (n2 != od) & 1;
+
+	    for (l = 0; l < CONVCODE_VLANES; l++) {
+		c1e[l] = conv0[j + l];
+		c2e[l] = conv0[j + half + l];
+		a1[l] = conv1[j + l];
+		a2[l] = conv1[j + half + l];
+	    }
+	    c1o = (c1e & (b1o - 1)) | (a1 & -b1o);
+	    c2o = (c2e & (b2o - 1)) | (a2 & -b2o);
+	    c1e = (c1e & (b1e - 1)) | (a1 & -b1e);
+	    c2e = (c2e & (b2e - 1)) | (a2 & -b2e);
+	} else {
+	    /* The bit is the low bit of the new state. */
+	    b1e = b2e = p1 ^ p1;
+	    b1o = b2o = b1e + 1;
+	    for (l = 0; l < CONVCODE_VLANES; l++) {
+		c1e[l] = conv0[j + l];
+		c2e[l] = conv0[j + half + l];
+		c1o[l] = conv1[j + l];
+		c2o[l] = conv1[j + half + l];
+	    }
+	}
+
+	/* Pick the lowest, the first on a tie like decode_one_state(). */
+	v1 = prev1;
+	add_branch_values_v(&v1, &c1e, base, delta, ce->num_polys);
+	v2 = prev2;
+	add_branch_values_v(&v2, &c2e, base, delta, ce->num_polys);
+	sel = (convcode_vpath) (v2 < v1);
+	curre = (v2 & sel) | (v1 & ~sel);
+	trele = (((p2 | (b2e << (CONVCODE_MAX_K - 1))) & sel) |
+		 ((p1 | (b1e << (CONVCODE_MAX_K - 1))) & ~sel));
+
+	v1 = prev1;
+	add_branch_values_v(&v1, &c1o, base, delta, ce->num_polys);
+	v2 = prev2;
+	add_branch_values_v(&v2, &c2o, base, delta, ce->num_polys);
+	sel = (convcode_vpath) (v2 < v1);
+	curro = (v2 & sel) | (v1 & ~sel);
+	trelo = (((p2 | (b2o << (CONVCODE_MAX_K - 1))) & sel) |
+		 ((p1 | (b1o << (CONVCODE_MAX_K - 1))) & ~sel));
+
+	for (l = 0; l < CONVCODE_VLANES; l++) {
+	    currp[(j + l) * 2] = curre[l];
+	    currp[(j + l) * 2 + 1] = curro[l];
+	    trel[(j + l) * 2] = trele[l];
+	    trel[(j + l) * 2 + 1] = trelo[l];
+	}
+    }
+}
 
 /*
  * We come here with a symbol (the number of bits is the number of
@@ -1221,7 +1389,7 @@ typedef unsigned int v4su __attribute__ ((vector_size (16)));
 static FORCE_INLINE int
 convdecode_symbol_i(struct convcode *ce, convcode_symsize symbol,
 		    bool do_tmptrel, bool do_uncertainty, bool do_recursive,
-		    const uint8_t *uncertainty)
+		    bool do_simd, const uint8_t *uncertainty)
 {
     /* Previous error count/uncertainty values. */
     unsigned int *prevp = ce->prev_path_values;
@@ -1245,72 +1413,10 @@ convdecode_symbol_i(struct convcode *ce, convcode_symsize symbol,
     else
 	trel = get_trellis_column(ce, ce->ctrellis);
 
-#if DO_SIMD
-    /*
-     * This is an SIMD implementation using GCC builtins, only valid
-     * for non-recursive without uncertainty.  It does 4 values at a
-     * time.  See the README for details on this.
-     */
-    if (!do_recursive && !do_uncertainty) {
-	for (i = 0; i < ce->num_states; ) {
-	    convcode_state pstate1[4], pstate2[4];
-	    v4su cmpv1, cmpv2;
-	    v4su dist1, dist2;
-	    v4su tmp;
-	    unsigned int j;
-#define X(v) ((v) & 1)
-
-	    for (j = 0; j < 4; j++) {
-		pstate1[j] = (i + j) >> 1;
-		pstate2[j] = ((i + j) >> 1) | (1 << (ce->k - 2));
-	    }
-
-	    for (j = 0; j < 4; j++)
-		cmpv1[j] = ce->convert[X(i + j)][pstate1[j]];
-
-	    for (j = 0; j < 4; j++)
-		cmpv2[j] = ce->convert[X(i + j)][pstate2[j]];
-
-	    for (j = 0; j < 4; j++)
-		dist1[j] = prevp[pstate1[j]];
-
-	    for (j = 0; j < 4; j++)
-		dist2[j] = prevp[pstate2[j]];
-
-	    /*
-	     * Two implementations of doing popcount are shown below.
-	     * There's not much performance difference on my system.
-	     */
-	    cmpv1 ^= symbol;
-	    /* Russian peasant algorithm in SIMD */
-	    cmpv1 = (cmpv1 & 0x55555555) + ((cmpv1 >> 1) & 0x55555555);
-	    cmpv1 = (cmpv1 & 0x33333333) + ((cmpv1 >> 2) & 0x33333333);
-	    cmpv1 = (cmpv1 & 0x0f0f0f0f) + ((cmpv1 >> 4) & 0x0f0f0f0f);
-	    cmpv1 = (cmpv1 & 0x00ff00ff) + ((cmpv1 >> 8) & 0x00ff00ff);
-	    cmpv1 = (cmpv1 & 0x0000ffff) + ((cmpv1 >> 16) & 0x0000ffff);
-	    dist1 += cmpv1;
-
-	    cmpv2 ^= symbol;
-	    /* Builtin instruction, but not vectorized */
-	    for (j = 0; j < 4; j++)
-		tmp[j] = __builtin_popcount(cmpv2[j]);
-	    dist2 += tmp;
-
-	    tmp = dist2 < dist1;
-
-	    for (j = 0; j < 4; j++, i++) {
-		if (tmp[j]) {
-		    trel[i] = CONVCODE_PSTATE_SET_BIT(pstate2[j], X(i));
-		    currp[i] = dist2[j];
-		} else {
-		    trel[i] = CONVCODE_PSTATE_SET_BIT(pstate1[j], X(i));
-		    currp[i] = dist1[j];
-		}
-	    }
-	}
-#undef X
+    if (do_simd) {
+	decode_states_v(ce, symbol, prevp, currp, trel,
+			do_uncertainty, do_recursive, uncertainty);
     } else
-#endif
     {
 	/*
 	 * For each possible state, calculate the most probable previous
@@ -1410,58 +1516,102 @@ static int
 convdecode_symbol_u_t_r(struct convcode *ce, convcode_symsize symbol,
 			const uint8_t *uncertainty)
 {
-    return convdecode_symbol_i(ce, symbol, true, true, true, uncertainty);
+    return convdecode_symbol_i(ce, symbol, true, true, true, false,
+			       uncertainty);
 }
 
 static int
 convdecode_symbol_nu_t_r(struct convcode *ce, convcode_symsize symbol,
 			 const uint8_t *uncertainty)
 {
-    return convdecode_symbol_i(ce, symbol, true, false, true, NULL);
+    return convdecode_symbol_i(ce, symbol, true, false, true, false,
+			       NULL);
 }
 
 static int
 convdecode_symbol_u_nt_r(struct convcode *ce, convcode_symsize symbol,
 			 const uint8_t *uncertainty)
 {
-    return convdecode_symbol_i(ce, symbol, false, true, true, uncertainty);
+    return convdecode_symbol_i(ce, symbol, false, true, true, false,
+			       uncertainty);
 }
 
 static int
 convdecode_symbol_nu_nt_r(struct convcode *ce, convcode_symsize symbol,
 			  const uint8_t *uncertainty)
 {
-    return convdecode_symbol_i(ce, symbol, false, false, true, NULL);
+    return convdecode_symbol_i(ce, symbol, false, false, true, false,
+			       NULL);
 }
 
 static int
 convdecode_symbol_u_t_nr(struct convcode *ce, convcode_symsize symbol,
 			 const uint8_t *uncertainty)
 {
-    return convdecode_symbol_i(ce, symbol, true, true, false, uncertainty);
+    return convdecode_symbol_i(ce, symbol, true, true, false, false,
+			       uncertainty);
 }
 
 static int
 convdecode_symbol_nu_t_nr(struct convcode *ce, convcode_symsize symbol,
 			  const uint8_t *uncertainty)
 {
-    return convdecode_symbol_i(ce, symbol, true, false, false, NULL);
+    return convdecode_symbol_i(ce, symbol, true, false, false, false,
+			       NULL);
 }
 
 static int
 convdecode_symbol_u_nt_nr(struct convcode *ce, convcode_symsize symbol,
 			  const uint8_t *uncertainty)
 {
-    return convdecode_symbol_i(ce, symbol, false, true, false, uncertainty);
+    return convdecode_symbol_i(ce, symbol, false, true, false, false,
+			       uncertainty);
 }
 
 static int
 convdecode_symbol_nu_nt_nr(struct convcode *ce, convcode_symsize symbol,
 			   const uint8_t *uncertainty)
 {
-    return convdecode_symbol_i(ce, symbol, false, false, false, NULL);
+    return convdecode_symbol_i(ce, symbol, false, false, false, false,
+			       NULL);
 }
 
+/*
+ * The vector versions.  Uncertainty only changes how the branch
+ * values are set up for each symbol, so it is not split out.
+ */
+#define CONVDECODE_SYMBOL_V(name, attr, tmptrel, recursive)		\
+static attr int								\
+name(struct convcode *ce, convcode_symsize symbol,			\
+     const uint8_t *uncertainty)					\
+{									\
+    return convdecode_symbol_i(ce, symbol, tmptrel, ce->do_uncertainty, \
+			       recursive, true, uncertainty);		\
+}
+
+CONVDECODE_SYMBOL_V(convdecode_symbol_v_t_r, , true, true)
+CONVDECODE_SYMBOL_V(convdecode_symbol_v_nt_r, , false, true)
+CONVDECODE_SYMBOL_V(convdecode_symbol_v_t_nr, , true, false)
+CONVDECODE_SYMBOL_V(convdecode_symbol_v_nt_nr, , false, false)
+
+static const convdecode_symbol_func convdecode_symbol_v[2][2] = {
+    { convdecode_symbol_v_nt_nr, convdecode_symbol_v_nt_r },
+    { convdecode_symbol_v_t_nr, convdecode_symbol_v_t_r }
+};
+
+#if CONVCODE_HAVE_AVX2
+#define CONVCODE_AVX2 __attribute__((target("avx2")))
+CONVDECODE_SYMBOL_V(convdecode_symbol_avx2_t_r, CONVCODE_AVX2, true, true)
+CONVDECODE_SYMBOL_V(convdecode_symbol_avx2_nt_r, CONVCODE_AVX2, false, true)
+CONVDECODE_SYMBOL_V(convdecode_symbol_avx2_t_nr, CONVCODE_AVX2, true, false)
+CONVDECODE_SYMBOL_V(convdecode_symbol_avx2_nt_nr, CONVCODE_AVX2, false, false)
+
+static const convdecode_symbol_func convdecode_symbol_avx2[2][2] = {
+    { convdecode_symbol_avx2_nt_nr, convdecode_symbol_avx2_nt_r },
+    { convdecode_symbol_avx2_t_nr, convdecode_symbol_avx2_t_r }
+};
+#endif
+
 /*
  * Extract nbits bits from bytes at offset curr.
  */
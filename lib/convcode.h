@@ -338,6 +338,16 @@ void reinit_convcode(struct convcode *ce);
 void convdecode_set_max_uncertainty(struct convcode *ce,
 				    uint8_t max_uncertainty);
 
+/*
+ * Decoding normally uses a vector (SIMD) version of the trellis
+ * calculations if the number of states is large enough (K of 5 or
+ * more), which gives exactly the same results as the scalar code,
+ * just faster.  Set this to false to use the scalar code.  Returns
+ * whether the vector code will be used.  Call this after allocation
+ * or setup_convcode1().
+ */
+bool convdecode_set_simd(struct convcode *ce, bool val);
+
 /*
  * Feed some data into encoder.  The size is given in bits, the data
  * goes in low bit first.  The last byte does not have to be completely
@@ -0,0 +1,206 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2024  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * Sliding DFT bins for the FSK receiver, done for all the bins at once
+ * with GCC vector extensions.
+ *
+ * The plain way to do this is one bin at a time, running the sine and
+ * cosine sums for a bin down the whole buffer, then the next bin.  The
+ * sum for each sample has to wait on the sum for the previous sample,
+ * so that runs at the speed of a float add per sample per bin.  Here
+ * the sine and cosine (or real and imaginary) sums of every bin sit
+ * next to each other in vectors so all the bins are added at once,
+ * and the first sum is split into several partial sums so the adds
+ * don't all wait on each other.  Adding in a different order rounds a
+ * little differently, so the results are not bit for bit the same as
+ * the plain way, just as good.
+ */
+
+#ifndef GENSIO_FSKDFT_H
+#define GENSIO_FSKDFT_H
+
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <gensio/gensio_os_funcs.h>
+
+#define DFTBINS_MAX	8
+#define DFTBINS_VLANES	4
+
+/* The allocator doesn't promise vector alignment, so don't ask for it. */
+typedef float dftbins_vec __attribute__ ((vector_size (16), aligned (4)));
+
+struct dftbins {
+    bool is_complex;
+    unsigned int nbins;
+    unsigned int nvecs; /* Vectors per sample, nbins * 2 lanes rounded up. */
+    unsigned int bitsize;
+    unsigned int workedge;
+    unsigned int worksize; /* bitsize + 2 * workedge */
+
+    /*
+     * worksize * nvecs vectors.  For real data, the sine and cosine
+     * for each bin are next to each other.  For complex data it's
+     * the real and imaginary part of each bin, and cswap holds the
+     * imaginary and real parts with the imaginary negated, which is
+     * what the imaginary part of the sample gets multiplied by.
+     */
+    dftbins_vec *coefs;
+    dftbins_vec *cswap;
+};
+
+static void
+dftbins_cleanup(struct gensio_os_funcs *o, struct dftbins *d)
+{
+    if (d->coefs)
+	o->free(o, d->coefs);
+    if (d->cswap)
+	o->free(o, d->cswap);
+    d->coefs = NULL;
+    d->cswap = NULL;
+}
+
+/*
+ * Set up from the per-bin tables.  Each table is laid out the way the
+ * FSK code generates them, for real data 2 * bitsize sines then 2 *
+ * bitsize cosines, for complex data 2 * bitsize complex values.  The
+ * tables are copied, the caller still owns them.  Returns true on
+ * failure.
+ */
+static bool
+dftbins_setup(struct gensio_os_funcs *o, struct dftbins *d, bool is_complex,
+	      unsigned int nbins, float **tabs, unsigned int bitsize,
+	      unsigned int workedge)
+{
+    unsigned int i, j, lane;
+    float *c, *s;
+
+    if (nbins == 0 || nbins > DFTBINS_MAX)
+	return true;
+
+    d->is_complex = is_complex;
+    d->nbins = nbins;
+    d->nvecs = (nbins * 2 + DFTBINS_VLANES - 1) / DFTBINS_VLANES;
+    d->bitsize = bitsize;
+    d->workedge = workedge;
+    d->worksize = bitsize + 2 * workedge;
+
+    d->coefs = o->zalloc(o, sizeof(dftbins_vec) * d->nvecs * d->worksize);
+    if (!d->coefs)
+	goto out_nomem;
+    if (is_complex) {
+	d->cswap = o->zalloc(o, sizeof(dftbins_vec) * d->nvecs * d->worksize);
+	if (!d->cswap)
+	    goto out_nomem;
+    }
+
+    c = (float *) d->coefs;
+    s = (float *) d->cswap;
+    for (i = 0; i < d->worksize; i++) {
+	for (j = 0; j < nbins; j++) {
+	    lane = i * d->nvecs * DFTBINS_VLANES + j * 2;
+	    if (is_complex) {
+		c[lane] = tabs[j][i * 2];
+		c[lane + 1] = tabs[j][i * 2 + 1];
+		s[lane] = -tabs[j][i * 2 + 1];
+		s[lane + 1] = tabs[j][i * 2];
+	    } else {
+		c[lane] = tabs[j][i];
+		c[lane + 1] = tabs[j][i + 2 * bitsize];
+	    }
+	}
+    }
+    return false;
+
+ out_nomem:
+    dftbins_cleanup(o, d);
+    return true;
+}
+
+/*
+ * Calculate the power of each bin at each alignment.  This is a DFT
+ * bin analysis, measuring the power of the signal at a bin's
+ * frequency against its sine/cosine (or complex exponential) table.
+ *
+ * buf holds worksize real or complex samples, the currently aligned
+ * bit is in the middle with workedge extra samples on each side.  The
+ * power of the bitsize samples starting at sample n goes in
+ * power[bin][n], n goes from 0 to 2 * workedge, so the middle value
+ * is the currently aligned one and the others are what it would be if
+ * the alignment moved left or right.  That lets the caller tell how
+ * well it is aligned on a transition between mark and space.  The
+ * maximum power for each bin goes in maxp[bin].
+ *
+ * The sums for the first bitsize samples give the power at 0, then
+ * for each following sample the product of the sample that moved out
+ * of the window is taken off and the new one added.  The first sums
+ * are done as four partial sums.
+ */
+static inline __attribute__ ((always_inline)) void
+dftbins_calc_vec(struct dftbins *d, const float *buf, float **power,
+		 float *maxp, unsigned int v, const bool is_complex)
+{
+    const dftbins_vec *c = d->coefs + v;
+    const dftbins_vec *s = is_complex ? d->cswap + v : NULL;
+    unsigned int nvecs = d->nvecs, bitsize = d->bitsize;
+    unsigned int i, j, b, bin = v * DFTBINS_VLANES / 2, nb = d->nbins - bin;
+    dftbins_vec s0 = { 0 }, s1 = { 0 }, s2 = { 0 }, s3 = { 0 }, acc, sq;
+    float p, maxv[DFTBINS_VLANES / 2];
+
+    if (nb > DFTBINS_VLANES / 2)
+	nb = DFTBINS_VLANES / 2;
+
+    /* Product of sample i and the coefficients. */
+#define DFTPROD(i)							\
+    (is_complex ?							\
+     c[(i) * nvecs] * buf[(i) * 2] + s[(i) * nvecs] * buf[(i) * 2 + 1] : \
+     c[(i) * nvecs] * buf[i])
+
+    for (i = 0; i + 4 <= bitsize; i += 4) {
+	s0 += DFTPROD(i);
+	s1 += DFTPROD(i + 1);
+	s2 += DFTPROD(i + 2);
+	s3 += DFTPROD(i + 3);
+    }
+    for (; i < bitsize; i++)
+	s0 += DFTPROD(i);
+    acc = (s0 + s1) + (s2 + s3);
+
+    for (j = 0; ; j++, i++) {
+	sq = acc * acc;
+	for (b = 0; b < nb; b++) {
+	    p = sq[b * 2] + sq[b * 2 + 1];
+	    if (is_complex)
+		p = sqrtf(p);
+	    power[bin + b][j] = p;
+	    if (j == 0 || p > maxv[b])
+		maxv[b] = p;
+	}
+	if (i >= d->worksize)
+	    break;
+	acc += DFTPROD(i) - DFTPROD(j);
+    }
+    for (b = 0; b < nb; b++)
+	maxp[bin + b] = maxv[b];
+#undef DFTPROD
+}
+
+static void
+dftbins_calc(struct dftbins *d, const float *buf, float **power, float *maxp)
+{
+    unsigned int v;
+
+    for (v = 0; v < d->nvecs; v++) {
+	if (d->is_complex)
+	    dftbins_calc_vec(d, buf, power, maxp, v, true);
+	else
+	    dftbins_calc_vec(d, buf, power, maxp, v, false);
+    }
+}
+
+#endif /* GENSIO_FSKDFT_H */
@@ -24,6 +24,7 @@
 #include <gensio/gensio_osops.h>
 
 #include "gensio_net.h"
+#include "resolve.h"
 
 static void check_flush_sync_io(struct gensio *io);
 
@@ -2495,6 +2496,7 @@ struct gensio_def_entry builtin_defaults[] = {
     { "nodelay",	GENSIO_DEFAULT_BOOL,	.def.intval = 0 },
     { "laddr",		GENSIO_DEFAULT_STR,	.def.strval = NULL },
     /* TCP only */
+    { "async-lookup",	GENSIO_DEFAULT_BOOL,	.def.intval = 0 },
 #ifdef HAVE_TCPD_H
     { "tcpd",		GENSIO_DEFAULT_ENUM,	.enums = tcpd_enums,
 						.def.intval = GENSIO_TCPD_ON },
@@ -2502,6 +2504,9 @@ struct gensio_def_entry builtin_defaults[] = {
     /* UDP only */
     { "mttl",		GENSIO_DEFAULT_INT,	.min = 1, .max = 255,
 						.def.intval = 1 },
+    /* UDP and unixdgram */
+    { "mmsg",		GENSIO_DEFAULT_INT,	.min = 1, .max = 1024,
+						.def.intval = 1 },
     /* SCTP only */
     { "instreams",	GENSIO_DEFAULT_INT,	.min = 1, .max = INT_MAX,
 						.def.intval = 1 },
@@ -2511,6 +2516,13 @@ struct gensio_def_entry builtin_defaults[] = {
 						.def.intval = 1 },
     { "sack_delay",	GENSIO_DEFAULT_INT,	.min = 0, .max = INT_MAX,
 						.def.intval = 10 },
+    /* Read buffer sizing and batching for tcp, unix, pty, and serialdev. */
+    { "readbuf",	GENSIO_DEFAULT_INT,	.min = 1, .max = INT_MAX,
+					.def.intval = GENSIO_DEFAULT_BUF_SIZE },
+    { "readbuf-max",	GENSIO_DEFAULT_INT,	.min = 0, .max = INT_MAX,
+						.def.intval = 0 },
+    { "readbatch",	GENSIO_DEFAULT_INT,	.min = 0, .max = INT_MAX,
+						.def.intval = 0 },
     /* TCP and SCTP, UDP get added in init as false. */
     { "reuseaddr",	GENSIO_DEFAULT_BOOL,	.def.intval = 1 },
     { "drain_timeout",	GENSIO_DEFAULT_INT,	.min = -1, .max = INT_MAX,
@@ -2554,6 +2566,7 @@ struct gensio_def_entry builtin_defaults[] = {
     { "cert",		GENSIO_DEFAULT_STR,	.def.strval = NULL },
     { "key",		GENSIO_DEFAULT_STR,	.def.strval = NULL },
     { "clientauth",	GENSIO_DEFAULT_BOOL,	.def.intval = false },
+    { "resume",		GENSIO_DEFAULT_BOOL,	.def.intval = false },
     /* General authentication flags. */
     { "allow-authfail",	GENSIO_DEFAULT_BOOL,	.def.intval = false },
     { "username",	GENSIO_DEFAULT_STR,	.def.strval = NULL },
@@ -2574,6 +2587,14 @@ struct gensio_def_entry builtin_defaults[] = {
      */
     { "con-timeout",	GENSIO_DEFAULT_INT,	.def.intval = 60 },
 
+    /*
+     * How long, in seconds, a scanned network address is kept in the
+     * address cache and before it is looked up again on a reopen.  0,
+     * the default, disables both.
+     */
+    { "addr-cache-time",GENSIO_DEFAULT_INT,	.min = 0, .max = INT_MAX,
+						.def.intval = 0 },
+
     /* For mdns */
     { "name",		GENSIO_DEFAULT_STR,	.def.strval = NULL },
     { "type",		GENSIO_DEFAULT_STR,	.def.strval = NULL },
@@ -2634,6 +2655,8 @@ gensio_cleanup_mem(struct gensio_os_funcs *o)
     struct registered_gensio *g, *g2;
     struct gensio_class_cleanup *cl = cleanups;
 
+    gensio_resolve_cleanup_mem();
+
     if (gensio_base_lock)
 	o->free_lock(gensio_base_lock);
     gensio_base_lock = NULL;
@@ -124,7 +124,15 @@ struct udpn_data {
 
     struct gensio_addr *raddr;		/* Points to remote, for convenience. */
 
+    /* Looks raddr up again on reopens, only for clients from a string. */
+    struct gensio_netaddr_refresh *refresh;
+
     struct gensio_link link;
+    bool on_udpns;		/* In nadata->udpns, not closed_udpns. */
+
+    /* For finding the connection from raddr, see udpn_find(). */
+    unsigned int hash;
+    struct udpn_data *hash_next;
 };
 
 #define gensio_link_to_ndata(l) \
@@ -148,6 +156,13 @@ struct udpna_data {
     struct gensio_accepter *acc;
     struct gensio_list udpns;
     unsigned int udpn_count;
+
+    /*
+     * All the udpns, open and closed, hashed by remote address.  The
+     * size is a power of 2 and grows with udpn_count.
+     */
+    struct udpn_data **udpn_hash;
+    unsigned int udpn_hash_size;
     unsigned int refcount;
 
     struct gensio_os_funcs *o;
@@ -156,6 +171,33 @@ struct udpna_data {
 
     gensiods max_read_size;
 
+    /*
+     * Received packets.  rxbuf holds mmsg buffers of max_read_size,
+     * with mmsg > 1 a single read handler call pulls in as many
+     * packets as it can with recvmfrom() and they are handed out one
+     * at a time from rxmsgs.  read_data and curr_recvaddr point to the
+     * packet currently being delivered.
+     */
+    unsigned int mmsg;
+    unsigned char *rxbuf;
+    struct gensio_msg *rxmsgs;
+    unsigned int rx_count;
+    unsigned int rx_pos;
+    struct gensio_iod *rx_iod;
+    bool in_rx_batch;
+
+    /*
+     * Packets written while handling a batch of received packets are
+     * copied into txbuf and sent together with sendmto() when the
+     * batch is done.  Only allocated if mmsg > 1.
+     */
+    unsigned char *txbuf;
+    gensiods tx_len;
+    struct gensio_msg *txmsgs;
+    struct gensio_sg *txsgs;
+    unsigned int tx_count;
+    struct gensio_iod *tx_iod;
+
     unsigned char *read_data;
 
     bool readhandler_read_disabled;
@@ -223,6 +265,7 @@ struct udpna_data {
 };
 
 static void udpna_do_free(struct udpna_data *nadata);
+static void udpna_process_rx(struct udpna_data *nadata);
 
 static void
 i_udpna_lock(struct udpna_data *nadata)
@@ -352,30 +395,139 @@ static void udpna_start_deferred_op(struct udpna_data *nadata)
     }
 }
 
+/*
+ * If received packets are waiting behind data that was just consumed,
+ * deliver them from the deferred op.  While handling a batch the read
+ * handler takes care of it itself.
+ */
+static void
+udpna_check_rx_pending(struct udpna_data *nadata)
+{
+    if (!nadata->in_rx_batch && !nadata->data_pending_len &&
+		nadata->rx_pos < nadata->rx_count)
+	udpna_start_deferred_op(nadata);
+}
+
 static void
 udpn_remove_from_list(struct gensio_list *list, struct udpn_data *ndata)
 {
     gensio_list_rm(list, &ndata->link);
 }
 
-static struct udpn_data *
-udpn_find(struct gensio_list *list, struct gensio_addr *addr)
+static void udpn_add_to_list(struct gensio_list *list, struct udpn_data *ndata)
 {
-    struct gensio_link *l;
+    gensio_list_add_tail(list, &ndata->link);
+    ndata->on_udpns = list == &ndata->nadata->udpns;
+}
 
-    gensio_list_for_each(list, l) {
-	struct udpn_data *ndata = gensio_link_to_ndata(l);
+#define UDPN_HASH_INIT_SIZE	16
 
-	if (gensio_addr_equal(ndata->raddr, addr, true, false))
-	    return ndata;
+/*
+ * Hash a remote address.  Addresses that gensio_addr_equal() says are
+ * the same must hash the same, so an IPv4 mapped IPv6 address is
+ * hashed like the IPv4 address.  This is FNV-1a over the address data
+ * and the port.
+ */
+static unsigned int
+udpn_addr_hash(const struct gensio_addr *addr)
+{
+    static const unsigned char v4mapped[12] = { 0, 0, 0, 0, 0, 0, 0, 0,
+						0, 0, 0xff, 0xff };
+    unsigned char data[128], *d = data;
+    gensiods i, len = sizeof(data);
+    unsigned int h = 2166136261U;
+    int port = gensio_addr_get_port(addr);
+
+    gensio_addr_get_data(addr, data, &len);
+    if (len > sizeof(data))
+	len = sizeof(data);
+    if (len == 16 && gensio_addr_get_nettype(addr) == GENSIO_NETTYPE_IPV6 &&
+		memcmp(data, v4mapped, sizeof(v4mapped)) == 0) {
+	d += 12;
+	len = 4;
     }
 
-    return NULL;
+    for (i = 0; i < len; i++)
+	h = (h ^ d[i]) * 16777619U;
+    h = (h ^ (port & 0xff)) * 16777619U;
+    h = (h ^ ((port >> 8) & 0xff)) * 16777619U;
+
+    return h;
 }
 
-static void udpn_add_to_list(struct gensio_list *list, struct udpn_data *ndata)
+/* Add to the end of the chain so the oldest connection is found first. */
+static void
+udpn_hash_link(struct udpn_data **table, unsigned int size,
+	       struct udpn_data *ndata)
 {
-    gensio_list_add_tail(list, &ndata->link);
+    struct udpn_data **p = &table[ndata->hash & (size - 1)];
+
+    while (*p)
+	p = &(*p)->hash_next;
+    ndata->hash_next = NULL;
+    *p = ndata;
+}
+
+static void
+udpn_hash_add(struct udpna_data *nadata, struct udpn_data *ndata)
+{
+    struct gensio_os_funcs *o = nadata->o;
+    struct udpn_data **table, *n, *next;
+    unsigned int i, size;
+
+    ndata->hash = udpn_addr_hash(ndata->raddr);
+
+    if (nadata->udpn_count >= nadata->udpn_hash_size) {
+	/* If this fails we just keep going with longer chains. */
+	size = nadata->udpn_hash_size * 2;
+	table = o->zalloc(o, sizeof(*table) * size);
+	if (table) {
+	    for (i = 0; i < nadata->udpn_hash_size; i++) {
+		for (n = nadata->udpn_hash[i]; n; n = next) {
+		    next = n->hash_next;
+		    udpn_hash_link(table, size, n);
+		}
+	    }
+	    o->free(o, nadata->udpn_hash);
+	    nadata->udpn_hash = table;
+	    nadata->udpn_hash_size = size;
+	}
+    }
+
+    udpn_hash_link(nadata->udpn_hash, nadata->udpn_hash_size, ndata);
+}
+
+static void
+udpn_hash_rm(struct udpna_data *nadata, struct udpn_data *ndata)
+{
+    struct udpn_data **p;
+
+    p = &nadata->udpn_hash[ndata->hash & (nadata->udpn_hash_size - 1)];
+    while (*p && *p != ndata)
+	p = &(*p)->hash_next;
+    if (*p)
+	*p = ndata->hash_next;
+}
+
+/*
+ * Find the connection for the remote address.  If open_only is set,
+ * only look at the ones in udpns.
+ */
+static struct udpn_data *
+udpn_find(struct udpna_data *nadata, struct gensio_addr *addr, bool open_only)
+{
+    struct udpn_data *ndata;
+    unsigned int hash = udpn_addr_hash(addr);
+
+    ndata = nadata->udpn_hash[hash & (nadata->udpn_hash_size - 1)];
+    for (; ndata; ndata = ndata->hash_next) {
+	if (ndata->hash != hash || (open_only && !ndata->on_udpns))
+	    continue;
+	if (gensio_addr_equal(ndata->raddr, addr, true, false))
+	    return ndata;
+    }
+
+    return NULL;
 }
 
 static void
@@ -486,10 +638,23 @@ udpna_do_free(struct udpna_data *nadata)
 #endif
     if (nadata->fds)
 	nadata->o->free(nadata->o, nadata->fds);
-    if (nadata->curr_recvaddr)
-	gensio_addr_free(nadata->curr_recvaddr);
-    if (nadata->read_data)
-	nadata->o->free(nadata->o, nadata->read_data);
+    if (nadata->rxmsgs) {
+	for (i = 0; i < nadata->mmsg; i++) {
+	    if (nadata->rxmsgs[i].addr)
+		gensio_addr_free(nadata->rxmsgs[i].addr);
+	}
+	nadata->o->free(nadata->o, nadata->rxmsgs);
+    }
+    if (nadata->rxbuf)
+	nadata->o->free(nadata->o, nadata->rxbuf);
+    if (nadata->txmsgs)
+	nadata->o->free(nadata->o, nadata->txmsgs);
+    if (nadata->txsgs)
+	nadata->o->free(nadata->o, nadata->txsgs);
+    if (nadata->txbuf)
+	nadata->o->free(nadata->o, nadata->txbuf);
+    if (nadata->udpn_hash)
+	nadata->o->free(nadata->o, nadata->udpn_hash);
     if (nadata->lock)
 	nadata->o->free_lock(nadata->lock);
     if (nadata->acc)
@@ -542,6 +707,8 @@ udpn_do_free(struct udpn_data *ndata)
 	ndata->o->free_runner(ndata->deferred_op_runner);
     if (ndata->raddr)
 	gensio_addr_free(ndata->raddr);
+    if (ndata->refresh)
+	gensio_netaddr_refresh_free(ndata->refresh);
     ndata->o->free(ndata->o, ndata);
 }
 
@@ -551,21 +718,95 @@ udpn_finish_free(struct udpn_data *ndata)
     struct udpna_data *nadata = ndata->nadata;
 
     udpn_remove_from_list(&nadata->closed_udpns, ndata);
+    udpn_hash_rm(nadata, ndata);
     assert(nadata->udpn_count > 0);
     nadata->udpn_count--;
     udpn_do_free(ndata);
     udpna_check_finish_free(nadata);
 }
 
+/*
+ * Send everything in the transmit queue.  This is UDP, if the socket
+ * is full or a send fails the packet is dropped.
+ */
+static void
+udpna_tx_flush(struct udpna_data *nadata)
+{
+    unsigned int i, sent = 0, count;
+    int err;
+
+    while (sent < nadata->tx_count) {
+	err = nadata->o->sendmto(nadata->tx_iod, nadata->txmsgs + sent,
+				 nadata->tx_count - sent, &count, 0);
+	if (err)
+	    count = 1; /* Skip the packet that failed. */
+	else if (count == 0)
+	    break;
+	sent += count;
+    }
+
+    for (i = 0; i < nadata->tx_count; i++)
+	gensio_addr_free(nadata->txmsgs[i].addr);
+    nadata->tx_count = 0;
+    nadata->tx_len = 0;
+}
+
+/*
+ * Copy a packet into the transmit queue.  Returns false if the packet
+ * could not be queued and must be sent directly.
+ */
+static bool
+udpna_tx_queue(struct udpna_data *nadata, struct gensio_iod *iod,
+	       const struct gensio_sg *sg, gensiods sglen,
+	       const struct gensio_addr *addr, gensiods *count)
+{
+    struct gensio_msg *msg;
+    gensiods i, len = 0;
+    unsigned char *pos;
+
+    for (i = 0; i < sglen; i++)
+	len += sg[i].buflen;
+    if (len > nadata->max_read_size)
+	return false;
+
+    if (nadata->tx_count > 0 && (nadata->tx_iod != iod ||
+				 nadata->tx_count >= nadata->mmsg ||
+				 nadata->tx_len + len > nadata->max_read_size))
+	udpna_tx_flush(nadata);
+
+    msg = &nadata->txmsgs[nadata->tx_count];
+    msg->addr = gensio_addr_dup(addr);
+    if (!msg->addr)
+	return false;
+
+    pos = nadata->txbuf + nadata->tx_len;
+    nadata->txsgs[nadata->tx_count].buf = pos;
+    nadata->txsgs[nadata->tx_count].buflen = len;
+    for (i = 0; i < sglen; i++) {
+	memcpy(pos, sg[i].buf, sg[i].buflen);
+	pos += sg[i].buflen;
+    }
+    msg->sg = &nadata->txsgs[nadata->tx_count];
+    msg->sglen = 1;
+    nadata->tx_iod = iod;
+    nadata->tx_len += len;
+    nadata->tx_count++;
+    if (count)
+	*count = len;
+
+    return true;
+}
+
 static int
 udpn_write(struct gensio *io, gensiods *count,
 	   const struct gensio_sg *sg, gensiods sglen,
 	   const char *const *auxdata)
 {
     struct udpn_data *ndata = gensio_get_gensio_data(io);
+    struct udpna_data *nadata = ndata->nadata;
     struct gensio_addr *addr = NULL;
     unsigned int i;
-    bool free_addr = false;
+    bool free_addr = false, queued;
     int err;
 
     for (i = 0; auxdata && auxdata[i]; i++) {
@@ -585,7 +826,23 @@ udpn_write(struct gensio *io, gensiods *count,
     if (!addr)
 	addr = ndata->raddr;
 
+    if (nadata->txbuf) {
+	/*
+	 * If we are in the middle of handling received packets, hold
+	 * the write and send it with the rest when the batch is done.
+	 */
+	udpna_lock(nadata);
+	queued = (nadata->in_rx_batch &&
+		  udpna_tx_queue(nadata, ndata->myiod, sg, sglen, addr, count));
+	udpna_unlock(nadata);
+	if (queued) {
+	    err = 0;
+	    goto out;
+	}
+    }
+
     err = ndata->o->sendto(ndata->myiod, sg, sglen, count, 0, addr);
+ out:
     if (free_addr)
 	gensio_addr_free(addr);
     return err;
@@ -615,6 +872,7 @@ udpn_finish_close(struct udpna_data *nadata, struct udpn_data *ndata)
     if (nadata->pending_data_owner == ndata) {
 	nadata->pending_data_owner = NULL;
 	nadata->data_pending_len = 0;
+	udpna_check_rx_pending(nadata);
     }
 
     if (ndata->freed && !ndata->deferred_op_pending)
@@ -706,6 +964,7 @@ udpn_finish_read(struct udpn_data *ndata)
     } else {
 	nadata->pending_data_owner = NULL;
 	nadata->data_pending_len = 0;
+	udpna_check_rx_pending(nadata);
     }
  out:
     ndata->in_read = false;
@@ -732,6 +991,9 @@ udpna_deferred_op(struct gensio_runner *runner, void *cbdata)
 	}
     }
 
+    if (!nadata->data_pending_len && nadata->rx_pos < nadata->rx_count)
+	udpna_process_rx(nadata);
+
     if (nadata->in_shutdown && !nadata->in_new_connection) {
 	struct gensio_accepter *accepter = nadata->acc;
 
@@ -792,12 +1054,25 @@ udpn_open(struct gensio *io, gensio_done_err open_done, void *open_data)
 {
     struct udpn_data *ndata = gensio_get_gensio_data(io);
     struct udpna_data *nadata = ndata->nadata;
+    struct gensio_addr *addr;
     int err = GE_INUSE;
 
     udpna_lock(nadata);
     if (!gensio_is_client(ndata->io)) {
 	err = GE_NOTSUP;
     } else if (ndata->state == UDPN_CLOSED) {
+	if (ndata->refresh) {
+	    addr = gensio_netaddr_refresh_check(ndata->refresh);
+	    /* The socket is already open, it can't change families. */
+	    if (addr && gensio_addr_get_nettype(addr) == nadata->fds->family) {
+		udpn_hash_rm(nadata, ndata);
+		gensio_addr_free(ndata->raddr);
+		ndata->raddr = addr;
+		udpn_hash_add(nadata, ndata);
+	    } else if (addr) {
+		gensio_addr_free(addr);
+	    }
+	}
 	udpn_remove_from_list(&nadata->closed_udpns, ndata);
 	udpn_add_to_list(&nadata->udpns, ndata);
 	udpna_fd_read_disable(nadata);
@@ -830,6 +1105,7 @@ udpn_start_close(struct udpn_data *ndata,
 	}
 	nadata->pending_data_owner = NULL;
 	nadata->data_pending_len = 0;
+	udpna_check_rx_pending(nadata);
     }
     ndata->close_done = close_done;
     ndata->close_data = close_data;
@@ -1359,38 +1635,21 @@ udp_alloc_gensio(struct udpna_data *nadata, struct gensio_iod *iod,
 
     /* Stick it on the end of the list. */
     udpn_add_to_list(starting_list, ndata);
+    udpn_hash_add(nadata, ndata);
     nadata->udpn_count++;
 
     return ndata;
 }
 
+/*
+ * Deliver the packet in read_data and curr_recvaddr to its
+ * connection, creating a new connection if necessary.  Called with
+ * the lock held.
+ */
 static void
-udpna_readhandler(struct gensio_iod *iod, void *cbdata)
+udpna_handle_packet(struct udpna_data *nadata, gensiods datalen)
 {
-    struct udpna_data *nadata = cbdata;
     struct udpn_data *ndata;
-    gensiods datalen;
-    int err;
-
-    udpna_lock_and_ref(nadata);
-    if (nadata->data_pending_len) {
-	nadata->readhandler_read_disabled = true;
-	udpna_fd_read_disable(nadata);
-	goto out_unlock;
-    }
-
-    err = nadata->o->recvfrom(iod, nadata->read_data, nadata->max_read_size,
-			      &datalen, 0, nadata->curr_recvaddr);
-    if (err) {
-	if (!nadata->is_dummy)
-	    /* Don't log on dummy accepters. */
-	    gensio_acc_log(nadata->acc, GENSIO_LOG_ERR,
-			   "Could not accept on UDP: %s",
-			   gensio_err_to_str(err));
-	goto out_unlock;
-    }
-    if (datalen == 0)
-	goto out_unlock;
 
     nadata->data_pending_len = datalen;
     nadata->data_pos = 0;
@@ -1402,7 +1661,7 @@ udpna_readhandler(struct gensio_iod *iod, void *cbdata)
 	    ndata = gensio_link_to_ndata(gensio_list_first(&nadata->udpns));
 	}
     } else {
-	ndata = udpn_find(&nadata->udpns, nadata->curr_recvaddr);
+	ndata = udpn_find(nadata, nadata->curr_recvaddr, true);
     }
     if (ndata) {
 	/* Data belongs to an existing connection. */
@@ -1412,14 +1671,18 @@ udpna_readhandler(struct gensio_iod *iod, void *cbdata)
 
     if (nadata->closed || !nadata->enabled) {
 	nadata->data_pending_len = 0;
-	goto out_unlock_enable;
+	return;
     }
 
     /* New connection. */
-    ndata = udp_alloc_gensio(nadata, iod, nadata->curr_recvaddr,
+    ndata = udp_alloc_gensio(nadata, nadata->rx_iod, nadata->curr_recvaddr,
 			     NULL, NULL, &nadata->udpns);
-    if (!ndata)
-	goto out_nomem;
+    if (!ndata) {
+	nadata->data_pending_len = 0;
+	gensio_acc_log(nadata->acc, GENSIO_LOG_ERR,
+		       "Out of memory allocating for udp port");
+	return;
+    }
 
     udpn_set_state(ndata, UDPN_OPEN);
     nadata->read_disable_count++;
@@ -1457,7 +1720,7 @@ udpna_readhandler(struct gensio_iod *iod, void *cbdata)
 
     if (ndata->state == UDPN_IN_CLOSE) {
 	udpn_finish_close(nadata, ndata);
-	goto out_unlock_enable;
+	return;
     }
 
     if (nadata->in_shutdown) {
@@ -1472,13 +1735,77 @@ udpna_readhandler(struct gensio_iod *iod, void *cbdata)
 	ndata->in_read = false;
     }
     udpna_check_finish_free(nadata);
-    goto out_unlock_enable;
+}
+
+/*
+ * Hand out received packets until they are all gone or one is left
+ * pending because the user didn't take it.  Anything written while
+ * doing this is queued and sent in one go at the end.
+ */
+static void
+udpna_process_rx(struct udpna_data *nadata)
+{
+    struct gensio_msg *msg;
+
+    nadata->in_rx_batch = true;
+    while (nadata->rx_pos < nadata->rx_count && !nadata->data_pending_len &&
+	   !nadata->finished_free) {
+	msg = &nadata->rxmsgs[nadata->rx_pos++];
+	if (msg->count == 0)
+	    continue;
+	nadata->read_data = msg->buf;
+	nadata->curr_recvaddr = msg->addr;
+	udpna_handle_packet(nadata, msg->count);
+    }
+    nadata->in_rx_batch = false;
+    if (nadata->tx_count)
+	udpna_tx_flush(nadata);
+}
+
+static void
+udpna_readhandler(struct gensio_iod *iod, void *cbdata)
+{
+    struct udpna_data *nadata = cbdata;
+    unsigned int count;
+    gensiods datalen;
+    int err;
+
+    udpna_lock_and_ref(nadata);
+    if (nadata->data_pending_len) {
+	nadata->readhandler_read_disabled = true;
+	udpna_fd_read_disable(nadata);
+	goto out_unlock;
+    }
+
+    if (nadata->rx_pos >= nadata->rx_count) {
+	if (nadata->mmsg > 1) {
+	    err = nadata->o->recvmfrom(iod, nadata->rxmsgs, nadata->mmsg,
+				       &count, 0);
+	} else {
+	    err = nadata->o->recvfrom(iod, nadata->rxmsgs[0].buf,
+				      nadata->max_read_size, &datalen, 0,
+				      nadata->rxmsgs[0].addr);
+	    nadata->rxmsgs[0].count = datalen;
+	    count = !err && datalen > 0;
+	}
+	if (err) {
+	    if (!nadata->is_dummy)
+		/* Don't log on dummy accepters. */
+		gensio_acc_log(nadata->acc, GENSIO_LOG_ERR,
+			       "Could not accept on UDP: %s",
+			       gensio_err_to_str(err));
+	    goto out_unlock;
+	}
+	if (count == 0)
+	    goto out_unlock;
+
+	nadata->rx_count = count;
+	nadata->rx_pos = 0;
+	nadata->rx_iod = iod;
+    }
+
+    udpna_process_rx(nadata);
 
- out_nomem:
-    nadata->data_pending_len = 0;
-    gensio_acc_log(nadata->acc, GENSIO_LOG_ERR,
-		   "Out of memory allocating for udp port");
- out_unlock_enable:
     if (nadata->readhandler_read_disabled) {
 	nadata->readhandler_read_disabled = false;
 	udpna_fd_read_enable(nadata);
@@ -1740,9 +2067,7 @@ udpna_str_to_gensio(struct gensio_accepter *accepter, const char *addrstr,
  found:
 
     udpna_lock(nadata);
-    ndata = udpn_find(&nadata->udpns, addr);
-    if (!ndata)
-	ndata = udpn_find(&nadata->closed_udpns, addr);
+    ndata = udpn_find(nadata, addr, false);
     if (ndata) {
 	udpna_unlock(nadata);
 	err = GE_EXISTS;
@@ -1833,6 +2158,7 @@ struct dgram_accepter_data {
     const char *typestr;
     bool reuseaddr;
     gensiods max_read_size;
+    unsigned int mmsg;
 #if HAVE_UNIX
     unsigned int mode;
     bool mode_set;
@@ -1849,6 +2175,7 @@ i_dgram_gensio_accepter_alloc(const struct gensio_addr *iai,
 			      struct gensio_accepter **accepter)
 {
     struct udpna_data *nadata;
+    unsigned int i;
 
     nadata = o->zalloc(o, sizeof(*nadata));
     if (!nadata)
@@ -1881,8 +2208,41 @@ i_dgram_gensio_accepter_alloc(const struct gensio_addr *iai,
     if (!nadata->ai && iai) /* Allow a null ai if it was passed in. */
 	goto out_nomem;
 
-    nadata->read_data = o->zalloc(o, d->max_read_size);
-    if (!nadata->read_data)
+    nadata->mmsg = d->mmsg;
+    if (!o->recvmfrom || !o->sendmto)
+	nadata->mmsg = 1;
+    nadata->rxbuf = o->zalloc(o, d->max_read_size * nadata->mmsg);
+    if (!nadata->rxbuf)
+	goto out_nomem;
+    nadata->rxmsgs = o->zalloc(o, sizeof(*nadata->rxmsgs) * nadata->mmsg);
+    if (!nadata->rxmsgs)
+	goto out_nomem;
+    for (i = 0; i < nadata->mmsg; i++) {
+	nadata->rxmsgs[i].buf = nadata->rxbuf + i * d->max_read_size;
+	nadata->rxmsgs[i].buflen = d->max_read_size;
+	nadata->rxmsgs[i].addr = o->addr_alloc_recvfrom(o);
+	if (!nadata->rxmsgs[i].addr)
+	    goto out_nomem;
+    }
+    nadata->read_data = nadata->rxbuf;
+    nadata->curr_recvaddr = nadata->rxmsgs[0].addr;
+
+    if (nadata->mmsg > 1) {
+	nadata->txbuf = o->zalloc(o, d->max_read_size);
+	if (!nadata->txbuf)
+	    goto out_nomem;
+	nadata->txmsgs = o->zalloc(o, sizeof(*nadata->txmsgs) * nadata->mmsg);
+	if (!nadata->txmsgs)
+	    goto out_nomem;
+	nadata->txsgs = o->zalloc(o, sizeof(*nadata->txsgs) * nadata->mmsg);
+	if (!nadata->txsgs)
+	    goto out_nomem;
+    }
+
+    nadata->udpn_hash_size = UDPN_HASH_INIT_SIZE;
+    nadata->udpn_hash = o->zalloc(o, sizeof(*nadata->udpn_hash) *
+				  nadata->udpn_hash_size);
+    if (!nadata->udpn_hash)
 	goto out_nomem;
 
     nadata->deferred_op_runner = o->alloc_runner(o, udpna_deferred_op, nadata);
@@ -1899,10 +2259,6 @@ i_dgram_gensio_accepter_alloc(const struct gensio_addr *iai,
     if (!nadata->lock)
 	goto out_nomem;
 
-    nadata->curr_recvaddr = o->addr_alloc_recvfrom(o);
-    if (!nadata->curr_recvaddr)
-	goto out_nomem;
-
     nadata->acc = gensio_acc_data_alloc(o, cb, user_data, gensio_acc_udp_func,
 					NULL, d->typestr, nadata);
     if (!nadata->acc)
@@ -1958,9 +2314,22 @@ dgram_gensio_accepter_alloc(const void *gdata,
 	d.reuseaddr = ival;
     }
 
+    err = gensio_get_default(o, typestr, "mmsg", false,
+			     GENSIO_DEFAULT_INT, NULL, &ival);
+    if (err)
+	return err;
+    d.mmsg = ival;
+
     for (i = 0; args && args[i]; i++) {
 	if (gensio_pparm_ds(&p, args[i], "readbuf", &d.max_read_size) > 0)
 	    continue;
+	if (gensio_pparm_uint(&p, args[i], "mmsg", &d.mmsg) > 0) {
+	    if (d.mmsg < 1 || d.mmsg > 1024) {
+		gensio_pparm_slog(&p, "mmsg must be from 1 to 1024");
+		return GE_INVAL;
+	    }
+	    continue;
+	}
 	if (isudp && gensio_pparm_bool(&p, args[i], "reuseaddr",
 				       &d.reuseaddr) > 0)
 	    continue;
@@ -2086,7 +2455,7 @@ static int
 dgram_gensio_alloc(const void *gdata, const char * const args[],
 		   struct gensio_os_funcs *o,
 		   gensio_event cb, void *user_data,
-		   int protocol, const char *typestr,
+		   int protocol, const char *typestr, const char *str,
 		   struct gensio **new_gensio)
 {
     const struct gensio_addr *addr = gdata;
@@ -2129,11 +2498,23 @@ dgram_gensio_alloc(const void *gdata, const char * const args[],
     if (err)
 	return err;
     mttl = ival;
+    err = gensio_get_default(o, typestr, "mmsg", false,
+			     GENSIO_DEFAULT_INT, NULL, &ival);
+    if (err)
+	return err;
+    d.mmsg = ival;
 
     err = GE_INVAL;
     for (i = 0; args && args[i]; i++) {
 	if (gensio_pparm_ds(&p, args[i], "readbuf", &d.max_read_size) > 0)
 	    continue;
+	if (gensio_pparm_uint(&p, args[i], "mmsg", &d.mmsg) > 0) {
+	    if (d.mmsg < 1 || d.mmsg > 1024) {
+		err = GE_INVAL;
+		goto parm_err;
+	    }
+	    continue;
+	}
 	tmpaddr = NULL;
 	if (gensio_pparm_addrs(&p, args[i], "laddr", protocol,
 			       true, false, &tmpaddr) > 0) {
@@ -2289,9 +2670,13 @@ dgram_gensio_alloc(const void *gdata, const char * const args[],
     } else {
 	gensio_set_is_client(ndata->io, true);
 	nadata->udpn_count = 1;
-	err = o->set_fd_handlers(new_iod, nadata,
-				 udpna_readhandler, udpna_writehandler, NULL,
-				 udpna_fd_cleared);
+	if (str)
+	    err = gensio_netaddr_refresh_alloc(o, str, false, protocol,
+					       &ndata->refresh);
+	if (!err)
+	    err = o->set_fd_handlers(new_iod, nadata,
+				     udpna_readhandler, udpna_writehandler,
+				     NULL, udpna_fd_cleared);
     }
 
     if (err) {
@@ -2331,12 +2716,14 @@ str_to_dgram_gensio(const char *str, const char * const args[],
     struct gensio_addr *addr;
     int err;
 
-    err = gensio_os_scan_netaddr(o, str, false, protocol, &addr);
+    err = gensio_scan_netaddr_cached(o, str, false, protocol, &addr);
     if (err)
 	return err;
 
-    err = dgram_gensio_alloc(addr, args, o, cb, user_data,
-			     protocol, typestr, new_gensio);
+    /* Only UDP names need to be looked up again. */
+    err = dgram_gensio_alloc(addr, args, o, cb, user_data, protocol, typestr,
+			     protocol == GENSIO_NET_PROTOCOL_UDP ? str : NULL,
+			     new_gensio);
     gensio_addr_free(addr);
     return err;
 }
@@ -2348,7 +2735,8 @@ udp_gensio_alloc(const void *gdata, const char * const args[],
 		 struct gensio **new_gensio)
 {
     return dgram_gensio_alloc(gdata, args, o, cb, user_data,
-			      GENSIO_NET_PROTOCOL_UDP, "udp", new_gensio);
+			      GENSIO_NET_PROTOCOL_UDP, "udp", NULL,
+			      new_gensio);
 }
 
 static int
@@ -2372,7 +2760,7 @@ unixdgram_gensio_alloc(const void *gdata, const char * const args[],
 
     return dgram_gensio_alloc(iai, args, o, cb, user_data,
 			      GENSIO_NET_PROTOCOL_UNIX_DGRAM, "unixdgram",
-			      new_gensio);
+			      NULL, new_gensio);
 #else
     return GE_NOTSUP;
 #endif
@@ -198,11 +198,88 @@ struct xmit_entry {
 /* IIR and FIR filter code. */
 #include "filters.h"
 
+/* The DFT bin calculations. */
+#include "fskdft.h"
+
 /* Code for handling the transmitter keying. */
 #include "xmitkey.h"
 
 enum fsk_format { FSK_FMT_NONE, FSK_FMT_FLOAT, FSK_FMT_FLOATC };
 
+/*
+ * A receive pipeline.  Normally there is just one, but with the
+ * decoders option there are several, each looking for the mark and
+ * space a little off from the others.  They all work on the same
+ * filtered input but each has its own DFT tables, bit alignment, and
+ * working messages.
+ */
+struct fsk_decoder {
+    /*
+     * DFT tables.  First 2 * in_bitsize values is sine, second 2 *
+     * in_bitsize values is cosine.  These are used to set up dft,
+     * which does the work.
+     */
+#define MAX_HZ_BINS 7
+    float *hzbin[MAX_HZ_BINS];
+    struct dftbins dft;
+
+    /*
+     * Storage for power measurements, each workextra samples long.
+     */
+    float *pmeas[MAX_HZ_BINS];
+    float *pmark2;
+    float *pspace2;
+
+    /*
+     * Buffer holding data being currently processed.  It is
+     * (in_bitsize + (2 * workedge)) bytes long.
+     */
+    float *workbuf;
+
+    /*
+     * Current position in the processed data workbuf above, this is
+     * the amount of data left over from the previous processing.
+     */
+    unsigned int work_pos;
+
+    unsigned int in_adj_counter; /* Current receive counter for in_adj. */
+
+    /* Previous level (mark = 1, space = 0) we received. */
+    unsigned int prev_recv_level;
+    unsigned int prev_best_pos;
+
+/*
+ * Use this to tell if we are receiving valid data, mostly to know if
+ * we can transmit.  If nr_in_sync is > the given value, we are in
+ * sync.  When a single sync is missed, set nr_in_sync to the given
+ * value to hurry it being reduced.  We then track how long we have
+ * been out of sync.
+ */
+#define IN_SYNC		16
+#define SYNC_RESET	32
+    unsigned int nr_in_sync;
+    unsigned int nr_out_sync;
+
+    /* The input frame number at the end of the bit being worked on. */
+    gensiods framenr;
+
+    /*
+     * Messages we are currently working on assembling.
+     */
+    struct wmsgset *wmsgsets;
+};
+
+/*
+ * A frame that was delivered, to catch the same frame coming from
+ * another decoder.
+ */
+struct fsk_recent_frame {
+    gensiods len; /* 0 if not used. */
+    uint16_t crc;
+    gensiods framenr;
+};
+#define FSK_RECENT_FRAMES 8
+
 struct fsk_filter {
     struct gensio_filter *filter;
     struct gensio_os_funcs *o;
@@ -249,7 +326,6 @@ struct fsk_filter {
     unsigned int in_bitsize;
     int in_adj; /* +1, 0, or -1 */
     unsigned int in_adj_period; /* How often to add in_adj. */
-    unsigned int in_adj_counter; /* Current receive counter for in_adj. */
     uint64_t in_adj_time; /* Time in nsec for a bitsize to be received. */
     int maxadj; /* Maximum we can adjust the frame for alignment. */
 
@@ -279,10 +355,6 @@ struct fsk_filter {
     gensiods framecount;
     gensiods framenr;
 
-    /* Previous level (mark = 1, space = 0) we received. */
-    unsigned int prev_recv_level;
-    unsigned int prev_best_pos;
-
     /* Level we sent last time. */
     unsigned char prev_xmit_level;
 
@@ -312,36 +384,26 @@ struct fsk_filter {
 			     unsigned int nchans, unsigned int chan,
 			     gensiods count);
 
-    /* Function to calculate DFT bins, either real or complex versions. */
-    void (*do_dftbin)(struct fsk_filter *sfilter, float *dftbin,
-		      float *buf, float *power, float *maxp);
-
     /*
-     * DFT tables.  First 2 * in_bitsize values is sine, second 2 *
-     * in_bitsize values is cosine.
+     * The receive pipelines, see struct fsk_decoder.  If there is
+     * more than one and the input has more than one channel, our
+     * channel is copied out once into chanbuf for all of them.
      */
-#define MAX_HZ_BINS 7
-    float *hzbin[MAX_HZ_BINS];
+    struct fsk_decoder *decoders;
+    unsigned int ndecoders;
+    float *chanbuf;
     unsigned int nr_hz_bins;
 
     /*
-     * Storage for power measurements, each workextra samples long.
+     * With more than one decoder, the same frame will usually be
+     * received by several of them.  Keep the last few delivered
+     * frames and don't deliver a frame if it matches one of them
+     * that ended within dup_window input frames.
      */
-    float *pmeas[MAX_HZ_BINS];
-    float *pmark2;
-    float *pspace2;
+    struct fsk_recent_frame recent[FSK_RECENT_FRAMES];
+    unsigned int recent_pos;
+    gensiods dup_window;
 
-/*
- * Use this to tell if we are receiving valid data, mostly to know if
- * we can transmit.  If nr_in_sync is > the given value, we are in
- * sync.  When a single sync is missed, set nr_in_sync to the given
- * value to hurry it being reduced.  We then track how long we have
- * been out of sync.
- */
-#define IN_SYNC		16
-#define SYNC_RESET	32
-    unsigned int nr_in_sync;
-    unsigned int nr_out_sync;
     unsigned int start_xmit_delay_count;
 
     /*
@@ -349,19 +411,9 @@ struct fsk_filter {
      */
     float min_certainty;
 
-    /*
-     * Buffer holding data being currently processed.  It is
-     * (in_bitsize + (2 * workedge)) bytes long.
-     */
-    float *workbuf;
+    /* Size of a decoder's workbuf. */
     unsigned int worksize;
 
-    /*
-     * Current position in the processed data workbuf above, this is
-     * the amount of data left over from the previous processing.
-     */
-    unsigned int work_pos;
-
     /*
      * Give the number of values on each side of the bit samples for
      * alignment calculation as described at the top of the file.
@@ -371,16 +423,7 @@ struct fsk_filter {
     unsigned int workmiddle; // (workedge + 1)
     unsigned int workextra; // ((2 * workedge) + 1)
 
-    /*
-     * Store the first workedge sin and cos values here to subtract
-     * off later.  This is workedge * 4 samples long.
-     */
-    float *firstv;
-
-    /*
-     * Messages we are currently working on assembling.
-     */
-    struct wmsgset *wmsgsets;
+    /* Sizes for the working messages in each decoder. */
     unsigned int wmsg_sets; /* Size of wmsgsets. */
     unsigned int max_wmsgs; /* Size of wmsgs in each wmsgset. */
 
@@ -646,6 +689,30 @@ fsk_try_connect(struct gensio_filter *filter, gensio_time *timeout,
     return key_try_open(&sfilter->keyinfo, timeout);
 }
 
+/*
+ * Is no decoder receiving anything?  Then we can transmit.
+ */
+static bool
+fsk_rx_quiet(struct fsk_filter *sfilter)
+{
+    unsigned int i;
+
+    for (i = 0; i < sfilter->ndecoders; i++) {
+	if (sfilter->decoders[i].nr_out_sync < sfilter->tx_delay)
+	    return false;
+    }
+    return true;
+}
+
+static void
+fsk_rx_reset_out_sync(struct fsk_filter *sfilter)
+{
+    unsigned int i;
+
+    for (i = 0; i < sfilter->ndecoders; i++)
+	sfilter->decoders[i].nr_out_sync = 0;
+}
+
 static unsigned long get_frames_left(struct fsk_filter *sfilter)
 {
     struct gensio_filter_cb_control_data cd;
@@ -1013,7 +1080,7 @@ fsk_handle_send(struct fsk_filter *sfilter,
 		if (sfilter->send_count > 0) {
 		    sfilter->wrbyte = 0x7e;
 		} else {
-		    sfilter->nr_out_sync = 0;
+		    fsk_rx_reset_out_sync(sfilter);
 		    sfilter->transmit_state = WAITING_ENDXMIT;
 		    if (sfilter->xmit_buf_len == 0)
 			/*
@@ -1101,7 +1168,7 @@ fsk_ul_write(struct gensio_filter *filter,
     }
     if (sfilter->transmit_state != NOT_SENDING)
 	goto out_process;
-    if (sfilter->full_duplex || sfilter->nr_out_sync >= sfilter->tx_delay ||
+    if (sfilter->full_duplex || fsk_rx_quiet(sfilter) ||
 		sfilter->do_raw) {
 	fsk_start_xmit(sfilter);
     } else {
@@ -1149,13 +1216,13 @@ fsk_deliver_data(struct fsk_filter *sfilter, struct wmsg *w)
 }
 
 static void
-fsk_process_raw_bit(struct fsk_filter *sfilter, unsigned int bit,
-		    float certainty)
+fsk_process_raw_bit(struct fsk_filter *sfilter, struct fsk_decoder *d,
+		    unsigned int bit, float certainty)
 {
-    struct wmsg *w = &sfilter->wmsgsets[0].wmsgs[0];
+    struct wmsg *w = &d->wmsgsets[0].wmsgs[0];
 
     if (sfilter->in_do_diff)
-	bit = sfilter->prev_recv_level != bit;
+	bit = d->prev_recv_level != bit;
     bit ^= sfilter->in_do_inv;
     w->curr_byte |= bit << w->curr_bit_pos;
     if (sfilter->do_uncert) {
@@ -1182,10 +1249,10 @@ fsk_process_raw_bit(struct fsk_filter *sfilter, unsigned int bit,
 }
 
 static void
-fsk_drop_wmsg(struct fsk_filter *sfilter, unsigned int wset,
-	      unsigned int msgn, struct wmsg *w, bool at_flag)
+fsk_drop_wmsg(struct fsk_filter *sfilter, struct fsk_decoder *d,
+	      unsigned int wset, unsigned int msgn, struct wmsg *w, bool at_flag)
 {
-    struct wmsgset *ws = &sfilter->wmsgsets[wset];
+    struct wmsgset *ws = &d->wmsgsets[wset];
 
     if (at_flag && !ws->got_flag) {
 	/*
@@ -1216,14 +1283,14 @@ fsk_drop_wmsg(struct fsk_filter *sfilter, unsigned int wset,
 }
 
 static void
-fsk_handle_new_byte(struct fsk_filter *sfilter,
+fsk_handle_new_byte(struct fsk_filter *sfilter, struct fsk_decoder *d,
 		    unsigned int wset, unsigned int msgn,
 		    struct wmsg *w)
 {
     if (sfilter->debug & GENSIO_FSK_DEBUG_BIT_HNDL)
 	printf("BYTE(%d): %2.2x\n", msgn, w->curr_byte);
     if (w->read_data_len >= sfilter->max_read_size) {
-	fsk_drop_wmsg(sfilter, wset, msgn, w, false);
+	fsk_drop_wmsg(sfilter, d, wset, msgn, w, false);
 	return;
     }
     w->read_data[w->read_data_len] = w->curr_byte;
@@ -1232,8 +1299,48 @@ fsk_handle_new_byte(struct fsk_filter *sfilter,
     w->read_data_len++;
 }
 
+/*
+ * See if another decoder already delivered this frame.  If not,
+ * remember it in case another decoder gets it later.  The decoders
+ * take turns working on each input buffer, so the other decoder may
+ * be ahead or behind this one.
+ */
+static bool
+fsk_dup_frame(struct fsk_filter *sfilter, struct fsk_decoder *d,
+	      struct wmsg *w)
+{
+    struct fsk_recent_frame *r;
+    uint16_t crc = 0xffff;
+    gensiods diff;
+    unsigned int i;
+
+    crc16_ccitt(w->read_data, w->read_data_len, &crc);
+    for (i = 0; i < FSK_RECENT_FRAMES; i++) {
+	r = &sfilter->recent[i];
+	if (r->len != w->read_data_len || r->crc != crc)
+	    continue;
+	if (r->framenr > d->framenr)
+	    diff = r->framenr - d->framenr;
+	else
+	    diff = d->framenr - r->framenr;
+	if (diff <= sfilter->dup_window) {
+	    if (sfilter->debug & GENSIO_FSK_DEBUG_STATE)
+		printf("DUP: decoder %u\n",
+		       (unsigned int) (d - sfilter->decoders));
+	    return true;
+	}
+    }
+
+    r = &sfilter->recent[sfilter->recent_pos];
+    r->len = w->read_data_len;
+    r->crc = crc;
+    r->framenr = d->framenr;
+    sfilter->recent_pos = (sfilter->recent_pos + 1) % FSK_RECENT_FRAMES;
+    return false;
+}
+
 static void
-fsk_handle_new_message(struct fsk_filter *sfilter,
+fsk_handle_new_message(struct fsk_filter *sfilter, struct fsk_decoder *d,
 		       unsigned int wset, unsigned int msgn, struct wmsg *w)
 {
     uint16_t crc, msgcrc;
@@ -1290,7 +1397,8 @@ fsk_handle_new_message(struct fsk_filter *sfilter,
 	fsk_print_msg(sfilter, "R", 0, w->read_data, w->read_data_len, false);
     }
 
-    if (sfilter->deliver_data_len == 0)
+    if (sfilter->deliver_data_len == 0 &&
+		!(sfilter->ndecoders > 1 && fsk_dup_frame(sfilter, d, w)))
 	fsk_deliver_data(sfilter, w);
 
     /* Cancel all working messages. */
@@ -1298,26 +1406,26 @@ fsk_handle_new_message(struct fsk_filter *sfilter,
 	unsigned int j;
 
 	for (j = 0; j < sfilter->max_wmsgs; j++) {
-	    sfilter->wmsgsets[i].wmsgs[j].read_data_len = 0;
-	    sfilter->wmsgsets[i].wmsgs[j].num_uncertain = 0;
-	    sfilter->wmsgsets[i].wmsgs[j].certainty = 0.0;
+	    d->wmsgsets[i].wmsgs[j].read_data_len = 0;
+	    d->wmsgsets[i].wmsgs[j].num_uncertain = 0;
+	    d->wmsgsets[i].wmsgs[j].certainty = 0.0;
 	}
     }
     return;
 
  bad_msg:
-    fsk_drop_wmsg(sfilter, wset, msgn, w, true);
+    fsk_drop_wmsg(sfilter, d, wset, msgn, w, true);
 }
 
 static void
-fsk_process_bit(struct fsk_filter *sfilter,
+fsk_process_bit(struct fsk_filter *sfilter, struct fsk_decoder *d,
 		unsigned int wset, unsigned int msgn,
 		unsigned char level, float certainty,
 		bool *in_sync)
 {
     unsigned int prev_num_rcv_1;
     unsigned char bit;
-    struct wmsg *w = &sfilter->wmsgsets[wset].wmsgs[msgn];
+    struct wmsg *w = &d->wmsgsets[wset].wmsgs[msgn];
 
     if (!w->in_use)
 	return;
@@ -1339,11 +1447,11 @@ fsk_process_bit(struct fsk_filter *sfilter,
 	for (i = 0; i < sfilter->max_wmsgs; i++) {
 	    if (i == msgn)
 		continue;
-	    if (!sfilter->wmsgsets[wset].wmsgs[i].in_use) {
+	    if (!d->wmsgsets[wset].wmsgs[i].in_use) {
 		struct wmsg *w2;
 
 	    add_wmsg_at:
-		w2 = &sfilter->wmsgsets[wset].wmsgs[i];
+		w2 = &d->wmsgsets[wset].wmsgs[i];
 		w2->in_use = true;
 		w2->certainty = alt_certainty;
 		w2->num_uncertain = w->num_uncertain;
@@ -1356,12 +1464,12 @@ fsk_process_bit(struct fsk_filter *sfilter,
 		memcpy(w2->read_data, w->read_data, w->read_data_len);
 		if (sfilter->debug & GENSIO_FSK_DEBUG_STATE)
 		    printf("WMSG: add %u %u\n", wset, i);
-		sfilter->wmsgsets[wset].curr_wmsgs++;
+		d->wmsgsets[wset].curr_wmsgs++;
 		w2->new_wmsg = true; /* Don't process this again on this run. */
 
 		if (i < msgn) {
 		    /* Process this bit, since we won't get it in the main. */
-		    fsk_process_bit(sfilter, wset, i, !level,
+		    fsk_process_bit(sfilter, d, wset, i, !level,
 				    certainty, in_sync);
 		} else {
 		    /*
@@ -1374,9 +1482,9 @@ fsk_process_bit(struct fsk_filter *sfilter,
 		}
 		break;
 	    }
-	    if (sfilter->wmsgsets[wset].wmsgs[i].certainty < min_certainty) {
+	    if (d->wmsgsets[wset].wmsgs[i].certainty < min_certainty) {
 		/* Keep a running track of the smallest certainty value. */
-		min_certainty = sfilter->wmsgsets[wset].wmsgs[i].certainty;
+		min_certainty = d->wmsgsets[wset].wmsgs[i].certainty;
 		min_cert_pos = i;
 	    }
 	}
@@ -1387,7 +1495,7 @@ fsk_process_bit(struct fsk_filter *sfilter,
 	     * lowest certainty message and replace it with this
 	     * message.
 	     */
-	    sfilter->wmsgsets[wset].curr_wmsgs--;
+	    d->wmsgsets[wset].curr_wmsgs--;
 	    i = min_cert_pos;
 	    goto add_wmsg_at;
 	}
@@ -1457,19 +1565,19 @@ fsk_process_bit(struct fsk_filter *sfilter,
 
 	w->curr_byte |= bit << w->curr_bit_pos;
 	if (w->curr_bit_pos == 7)
-	    fsk_handle_new_byte(sfilter, wset, msgn, w);
+	    fsk_handle_new_byte(sfilter, d, wset, msgn, w);
 	else
 	    w->curr_bit_pos++;
 	break;
 
     case FSK_STATE_POSTAMBLE_LAST_0:
 	if (!bit) {
-	    fsk_handle_new_message(sfilter, wset, msgn, w);
+	    fsk_handle_new_message(sfilter, d, wset, msgn, w);
 	    w->state = FSK_STATE_IN_MSG;
 	    w->curr_byte = 0;
 	    w->curr_bit_pos = 0;
 	} else {
-	    fsk_drop_wmsg(sfilter, wset, msgn, w, false);
+	    fsk_drop_wmsg(sfilter, d, wset, msgn, w, false);
 	    *in_sync = false;
 	}
 	break;
@@ -1520,131 +1628,13 @@ process_powers(struct fsk_filter *sfilter,
 	*rcertainty = 50.0;
 }
 
-/*
- * Do a DFT bin analysis.  You generally do this against a sine and
- * cosine table, this lets you measure the power (and phase) of a
- * signal against the frequency of the sine/cosine.
- *
- * dftbin is the sine/cosine table to do the DFT analysis on a single
- * frequency, the first 2 * in_bitsize floats are the sine table, the
- * second 2 * in_bitsize floats are the cosine table.
- *
- * The input has extra data on both edges, the actually currently
- * aligned signal is in the middle.  We start at the data past the
- * left edges and process that data.  Then we store the data and
- * subtract off each frame from the left edge and add on the next data
- * until we have processed the whole right edge.  This gives is values
- * in the "power" array where the middle value is the currently
- * aligned value, but we have power measurements assuming we move the
- * alignment point left and right.  This lets us measure how well we
- * are aligned on a transition from a mark to a space or back.
- *
- * Each DFT bin is done on in_bitsize frames of data.  The first
- * in_bitsize bytes is processed and put into power[0] (power at the
- * given frequency).  Then we skip the first sample and calculate the
- * power then, then skip two samples, and so on, up to workedge * 2
- * samples.
- *
- * We don't do it that way, though, we use a much more efficient way.
- * To process at sample 1 we subtract off the first values and add on
- * the next values, so it's quite efficient.
- *
- * power must be [(edge * 2) + 1].  The input data size must be
- * [in_bitsize + edge * 2].
- */
-static void
-float_dftbin(struct fsk_filter *sfilter, float *dftbin,
-	     float *buf, float *power, float *maxp)
-{
-    float *csin = dftbin;
-    float *ccos = dftbin + 2 * sfilter->in_bitsize;
-    float psin = 0, pcos = 0;
-    unsigned int i, ppos = 0, fpos;
-
-    /* Calculate the beginning portion and save off the first values. */
-    for (i = 0; i < sfilter->workedge * 2; i++, csin++, ccos++) {
-	sfilter->firstv[i * 2] = *csin * buf[i];
-	sfilter->firstv[i * 2 + 1] = *ccos * buf[i];
-	psin += sfilter->firstv[i * 2];
-	pcos += sfilter->firstv[i * 2 + 1];
-    }
-    /*
-     * Calculate the rest of the buffer to the point where we have the
-     * first value to save.
-     */
-    for (; i < sfilter->in_bitsize; i++, csin++, ccos++) {
-	psin += *csin * buf[i];
-	pcos += *ccos * buf[i];
-    }
-
-    /* Save the first value's power. */
-    power[ppos] = psin * psin + pcos * pcos;
-    *maxp = power[ppos];
-    ppos++;
-
-    /*
-     * Now go through the rest of the buffer and calculate the power for
-     * each succeeding position.
-     */
-    for (fpos = 0; i < sfilter->worksize; i++, fpos++, ppos++) {
-	psin -= sfilter->firstv[fpos * 2];
-	pcos -= sfilter->firstv[fpos * 2 + 1];
-	psin += *csin++ * buf[i];
-	pcos += *ccos++ * buf[i];
-	power[ppos] = psin * psin + pcos * pcos;
-	if (power[ppos] > *maxp)
-	    *maxp = power[ppos];
-    }
-}
-
-/* Like above, but complex. */
-static void
-floatc_dftbin(struct fsk_filter *sfilter, float *in_dftbin,
-	      float *in_buf, float *power, float *maxp)
-{
-    float complex *cwave = (float complex *) in_dftbin;
-    float complex *buf = (float complex *) in_buf;
-    float complex pow = 0;
-    float complex *firstv = (float complex *) sfilter->firstv;
-    unsigned int i, ppos = 0, fpos;
-
-    /* Calculate the beginning portion and save off the first values. */
-    for (i = 0; i < sfilter->workedge * 2; i++, cwave++) {
-	firstv[i] = *cwave * buf[i];
-	pow += sfilter->firstv[i];
-    }
-    /*
-     * Calculate the rest of the buffer to the point where we have the
-     * first value to save.
-     */
-    for (; i < sfilter->in_bitsize; i++, cwave++) {
-	pow += *cwave * buf[i];
-    }
-
-    /* Save the first value's power. */
-    power[ppos] = cabsf(pow);
-    *maxp = power[ppos];
-    ppos++;
-
-    /*
-     * Now go through the rest of the buffer and calculate the power for
-     * each succeeding position.
-     */
-    for (fpos = 0; i < sfilter->worksize; i++, fpos++, cwave++, ppos++) {
-	pow -= firstv[fpos];
-	pow += *cwave * buf[i];
-	power[ppos] = cabsf(pow);
-	if (power[ppos] > *maxp)
-	    *maxp = power[ppos];
-    }
-}
-
 /*
  * Do DFT bin analysis at mark and space the data then call the bit
  * processing with the info extracted from the data.
  */
 static int
-fsk_check_for_data(struct fsk_filter *sfilter, float *buf, bool *in_sync)
+fsk_check_for_data(struct fsk_filter *sfilter, struct fsk_decoder *d,
+		   float *buf, bool *in_sync)
 {
     unsigned char level;
     unsigned int i, best_pos = 0, wset;
@@ -1660,9 +1650,7 @@ fsk_check_for_data(struct fsk_filter *sfilter, float *buf, bool *in_sync)
     }
 #endif
 
-    for (i = 0; i < sfilter->nr_hz_bins; i++)
-	sfilter->do_dftbin(sfilter, sfilter->hzbin[i], buf, sfilter->pmeas[i],
-			   &maxp[i]);
+    dftbins_calc(&d->dft, buf, d->pmeas, maxp);
     if (sfilter->nr_hz_bins == 2) {
 	spacebin = 0;
 	markbin = 1;
@@ -1689,20 +1677,20 @@ fsk_check_for_data(struct fsk_filter *sfilter, float *buf, bool *in_sync)
 	markbin = 4;
     }
 
-    process_powers(sfilter, sfilter->pmeas[markbin], sfilter->pmeas[spacebin],
+    process_powers(sfilter, d->pmeas[markbin], d->pmeas[spacebin],
 		   &best_pos, &certainty, &level);
 
     if (sfilter->debug & GENSIO_FSK_DEBUG_BIT_HNDL) {
 	printf("WORK(%lu): level: %u (%u)  cert: %f  best_pos: %u (%u)\n",
 	       sfilter->framecount++,
-	       level, sfilter->prev_recv_level, certainty,
-	       best_pos, sfilter->prev_best_pos);
+	       level, d->prev_recv_level, certainty,
+	       best_pos, d->prev_best_pos);
 	for (i = 0; i < sfilter->workextra; i++) {
 	    if (i == sfilter->workmiddle)
 		printf(" (");
 	    else
 		printf(" ");
-	    printf("%f", sfilter->pmeas[markbin][i]);
+	    printf("%f", d->pmeas[markbin][i]);
 	    if (i == sfilter->workmiddle)
 		printf(")");
 	}
@@ -1712,14 +1700,14 @@ fsk_check_for_data(struct fsk_filter *sfilter, float *buf, bool *in_sync)
 		printf(" (");
 	    else
 		printf(" ");
-	    printf("%f", sfilter->pmeas[spacebin][i]);
+	    printf("%f", d->pmeas[spacebin][i]);
 	    if (i == sfilter->workmiddle)
 		printf(")");
 	}
 	printf("\n");
     }
 
-    if (sfilter->prev_recv_level != level) {
+    if (d->prev_recv_level != level) {
 	/*
 	 * Check re-align on a 1->0 or 0->1 level transition.  You
 	 * can't align on no transition because you have to have a
@@ -1730,44 +1718,44 @@ fsk_check_for_data(struct fsk_filter *sfilter, float *buf, bool *in_sync)
 	 * at the current position if it move the bar backwards.
 	 */
 
-	if (sfilter->prev_best_pos > sfilter->workmiddle)
-	    adj += ((int) sfilter->prev_best_pos - (int) sfilter->workmiddle) / 2;
+	if (d->prev_best_pos > sfilter->workmiddle)
+	    adj += ((int) d->prev_best_pos - (int) sfilter->workmiddle) / 2;
 
 	if (best_pos < sfilter->workmiddle)
 	    adj += ((int) best_pos - (int) sfilter->workmiddle) / 2;
     }
 
-    sfilter->prev_best_pos = best_pos;
+    d->prev_best_pos = best_pos;
     if (sfilter->do_raw) {
-	fsk_process_raw_bit(sfilter, level, certainty);
-	sfilter->prev_recv_level = level;
+	fsk_process_raw_bit(sfilter, d, level, certainty);
+	d->prev_recv_level = level;
 	return adj;
     }
 
-    sfilter->prev_recv_level = level;
+    d->prev_recv_level = level;
 
-    sfilter->wmsgsets[0].got_flag = false;
+    d->wmsgsets[0].got_flag = false;
     for (i = 0; i < sfilter->max_wmsgs; i++)
-	fsk_process_bit(sfilter, 0, i, level, certainty, in_sync);
+	fsk_process_bit(sfilter, d, 0, i, level, certainty, in_sync);
 
     for (wset = 1, m = 4.0; wset < sfilter->wmsg_sets; wset += 2, m += 4.0) {
 	for (i = 0; i < sfilter->workextra; i++)
-	    sfilter->pmark2[i] = sfilter->pmeas[markbin][i] * m;
+	    d->pmark2[i] = d->pmeas[markbin][i] * m;
 	certainty = 0.0;
-	process_powers(sfilter, sfilter->pmark2, sfilter->pmeas[spacebin],
+	process_powers(sfilter, d->pmark2, d->pmeas[spacebin],
 		       &best_pos, &certainty, &level);
-	sfilter->wmsgsets[wset].got_flag = false;
+	d->wmsgsets[wset].got_flag = false;
 	for (i = 0; i < sfilter->max_wmsgs; i++)
-	    fsk_process_bit(sfilter, wset, i, level, certainty, in_sync);
+	    fsk_process_bit(sfilter, d, wset, i, level, certainty, in_sync);
 
 	for (i = 0; i < sfilter->workextra; i++)
-	    sfilter->pspace2[i] = sfilter->pmeas[spacebin][i] * m;
+	    d->pspace2[i] = d->pmeas[spacebin][i] * m;
 	certainty = 0.0;
-	process_powers(sfilter, sfilter->pmeas[markbin], sfilter->pspace2,
+	process_powers(sfilter, d->pmeas[markbin], d->pspace2,
 		       &best_pos, &certainty, &level);
-	sfilter->wmsgsets[wset + 1].got_flag = false;
+	d->wmsgsets[wset + 1].got_flag = false;
 	for (i = 0; i < sfilter->max_wmsgs; i++)
-	    fsk_process_bit(sfilter, wset + 1, i, level, certainty, in_sync);
+	    fsk_process_bit(sfilter, d, wset + 1, i, level, certainty, in_sync);
     }
 
     return adj;
@@ -1808,6 +1796,109 @@ floatc_frame_in_copy(float *in_dest, gensiods destpos,
 	*dest = *src;
 }
 
+/*
+ * We are transmitting half duplex, throw away the partial bits.
+ */
+static void
+fsk_rx_reset_work(struct fsk_filter *sfilter)
+{
+    unsigned int i;
+
+    for (i = 0; i < sfilter->ndecoders; i++)
+	sfilter->decoders[i].work_pos = 0;
+}
+
+/*
+ * Run a buffer of buflen frames through a decoder.  Returns true if
+ * we started transmitting and receive processing needs to stop.
+ */
+static bool
+fsk_decode_frames(struct fsk_filter *sfilter, struct fsk_decoder *d,
+		  float *buf, unsigned int nchans, unsigned int chan,
+		  gensiods buflen)
+{
+    gensiods pos = 0; /* Input buffer position. */
+
+    while (sfilter->worksize - d->work_pos <= buflen - pos) {
+	bool in_sync = true;
+	int adj;
+	unsigned int j;
+
+	/* Copy the data from the incoming buffer into workbuf. */
+	sfilter->do_frame_in_copy(d->workbuf, d->work_pos,
+				  buf, pos, nchans, chan,
+				  sfilter->worksize - d->work_pos);
+	pos += sfilter->worksize - d->work_pos;
+	d->framenr = sfilter->framenr + pos;
+	if (sfilter->debug & GENSIO_FSK_DEBUG_BIT_HNDL)
+	    printf("BIT(%lu+%u): ",
+		   sfilter->framenr + pos - sfilter->worksize,
+		   sfilter->workedge);
+	adj = fsk_check_for_data(sfilter, d, d->workbuf, &in_sync);
+
+	if (in_sync) {
+	    d->nr_in_sync++;
+	} else {
+	    if (d->nr_in_sync > SYNC_RESET)
+		d->nr_in_sync = SYNC_RESET;
+	    else if (d->nr_in_sync > 0)
+		d->nr_in_sync--;
+	    if (d->nr_in_sync < IN_SYNC)
+		d->nr_out_sync++;
+	}
+	if (d->nr_in_sync > IN_SYNC) {
+	    d->nr_out_sync = 0;
+	} else {
+	    d->nr_out_sync++;
+	    if (!sfilter->full_duplex &&
+			sfilter->transmit_state == WAITING_TRANSMIT &&
+			fsk_rx_quiet(sfilter)) {
+		fsk_check_start_xmit(sfilter);
+		if (!sfilter->full_duplex &&
+			sfilter->transmit_state > WAITING_TRANSMIT)
+		    return true;
+	    }
+	}
+
+	if (sfilter->debug & GENSIO_FSK_DEBUG_BIT_HNDL)
+	    printf("SYNC: %d %d %u\n", adj, in_sync, d->nr_in_sync);
+
+	d->in_adj_counter++;
+	if (d->in_adj_counter >= sfilter->in_adj_period) {
+	    adj += sfilter->in_adj;
+	    d->in_adj_counter = 0;
+	}
+
+	/*
+	 * You cannot adjust more than the edge
+	 */
+	if (adj > (int) sfilter->maxadj)
+	    adj = (int) sfilter->maxadj;
+	if (adj < - (int) sfilter->maxadj)
+	    adj = - (int) sfilter->maxadj;
+
+	/*
+	 * Copy the end of the buffer to the beginning.  In this
+	 * buffer the end workedge bytes are the first workedge bytes
+	 * of the next  The last workedge bytes of this sample
+	 */
+	d->work_pos = sfilter->workedge * 2 - adj;
+	j = sfilter->worksize - d->work_pos;
+	memmove(d->workbuf,
+		((char *) d->workbuf) + j * sfilter->in_samplesize,
+		(size_t) d->work_pos * sfilter->in_samplesize);
+    }
+
+    /*
+     * Copy what is left in the incoming buffer into the work buffer
+     * to be processed on the next round.
+     */
+    sfilter->do_frame_in_copy(d->workbuf, d->work_pos,
+			      buf, pos, nchans, chan, buflen - pos);
+    d->work_pos += buflen - pos;
+    return false;
+}
+
 static int
 fsk_ll_write(struct gensio_filter *filter,
 	     gensio_ll_filter_data_handler handler, void *cb_data,
@@ -1816,11 +1907,10 @@ fsk_ll_write(struct gensio_filter *filter,
 	     const char *const *auxdata)
 {
     struct fsk_filter *sfilter = filter_to_fsk(filter);
-    gensiods pos;
+    unsigned int i, nchans, chan;
     int err = 0;
     /* Work in float increments to simplify calculations. */
     float *buf = (float *) inbuf;
-    gensiods buflen = inbuflen / sfilter->in_samplesize;
 
     if (!sfilter->rx || gensio_str_in_auxdata(auxdata, "oob")) {
 	/* Ignore oob data or if we are only tx. */
@@ -1834,7 +1924,7 @@ fsk_ll_write(struct gensio_filter *filter,
 	err = sfilter->err;
 	goto out_err;
     }
-    if (buflen == 0)
+    if (inbuflen == 0)
 	goto try_deliver;
 
     if (inbuflen != (gensiods) sfilter->in_bufsize * sfilter->in_framesize) {
@@ -1866,91 +1956,27 @@ fsk_ll_write(struct gensio_filter *filter,
 	printf("Processing frame %lu %d\n", sfilter->framenr,
 	       sfilter->transmit_state);
     if (!sfilter->full_duplex && sfilter->transmit_state > WAITING_TRANSMIT) {
-	sfilter->work_pos = 0;
+	fsk_rx_reset_work(sfilter);
 	goto skip_processing;
     }
 
-    pos = 0; /* Input buffer position. */
-    while (sfilter->worksize - sfilter->work_pos <= buflen - pos) {
-	bool in_sync = true;
-	int adj;
-	unsigned int j;
-
-	/* Copy the data from the incoming buffer into workbuf. */
-	sfilter->do_frame_in_copy(sfilter->workbuf, sfilter->work_pos,
-				  buf, pos, sfilter->in_nchans, sfilter->in_chan,
-				  sfilter->worksize - sfilter->work_pos);
-	pos += sfilter->worksize - sfilter->work_pos;
-	if (sfilter->debug & GENSIO_FSK_DEBUG_BIT_HNDL)
-	    printf("BIT(%lu+%u): ",
-		   sfilter->framenr + pos - sfilter->worksize,
-		   sfilter->workedge);
-	adj = fsk_check_for_data(sfilter, sfilter->workbuf, &in_sync);
-
-	if (in_sync) {
-	    sfilter->nr_in_sync++;
-	} else {
-	    if (sfilter->nr_in_sync > SYNC_RESET)
-		sfilter->nr_in_sync = SYNC_RESET;
-	    else if (sfilter->nr_in_sync > 0)
-		sfilter->nr_in_sync--;
-	    if (sfilter->nr_in_sync < IN_SYNC)
-		sfilter->nr_out_sync++;
-	}
-	if (sfilter->nr_in_sync > IN_SYNC) {
-	    sfilter->nr_out_sync = 0;
-	} else {
-	    sfilter->nr_out_sync++;
-	    if (!sfilter->full_duplex &&
-			sfilter->transmit_state == WAITING_TRANSMIT &&
-			sfilter->nr_out_sync >= sfilter->tx_delay) {
-		fsk_check_start_xmit(sfilter);
-		if (!sfilter->full_duplex &&
-			sfilter->transmit_state > WAITING_TRANSMIT) {
-		    sfilter->work_pos = 0;
-		    goto skip_processing;
-		}
-	    }
-	}
-
-	if (sfilter->debug & GENSIO_FSK_DEBUG_BIT_HNDL)
-	    printf("SYNC: %d %d %u\n", adj, in_sync, sfilter->nr_in_sync);
-
-	sfilter->in_adj_counter++;
-	if (sfilter->in_adj_counter >= sfilter->in_adj_period) {
-	    adj += sfilter->in_adj;
-	    sfilter->in_adj_counter = 0;
+    nchans = sfilter->in_nchans;
+    chan = sfilter->in_chan;
+    if (sfilter->chanbuf) {
+	sfilter->do_frame_in_copy(sfilter->chanbuf, 0, buf, 0, nchans, chan,
+				  sfilter->in_bufsize);
+	buf = sfilter->chanbuf;
+	nchans = 1;
+	chan = 0;
+    }
+    for (i = 0; i < sfilter->ndecoders; i++) {
+	if (fsk_decode_frames(sfilter, &sfilter->decoders[i], buf,
+			      nchans, chan, sfilter->in_bufsize)) {
+	    fsk_rx_reset_work(sfilter);
+	    goto skip_processing;
 	}
-
-	/*
-	 * You cannot adjust more than the edge
-	 */
-	if (adj > (int) sfilter->maxadj)
-	    adj = (int) sfilter->maxadj;
-	if (adj < - (int) sfilter->maxadj)
-	    adj = - (int) sfilter->maxadj;
-
-	/*
-	 * Copy the end of the buffer to the beginning.  In this
-	 * buffer the end workedge bytes are the first workedge bytes
-	 * of the next  The last workedge bytes of this sample
-	 */
-	sfilter->work_pos = sfilter->workedge * 2 - adj;
-	j = sfilter->worksize - sfilter->work_pos;
-	memmove(sfilter->workbuf,
-		((char *) sfilter->workbuf) + j * sfilter->in_samplesize,
-		(size_t) sfilter->work_pos * sfilter->in_samplesize);
     }
 
-    /*
-     * Copy what is left in the incoming buffer into the work buffer
-     * to be processed on the next round.
-     */
-    sfilter->do_frame_in_copy(sfilter->workbuf, sfilter->work_pos,
-			      buf, pos, sfilter->in_nchans, sfilter->in_chan,
-			      buflen - pos);
-    sfilter->work_pos += buflen - pos;
-
  skip_processing:
     sfilter->framenr += sfilter->in_bufsize;
 
@@ -2003,37 +2029,79 @@ static void
 fsk_cleanup(struct gensio_filter *filter)
 {
     struct fsk_filter *sfilter = filter_to_fsk(filter);
-    unsigned int i, j;
+    struct fsk_decoder *d;
+    unsigned int i, j, k;
 
     key_cleanup(&sfilter->keyinfo);
     sfilter->prev_xmit_level = 0;
-    sfilter->prev_recv_level = 0;
-    if (sfilter->wmsgsets) {
-	for (i = 0; i < sfilter->wmsg_sets; i++) {
-	    sfilter->wmsgsets[i].wmsgs[0].in_use = true;
-	    sfilter->wmsgsets[i].wmsgs[0].read_data_len = 0;
-	    sfilter->wmsgsets[i].wmsgs[0].num_uncertain = 0;
-	    sfilter->wmsgsets[i].wmsgs[0].certainty = 0.0;
-	    sfilter->wmsgsets[i].wmsgs[0].state = FSK_STATE_PREAMBLE_FIRST_0;
-	    for (j = 1; j < sfilter->max_wmsgs; j++)
-		sfilter->wmsgsets[i].wmsgs[j].in_use = false;
-	    sfilter->wmsgsets[i].curr_wmsgs = 1;
+    for (k = 0; k < sfilter->ndecoders; k++) {
+	d = &sfilter->decoders[k];
+	d->prev_recv_level = 0;
+	if (d->wmsgsets) {
+	    for (i = 0; i < sfilter->wmsg_sets; i++) {
+		d->wmsgsets[i].wmsgs[0].in_use = true;
+		d->wmsgsets[i].wmsgs[0].read_data_len = 0;
+		d->wmsgsets[i].wmsgs[0].num_uncertain = 0;
+		d->wmsgsets[i].wmsgs[0].certainty = 0.0;
+		d->wmsgsets[i].wmsgs[0].state = FSK_STATE_PREAMBLE_FIRST_0;
+		for (j = 1; j < sfilter->max_wmsgs; j++)
+		    d->wmsgsets[i].wmsgs[j].in_use = false;
+		d->wmsgsets[i].curr_wmsgs = 1;
+	    }
 	}
+	d->work_pos = 0;
+	d->in_adj_counter = 0;
     }
-    sfilter->work_pos = 0;
+    memset(sfilter->recent, 0, sizeof(sfilter->recent));
     sfilter->deliver_data_len = 0;
     sfilter->xmit_buf_len = 0;
     sfilter->xmit_buf_pos = 0;
     sfilter->nr_wrbufs = 0;
-    sfilter->in_adj_counter = 0;
     sfilter->out_bit_counter = 0;
 }
 
 static void
-fsk_sfilter_free(struct fsk_filter *sfilter)
+fsk_decoder_free(struct fsk_filter *sfilter, struct fsk_decoder *d)
 {
     struct gensio_os_funcs *o = sfilter->o;
     unsigned int i, j;
+
+    for (i = 0; i < sfilter->nr_hz_bins; i++) {
+	if (d->hzbin[i])
+	    o->free(o, d->hzbin[i]);
+    }
+    dftbins_cleanup(o, &d->dft);
+    if (d->workbuf)
+	o->free(o, d->workbuf);
+    for (i = 0; i < sfilter->nr_hz_bins; i++) {
+	if (d->pmeas[i])
+	    o->free(o, d->pmeas[i]);
+    }
+    if (d->pmark2)
+	o->free(o, d->pmark2);
+    if (d->pspace2)
+	o->free(o, d->pspace2);
+    if (d->wmsgsets) {
+	for (i = 0; i < sfilter->wmsg_sets; i++) {
+	    if (d->wmsgsets[i].wmsgs) {
+		for (j = 0; j < sfilter->max_wmsgs; j++) {
+		    if (d->wmsgsets[i].wmsgs[j].read_data)
+			o->free(o, d->wmsgsets[i].wmsgs[j].read_data);
+		    if (d->wmsgsets[i].wmsgs[j].raw_uncertainty)
+			o->free(o, d->wmsgsets[i].wmsgs[j].raw_uncertainty);
+		}
+	    }
+	    o->free(o, d->wmsgsets[i].wmsgs);
+	}
+	o->free(o, d->wmsgsets);
+    }
+}
+
+static void
+fsk_sfilter_free(struct fsk_filter *sfilter)
+{
+    struct gensio_os_funcs *o = sfilter->o;
+    unsigned int i;
     struct xmit_entry *e = sfilter->xmit_ent_list, *n;
 
     key_free(&sfilter->keyinfo, o);
@@ -2048,36 +2116,13 @@ fsk_sfilter_free(struct fsk_filter *sfilter)
 	o->free(o, sfilter->space_xmit);
     if (sfilter->lock)
 	o->free_lock(sfilter->lock);
-    for (i = 0; i < sfilter->nr_hz_bins; i++) {
-	if (sfilter->hzbin[i])
-	    o->free(o, sfilter->hzbin[i]);
-    }
-    if (sfilter->workbuf)
-	o->free(o, sfilter->workbuf);
-    if (sfilter->firstv)
-	o->free(o, sfilter->firstv);
-    for (i = 0; i < sfilter->nr_hz_bins; i++) {
-	if (sfilter->pmeas[i])
-	    o->free(o, sfilter->pmeas[i]);
-    }
-    if (sfilter->pmark2)
-	o->free(o, sfilter->pmark2);
-    if (sfilter->pspace2)
-	o->free(o, sfilter->pspace2);
-    if (sfilter->wmsgsets) {
-	for (i = 0; i < sfilter->wmsg_sets; i++) {
-	    if (sfilter->wmsgsets[i].wmsgs) {
-		for (j = 0; j < sfilter->max_wmsgs; j++) {
-		    if (sfilter->wmsgsets[i].wmsgs[j].read_data)
-			o->free(o, sfilter->wmsgsets[i].wmsgs[j].read_data);
-		    if (sfilter->wmsgsets[i].wmsgs[j].raw_uncertainty)
-			o->free(o, sfilter->wmsgsets[i].wmsgs[j].raw_uncertainty);
-		}
-	    }
-	    o->free(o, sfilter->wmsgsets[i].wmsgs);
-	}
-	o->free(o, sfilter->wmsgsets);
+    if (sfilter->decoders) {
+	for (i = 0; i < sfilter->ndecoders; i++)
+	    fsk_decoder_free(sfilter, &sfilter->decoders[i]);
+	o->free(o, sfilter->decoders);
     }
+    if (sfilter->chanbuf)
+	o->free(o, sfilter->chanbuf);
     if (sfilter->deliver_data)
 	o->free(o, sfilter->deliver_data);
     if (sfilter->deliver_raw_uncertainty)
@@ -2416,6 +2461,8 @@ struct gensio_fsk_data {
     unsigned int max_wmsgs;
     unsigned int wmsg_sets;
     float min_certainty;
+    unsigned int ndecoders;
+    float decoder_shift;
 
     int filt_type;
 #define NO_FILT 0
@@ -2547,6 +2594,99 @@ float_gen_hz(float *buf, unsigned int bufsize,
     }
 }
 
+/*
+ * Set up a receive pipeline, looking for the mark and space offset
+ * by freq_offset Hz.  Returns true on failure, the caller must free
+ * the decoder.
+ */
+static bool
+fsk_decoder_setup(struct fsk_filter *sfilter, struct fsk_decoder *d,
+		  struct gensio_fsk_data *data, float freq_offset,
+		  float fin_bitsize)
+{
+    struct gensio_os_funcs *o = sfilter->o;
+    unsigned int i, j;
+    float freq, freq_incr;
+
+    /*
+     * For complex, we don't have a separate sin and cos part,
+     * it's e^(2 * I * w), so it's the same size real or float.
+     */
+    if (sfilter->nr_hz_bins < 5) {
+	/* Really, below 5 is 2, as 3 and 4 are not useful numbers. */
+	freq_incr = data->in_mark_freq - data->in_space_freq;
+	freq = data->in_space_freq;
+    } else {
+	freq_incr = 1200;
+	freq = (data->in_space_freq
+		- (sfilter->nr_hz_bins / 2 - 1) * freq_incr);
+    }
+    freq += freq_offset;
+    for (i = 0; i < sfilter->nr_hz_bins; i++, freq += freq_incr) {
+	d->hzbin[i] = o->zalloc(o, (sizeof(float) * 4
+				    * sfilter->in_bitsize));
+	if (!d->hzbin[i])
+	    return true;
+	if (sfilter->in_format == FSK_FMT_FLOATC)
+	    floatc_gen_hz(d->hzbin[i], sfilter->in_bitsize,
+			  freq, data->in_framerate);
+	else
+	    float_gen_hz(d->hzbin[i], sfilter->in_bitsize,
+			 freq / data->in_data_rate,
+			 fin_bitsize);
+    }
+
+    d->workbuf = o->zalloc(o, sfilter->worksize * sfilter->in_samplesize);
+    if (!d->workbuf)
+	return true;
+
+    if (dftbins_setup(o, &d->dft,
+		      sfilter->in_format == FSK_FMT_FLOATC,
+		      sfilter->nr_hz_bins, d->hzbin,
+		      sfilter->in_bitsize, sfilter->workedge))
+	return true;
+
+    for (i = 0; i < sfilter->nr_hz_bins; i++) {
+	d->pmeas[i] = o->zalloc(o, (sfilter->workextra
+				    * sfilter->in_samplesize));
+	if (!d->pmeas[i])
+	    return true;
+    }
+    d->pmark2 = o->zalloc(o, sfilter->workextra * sfilter->in_samplesize);
+    if (!d->pmark2)
+	return true;
+    d->pspace2 = o->zalloc(o, sfilter->workextra * sfilter->in_samplesize);
+    if (!d->pspace2)
+	return true;
+
+    d->wmsgsets = o->zalloc(o, sizeof(struct wmsgset) * sfilter->wmsg_sets);
+    if (!d->wmsgsets)
+	return true;
+    for (i = 0; i < sfilter->wmsg_sets; i++) {
+	d->wmsgsets[i].wmsgs =
+	    o->zalloc(o, sizeof(struct wmsg) * sfilter->max_wmsgs);
+	if (!d->wmsgsets[i].wmsgs)
+	    return true;
+	for (j = 0; j < sfilter->max_wmsgs; j++) {
+	    d->wmsgsets[i].wmsgs[j].read_data =
+		o->zalloc(o, sfilter->max_read_size);
+	    if (!d->wmsgsets[i].wmsgs[j].read_data)
+		return true;
+	    if (sfilter->do_uncert) {
+		d->wmsgsets[i].wmsgs[j].raw_uncertainty =
+		    o->zalloc(o, sfilter->max_read_size * 8);
+		if (!d->wmsgsets[i].wmsgs[j].raw_uncertainty)
+		    return true;
+	    }
+	}
+	d->wmsgsets[i].wmsgs[0].in_use = true;
+	d->wmsgsets[i].wmsgs[0].state = FSK_STATE_PREAMBLE_FIRST_0;
+	d->wmsgsets[i].curr_wmsgs = 1;
+    }
+
+    return false;
+}
+
 static struct gensio_filter *
 gensio_fsk_filter_raw_alloc(struct gensio_pparm_info *p,
 			    struct gensio_os_funcs *o,
@@ -2555,8 +2695,8 @@ gensio_fsk_filter_raw_alloc(struct gensio_pparm_info *p,
 			    struct gensio_fsk_data *data)
 {
     struct fsk_filter *sfilter;
-    unsigned int i, j;
-    float fin_bitsize, fout_bitsize, freq, freq_incr;
+    unsigned int i;
+    float fin_bitsize, fout_bitsize, freq;
     bool err;
 
     sfilter = o->zalloc(o, sizeof(*sfilter));
@@ -2595,7 +2735,6 @@ gensio_fsk_filter_raw_alloc(struct gensio_pparm_info *p,
     sfilter->in_do_diff = data->in_do_diff;
     sfilter->out_do_diff = data->out_do_diff;
     sfilter->prev_xmit_level = 0;
-    sfilter->prev_recv_level = 0;
     sfilter->in_bufsize = data->in_bufsize;
     sfilter->out_bufsize = data->out_bufsize;
     sfilter->max_wmsgs = data->max_wmsgs;
@@ -2669,40 +2808,10 @@ gensio_fsk_filter_raw_alloc(struct gensio_pparm_info *p,
 	 */
 	sfilter->nr_hz_bins = 2;
 
-	/*
-	 * For complex, we don't have a separate sin and cos part,
-	 * it's e^(2 * I * w), so it's the same size real or float.
-	 */
-	if (sfilter->nr_hz_bins < 5) {
-	    /* Really, below 5 is 2, as 3 and 4 are not useful numbers. */
-	    freq_incr = data->in_mark_freq - data->in_space_freq;
-	    freq = data->in_space_freq;
-	} else {
-	    freq_incr = 1200;
-	    freq = (data->in_space_freq
-		    - (sfilter->nr_hz_bins / 2 - 1) * freq_incr);
-	}
-	for (i = 0; i < sfilter->nr_hz_bins; i++, freq += freq_incr) {
-	    sfilter->hzbin[i] = o->zalloc(o, (sizeof(float) * 4
-					      * sfilter->in_bitsize));
-	    if (!sfilter->hzbin[i])
-		goto out_nomem;
-	    if (sfilter->in_format == FSK_FMT_FLOATC)
-		floatc_gen_hz(sfilter->hzbin[i], sfilter->in_bitsize,
-			      freq, data->in_framerate);
-	    else
-		float_gen_hz(sfilter->hzbin[i], sfilter->in_bitsize,
-			     freq / data->in_data_rate,
-			     fin_bitsize);
-	}
-
-	if (sfilter->in_format == FSK_FMT_FLOATC) {
-	    sfilter->do_dftbin = floatc_dftbin;
+	if (sfilter->in_format == FSK_FMT_FLOATC)
 	    sfilter->do_frame_in_copy = floatc_frame_in_copy;
-	} else {
-	    sfilter->do_dftbin = float_dftbin;
+	else
 	    sfilter->do_frame_in_copy = float_frame_in_copy;
-	}
 
 	err = 0;
 	if (data->lpcutoff && data->filt_type != NO_FILT) {
@@ -2756,10 +2865,6 @@ gensio_fsk_filter_raw_alloc(struct gensio_pparm_info *p,
 	sfilter->workextra = (2 * sfilter->workedge) + 1;
 
 	sfilter->worksize = sfilter->in_bitsize + 2 * sfilter->workedge;
-	sfilter->workbuf = o->zalloc(o, (sfilter->worksize
-					 * sfilter->in_samplesize));
-	if (!sfilter->workbuf)
-	    goto out_nomem;
 
 	if (data->maxadj == 0)
 	    sfilter->maxadj = sfilter->workedge / 2 + 1;
@@ -2770,54 +2875,31 @@ gensio_fsk_filter_raw_alloc(struct gensio_pparm_info *p,
 	if (data->maxadj > sfilter->workedge)
 	    data->maxadj = sfilter->workedge;
 
-	/*
-	 * Complex version stores e^(I * w), real version stores sin
-	 * and cos values, so they are the same size.
-	 */
-	sfilter->firstv = o->zalloc(o, sfilter->workedge * 4 * sizeof(float));
-	if (!sfilter->firstv)
+	sfilter->decoders = o->zalloc(o, (sizeof(struct fsk_decoder)
+					  * data->ndecoders));
+	if (!sfilter->decoders)
 	    goto out_nomem;
-
-	for (i = 0; i < sfilter->nr_hz_bins; i++) {
-	    sfilter->pmeas[i] = o->zalloc(o, (sfilter->workextra
-					      * sfilter->in_samplesize));
-	    if (!sfilter->pmeas[i])
+	sfilter->ndecoders = data->ndecoders;
+	for (i = 0; i < sfilter->ndecoders; i++) {
+	    /* Offsets go 0, +shift, -shift, +2 * shift, -2 * shift, ... */
+	    freq = data->decoder_shift * ((i + 1) / 2);
+	    if (i % 2 == 0)
+		freq = -freq;
+	    if (fsk_decoder_setup(sfilter, &sfilter->decoders[i], data,
+				  freq, fin_bitsize))
 		goto out_nomem;
 	}
-	sfilter->pmark2 = o->zalloc(o, (sfilter->workextra
-					* sfilter->in_samplesize));
-	if (!sfilter->pmark2)
-	    goto out_nomem;
-	sfilter->pspace2 = o->zalloc(o, (sfilter->workextra
-					 * sfilter->in_samplesize));
-	if (!sfilter->pspace2)
-	    goto out_nomem;
-
-	sfilter->wmsgsets = o->zalloc(o, (sizeof(struct wmsgset) *
-					  sfilter->wmsg_sets));
-	if (!sfilter->wmsgsets)
-	    goto out_nomem;
-	for (i = 0; i < sfilter->wmsg_sets; i++) {
-	    sfilter->wmsgsets[i].wmsgs =
-		o->zalloc(o, sizeof(struct wmsg) * sfilter->max_wmsgs);
-	    if (!sfilter->wmsgsets[i].wmsgs)
+	if (sfilter->ndecoders > 1 && sfilter->in_nchans > 1) {
+	    sfilter->chanbuf = o->zalloc(o, (sfilter->in_samplesize
+					     * sfilter->in_bufsize));
+	    if (!sfilter->chanbuf)
 		goto out_nomem;
-	    for (j = 0; j < sfilter->max_wmsgs; j++) {
-		sfilter->wmsgsets[i].wmsgs[j].read_data =
-		    o->zalloc(o, sfilter->max_read_size);
-		if (!sfilter->wmsgsets[i].wmsgs[j].read_data)
-		    goto out_nomem;
-		if (sfilter->do_uncert) {
-		    sfilter->wmsgsets[i].wmsgs[j].raw_uncertainty =
-			o->zalloc(o, sfilter->max_read_size * 8);
-		    if (!sfilter->wmsgsets[i].wmsgs[j].raw_uncertainty)
-			goto out_nomem;
-		}
-	    }
-	    sfilter->wmsgsets[i].wmsgs[0].in_use = true;
-	    sfilter->wmsgsets[i].wmsgs[0].state = FSK_STATE_PREAMBLE_FIRST_0;
-	    sfilter->wmsgsets[i].curr_wmsgs = 1;
 	}
+	/*
+	 * The decoders see the end of a frame within a few bits of
+	 * each other, allow plenty of slop.
+	 */
+	sfilter->dup_window = (gensiods) sfilter->in_bitsize * 32;
 
 	sfilter->deliver_data = o->zalloc(o, sfilter->max_read_size);
 	if (!sfilter->deliver_data)
@@ -2970,6 +3052,8 @@ gensio_fsk_filter_alloc(struct gensio_pparm_info *p,
 	.out_bufsize = 0,
 	.max_wmsgs = 1,
 	.min_certainty = 3.5,
+	.ndecoders = 1,
+	.decoder_shift = 100,
 	.filt_type = NO_FILT,
 	.filt_type_set = false,
 	.lpcutoff = 0,
@@ -3000,6 +3084,7 @@ gensio_fsk_filter_alloc(struct gensio_pparm_info *p,
     gensiods cdata_len;
     unsigned int chan;
     unsigned int wmsg_extra = 0;
+    bool lpcutoff_set = false;
     struct gensio *out_child = child;
 
     if (is_afsk) {
@@ -3102,13 +3187,20 @@ gensio_fsk_filter_alloc(struct gensio_pparm_info *p,
 	if (gensio_pparm_float(p, args[i], "min-certainty",
 				  &data.min_certainty) > 0)
 	    continue;
+	if (gensio_pparm_uint(p, args[i], "decoders", &data.ndecoders) > 0)
+	    continue;
+	if (gensio_pparm_float(p, args[i], "decoder-shift",
+			       &data.decoder_shift) > 0)
+	    continue;
 	if (gensio_pparm_enum(p, args[i], "filttype", filttype_enums,
 				 &data.filt_type) > 0) {
 	    data.filt_type_set = true;
 	    continue;
 	}
-	if (gensio_pparm_uint(p, args[i], "lpcutoff", &data.lpcutoff) > 0)
+	if (gensio_pparm_uint(p, args[i], "lpcutoff", &data.lpcutoff) > 0) {
+	    lpcutoff_set = true;
 	    continue;
+	}
 	if (gensio_pparm_float(p, args[i], "lpgain", &data.lpgain) > 0)
 	    continue;
 	if (gensio_pparm_uint(p, args[i], "hpcutoff", &data.hpcutoff) > 0)
@@ -3309,6 +3401,12 @@ gensio_fsk_filter_alloc(struct gensio_pparm_info *p,
     if (data.rx) {
 	CHECK_VAL(in_chan, >=, data.in_nchans);
 	CHECK_VAL(max_wmsgs, ==, 0);
+	CHECK_VAL(ndecoders, ==, 0);
+	if (data.do_raw && data.ndecoders > 1) {
+	    gensio_pparm_slog(p, "Only one decoder can be used in raw mode");
+	    err = GE_INCONSISTENT;
+	    goto out_err;
+	}
     }
 
     if (data.tx) {
@@ -3350,6 +3448,13 @@ gensio_fsk_filter_alloc(struct gensio_pparm_info *p,
 	    data.lpcutoff = data.in_mark_freq * 2;
     }
 
+    /*
+     * The filter is shared by all the decoders, so it has to pass the
+     * highest tone any of them listen for.
+     */
+    if (!lpcutoff_set && data.ndecoders > 1)
+	data.lpcutoff += data.decoder_shift * (data.ndecoders / 2);
+
     if (data.out_do_freqadj) {
 	if (data.out_mark_freq < 0.1)
 	    data.out_mark_freq = data.out_data_rate * 4;
@@ -3407,6 +3512,8 @@ gensio_fsk_filter_alloc(struct gensio_pparm_info *p,
 	printf("in_mark = %f\n", data.in_mark_freq);
 	printf("in_space = %f\n", data.in_space_freq);
 	printf("in_freqadj = %f\n", -((data.in_mark_freq + data.in_space_freq) / 2));
+	printf("decoders = %u\n", data.ndecoders);
+	printf("decoder_shift = %f\n", data.decoder_shift);
 
 	printf("lpcutoff = %u\n", data.lpcutoff);
 	printf("hpcutoff = %u\n", data.hpcutoff);
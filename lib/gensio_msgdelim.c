@@ -16,52 +16,7 @@
 #include <gensio/gensio_acc_gensio.h>
 #include <gensio/argvutils.h>
 
-static const uint16_t crc16_table[256] = {
-    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
-    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
-    0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
-    0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
-    0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
-    0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
-    0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
-    0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
-    0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
-    0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
-    0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
-    0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
-    0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
-    0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
-    0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
-    0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
-    0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
-    0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
-    0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
-    0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
-    0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
-    0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
-    0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
-    0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
-    0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
-    0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
-    0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
-    0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
-    0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
-    0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
-    0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
-    0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0
-};
-
-static void
-crc16(const unsigned char *buf, unsigned int len, uint16_t *icrc)
-{
-    unsigned int i;
-    uint16_t crc = *icrc;
-
-    for (i = 0; i < len; i++)
-	crc = (crc << 8) ^ crc16_table[((crc >> 8) ^ buf[i]) & 0xff];
-
-    *icrc = crc;
-}
+#include "crc.h"
 
 struct msgdelim_config {
     gensiods max_read_size;
@@ -174,6 +129,92 @@ msgdelim_add_wrbyte(struct msgdelim_filter *mfilter, unsigned char byte)
 	mfilter->write_data[mfilter->write_data_len++] = 0;
 }
 
+/*
+ * Maximum number of pieces a message is split into when writing it
+ * straight from the user's buffers, see msgdelim_direct_sg().
+ */
+#define MSGDELIM_MAX_DIRECT_SG	16
+
+static const unsigned char msgdelim_escape_byte = 0;
+
+/*
+ * Build a scatter-gather list for the message that points into the
+ * user's buffers, with the escapes for 254s and the trailer (the CRC
+ * and separator, already escaped in trailer) added as their own
+ * pieces.  Anything already in write_data (the separator before the
+ * first message) goes first.  This way the message can be written
+ * with no copying if the lower layer takes it all.  Returns the
+ * number of pieces, or 0 if there are too many 254s to do it this
+ * way.
+ */
+static gensiods
+msgdelim_direct_sg(struct msgdelim_filter *mfilter,
+		   const struct gensio_sg *isg, gensiods sglen,
+		   const unsigned char *trailer, gensiods trailer_len,
+		   struct gensio_sg *sg)
+{
+    gensiods i, nsg = 0, left;
+    const unsigned char *buf, *pos;
+
+    if (mfilter->write_data_len > mfilter->write_data_pos) {
+	sg[nsg].buf = mfilter->write_data + mfilter->write_data_pos;
+	sg[nsg++].buflen = mfilter->write_data_len - mfilter->write_data_pos;
+    }
+    for (i = 0; i < sglen; i++) {
+	buf = isg[i].buf;
+	left = isg[i].buflen;
+	while (left > 0) {
+	    if (nsg >= MSGDELIM_MAX_DIRECT_SG - 1)
+		return 0;
+	    pos = memchr(buf, 254, left);
+	    if (!pos) {
+		sg[nsg].buf = buf;
+		sg[nsg++].buflen = left;
+		break;
+	    }
+	    pos++;
+	    sg[nsg].buf = buf;
+	    sg[nsg++].buflen = pos - buf;
+	    if (nsg >= MSGDELIM_MAX_DIRECT_SG - 1)
+		return 0;
+	    sg[nsg].buf = &msgdelim_escape_byte;
+	    sg[nsg++].buflen = 1;
+	    left -= pos - buf;
+	    buf = pos;
+	}
+    }
+    sg[nsg].buf = trailer;
+    sg[nsg++].buflen = trailer_len;
+    return nsg;
+}
+
+/*
+ * Save the part of a directly written message that the lower layer
+ * did not take so it can be sent later.  The first piece may be from
+ * write_data itself, thus the memmove.
+ */
+static void
+msgdelim_save_unwritten(struct msgdelim_filter *mfilter,
+			const struct gensio_sg *sg, gensiods nsg,
+			gensiods count)
+{
+    gensiods i, len;
+
+    mfilter->write_data_len = 0;
+    mfilter->write_data_pos = 0;
+    for (i = 0; i < nsg; i++) {
+	len = sg[i].buflen;
+	if (count >= len) {
+	    count -= len;
+	    continue;
+	}
+	memmove(mfilter->write_data + mfilter->write_data_len,
+		((const unsigned char *) sg[i].buf) + count, len - count);
+	mfilter->write_data_len += len - count;
+	count = 0;
+    }
+}
+
 static int
 msgdelim_ul_write(struct gensio_filter *filter,
 		  gensio_ul_filter_data_handler handler, void *cb_data,
@@ -189,39 +230,68 @@ msgdelim_ul_write(struct gensio_filter *filter,
 	if (rcount)
 	    *rcount = 0;
     } else {
-	gensiods i, j, writelen = 0;
+	gensiods i, j, writelen = 0, nsg, trailer_len = 0, total, count;
+	struct gensio_sg sg[MSGDELIM_MAX_DIRECT_SG];
+	unsigned char trailer[6];
 	uint16_t crc = 0;
 
 	for (i = 0; i < sglen; i++) {
-	    gensiods inlen = isg[i].buflen;
-	    const unsigned char *buf = isg[i].buf;
-
-	    crc16(buf, inlen, &crc);
-	    for (j = 0; j < inlen; j++) {
-		if (mfilter->user_write_pos >= mfilter->config.max_write_size) {
-		    err = GE_TOOBIG;
-		    mfilter->user_write_pos = 0;
-		    mfilter->write_data_len = 0;
-		    mfilter->write_data_pos = 0;
-		    goto out_err;
-		}
-		mfilter->user_write_pos++;
-		msgdelim_add_wrbyte(mfilter, buf[j]);
-	    }
-	    writelen += inlen;
+	    crc16_xmodem(isg[i].buf, isg[i].buflen, &crc);
+	    writelen += isg[i].buflen;
+	}
+	if (writelen > mfilter->config.max_write_size) {
+	    err = GE_TOOBIG;
+	    goto out_err;
 	}
 	if (rcount)
 	    *rcount = writelen;
-
-	if (mfilter->user_write_pos > 0) {
+	if (writelen == 0)
+	    goto out_err;
+
+	if (mfilter->config.crc) {
+	    trailer[trailer_len++] = crc >> 8;
+	    if (trailer[trailer_len - 1] == 254)
+		trailer[trailer_len++] = 0;
+	    trailer[trailer_len++] = crc & 0xff;
+	    if (trailer[trailer_len - 1] == 254)
+		trailer[trailer_len++] = 0;
+	}
+	trailer[trailer_len++] = 254;
+	trailer[trailer_len++] = 1; /* separator */
+
+	nsg = msgdelim_direct_sg(mfilter, isg, sglen, trailer, trailer_len,
+				 sg);
+	if (nsg) {
+	    for (i = 0, total = 0; i < nsg; i++)
+		total += sg[i].buflen;
+	    /* Keep other writes out while unlocked. */
 	    mfilter->out_msg_complete = true;
-	    if (mfilter->config.crc) {
-		msgdelim_add_wrbyte(mfilter, crc >> 8);
-		msgdelim_add_wrbyte(mfilter, crc & 0xff);
+	    msgdelim_unlock(mfilter);
+	    err = handler(cb_data, &count, sg, nsg, NULL);
+	    msgdelim_lock(mfilter);
+	    if (err) {
+		mfilter->out_msg_complete = false;
+	    } else if (count >= total) {
+		mfilter->write_data_len = 0;
+		mfilter->write_data_pos = 0;
+		mfilter->out_msg_complete = false;
+	    } else {
+		msgdelim_save_unwritten(mfilter, sg, nsg, count);
 	    }
-	    mfilter->write_data[mfilter->write_data_len++] = 254;
-	    mfilter->write_data[mfilter->write_data_len++] = 1; /* separator */
+	    goto out_err;
+	}
+
+	for (i = 0; i < sglen; i++) {
+	    const unsigned char *buf = isg[i].buf;
+
+	    for (j = 0; j < isg[i].buflen; j++)
+		msgdelim_add_wrbyte(mfilter, buf[j]);
 	}
+	memcpy(mfilter->write_data + mfilter->write_data_len, trailer,
+	       trailer_len);
+	mfilter->write_data_len += trailer_len;
+	mfilter->user_write_pos = writelen;
+	mfilter->out_msg_complete = true;
     }
 
     if (mfilter->out_msg_complete) {
@@ -290,8 +360,8 @@ msgdelim_ll_write(struct gensio_filter *filter,
 			    if (mfilter->read_data_len <= 2)
 				break;
 			    crc = 0;
-			    crc16(mfilter->read_data, mfilter->read_data_len,
-				  &crc);
+			    crc16_xmodem(mfilter->read_data,
+					 mfilter->read_data_len, &crc);
 			    if (crc != 0)
 				break;
 			    mfilter->read_data_len -= 2; /* Remove the CRC */
@@ -488,7 +558,7 @@ gensio_msgdelim_filter_raw_alloc(struct gensio_os_funcs *o,
     if (!mfilter->lock)
 	goto out_nomem;
 
-    mfilter->read_data = o->zalloc(o, config->max_read_size);
+    mfilter->read_data = o->zalloc(o, mfilter->config.max_read_size);
     if (!mfilter->read_data)
 	goto out_nomem;
 
@@ -151,6 +151,19 @@ static unsigned int mux_msg_hdr_sizes[] = { 0, 1, 2, 3, 2, 2 };
 #define MUX_MAX_HDR_SIZE	12
 #define MUX_MIN_SEND_WINDOW_SIZE	128
 
+/* Starting size of the channel hash tables, must be a power of two. */
+#define MUX_CHAN_HASH_INIT_SIZE	16
+
+/*
+ * Transmit scheduling, see mux_child_write_ready().  Channels have a
+ * priority from 0 to MUX_NR_PRIORITIES - 1, higher goes first, and a
+ * weight from 1 to MUX_MAX_WEIGHT.  Each turn a channel gets to send
+ * weight * MUX_DRR_QUANTUM bytes.
+ */
+#define MUX_NR_PRIORITIES	8
+#define MUX_MAX_WEIGHT		100
+#define MUX_DRR_QUANTUM		1024
+
 #ifdef ENABLE_INTERNAL_TRACE
 #define MUX_TRACING
 #endif
@@ -261,7 +274,21 @@ struct mux_inst {
     bool in_wrlist;
     bool in_open_chan;
 
+    /*
+     * Scheduling.  deficit is the number of bytes the channel may
+     * still send in its current turn, it goes negative if the last
+     * message sent was bigger than what was left.
+     */
+    unsigned int priority;
+    unsigned int weight;
+    long deficit;
+    bool in_turn;
+
     struct gensio_link link;
+
+    /* Chains in the muxdata hash tables by id and remote id. */
+    struct mux_inst *id_next;
+    struct mux_inst *rid_next;
 };
 
 static gensiods
@@ -352,6 +379,8 @@ struct gensio_mux_config {
     char *service;
     size_t service_len;
     unsigned int max_channels;
+    unsigned int priority;
+    unsigned int weight;
     bool is_client;
 };
 
@@ -477,8 +506,8 @@ struct mux_data {
     /* The last id we chose for a channel. */
     unsigned int last_id;
 
-    /* Mux instances with write pending. */
-    struct gensio_list wrchans;
+    /* Mux instances with write pending, one list per priority. */
+    struct gensio_list wrchans[MUX_NR_PRIORITIES];
 
     /* Muxes waiting to open. */
     struct gensio_list openchans;
@@ -497,6 +526,17 @@ struct mux_data {
      * order.
      */
     struct gensio_list chans;
+    unsigned int nr_chans;
+
+    /*
+     * The channels hashed by id and by remote id, so finding the
+     * channel for a received message doesn't have to go through the
+     * whole list.  Both tables are chan_hash_size entries, a power
+     * of two.
+     */
+    struct mux_inst **id_hash;
+    struct mux_inst **rid_hash;
+    unsigned int chan_hash_size;
 
 #ifdef MUX_TRACING
     struct mux_trace_info trace[MUX_TRACE_SIZE];
@@ -590,6 +630,10 @@ muxdata_free(struct mux_data *muxdata)
 {
     assert(gensio_list_empty(&muxdata->chans));
 
+    if (muxdata->id_hash)
+	muxdata->o->free(muxdata->o, muxdata->id_hash);
+    if (muxdata->rid_hash)
+	muxdata->o->free(muxdata->o, muxdata->rid_hash);
     if (muxdata->lock)
 	muxdata->o->free_lock(muxdata->lock);
     if (muxdata->child)
@@ -670,6 +714,95 @@ static bool i_mux_deref_and_unlock(struct mux_data *mux)
 #define mux_deref i_mux_deref
 #endif
 
+static void
+mux_hash_link(struct mux_data *muxdata, struct mux_inst *chan)
+{
+    unsigned int mask = muxdata->chan_hash_size - 1;
+
+    chan->id_next = muxdata->id_hash[chan->id & mask];
+    muxdata->id_hash[chan->id & mask] = chan;
+    chan->rid_next = muxdata->rid_hash[chan->remote_id & mask];
+    muxdata->rid_hash[chan->remote_id & mask] = chan;
+}
+
+static void
+mux_hash_unlink_rid(struct mux_data *muxdata, struct mux_inst *chan)
+{
+    unsigned int mask = muxdata->chan_hash_size - 1;
+    struct mux_inst **p = &muxdata->rid_hash[chan->remote_id & mask];
+
+    while (*p != chan)
+	p = &(*p)->rid_next;
+    *p = chan->rid_next;
+}
+
+/*
+ * Add a channel to the hash tables.  The channel must already be in
+ * the chans list.  If the tables are full, try to double them and
+ * rehash everything; if that fails just keep using the old ones, the
+ * chains will be longer but it still works.
+ */
+static void
+mux_hash_add(struct mux_data *muxdata, struct mux_inst *chan)
+{
+    struct gensio_os_funcs *o = muxdata->o;
+    struct mux_inst **id_hash = NULL, **rid_hash = NULL;
+    unsigned int size = muxdata->chan_hash_size * 2;
+    struct gensio_link *l;
+
+    muxdata->nr_chans++;
+    if (muxdata->nr_chans <= muxdata->chan_hash_size)
+	goto link_one;
+
+    id_hash = o->zalloc(o, size * sizeof(*id_hash));
+    rid_hash = o->zalloc(o, size * sizeof(*rid_hash));
+    if (!id_hash || !rid_hash) {
+	if (id_hash)
+	    o->free(o, id_hash);
+	if (rid_hash)
+	    o->free(o, rid_hash);
+	goto link_one;
+    }
+
+    o->free(o, muxdata->id_hash);
+    o->free(o, muxdata->rid_hash);
+    muxdata->id_hash = id_hash;
+    muxdata->rid_hash = rid_hash;
+    muxdata->chan_hash_size = size;
+    gensio_list_for_each(&muxdata->chans, l)
+	mux_hash_link(muxdata,
+		      gensio_container_of(l, struct mux_inst, link));
+    return;
+
+ link_one:
+    mux_hash_link(muxdata, chan);
+}
+
+static void
+mux_hash_rm(struct mux_data *muxdata, struct mux_inst *chan)
+{
+    unsigned int mask = muxdata->chan_hash_size - 1;
+    struct mux_inst **p = &muxdata->id_hash[chan->id & mask];
+
+    while (*p != chan)
+	p = &(*p)->id_next;
+    *p = chan->id_next;
+    mux_hash_unlink_rid(muxdata, chan);
+    muxdata->nr_chans--;
+}
+
+static void
+mux_chan_set_remote_id(struct mux_inst *chan, unsigned int remote_id)
+{
+    struct mux_data *muxdata = chan->mux;
+    unsigned int mask = muxdata->chan_hash_size - 1;
+
+    mux_hash_unlink_rid(muxdata, chan);
+    chan->remote_id = remote_id;
+    chan->rid_next = muxdata->rid_hash[remote_id & mask];
+    muxdata->rid_hash[remote_id & mask] = chan;
+}
+
 static void
 chan_free(struct mux_inst *chan)
 {
@@ -700,6 +833,7 @@ static bool i_chan_deref(struct mux_inst *chan)
     if (--chan->refcount == 0) {
 	struct mux_data *mux = chan->mux;
 
+	mux_hash_rm(mux, chan);
 	gensio_list_rm(&mux->chans, &chan->link);
 	chan_free(chan);
 	i_mux_deref(mux);
@@ -1090,6 +1224,27 @@ chan_sched_deferred_op(struct mux_inst *chan)
     }
 }
 
+/* The channel has nothing more to send, it loses the rest of its turn. */
+static void
+chan_wr_idle(struct mux_inst *chan)
+{
+    chan->wr_ready = false;
+    chan->deficit = 0;
+    chan->in_turn = false;
+}
+
+static void
+muxc_set_priority(struct mux_inst *chan, unsigned int priority)
+{
+    struct mux_data *muxdata = chan->mux;
+
+    if (chan->in_wrlist) {
+	gensio_list_rm(&muxdata->wrchans[chan->priority], &chan->wrlink);
+	gensio_list_add_tail(&muxdata->wrchans[priority], &chan->wrlink);
+    }
+    chan->priority = priority;
+}
+
 static void
 muxc_add_to_wrlist(struct mux_inst *chan)
 {
@@ -1097,7 +1252,7 @@ muxc_add_to_wrlist(struct mux_inst *chan)
 
     if (!chan->wr_ready && !muxdata->err_shutdown) {
 	assert(!chan->in_wrlist);
-	gensio_list_add_tail(&muxdata->wrchans, &chan->wrlink);
+	gensio_list_add_tail(&muxdata->wrchans[chan->priority], &chan->wrlink);
 	chan->wr_ready = true;
 	chan->in_wrlist = true;
 	if (muxdata->state != MUX_CLOSED)
@@ -1403,6 +1558,7 @@ mux_new_channel(struct mux_data *muxdata, gensio_event cb, void *user_data,
     chan->mux = muxdata;
     chan->refcount = 1;
     chan->is_client = is_client;
+    chan->weight = 1;
     chan->max_read_size = muxdata->max_read_size;
     chan->max_write_size = muxdata->max_write_size;
     chan->read_data = o->zalloc(o, chan->max_read_size);
@@ -1419,6 +1575,7 @@ mux_new_channel(struct mux_data *muxdata, gensio_event cb, void *user_data,
      */
     if (gensio_list_empty(&muxdata->chans)) {
 	gensio_list_add_tail(&muxdata->chans, &chan->link);
+	mux_hash_add(muxdata, chan);
 	/* Note that we do not claim a ref here, there is already one. */
     } else {
 	struct gensio_link *l, *p = &muxdata->chans.link, *f;
@@ -1459,6 +1616,7 @@ mux_new_channel(struct mux_data *muxdata, gensio_event cb, void *user_data,
 	chan->id = id;
 	muxdata->last_id = id;
 	gensio_list_add_next(&muxdata->chans, p, &chan->link);
+	mux_hash_add(muxdata, chan);
 	mux_ref(muxdata);
     }
 
@@ -1479,6 +1637,8 @@ muxc_alloc_channel_data(struct mux_data *muxdata,
     err = mux_new_channel(muxdata, cb, user_data, data->is_client, &chan);
     if (err)
 	goto out_err;
+    chan->priority = data->priority;
+    chan->weight = data->weight;
 
     if (data->service) {
 	if (data->service_len > chan->max_write_size - 10) {
@@ -1533,6 +1693,20 @@ gensio_mux_config(struct gensio_pparm_info *p,
 	    }
 	    continue;
 	}
+	if (gensio_pparm_uint(p, args[i], "priority", &data->priority) > 0) {
+	    if (data->priority >= MUX_NR_PRIORITIES) {
+		rv = GE_INVAL;
+		goto out_err;
+	    }
+	    continue;
+	}
+	if (gensio_pparm_uint(p, args[i], "weight", &data->weight) > 0) {
+	    if (data->weight > MUX_MAX_WEIGHT || data->weight < 1) {
+		rv = GE_INVAL;
+		goto out_err;
+	    }
+	    continue;
+	}
 	if (gensio_pparm_value(p, args[i], "service", &str) > 0) {
 	    data->service = gensio_strdup(o, str);
 	    if (!data->service)
@@ -1610,6 +1784,7 @@ muxc_alloc_channel(struct mux_data *muxdata,
     data.max_read_size = muxdata->max_read_size;
     data.max_write_size = muxdata->max_write_size;
     data.max_channels = muxdata->max_channels;
+    data.weight = 1;
     data.is_client = true;
     err = get_default_mode(muxdata->o, &data.is_client);
     if (err)
@@ -1819,6 +1994,34 @@ muxc_control(struct mux_inst *chan, bool get, int op,
 	    chan->do_oob = !!strtoul(data, NULL, 0);
 	break;
 
+    case GENSIO_CONTROL_PRIORITY:
+	if (get) {
+	    *datalen = snprintf(data, *datalen, "%u", chan->priority);
+	} else {
+	    unsigned long priority = strtoul(data, NULL, 0);
+
+	    if (priority >= MUX_NR_PRIORITIES) {
+		err = GE_INVAL;
+		goto out;
+	    }
+	    muxc_set_priority(chan, priority);
+	}
+	break;
+
+    case GENSIO_CONTROL_WEIGHT:
+	if (get) {
+	    *datalen = snprintf(data, *datalen, "%u", chan->weight);
+	} else {
+	    unsigned long weight = strtoul(data, NULL, 0);
+
+	    if (weight < 1 || weight > MUX_MAX_WEIGHT) {
+		err = GE_INVAL;
+		goto out;
+	    }
+	    chan->weight = weight;
+	}
+	break;
+
     default:
 	err = GE_NOTSUP;
 	break;
@@ -1901,10 +2104,10 @@ mux_shutdown_channels(struct mux_data *muxdata, int err)
     gensio_list_for_each_safe(&muxdata->chans, l, l2) {
 	chan = gensio_container_of(l, struct mux_inst, link);
 	if (chan->in_wrlist) {
-	    gensio_list_rm(&muxdata->wrchans, &chan->wrlink);
+	    gensio_list_rm(&muxdata->wrchans[chan->priority], &chan->wrlink);
 	    chan->in_wrlist = false;
 	}
-	chan->wr_ready = false;
+	chan_wr_idle(chan);
 	if (chan->in_open_chan) {
 	    gensio_list_rm(&muxdata->openchans, &chan->wrlink);
 	    chan->in_open_chan = false;
@@ -2056,6 +2259,20 @@ mux_on_err_close(struct gensio *child, void *close_data)
     mux_deref_and_unlock(muxdata); /* Lose the open ref. */
 }
 
+static struct mux_inst *
+mux_next_wrchan(struct mux_data *muxdata)
+{
+    unsigned int i;
+
+    for (i = MUX_NR_PRIORITIES; i > 0; i--) {
+	if (!gensio_list_empty(&muxdata->wrchans[i - 1]))
+	    return gensio_container_of(
+				gensio_list_first(&muxdata->wrchans[i - 1]),
+				struct mux_inst, wrlink);
+    }
+    return NULL;
+}
+
 static int
 mux_child_write_ready(struct mux_data *muxdata)
 {
@@ -2096,17 +2313,29 @@ mux_child_write_ready(struct mux_data *muxdata)
 	    /* Finished sending one message. */
 	    chan->write_data_pos = chan_next_write_pos(chan, chan->cur_msg_len);
 	    chan->write_data_len -= chan->cur_msg_len;
+	    chan->deficit -= chan->cur_msg_len;
 	    chan->cur_msg_len = 0;
 	    chan->sgpos = 0;
 	    chan->sglen = 0;
 	    muxdata->sending_chan = NULL;
 	    if (chan->write_data_len > 0 || chan->send_new_channel ||
 			chan->send_close) {
-		/* More messages to send, add it to the tail for fairness. */
-		gensio_list_add_tail(&muxdata->wrchans, &chan->wrlink);
+		/*
+		 * More messages to send.  If the channel has some of
+		 * its turn left keep it at the head, otherwise the
+		 * next channel at its priority gets a turn.
+		 */
+		if (chan->deficit > 0) {
+		    gensio_list_add_head(&muxdata->wrchans[chan->priority],
+					 &chan->wrlink);
+		} else {
+		    chan->in_turn = false;
+		    gensio_list_add_tail(&muxdata->wrchans[chan->priority],
+					 &chan->wrlink);
+		}
 		chan->in_wrlist = true;
 	    } else {
-		chan->wr_ready = false;
+		chan_wr_idle(chan);
 	    }
 	    /*
 	     * Maybe the user can write.  Also, if a close is pending,
@@ -2139,13 +2368,32 @@ mux_child_write_ready(struct mux_data *muxdata)
 	}
     }
 
-    /* Now look for a new channel to send. */
+    /*
+     * Now look for a new channel to send.  The highest priority
+     * channels always go first.  Channels at the same priority are
+     * scheduled with deficit round robin: at the start of its turn a
+     * channel gets weight * MUX_DRR_QUANTUM more bytes it can send,
+     * and it keeps sending until that runs out or it has nothing more
+     * to send.  Messages are not split, so a channel may go over, in
+     * which case it is charged on its next turns.
+     */
  check_next_channel:
-    if (!gensio_list_empty(&muxdata->wrchans)) {
+    chan = mux_next_wrchan(muxdata);
+    if (chan) {
 	assert(muxdata->sending_chan == NULL);
-	chan = gensio_container_of(gensio_list_first(&muxdata->wrchans),
-				   struct mux_inst, wrlink);
-	gensio_list_rm(&muxdata->wrchans, &chan->wrlink);
+	if (!chan->in_turn) {
+	    chan->deficit += (long) chan->weight * MUX_DRR_QUANTUM;
+	    if (chan->deficit <= 0) {
+		/* Still paying for an earlier big message. */
+		gensio_list_rm(&muxdata->wrchans[chan->priority],
+			       &chan->wrlink);
+		gensio_list_add_tail(&muxdata->wrchans[chan->priority],
+				     &chan->wrlink);
+		goto check_next_channel;
+	    }
+	    chan->in_turn = true;
+	}
+	gensio_list_rm(&muxdata->wrchans[chan->priority], &chan->wrlink);
 	chan->in_wrlist = false;
 
 	if (chan->send_new_channel) {
@@ -2160,7 +2408,7 @@ mux_child_write_ready(struct mux_data *muxdata)
 	     * thus the check in the if statement above.
 	     */
 	    if (!chan_setup_send_data(chan)) {
-		chan->wr_ready = false;
+		chan_wr_idle(chan);
 		goto check_next_channel;
 	    }
 	    muxdata->sending_chan = chan;
@@ -2181,14 +2429,14 @@ mux_child_write_ready(struct mux_data *muxdata)
 	    chan->close_sent = true;
 	    muxdata->sending_chan = chan;
 	} else {
-	    chan->wr_ready = false;
+	    chan_wr_idle(chan);
 	    goto check_next_channel;
 	}
 	goto next_channel;
     }
  out:
     gensio_set_write_callback_enable(muxdata->child,
-		muxdata->sending_chan || !gensio_list_empty(&muxdata->wrchans));
+		muxdata->sending_chan || mux_next_wrchan(muxdata));
     mux_deref_and_unlock(muxdata);
     return 0;
 
@@ -2208,12 +2456,11 @@ mux_child_write_ready(struct mux_data *muxdata)
 static struct mux_inst *
 mux_get_channel(struct mux_data *muxdata)
 {
-    struct gensio_link *l;
     unsigned int id = gensio_buf_to_u16(muxdata->hdr + 2);
+    struct mux_inst *chan;
 
-    gensio_list_for_each(&muxdata->chans, l) {
-	struct mux_inst *chan = gensio_container_of(l, struct mux_inst, link);
-
+    chan = muxdata->id_hash[id & (muxdata->chan_hash_size - 1)];
+    for (; chan; chan = chan->id_next) {
 	if (chan->id == id)
 	    return chan;
     }
@@ -2223,11 +2470,10 @@ mux_get_channel(struct mux_data *muxdata)
 static bool
 mux_find_remote_id(struct mux_data *muxdata, unsigned int id)
 {
-    struct gensio_link *l;
-
-    gensio_list_for_each(&muxdata->chans, l) {
-	struct mux_inst *chan = gensio_container_of(l, struct mux_inst, link);
+    struct mux_inst *chan;
 
+    chan = muxdata->rid_hash[id & (muxdata->chan_hash_size - 1)];
+    for (; chan; chan = chan->rid_next) {
 	if (chan->remote_id == id &&
 		chan->state != MUX_INST_PENDING_OPEN &&
 		chan->state != MUX_INST_IN_OPEN &&
@@ -2356,7 +2602,7 @@ mux_child_read(struct mux_data *muxdata, int ierr,
 			else
 			    goto protocol_err_close_chan;
 		    }
-		    chan->remote_id = remote_id;
+		    mux_chan_set_remote_id(chan, remote_id);
 		    muxdata->data_pos = 0;
 		    muxdata->in_hdr = false; /* Receive the service data */
 		}
@@ -2381,7 +2627,8 @@ mux_child_read(struct mux_data *muxdata, int ierr,
 		    proto_err_str = "New channel response in bad state";
 		    goto protocol_err;
 		}
-		chan->remote_id = gensio_buf_to_u16(muxdata->hdr + 8);
+		mux_chan_set_remote_id(chan,
+				       gensio_buf_to_u16(muxdata->hdr + 8));
 		chan->send_window_size = gensio_buf_to_u32(muxdata->hdr + 4);
 		if (chan->send_window_size <= MUX_MIN_SEND_WINDOW_SIZE) {
 		    proto_err_str = "Invalid send window size";
@@ -2741,6 +2988,7 @@ mux_gensio_alloc_data(struct gensio *child, struct gensio_mux_config *data,
 {
     struct gensio_os_funcs *o = data->o;
     struct mux_data *muxdata;
+    unsigned int i;
     int rv;
 
     if (data->max_write_size < MUX_MIN_SEND_WINDOW_SIZE ||
@@ -2762,7 +3010,17 @@ mux_gensio_alloc_data(struct gensio *child, struct gensio_mux_config *data,
     muxdata->max_channels = data->max_channels;
     gensio_list_init(&muxdata->chans);
     gensio_list_init(&muxdata->openchans);
-    gensio_list_init(&muxdata->wrchans);
+    for (i = 0; i < MUX_NR_PRIORITIES; i++)
+	gensio_list_init(&muxdata->wrchans[i]);
+    muxdata->chan_hash_size = MUX_CHAN_HASH_INIT_SIZE;
+    muxdata->id_hash = o->zalloc(o, muxdata->chan_hash_size *
+				 sizeof(*muxdata->id_hash));
+    if (!muxdata->id_hash)
+	goto out_nomem;
+    muxdata->rid_hash = o->zalloc(o, muxdata->chan_hash_size *
+				  sizeof(*muxdata->rid_hash));
+    if (!muxdata->rid_hash)
+	goto out_nomem;
     muxdata->lock = o->alloc_lock(o);
     if (!muxdata->lock)
 	goto out_nomem;
@@ -2786,6 +3044,10 @@ mux_gensio_alloc_data(struct gensio *child, struct gensio_mux_config *data,
 	chan_deref(gensio_container_of(
 				gensio_list_first(&muxdata->chans),
 				struct mux_inst, link));
+    if (muxdata->id_hash)
+	o->free(o, muxdata->id_hash);
+    if (muxdata->rid_hash)
+	o->free(o, muxdata->rid_hash);
     if (muxdata->lock)
 	o->free_lock(muxdata->lock);
     o->free(o, muxdata);
@@ -2813,6 +3075,7 @@ mux_gensio_alloc(struct gensio *child, const char *const args[],
     data.max_read_size = GENSIO_DEFAULT_BUF_SIZE * 16;
     data.max_write_size = GENSIO_DEFAULT_BUF_SIZE * 2;
     data.max_channels = 1000;
+    data.weight = 1;
     err = gensio_get_default(o, "mux", "max-channels", false,
 			     GENSIO_DEFAULT_INT, NULL, &ival);
     if (err)
@@ -2960,6 +3223,7 @@ mux_gensio_accepter_alloc(struct gensio_accepter *child,
     nadata->data.max_read_size = GENSIO_DEFAULT_BUF_SIZE;
     nadata->data.max_write_size = GENSIO_DEFAULT_BUF_SIZE;
     nadata->data.max_channels = 1000;
+    nadata->data.weight = 1;
     err = gensio_get_default(o, "mux", "max-channels", false,
 			     GENSIO_DEFAULT_INT, NULL, &ival);
     if (err) {
@@ -101,6 +101,20 @@ struct net_data {
     struct gensio_addr *ai; /* Iterater points to the remote. */
     struct gensio_addr *lai; /* Local address, NULL if not set. */
 
+    /* Looks the remote up again on reopens, NULL if not from a string. */
+    struct gensio_netaddr_refresh *refresh;
+
+    /*
+     * With async-lookup, ai is NULL until the first open looks
+     * lookup_str up.  The lookup result is held here until sub_open
+     * takes it.
+     */
+    struct gensio_lock *lock;
+    char *lookup_str;
+    bool lookup_pending;
+    int lookup_err;
+    struct gensio_addr *lookup_addr;
+
     bool nodelay;
     bool reuseaddr;
 
@@ -191,12 +205,78 @@ net_retry_open(void *handler_data, struct gensio_iod **iod,
     return net_try_open(tdata, iod, timeout);
 }
 
+static void
+net_lookup_done(struct gensio_os_funcs *o, int err, struct gensio_addr *addr,
+		void *cb_data)
+{
+    struct net_data *tdata = cb_data;
+
+    o->lock(tdata->lock);
+    tdata->lookup_pending = false;
+    tdata->lookup_err = err;
+    tdata->lookup_addr = addr;
+    o->unlock(tdata->lock);
+    gensio_fd_ll_sub_open_ready(tdata->ll);
+}
+
+/*
+ * Get the address for the first open with async-lookup.  Returns
+ * GE_INPROGRESS without an iod while the lookup runs, ll_fd calls
+ * net_sub_open() again when it is done.
+ */
+static int
+net_lookup_addr(struct net_data *tdata)
+{
+    struct gensio_os_funcs *o = tdata->o;
+    struct gensio_addr *addr;
+    int err;
+
+    o->lock(tdata->lock);
+    if (tdata->lookup_pending) {
+	/* Closed and opened again while the lookup was running. */
+	o->unlock(tdata->lock);
+	return GE_INPROGRESS;
+    }
+    err = tdata->lookup_err;
+    addr = tdata->lookup_addr;
+    if (!err && !addr) {
+	err = gensio_scan_netaddr_async(o, tdata->lookup_str, false,
+					tdata->protocol, net_lookup_done,
+					tdata, NULL);
+	if (!err) {
+	    tdata->lookup_pending = true;
+	    o->unlock(tdata->lock);
+	    return GE_INPROGRESS;
+	}
+    }
+    /* On failure the next open looks it up again. */
+    tdata->lookup_err = 0;
+    tdata->lookup_addr = NULL;
+    o->unlock(tdata->lock);
+    if (!err)
+	tdata->ai = addr;
+    return err;
+}
+
 static int
 net_sub_open(void *handler_data, struct gensio_iod **iod,
 	     gensio_time *timeout)
 {
     struct net_data *tdata = handler_data;
+    struct gensio_addr *addr;
+    int err;
 
+    if (!tdata->ai) {
+	err = net_lookup_addr(tdata);
+	if (err)
+	    return err;
+    } else if (tdata->refresh) {
+	addr = gensio_netaddr_refresh_check(tdata->refresh);
+	if (addr) {
+	    gensio_addr_free(tdata->ai);
+	    tdata->ai = addr;
+	}
+    }
     gensio_addr_rewind(tdata->ai);
     return net_try_open(tdata, iod, timeout);
 }
@@ -210,6 +290,14 @@ net_free(void *handler_data)
 	gensio_addr_free(tdata->ai);
     if (tdata->lai)
 	gensio_addr_free(tdata->lai);
+    if (tdata->refresh)
+	gensio_netaddr_refresh_free(tdata->refresh);
+    if (tdata->lookup_addr)
+	gensio_addr_free(tdata->lookup_addr);
+    if (tdata->lookup_str)
+	tdata->o->free(tdata->o, tdata->lookup_str);
+    if (tdata->lock)
+	tdata->o->free_lock(tdata->lock);
     tdata->o->free(tdata->o, tdata);
 }
 
@@ -280,6 +368,8 @@ net_control(void *handler_data, struct gensio_iod *iod, bool get,
 	if (strtoul(data, NULL, 0) > 0)
 	    return GE_NOTFOUND;
 
+	if (!tdata->ai)
+	    return GE_NOTREADY;
 	pos = 0;
 	rv = gensio_addr_to_str(tdata->ai, data, &pos, *datalen);
 	if (rv)
@@ -291,6 +381,8 @@ net_control(void *handler_data, struct gensio_iod *iod, bool get,
     case GENSIO_CONTROL_RADDR_BIN:
 	if (!get)
 	    return GE_NOTSUP;
+	if (!tdata->ai)
+	    return GE_NOTREADY;
 	gensio_addr_getaddr(tdata->ai, data, datalen);
 	return 0;
 
@@ -427,17 +519,18 @@ static const struct gensio_fd_ll_ops net_fd_ll_ops = {
 static int
 net_gensio_alloc(const struct gensio_addr *iai, const char * const args[],
 		 struct gensio_os_funcs *o, gensio_event cb, void *user_data,
-		 int protocol, const char *typestr,
+		 int protocol, const char *typestr, const char *str,
 		 struct gensio_base_parms **rparms, struct gensio **new_gensio)
 {
     struct net_data *tdata = NULL;
     struct gensio_addr *laddr = NULL, *laddr2 = NULL, *addr = NULL;
+    struct gensio_netaddr_refresh *refresh = NULL;
     struct gensio *io;
-    gensiods max_read_size = GENSIO_DEFAULT_BUF_SIZE;
+    gensiods max_read_size, readbuf_max, read_batch;
     unsigned int i;
     int ival, err;
     bool istcp = protocol == GENSIO_NET_PROTOCOL_TCP;
-    bool nodelay = false, reuseaddr = istcp;
+    bool nodelay = false, reuseaddr = istcp, async_lookup = false;
     struct gensio_base_parms *parms;
     GENSIO_DECLARE_PPGENSIO(p, o, cb, typestr, user_data);
 
@@ -455,6 +548,24 @@ net_gensio_alloc(const struct gensio_addr *iai, const char * const args[],
 	goto out_err;
     nodelay = ival;
 
+    err = gensio_get_default(o, typestr, "readbuf", false,
+			     GENSIO_DEFAULT_INT, NULL, &ival);
+    if (err)
+	goto out_err;
+    max_read_size = ival;
+
+    err = gensio_get_default(o, typestr, "readbuf-max", false,
+			     GENSIO_DEFAULT_INT, NULL, &ival);
+    if (err)
+	goto out_err;
+    readbuf_max = ival;
+
+    err = gensio_get_default(o, typestr, "readbatch", false,
+			     GENSIO_DEFAULT_INT, NULL, &ival);
+    if (err)
+	goto out_err;
+    read_batch = ival;
+
     if (istcp) {
 	err = gensio_get_default(o, typestr, "reuseaddr", false,
 				 GENSIO_DEFAULT_BOOL, NULL, &ival);
@@ -480,6 +591,10 @@ net_gensio_alloc(const struct gensio_addr *iai, const char * const args[],
     for (i = 0; args && args[i]; i++) {
 	if (gensio_pparm_ds(&p, args[i], "readbuf", &max_read_size) > 0)
 	    continue;
+	if (gensio_pparm_ds(&p, args[i], "readbuf-max", &readbuf_max) > 0)
+	    continue;
+	if (gensio_pparm_ds(&p, args[i], "readbatch", &read_batch) > 0)
+	    continue;
 	if (istcp && gensio_pparm_addrs(&p, args[i], "laddr",
 					GENSIO_NET_PROTOCOL_TCP,
 					true, false, &laddr2) > 0) {
@@ -493,6 +608,10 @@ net_gensio_alloc(const struct gensio_addr *iai, const char * const args[],
 	if (istcp && gensio_pparm_bool(&p, args[i], "reuseaddr",
 				       &reuseaddr) > 0)
 	    continue;
+	/* str_to_net_gensio() handles this, it is just accepted here. */
+	if (istcp && gensio_pparm_bool(&p, args[i], "async-lookup",
+				       &async_lookup) > 0)
+	    continue;
 
 	if (laddr)
 	    gensio_addr_free(laddr);
@@ -509,15 +628,31 @@ net_gensio_alloc(const struct gensio_addr *iai, const char * const args[],
     if (!tdata)
 	goto out_nomem;
 
+    tdata->o = o;
     tdata->protocol = protocol;
     tdata->typestr = typestr;
     tdata->oob_char = -1;
 
-    addr = gensio_addr_dup(iai);
-    if (!addr)
-	goto out_nomem;
+    if (iai) {
+	addr = gensio_addr_dup(iai);
+	if (!addr)
+	    goto out_nomem;
+    } else {
+	/* str_to_net_gensio() left the lookup to the first open. */
+	tdata->lookup_str = gensio_strdup(o, str);
+	if (!tdata->lookup_str)
+	    goto out_nomem;
+	tdata->lock = o->alloc_lock(o);
+	if (!tdata->lock)
+	    goto out_nomem;
+    }
+
+    if (str) {
+	err = gensio_netaddr_refresh_alloc(o, str, false, protocol, &refresh);
+	if (err)
+	    goto out_err2;
+    }
 
-    tdata->o = o;
     tdata->nodelay = nodelay;
     tdata->reuseaddr = reuseaddr;
 
@@ -525,6 +660,8 @@ net_gensio_alloc(const struct gensio_addr *iai, const char * const args[],
 				   max_read_size, false, false);
     if (!tdata->ll)
 	goto out_nomem;
+    gensio_fd_ll_set_readbuf_max(tdata->ll, readbuf_max);
+    gensio_fd_ll_set_read_batch(tdata->ll, read_batch);
 
     io = base_gensio_alloc(o, tdata->ll, NULL, NULL, typestr, cb, user_data);
     if (!io)
@@ -539,6 +676,7 @@ net_gensio_alloc(const struct gensio_addr *iai, const char * const args[],
     /* Assign these last so gensio_ll_free() won't free it on err. */
     tdata->ai = addr;
     tdata->lai = laddr;
+    tdata->refresh = refresh;
 
     gensio_set_is_reliable(io, true);
     if (protocol == GENSIO_NET_PROTOCOL_UNIX_SEQPACKET)
@@ -554,12 +692,14 @@ net_gensio_alloc(const struct gensio_addr *iai, const char * const args[],
 	gensio_addr_free(laddr);
     if (addr)
 	gensio_addr_free(addr);
+    if (refresh)
+	gensio_netaddr_refresh_free(refresh);
     if (tdata) {
 	if (tdata->ll)
 	    gensio_ll_free(tdata->ll);
 	else
 	    /* gensio_ll_free() frees it otherwise. */
-	    o->free(o, tdata);
+	    net_free(tdata);
     }
  out_err:
     if (rparms)
@@ -577,9 +717,25 @@ str_to_net_gensio(const char *str, const char * const args[],
 		  struct gensio **new_gensio)
 {
     struct gensio_addr *addr;
-    int err;
+    unsigned int i;
+    int ival, err;
+    bool async_lookup = false;
 
-    err = gensio_os_scan_netaddr(o, str, false, protocol, &addr);
+    if (protocol == GENSIO_NET_PROTOCOL_TCP) {
+	err = gensio_get_default(o, typestr, "async-lookup", false,
+				 GENSIO_DEFAULT_BOOL, NULL, &ival);
+	if (err)
+	    return err;
+	async_lookup = ival;
+	for (i = 0; args && args[i]; i++)
+	    gensio_check_keybool(args[i], "async-lookup", &async_lookup);
+    }
+    if (async_lookup)
+	/* The first open looks it up, net_gensio_alloc() checks the args. */
+	return net_gensio_alloc(NULL, args, o, cb, user_data, protocol,
+				typestr, str, NULL, new_gensio);
+
+    err = gensio_scan_netaddr_cached(o, str, false, protocol, &addr);
     if (err) {
 	GENSIO_DECLARE_PPGENSIO(p, o, cb, typestr, user_data);
 
@@ -587,8 +743,10 @@ str_to_net_gensio(const char *str, const char * const args[],
 	return err;
     }
 
-    err = net_gensio_alloc(addr, args, o, cb, user_data, protocol,
-			   typestr, NULL, new_gensio);
+    /* Only TCP names need to be looked up again. */
+    err = net_gensio_alloc(addr, args, o, cb, user_data, protocol, typestr,
+			   protocol == GENSIO_NET_PROTOCOL_TCP ? str : NULL,
+			   NULL, new_gensio);
     gensio_addr_free(addr);
 
     return err;
@@ -603,7 +761,8 @@ tcp_gensio_alloc(const void *gdata, const char * const args[],
     const struct gensio_addr *iai = gdata;
 
     return net_gensio_alloc(iai, args, o, cb, user_data,
-			    GENSIO_NET_PROTOCOL_TCP, "tcp", NULL, new_gensio);
+			    GENSIO_NET_PROTOCOL_TCP, "tcp", NULL, NULL,
+			    new_gensio);
 }
 
 static int
@@ -626,7 +785,8 @@ unix_gensio_alloc(const void *gdata, const char * const args[],
     const struct gensio_addr *iai = gdata;
 
     return net_gensio_alloc(iai, args, o, cb, user_data,
-			    GENSIO_NET_PROTOCOL_UNIX, "unix", NULL, new_gensio);
+			    GENSIO_NET_PROTOCOL_UNIX, "unix", NULL, NULL,
+			    new_gensio);
 #else
     return GE_NOTSUP;
 #endif
@@ -643,7 +803,7 @@ unixseq_gensio_alloc(const void *gdata, const char * const args[],
 
     return net_gensio_alloc(iai, args, o, cb, user_data,
 			    GENSIO_NET_PROTOCOL_UNIX_SEQPACKET, "unixseq",
-			    NULL, new_gensio);
+			    NULL, NULL, new_gensio);
 #else
     return GE_NOTSUP;
 #endif
@@ -683,8 +843,13 @@ struct netna_data {
     struct gensio_runner *cb_en_done_runner;
 
     gensiods max_read_size;
+    gensiods readbuf_max;
+    gensiods read_batch;
     bool nodelay;
 
+    /* Open a listen socket on each shard of the os handler. */
+    bool shard;
+
     gensio_acc_done shutdown_done;
     gensio_acc_done cb_en_done;
 
@@ -735,7 +900,8 @@ netna_fd_cleared(struct gensio_iod *iod, void *cbdata)
 	    break;
     }
     assert(i < nadata->nr_acceptfds);
-    nadata->o->close(&nadata->acceptfds[i].iod);
+    /* May be on a different shard than nadata->o. */
+    iod->f->close(&nadata->acceptfds[i].iod);
 
     nadata->o->lock(nadata->lock);
     assert(nadata->nr_accept_close_waiting > 0);
@@ -807,6 +973,11 @@ static void
 netna_readhandler(struct gensio_iod *iod, void *cbdata)
 {
     struct netna_data *nadata = cbdata;
+    /*
+     * Use the os handler the listen socket is on, so the new
+     * connection stays on the same shard if sharding is enabled.
+     */
+    struct gensio_os_funcs *o = iod->f;
     struct gensio_iod *new_iod = NULL;
     struct gensio_addr *raddr;
     struct net_data *tdata = NULL;
@@ -820,7 +991,7 @@ netna_readhandler(struct gensio_iod *iod, void *cbdata)
 		 GENSIO_SET_OPENSOCK_KEEPALIVE |
 		 GENSIO_SET_OPENSOCK_NODELAY);
     }
-    err = nadata->o->accept(iod, &raddr, &new_iod);
+    err = o->accept(iod, &raddr, &new_iod);
     if (err) {
 	if (err != GE_NODATA)
 	    /* FIXME - maybe shut down the socket I/O? */
@@ -833,7 +1004,7 @@ netna_readhandler(struct gensio_iod *iod, void *cbdata)
     err = base_gensio_accepter_new_child_start(nadata->acc);
     if (err) {
 	gensio_addr_free(raddr);
-	nadata->o->close(&new_iod);
+	o->close(&new_iod);
 	return;
     }
 
@@ -846,7 +1017,7 @@ netna_readhandler(struct gensio_iod *iod, void *cbdata)
 	if (msg) {
 	    if (nadata->tcpd == GENSIO_TCPD_PRINT) {
 		struct gensio_sg sg[1] = { { msg, strlen(msg) } };
-		nadata->o->send(new_iod, sg, 1, NULL, 0);
+		o->send(new_iod, sg, 1, NULL, 0);
 	    }
 	    gensio_acc_log(nadata->acc, GENSIO_LOG_INFO,
 			   "Error accepting net gensio: tcpd check failed");
@@ -858,10 +1029,10 @@ netna_readhandler(struct gensio_iod *iod, void *cbdata)
 #if HAVE_UCRED
     if (nadata->protocol != GENSIO_NET_PROTOCOL_TCP &&
 		(nadata->permusers || nadata->permgrps)) {
-	int fd = nadata->o->iod_get_fd(new_iod);
+	int fd = o->iod_get_fd(new_iod);
 	struct ucred cred;
 
-	err = netna_get_ucred(nadata->o, fd, &cred);
+	err = netna_get_ucred(o, fd, &cred);
 	if (err) {
 	    gensio_acc_log(nadata->acc, GENSIO_LOG_INFO,
 			   "Error getting peer credentials: %s",
@@ -878,7 +1049,7 @@ netna_readhandler(struct gensio_iod *iod, void *cbdata)
     }
 #endif
 
-    tdata = nadata->o->zalloc(nadata->o, sizeof(*tdata));
+    tdata = o->zalloc(o, sizeof(*tdata));
     if (!tdata) {
 	gensio_acc_log(nadata->acc, GENSIO_LOG_INFO,
 		       "Error accepting net gensio: out of memory");
@@ -886,7 +1057,7 @@ netna_readhandler(struct gensio_iod *iod, void *cbdata)
 	goto out_err;
     }
 
-    tdata->o = nadata->o;
+    tdata->o = o;
     tdata->oob_char = -1;
     tdata->ai = raddr;
     tdata->protocol = nadata->protocol;
@@ -904,7 +1075,7 @@ netna_readhandler(struct gensio_iod *iod, void *cbdata)
 	goto out_err;
     }
 
-    tdata->ll = fd_gensio_ll_alloc(nadata->o, new_iod, &net_server_fd_ll_ops,
+    tdata->ll = fd_gensio_ll_alloc(o, new_iod, &net_server_fd_ll_ops,
 				   tdata, nadata->max_read_size, false, false);
     if (!tdata->ll) {
 	gensio_acc_log(nadata->acc, GENSIO_LOG_ERR,
@@ -912,8 +1083,10 @@ netna_readhandler(struct gensio_iod *iod, void *cbdata)
 	err = GE_NOMEM;
 	goto out_err;
     }
+    gensio_fd_ll_set_readbuf_max(tdata->ll, nadata->readbuf_max);
+    gensio_fd_ll_set_read_batch(tdata->ll, nadata->read_batch);
 
-    io = base_gensio_server_alloc(nadata->o, tdata->ll, NULL, NULL,
+    io = base_gensio_server_alloc(o, tdata->ll, NULL, NULL,
 				  nadata->typestr,
 				  netna_finish_server_open, nadata);
     if (!io) {
@@ -954,7 +1127,7 @@ netna_readhandler(struct gensio_iod *iod, void *cbdata)
     if (raddr)
 	gensio_addr_free(raddr);
     if (new_iod)
-	nadata->o->close(&new_iod);
+	o->close(&new_iod);
 }
 
 #if HAVE_UNIX || defined(_WIN32)
@@ -1076,12 +1249,99 @@ netna_b4_listen(struct gensio_iod *iod, void *data)
 #endif
 }
 
+static void
+netna_close_fds(struct gensio_opensocks *fds, unsigned int nr_fds)
+{
+    unsigned int i;
+
+    for (i = 0; i < nr_fds; i++) {
+	struct gensio_os_funcs *o = fds[i].iod->f;
+
+	o->clear_fd_handlers_norpt(fds[i].iod);
+	o->close(&fds[i].iod);
+    }
+}
+
+/*
+ * Open a set of SO_REUSEPORT listen sockets on each shard of the os
+ * handler, so each shard accepts its own connections.  Returns
+ * GE_NOTSUP if the os handler is not sharded.
+ */
 static int
-netna_startup(struct gensio_accepter *accepter, struct netna_data *nadata)
+netna_startup_shards(struct netna_data *nadata)
 {
+    struct gensio_os_funcs *o = nadata->o, **shards = NULL;
+    struct gensio_opensocks *allfds = NULL, *fds;
+    unsigned int nr_allfds = 0, nr_fds, i;
+    gensiods nshards = 0;
     int rv;
 
-    rv = gensio_os_open_listen_sockets(nadata->o, nadata->ai,
+    rv = o->control(o, GENSIO_CONTROL_GET_SHARDS, NULL, &nshards);
+    if (rv)
+	return rv;
+
+    shards = o->zalloc(o, nshards * sizeof(*shards));
+    if (!shards)
+	return GE_NOMEM;
+    rv = o->control(o, GENSIO_CONTROL_GET_SHARDS, shards, &nshards);
+    if (rv)
+	goto out;
+
+    for (i = 0; i < nshards; i++) {
+	struct gensio_opensocks *newfds;
+
+	rv = gensio_os_open_listen_sockets(shards[i], nadata->ai,
+			       netna_readhandler,
+			       NULL, netna_fd_cleared, netna_b4_listen, nadata,
+			       (nadata->opensock_flags |
+				GENSIO_OPENSOCK_REUSEPORT),
+			       &fds, &nr_fds);
+	if (rv)
+	    goto out;
+
+	newfds = o->zalloc(o, (nr_allfds + nr_fds) * sizeof(*newfds));
+	if (!newfds) {
+	    netna_close_fds(fds, nr_fds);
+	    shards[i]->free(shards[i], fds);
+	    rv = GE_NOMEM;
+	    goto out;
+	}
+	if (allfds) {
+	    memcpy(newfds, allfds, nr_allfds * sizeof(*newfds));
+	    o->free(o, allfds);
+	}
+	memcpy(newfds + nr_allfds, fds, nr_fds * sizeof(*newfds));
+	shards[i]->free(shards[i], fds);
+	allfds = newfds;
+	nr_allfds += nr_fds;
+    }
+
+    nadata->acceptfds = allfds;
+    nadata->nr_acceptfds = nr_allfds;
+    allfds = NULL;
+
+ out:
+    if (allfds) {
+	netna_close_fds(allfds, nr_allfds);
+	o->free(o, allfds);
+    }
+    o->free(o, shards);
+    return rv;
+}
+
+static int
+netna_startup(struct gensio_accepter *accepter, struct netna_data *nadata)
+{
+    int rv = GE_NOTSUP;
+
+    /*
+     * Sharding requires a fixed port, otherwise each shard would get
+     * a different one.
+     */
+    if (nadata->shard && gensio_addr_get_port(nadata->ai) > 0)
+	rv = netna_startup_shards(nadata);
+    if (rv == GE_NOTSUP)
+	rv = gensio_os_open_listen_sockets(nadata->o, nadata->ai,
 			       netna_readhandler,
 			       NULL, netna_fd_cleared, netna_b4_listen, nadata,
 			       nadata->opensock_flags,
@@ -1174,10 +1434,12 @@ netna_str_to_gensio(struct gensio_accepter *accepter,
 		    gensio_event cb, void *user_data, struct gensio **new_io)
 {
     int err;
-    const char *args[5] = { NULL, NULL, NULL, NULL, NULL };
-    char buf[100];
+    const char *args[6] = { NULL, NULL, NULL, NULL, NULL, NULL };
+    char buf[100], buf2[100], buf3[100];
     unsigned int i;
     gensiods max_read_size = nadata->max_read_size;
+    gensiods readbuf_max = nadata->readbuf_max;
+    gensiods read_batch = nadata->read_batch;
     const char **iargs = NULL;
     struct gensio_addr *ai = NULL;
     const char *laddr = NULL, *dummy;
@@ -1208,6 +1470,10 @@ netna_str_to_gensio(struct gensio_accepter *accepter,
     for (i = 0; iargs && iargs[i]; i++) {
 	if (gensio_pparm_ds(&p, iargs[i], "readbuf", &max_read_size) > 0)
 	    continue;
+	if (gensio_pparm_ds(&p, iargs[i], "readbuf-max", &readbuf_max) > 0)
+	    continue;
+	if (gensio_pparm_ds(&p, iargs[i], "readbatch", &read_batch) > 0)
+	    continue;
 	if (nadata->protocol == GENSIO_NET_PROTOCOL_TCP &&
 		gensio_pparm_value(&p, iargs[i], "laddr", &dummy) > 0) {
 	    laddr = iargs[i];
@@ -1229,6 +1495,15 @@ netna_str_to_gensio(struct gensio_accepter *accepter,
 	args[i++] = buf;
     }
 
+    if (readbuf_max) {
+	snprintf(buf2, sizeof(buf2), "readbuf-max=%lu",
+		 (unsigned long) readbuf_max);
+	args[i++] = buf2;
+    }
+
+    snprintf(buf3, sizeof(buf3), "readbatch=%lu", (unsigned long) read_batch);
+    args[i++] = buf3;
+
     if (laddr)
 	args[i++] = laddr;
 
@@ -1236,7 +1511,8 @@ netna_str_to_gensio(struct gensio_accepter *accepter,
 	args[i++] = "nodelay";
 
     err = net_gensio_alloc(ai, args, nadata->o, cb, user_data,
-			   nadata->protocol, nadata->typestr, &parms, new_io);
+			   nadata->protocol, nadata->typestr, NULL, &parms,
+			   new_io);
 
  out_err:
     if (iargs)
@@ -1409,9 +1685,10 @@ net_gensio_accepter_alloc(const struct gensio_addr *iai,
 			  struct gensio_accepter **accepter)
 {
     struct netna_data *nadata;
-    gensiods max_read_size = GENSIO_DEFAULT_BUF_SIZE;
+    gensiods max_read_size, readbuf_max, read_batch;
     bool nodelay = false;
     bool reuseaddr = protocol == GENSIO_NET_PROTOCOL_TCP;
+    bool reuseport = false, shard = false;
 #if HAVE_UNIX
     unsigned int umode = 6, gmode = 6, omode = 6, mode;
     bool mode_set = false;
@@ -1449,6 +1726,24 @@ net_gensio_accepter_alloc(const struct gensio_addr *iai,
     }
     reuseaddr = ival;
 
+    err = gensio_get_default(o, typestr, "readbuf", false,
+			     GENSIO_DEFAULT_INT, NULL, &ival);
+    if (err)
+	goto out_err2;
+    max_read_size = ival;
+
+    err = gensio_get_default(o, typestr, "readbuf-max", false,
+			     GENSIO_DEFAULT_INT, NULL, &ival);
+    if (err)
+	goto out_err2;
+    readbuf_max = ival;
+
+    err = gensio_get_default(o, typestr, "readbatch", false,
+			     GENSIO_DEFAULT_INT, NULL, &ival);
+    if (err)
+	goto out_err2;
+    read_batch = ival;
+
 #ifdef HAVE_TCPD_H
     err = gensio_get_default(o, typestr, "tcpd", false,
 			     GENSIO_DEFAULT_INT, NULL, &ival);
@@ -1460,6 +1755,10 @@ net_gensio_accepter_alloc(const struct gensio_addr *iai,
     for (i = 0; args && args[i]; i++) {
 	if (gensio_pparm_ds(&p, args[i], "readbuf", &max_read_size) > 0)
 	    continue;
+	if (gensio_pparm_ds(&p, args[i], "readbuf-max", &readbuf_max) > 0)
+	    continue;
+	if (gensio_pparm_ds(&p, args[i], "readbatch", &read_batch) > 0)
+	    continue;
 	if (istcp && gensio_pparm_bool(&p, args[i], "nodelay", &nodelay) > 0)
 	    continue;
 	if (!istcp &&
@@ -1468,6 +1767,11 @@ net_gensio_accepter_alloc(const struct gensio_addr *iai,
 	if (istcp &&
 		gensio_pparm_bool(&p, args[i], "reuseaddr", &reuseaddr) > 0)
 	    continue;
+	if (istcp &&
+		gensio_pparm_bool(&p, args[i], "reuseport", &reuseport) > 0)
+	    continue;
+	if (istcp && gensio_pparm_bool(&p, args[i], "shard", &shard) > 0)
+	    continue;
 #ifdef HAVE_TCPD_H
 	if (istcp && gensio_pparm_value(&p, args[i], "tcpdname", &tcpdname))
 	    continue;
@@ -1529,6 +1833,9 @@ net_gensio_accepter_alloc(const struct gensio_addr *iai,
     err = GE_NOMEM;
     if (reuseaddr)
 	nadata->opensock_flags |= GENSIO_OPENSOCK_REUSEADDR;
+    if (reuseport)
+	nadata->opensock_flags |= GENSIO_OPENSOCK_REUSEPORT;
+    nadata->shard = shard;
 #if HAVE_UNIX
 #if HAVE_UCRED
     nadata->permusers = permusers;
@@ -1589,6 +1896,8 @@ net_gensio_accepter_alloc(const struct gensio_addr *iai,
     if (protocol == GENSIO_NET_PROTOCOL_UNIX_SEQPACKET)
 	gensio_acc_set_is_packet(nadata->acc, true);
     nadata->max_read_size = max_read_size;
+    nadata->readbuf_max = readbuf_max;
+    nadata->read_batch = read_batch;
     nadata->nodelay = nodelay;
 
     return 0;
@@ -635,7 +635,7 @@ pty_gensio_alloc(const void *gdata, const char * const args[],
     const char * const *argv = gdata;
     struct pty_data *tdata = NULL;
     struct gensio *io;
-    gensiods max_read_size = GENSIO_DEFAULT_BUF_SIZE;
+    gensiods max_read_size, readbuf_max, read_batch;
     unsigned int i;
 #if HAVE_PTSNAME_R
     unsigned int umode = 6, gmode = 6, omode = 6, mode;
@@ -648,12 +648,32 @@ pty_gensio_alloc(const void *gdata, const char * const args[],
 #endif
     const char *start_dir = NULL;
     bool raw = false;
-    int err;
+    int err, ival;
     GENSIO_DECLARE_PPGENSIO(p, o, cb, "pty", user_data);
 
+    err = gensio_get_default(o, "pty", "readbuf", false,
+			     GENSIO_DEFAULT_INT, NULL, &ival);
+    if (err)
+	return err;
+    max_read_size = ival;
+    err = gensio_get_default(o, "pty", "readbuf-max", false,
+			     GENSIO_DEFAULT_INT, NULL, &ival);
+    if (err)
+	return err;
+    readbuf_max = ival;
+    err = gensio_get_default(o, "pty", "readbatch", false,
+			     GENSIO_DEFAULT_INT, NULL, &ival);
+    if (err)
+	return err;
+    read_batch = ival;
+
     for (i = 0; args && args[i]; i++) {
 	if (gensio_pparm_ds(&p, args[i], "readbuf", &max_read_size) > 0)
 	    continue;
+	if (gensio_pparm_ds(&p, args[i], "readbuf-max", &readbuf_max) > 0)
+	    continue;
+	if (gensio_pparm_ds(&p, args[i], "readbatch", &read_batch) > 0)
+	    continue;
 	if (gensio_pparm_value(&p, args[i], "start-dir", &start_dir) > 0)
 	    continue;
 #if HAVE_PTSNAME_R
@@ -782,6 +802,8 @@ pty_gensio_alloc(const void *gdata, const char * const args[],
 				   max_read_size, false, false);
     if (!tdata->ll)
 	goto out_nomem;
+    gensio_fd_ll_set_readbuf_max(tdata->ll, readbuf_max);
+    gensio_fd_ll_set_read_batch(tdata->ll, read_batch);
 
     io = base_gensio_alloc(o, tdata->ll, NULL, NULL, "pty", cb, user_data);
     if (!io)
@@ -544,6 +544,9 @@ ratelimit_gensio_accepter_alloc(struct gensio_accepter *child,
 				       &nadata->acc);
     if (err)
 	goto out_err;
+    gensio_acc_set_is_reliable(nadata->acc, gensio_acc_is_reliable(child));
+    gensio_acc_set_is_packet(nadata->acc, gensio_acc_is_packet(child));
+    gensio_acc_set_is_message(nadata->acc, gensio_acc_is_message(child));
     *accepter = nadata->acc;
 
     err = gensio_acc_base_parms_set(nadata->acc, &parms);
@@ -11,6 +11,7 @@
 
 #include <gensio/gensio.h>
 #include <gensio/gensio_os_funcs.h>
+#include <gensio/gensio_time.h>
 #include <gensio/gensio_class.h>
 #include <gensio/gensio_ll_gensio.h>
 #include <gensio/gensio_acc_gensio.h>
@@ -27,6 +28,58 @@ unsigned int curr_drop;
 #endif
 #include "utils.h"
 
+/*
+ * Protocol versions.  Version 0 uses 8-bit sequence numbers and a
+ * fixed retransmit timeout.  Version 1 (extended) uses 16-bit
+ * sequence numbers, so the window can be much larger, and adds an
+ * adaptive retransmit timeout and a congestion window on the sender.
+ * The sequence number fields in the messages below are 2 bytes (msb
+ * first) in version 1.
+ *
+ * The client sends the highest version it supports in its init, the
+ * server responds with the lower of that and its own, and both use
+ * that.  An old implementation ignores the version and the extra init
+ * bytes and responds with 0.
+ */
+#define RELPKT_VERSION_EXT	1
+
+/*
+ * Sequence numbers are kept internally as 32-bit values and only the
+ * low 8 or 16 bits go on the wire, so the window must be less than
+ * half the wire sequence space.
+ */
+#define RELPKT_MAX_PACKETS	32767
+#define RELPKT_MAX_PACKETS_V0	255
+#define RELPKT_MAX_HDR		5
+
+/* Retransmit timeout limits for version 1, in microseconds. */
+#define RELPKT_MIN_RTO		200000
+#define RELPKT_MAX_RTO		(60 * GENSIO_USECS_IN_SEC)
+
+/*
+ * A packet is taken as lost when this many packets sent after it have
+ * been selectively acked, the same as a fast retransmit after three
+ * duplicate acks in TCP.
+ */
+#define RELPKT_DUP_THRESH	3
+
+/* Maximum bitmap size in a selective ack. */
+#define RELPKT_MAX_SACK_BYTES	64
+
+/* The initial congestion window, in packets. */
+#define RELPKT_INIT_CWND	10
+
+/*
+ * Once past slow start, the congestion window grows by 1/32 of itself
+ * every round trip (but at least one packet), and on a loss it drops
+ * to 7/10 of the data in flight.  This gets back to the full link rate
+ * in a few round trips even when the window is large, where growing by
+ * one packet per round trip would take seconds.
+ */
+#define RELPKT_CA_DIV		32
+#define RELPKT_LOSS_MUL		7
+#define RELPKT_LOSS_DIV		10
+
 enum relpkt_msgs {
     /*
      * Request a connection be established.
@@ -38,6 +91,13 @@ enum relpkt_msgs {
      * | pktlen msb     |    pktlen lsb  |
      * +----------------+----------------+
      * A - response bit, 1 if a response, 0 if not.
+     *
+     * If version is 1 or more, the 8-bit recv window is limited to
+     * 255 and the full window follows:
+     *
+     * +----------------+----------------+
+     * | recv window msb| recv window lsb|
+     * +----------------+----------------+
      */
     RELPKT_MSG_INIT = 1,
 
@@ -70,7 +130,25 @@ enum relpkt_msgs {
      * |   4   |reserved|   error msb    |   error lsb    |
      * +----------------+----------------+----------------+
      */
-    RELPKT_MSG_CLOSE = 4
+    RELPKT_MSG_CLOSE = 4,
+
+    /*
+     * Selective ack, version 1 only.  This is sent instead of a plain
+     * ack when the receiver has a hole in what it has received.  It
+     * acks everything before next expected, like the ack in a data
+     * message, and has a bitmap of the packets after that which have
+     * been received.  The msb of the first bitmap byte is for next
+     * expected itself, and so on.  Any bitmap bits after the last
+     * packet the sender has sent are ignored.
+     *
+     * +----------------+----------------+----------------+
+     * |   5   |reserved|next expctd msb |next expctd lsb |
+     * +----------------+----------------+----------------+
+     * +----------------+-----
+     * | bitmap         | ...
+     * +----------------+-----
+     */
+    RELPKT_MSG_SACK = 5
 };
 
 enum relpkt_state {
@@ -252,6 +330,11 @@ struct pkt {
     bool ready; /* If true, packet is ready to deliver to the user. */
     bool eom; /* If true, report end of message. */
 
+    unsigned int xmits; /* Number of times sent, for RTT sampling. */
+    int64_t send_time; /* Last time sent, in usecs. */
+    uint32_t xmit_order; /* Order it was last sent in, see xmit_count. */
+    bool sacked; /* The remote end has it, never resend it. */
+
     unsigned char *data;
 };
 
@@ -271,12 +354,18 @@ struct relpkt_filter {
 
     bool server; /* True if server mode. */
 
+    bool allow_ext; /* Ask for version 1 on connect. */
+    unsigned int version; /* Negotiated protocol version. */
+    unsigned int seqlen; /* Bytes in a sequence number on the wire. */
+    unsigned int hdrlen; /* Bytes in a data header. */
+
     gensiods max_pktsize;
     unsigned int max_pkt; /* Our set value. */
+    unsigned int recv_window; /* What we told the remote end. */
 
-    uint8_t next_expected_seq; /* Next seq we expect from the remote. */
-    uint8_t next_deliver_seq; /* Next seq we will deliver to the user. */
-    uint8_t deliver_recvpkt; /* Pos in recvpkts of next_deliver_seq. */
+    uint32_t next_expected_seq; /* Next seq we expect from the remote. */
+    uint32_t next_deliver_seq; /* Next seq we will deliver to the user. */
+    unsigned int deliver_recvpkt; /* Pos in recvpkts of next_deliver_seq. */
     struct pkt *recvpkts;
 
     /*
@@ -289,13 +378,40 @@ struct relpkt_filter {
 
     unsigned int max_xmit_pktsize;
     unsigned int max_xmitpkt; /* Set from remote end by init packet. */
-    uint8_t next_acked_seq; /* Seq for next packet that is unacked. */
-    uint8_t next_send_seq; /* Seq for next packet we will send. */
-    uint8_t first_xmitpkt; /* Pos in xmitpkts of where next_ack_seq is. */
+    uint32_t next_acked_seq; /* Seq for next packet that is unacked. */
+    uint32_t next_send_seq; /* Seq for next packet we will send. */
+    uint32_t first_unsent_seq; /* Lowest unsent seq if nr_waiting_xmitpkt */
+    uint32_t xmit_high_seq; /* One past the highest seq ever sent. */
+    unsigned int first_xmitpkt; /* Pos in xmitpkts of where next_ack_seq is. */
     struct pkt *xmitpkts;
     unsigned int nr_waiting_xmitpkt; /* nr in xmitpkt unsent */
+    uint32_t xmit_count; /* Incremented for every data packet sent. */
 
-    char init_pkt[5];
+    /*
+     * Congestion control, version 1 only.  Packets may be sent as
+     * long as less than cwnd of them are in flight, not counting ones
+     * the remote end has reported with a selective ack.  In version 0
+     * cwnd is always max_xmitpkt.
+     */
+    unsigned int cwnd;
+    unsigned int cwnd_acked; /* Acks counted toward the next cwnd step. */
+    unsigned int nr_sacked; /* Packets past next_acked_seq with sacked set. */
+    unsigned int ssthresh;
+    bool in_recovery;
+    uint32_t recover_seq; /* Recovery is done when this is acked. */
+
+    /*
+     * Retransmit timing, version 1 only, all in usecs.  srtt is zero
+     * until the first sample.
+     */
+    int64_t srtt;
+    int64_t rttvar;
+    int64_t rto;
+    int64_t rto_start; /* Time of the last ack progress or first send. */
+    int64_t next_keepalive;
+
+    char init_pkt[7];
+    unsigned int init_pkt_len;
     bool send_init_pkt;
     unsigned int init_retry_count;
 
@@ -303,16 +419,19 @@ struct relpkt_filter {
     bool send_close_pkt;
     unsigned int close_retry_count;
 
-    char ack_pkt[3];
+    char ack_pkt[RELPKT_MAX_HDR];
     bool send_ack_pkt;
 
     char resend_pkt[51];
     bool send_resend_pkt;
     uint16_t resend_pkt_len;
 
+    unsigned char sack_pkt[3 + RELPKT_MAX_SACK_BYTES];
+    bool send_sack_pkt;
+
     gensio_time timeout;
     unsigned int max_timeouts;
-    uint8_t last_timeout_ack; /* next_acked_seq on the last timeout. */
+    uint32_t last_timeout_ack; /* next_acked_seq on the last timeout. */
     unsigned int timeout_ack_count; /* nr timeouts last_timeout_ack same. */
 };
 
@@ -339,67 +458,154 @@ relpkt_unlock(struct relpkt_filter *rfilter)
  * wrapping.  If first == next, this will always return false.
  */
 static bool
-seq_inside(uint8_t seq, uint8_t first, uint8_t next)
+seq_inside(uint32_t seq, uint32_t first, uint32_t next)
 {
-    if (first <= next)
-	/* not wrapped */
-	return seq >= first && seq < next;
-    else
-	/* wrapped */
-	return seq >= first || seq < next;
+    return seq - first < next - first;
+}
+
+/* Returns true if seq1 comes before seq2. */
+static bool
+seq_before(uint32_t seq1, uint32_t seq2)
+{
+    return (int32_t) (seq1 - seq2) < 0;
+}
+
+/*
+ * Pull a sequence number from the wire and expand it to the full
+ * sequence number at or after base.
+ */
+static uint32_t
+relpkt_get_seq(struct relpkt_filter *rfilter, const unsigned char *buf,
+	       uint32_t base)
+{
+    if (rfilter->seqlen == 2)
+	return base + (uint16_t) ((buf[0] << 8 | buf[1]) - base);
+    return base + (uint8_t) (buf[0] - base);
+}
+
+static void
+relpkt_put_seq(struct relpkt_filter *rfilter, unsigned char *buf,
+	       uint32_t seq)
+{
+    if (rfilter->seqlen == 2) {
+	buf[0] = (seq >> 8) & 0xff;
+	buf[1] = seq & 0xff;
+    } else {
+	buf[0] = seq & 0xff;
+    }
 }
 
-static uint8_t
-recvpkt_pos(struct relpkt_filter *rfilter, uint8_t pos)
+static int64_t
+relpkt_now(struct relpkt_filter *rfilter)
+{
+    gensio_time now;
+
+    rfilter->o->get_monotonic_time(rfilter->o, &now);
+    return gensio_time_to_usecs(&now);
+}
+
+static unsigned int
+recvpkt_pos(struct relpkt_filter *rfilter, unsigned int pos)
 {
     return (rfilter->deliver_recvpkt + pos) % rfilter->max_pkt;
 }
 
-static uint8_t
-xmitpkt_pos(struct relpkt_filter *rfilter, uint8_t pos)
+static unsigned int
+xmitpkt_pos(struct relpkt_filter *rfilter, unsigned int pos)
 {
     return (rfilter->first_xmitpkt + pos) % rfilter->max_xmitpkt;
 }
 
+static struct pkt *
+xmitpkt_seq(struct relpkt_filter *rfilter, uint32_t seq)
+{
+    return &(rfilter->xmitpkts[xmitpkt_pos(rfilter,
+					   seq - rfilter->next_acked_seq)]);
+}
+
 static void
-resend_packets(struct relpkt_filter *rfilter, uint8_t first, uint8_t last)
+resend_packets(struct relpkt_filter *rfilter, uint32_t first, uint32_t last)
 {
-    uint8_t seq;
-    unsigned int i, pos;
+    uint32_t seq;
+    struct pkt *p;
 
-    for (seq = first, i = first - rfilter->next_acked_seq; seq != last; i++) {
-	pos = xmitpkt_pos(rfilter, i);
-	if (rfilter->xmitpkts[pos].sent) {
-	    rfilter->xmitpkts[pos].sent = false;
+    for (seq = first; seq != last; seq++) {
+	p = xmitpkt_seq(rfilter, seq);
+	if (p->sent && !p->sacked) {
+	    p->sent = false;
+	    if (!rfilter->nr_waiting_xmitpkt ||
+			seq_before(seq, rfilter->first_unsent_seq))
+		rfilter->first_unsent_seq = seq;
 	    rfilter->nr_waiting_xmitpkt++;
 	}
-	seq++;
     }
 }
 
-static struct pkt *
-first_xmitpkt_to_send(struct relpkt_filter *rfilter)
+/*
+ * Move first_unsent_seq up to the next packet that needs to be sent,
+ * if there is one.
+ */
+static void
+find_first_unsent(struct relpkt_filter *rfilter)
 {
-    uint8_t seq = rfilter->next_acked_seq;
-    unsigned int i, pos;
-
-    for (i = 0; seq != rfilter->next_send_seq; i++, seq++) {
-	pos = xmitpkt_pos(rfilter, i);
-	if (!rfilter->xmitpkts[pos].sent)
-	    return &(rfilter->xmitpkts[pos]);
+    if (!rfilter->nr_waiting_xmitpkt)
+	return;
+    if (seq_before(rfilter->first_unsent_seq, rfilter->next_acked_seq))
+	rfilter->first_unsent_seq = rfilter->next_acked_seq;
+    while (xmitpkt_seq(rfilter, rfilter->first_unsent_seq)->sent) {
+	rfilter->first_unsent_seq++;
+	assert(rfilter->first_unsent_seq != rfilter->next_send_seq);
     }
-    assert(0);
-    return NULL;
+}
+
+/*
+ * The number of packets that are still in the network, everything
+ * sent that hasn't been acked or selectively acked.
+ */
+static unsigned int
+relpkt_flight(struct relpkt_filter *rfilter)
+{
+    return rfilter->xmit_high_seq - rfilter->next_acked_seq -
+	rfilter->nr_sacked;
+}
+
+/*
+ * Is there a packet to send that is inside the congestion window?  A
+ * lost packet holds up next_acked_seq until it is resent, so don't
+ * count packets past it the remote end already has, or sending would
+ * stall for a round trip on every loss.
+ */
+static bool
+xmitpkt_ready(struct relpkt_filter *rfilter)
+{
+    return rfilter->nr_waiting_xmitpkt &&
+	rfilter->first_unsent_seq - rfilter->next_acked_seq <
+	    rfilter->cwnd + rfilter->nr_sacked;
 }
 
 static void
 send_init(struct relpkt_filter *rfilter, bool response)
 {
+    unsigned int version = RELPKT_VERSION_EXT;
+
+    if (response)
+	version = rfilter->version;
+    else if (!rfilter->allow_ext)
+	version = 0;
     rfilter->init_pkt[0] = (RELPKT_MSG_INIT << 4) | (uint8_t) response;
-    rfilter->init_pkt[1] = 0; /* version */
-    rfilter->init_pkt[2] = rfilter->max_pkt;
+    rfilter->init_pkt[1] = version;
+    if (rfilter->max_pkt > RELPKT_MAX_PACKETS_V0)
+	rfilter->init_pkt[2] = RELPKT_MAX_PACKETS_V0;
+    else
+	rfilter->init_pkt[2] = rfilter->max_pkt;
     rfilter->init_pkt[3] = rfilter->max_pktsize >> 8;
     rfilter->init_pkt[4] = rfilter->max_pktsize & 0xff;
+    rfilter->init_pkt_len = 5;
+    if (version >= RELPKT_VERSION_EXT) {
+	rfilter->init_pkt[5] = rfilter->max_pkt >> 8;
+	rfilter->init_pkt[6] = rfilter->max_pkt & 0xff;
+	rfilter->init_pkt_len = 7;
+    }
     rfilter->send_init_pkt = true;
 }
 
@@ -416,31 +622,148 @@ static void
 send_ack(struct relpkt_filter *rfilter)
 {
     rfilter->ack_pkt[0] = RELPKT_MSG_DATA << 4;
-    /* seq will be filled in at send time. */
-    rfilter->ack_pkt[2] = 0;
+    /* ack will be filled in at send time, seq is ignored. */
+    memset(rfilter->ack_pkt + 1, 0, sizeof(rfilter->ack_pkt) - 1);
     rfilter->send_ack_pkt = true;
 }
 
 static void
-request_resend(struct relpkt_filter *rfilter, uint8_t first, uint8_t last)
+request_resend(struct relpkt_filter *rfilter, uint32_t first, uint32_t last)
 {
     if (!rfilter->send_resend_pkt) {
 	rfilter->resend_pkt_len = 1;
 	rfilter->resend_pkt[0] = RELPKT_MSG_RESEND << 4;
 	rfilter->send_resend_pkt = true;
     }
-    if (rfilter->resend_pkt_len + 1U >= sizeof(rfilter->resend_pkt))
+    if (rfilter->resend_pkt_len + 2 * rfilter->seqlen >
+		sizeof(rfilter->resend_pkt))
 	return; /* No space left, let transmit timeout get it. */
-    rfilter->resend_pkt[rfilter->resend_pkt_len++] = first;
-    rfilter->resend_pkt[rfilter->resend_pkt_len++] = last;
+    relpkt_put_seq(rfilter, (unsigned char *) rfilter->resend_pkt +
+		   rfilter->resend_pkt_len, first);
+    rfilter->resend_pkt_len += rfilter->seqlen;
+    relpkt_put_seq(rfilter, (unsigned char *) rfilter->resend_pkt +
+		   rfilter->resend_pkt_len, last);
+    rfilter->resend_pkt_len += rfilter->seqlen;
     rfilter->timeout_ack_count = 0;
 }
 
+static void
+send_sack(struct relpkt_filter *rfilter)
+{
+    rfilter->send_sack_pkt = true;
+}
+
+/*
+ * Fill in the selective ack from what has been received.  This is
+ * done at send time so it is up to date.  Returns the length.
+ */
+static gensiods
+relpkt_build_sack(struct relpkt_filter *rfilter)
+{
+    unsigned int i, n = rfilter->next_expected_seq - rfilter->next_deliver_seq;
+
+    if (n > RELPKT_MAX_SACK_BYTES * 8)
+	n = RELPKT_MAX_SACK_BYTES * 8;
+    rfilter->sack_pkt[0] = RELPKT_MSG_SACK << 4;
+    relpkt_put_seq(rfilter, rfilter->sack_pkt + 1, rfilter->next_deliver_seq);
+    memset(rfilter->sack_pkt + 3, 0, (n + 7) / 8);
+    for (i = 0; i < n; i++) {
+	if (rfilter->recvpkts[recvpkt_pos(rfilter, i)].ready)
+	    rfilter->sack_pkt[3 + i / 8] |= 0x80 >> (i % 8);
+    }
+    return 3 + (n + 7) / 8;
+}
+
+/*
+ * Update the smoothed round trip time and the retransmit timeout
+ * from a new sample, per RFC 6298.
+ */
+static void
+relpkt_rtt_sample(struct relpkt_filter *rfilter, int64_t rtt)
+{
+    int64_t delta;
+
+    if (!rfilter->srtt) {
+	rfilter->srtt = rtt;
+	rfilter->rttvar = rtt / 2;
+    } else {
+	delta = rfilter->srtt - rtt;
+	if (delta < 0)
+	    delta = -delta;
+	rfilter->rttvar = (3 * rfilter->rttvar + delta) / 4;
+	rfilter->srtt = (7 * rfilter->srtt + rtt) / 8;
+    }
+    rfilter->rto = rfilter->srtt + 4 * rfilter->rttvar;
+    if (rfilter->rto < RELPKT_MIN_RTO)
+	rfilter->rto = RELPKT_MIN_RTO;
+    if (rfilter->rto > RELPKT_MAX_RTO)
+	rfilter->rto = RELPKT_MAX_RTO;
+}
+
+/*
+ * The remote end reported lost packets.  Cut the congestion window to
+ * RELPKT_LOSS_MUL/RELPKT_LOSS_DIV of what is in flight, but only once
+ * per window of data.
+ */
+static void
+relpkt_loss(struct relpkt_filter *rfilter)
+{
+    unsigned int flight;
+
+    if (rfilter->version < RELPKT_VERSION_EXT || rfilter->in_recovery)
+	return;
+    flight = relpkt_flight(rfilter);
+    rfilter->ssthresh = flight * RELPKT_LOSS_MUL / RELPKT_LOSS_DIV;
+    if (rfilter->ssthresh < 2)
+	rfilter->ssthresh = 2;
+    rfilter->cwnd = rfilter->ssthresh;
+    rfilter->cwnd_acked = 0;
+    rfilter->in_recovery = true;
+    rfilter->recover_seq = rfilter->xmit_high_seq;
+}
+
+/*
+ * Grow the congestion window, slow start then congestion avoidance.
+ * A single ack can cover a lot of packets after a loss is repaired,
+ * so don't let the window jump up and send a big burst.
+ */
+static void
+relpkt_cwnd_acked(struct relpkt_filter *rfilter, unsigned int count)
+{
+    unsigned int flight, step;
+
+    if (rfilter->in_recovery) {
+	if (seq_before(rfilter->next_acked_seq, rfilter->recover_seq))
+	    return;
+	rfilter->in_recovery = false;
+	flight = relpkt_flight(rfilter);
+	if (flight + 1 < rfilter->cwnd)
+	    rfilter->cwnd = flight + 1;
+	return;
+    }
+    if (rfilter->cwnd < rfilter->ssthresh) {
+	rfilter->cwnd += count < 2 ? count : 2;
+    } else {
+	step = rfilter->cwnd / RELPKT_CA_DIV;
+	if (step == 0)
+	    step = 1;
+	rfilter->cwnd_acked += count;
+	if (rfilter->cwnd_acked >= rfilter->cwnd / step) {
+	    rfilter->cwnd_acked -= rfilter->cwnd / step;
+	    rfilter->cwnd++;
+	}
+    }
+    if (rfilter->cwnd > rfilter->max_xmitpkt)
+	rfilter->cwnd = rfilter->max_xmitpkt;
+}
+
 /* Returns true on a protocol error. */
 static bool
-handle_ack(struct relpkt_filter *rfilter, uint8_t seq)
+handle_ack(struct relpkt_filter *rfilter, uint32_t seq)
 {
-    unsigned int pos;
+    struct pkt *p, *sample = NULL;
+    unsigned int count = 0;
+    int64_t now;
 
     /*
      * The last received message on the other end is in seq, but we
@@ -450,30 +773,207 @@ handle_ack(struct relpkt_filter *rfilter, uint8_t seq)
 		    rfilter->next_send_seq + 1))
 	return true;
     while (rfilter->next_acked_seq != seq) {
-	pos = rfilter->first_xmitpkt;
-	if (!rfilter->xmitpkts[pos].sent) {
+	p = &(rfilter->xmitpkts[rfilter->first_xmitpkt]);
+	if (!p->sent) {
 	    /*
 	     * Packets wasn't sent yet, but we got an ack.  Could
 	     * happen on a retransmit or some other error.  Just act
 	     * like it was transmitted.
 	     */
-	    rfilter->xmitpkts[pos].sent = true;
+	    p->sent = true;
 	    assert(rfilter->nr_waiting_xmitpkt > 0);
 	    rfilter->nr_waiting_xmitpkt--;
+	} else if (p->xmits == 1 && !p->sacked && !rfilter->in_recovery) {
+	    /*
+	     * Karn's algorithm, only sample packets sent once.  In
+	     * recovery the ack was held up by the lost packet, so that
+	     * would be a bad sample, too.
+	     */
+	    sample = p;
+	}
+	if (p->sacked) {
+	    assert(rfilter->nr_sacked > 0);
+	    rfilter->nr_sacked--;
+	    p->sacked = false;
 	}
 	rfilter->first_xmitpkt = xmitpkt_pos(rfilter, 1);
 	rfilter->next_acked_seq++;
+	count++;
     }
     rfilter->timeouts_since_ack = 0;
+    if (seq_before(rfilter->xmit_high_seq, rfilter->next_acked_seq))
+	rfilter->xmit_high_seq = rfilter->next_acked_seq;
+    find_first_unsent(rfilter);
+
+    if (count && rfilter->version >= RELPKT_VERSION_EXT) {
+	now = relpkt_now(rfilter);
+	if (sample)
+	    relpkt_rtt_sample(rfilter, now - sample->send_time);
+	rfilter->rto_start = now;
+	relpkt_cwnd_acked(rfilter, count);
+    }
 
     return false;
 }
 
+/*
+ * Handle the bitmap from a selective ack, after the ack in it has
+ * been handled, so bit 0 is for next_acked_seq.  Mark the packets the
+ * remote end has so they are not resent, then resend any packet that
+ * has RELPKT_DUP_THRESH packets sent after it marked.  Ordering this
+ * by when the packets were sent instead of by sequence number means a
+ * resent packet that is lost again is also found without waiting for
+ * the retransmit timeout.
+ */
+static void
+relpkt_handle_sack(struct relpkt_filter *rfilter, const unsigned char *bits,
+		   gensiods nbytes)
+{
+    uint32_t top[RELPKT_DUP_THRESH], order;
+    unsigned int i, j, n, nsacked = 0;
+    struct pkt *p;
+    bool lost = false;
+
+    n = nbytes * 8;
+    if (n > rfilter->xmit_high_seq - rfilter->next_acked_seq)
+	n = rfilter->xmit_high_seq - rfilter->next_acked_seq;
+
+    for (i = 0; i < n; i++) {
+	p = xmitpkt_seq(rfilter, rfilter->next_acked_seq + i);
+	if (!p->sacked && (bits[i / 8] & (0x80 >> (i % 8)))) {
+	    p->sacked = true;
+	    rfilter->nr_sacked++;
+	    if (!p->sent) {
+		/* It was going to be resent, no need now. */
+		p->sent = true;
+		assert(rfilter->nr_waiting_xmitpkt > 0);
+		rfilter->nr_waiting_xmitpkt--;
+	    }
+	}
+	if (!p->sacked)
+	    continue;
+
+	/* Keep the highest RELPKT_DUP_THRESH orders, highest first. */
+	order = p->xmit_order;
+	for (j = 0; j < nsacked; j++) {
+	    if (seq_before(top[j], order))
+		break;
+	}
+	if (j < RELPKT_DUP_THRESH) {
+	    if (nsacked < RELPKT_DUP_THRESH)
+		nsacked++;
+	    memmove(top + j + 1, top + j, (nsacked - j - 1) * sizeof(*top));
+	    top[j] = order;
+	}
+    }
+    find_first_unsent(rfilter);
+    if (nsacked < RELPKT_DUP_THRESH)
+	return;
+
+    order = top[RELPKT_DUP_THRESH - 1];
+    for (i = 0; i < n; i++) {
+	p = xmitpkt_seq(rfilter, rfilter->next_acked_seq + i);
+	if (p->sent && !p->sacked && seq_before(p->xmit_order, order)) {
+	    resend_packets(rfilter, rfilter->next_acked_seq + i,
+			   rfilter->next_acked_seq + i + 1);
+	    lost = true;
+	}
+    }
+    if (lost)
+	relpkt_loss(rfilter);
+}
+
 static void
 relpkt_filter_start_timer(struct relpkt_filter *rfilter)
 {
+    gensio_time timeout = rfilter->timeout;
+    int64_t now, next;
+
+    if (rfilter->version >= RELPKT_VERSION_EXT) {
+	/*
+	 * The timer can't be moved once it is running, so run it at
+	 * the retransmit timeout even if nothing is outstanding, a
+	 * packet sent later will then get retransmitted in time.
+	 */
+	now = relpkt_now(rfilter);
+	next = rfilter->next_keepalive;
+	if (rfilter->next_acked_seq != rfilter->xmit_high_seq) {
+	    if (rfilter->rto_start + rfilter->rto < next)
+		next = rfilter->rto_start + rfilter->rto;
+	} else if (now + rfilter->rto < next) {
+	    next = now + rfilter->rto;
+	}
+	next -= now;
+	if (next < 1000)
+	    next = 1000;
+	gensio_usecs_to_time(&timeout, next);
+    }
     rfilter->filter_cb(rfilter->filter_cb_data,
-		       GENSIO_FILTER_CB_START_TIMER, &rfilter->timeout);
+		       GENSIO_FILTER_CB_START_TIMER, &timeout);
+}
+
+/*
+ * The init exchange is done, set up for the negotiated version and
+ * start running.
+ */
+static void
+relpkt_start(struct relpkt_filter *rfilter)
+{
+    if (rfilter->version >= RELPKT_VERSION_EXT) {
+	rfilter->seqlen = 2;
+	rfilter->hdrlen = 5;
+	rfilter->recv_window = rfilter->max_pkt;
+	rfilter->cwnd = RELPKT_INIT_CWND;
+	if (rfilter->cwnd > rfilter->max_xmitpkt)
+	    rfilter->cwnd = rfilter->max_xmitpkt;
+	rfilter->ssthresh = rfilter->max_xmitpkt;
+	rfilter->rto = gensio_time_to_usecs(&rfilter->timeout);
+	if (rfilter->rto < RELPKT_MIN_RTO)
+	    rfilter->rto = RELPKT_MIN_RTO;
+	rfilter->next_keepalive = (relpkt_now(rfilter) +
+				   gensio_time_to_usecs(&rfilter->timeout));
+    } else {
+	rfilter->seqlen = 1;
+	rfilter->hdrlen = 3;
+	rfilter->recv_window = rfilter->max_pkt;
+	if (rfilter->recv_window > RELPKT_MAX_PACKETS_V0)
+	    rfilter->recv_window = RELPKT_MAX_PACKETS_V0;
+	rfilter->cwnd = rfilter->max_xmitpkt;
+    }
+    rfilter->state = RELPKT_OPEN;
+    relpkt_filter_start_timer(rfilter);
+}
+
+/*
+ * Handle the window and packet size from the remote end's init.
+ * Returns true on a protocol error.
+ */
+static bool
+relpkt_handle_init(struct relpkt_filter *rfilter,
+		   const unsigned char *buf, gensiods buflen)
+{
+    rfilter->version = buf[1];
+    if (rfilter->version > RELPKT_VERSION_EXT)
+	rfilter->version = RELPKT_VERSION_EXT;
+    if (!rfilter->allow_ext)
+	rfilter->version = 0;
+    if (rfilter->version >= RELPKT_VERSION_EXT) {
+	if (buflen < 7)
+	    return true;
+	rfilter->max_xmitpkt = buf[5] << 8 | buf[6];
+	if (rfilter->max_xmitpkt > RELPKT_MAX_PACKETS)
+	    return true;
+    } else {
+	rfilter->max_xmitpkt = buf[2];
+    }
+    if (rfilter->max_xmitpkt == 0)
+	return true;
+    if (rfilter->max_xmitpkt > rfilter->max_pkt)
+	rfilter->max_xmitpkt = rfilter->max_pkt;
+    rfilter->max_xmit_pktsize = buf[3] << 8 | buf[4];
+    if (rfilter->max_xmit_pktsize > rfilter->max_pktsize)
+	rfilter->max_xmit_pktsize = rfilter->max_pktsize;
+    return false;
 }
 
 static void
@@ -495,9 +995,9 @@ relpkt_ul_read_pending(struct relpkt_filter *rfilter)
 static bool
 relpkt_ll_write_pending(struct relpkt_filter *rfilter)
 {
-    return rfilter->nr_waiting_xmitpkt || rfilter->send_init_pkt ||
+    return xmitpkt_ready(rfilter) || rfilter->send_init_pkt ||
 	rfilter->send_close_pkt || rfilter->send_resend_pkt ||
-	rfilter->send_ack_pkt;
+	rfilter->send_sack_pkt || rfilter->send_ack_pkt;
 }
 
 static bool
@@ -717,7 +1217,7 @@ relpkt_ul_write(struct relpkt_filter *rfilter,
 		inlen = rfilter->max_xmit_pktsize - p->len;
 		trunc = true;
 	    }
-	    memcpy(p->data + p->len + 3, buf, inlen);
+	    memcpy(p->data + p->len + rfilter->hdrlen, buf, inlen);
 	    writelen += inlen;
 	    p->len += inlen;
 	    if (p->len == rfilter->max_xmit_pktsize)
@@ -730,11 +1230,16 @@ relpkt_ul_write(struct relpkt_filter *rfilter,
 	    if (!trunc && gensio_str_in_auxdata(auxdata, "eom"))
 		p->eom = true;
 	    p->data[0] = (RELPKT_MSG_DATA << 4) | (uint8_t) p->eom;
-	    /* Ack (byte 1) will be filled in on transmit. */
-	    p->data[2] = rfilter->next_send_seq;
+	    /* Ack will be filled in on transmit. */
+	    relpkt_put_seq(rfilter, p->data + 1 + rfilter->seqlen,
+			   rfilter->next_send_seq);
+	    if (!rfilter->nr_waiting_xmitpkt)
+		rfilter->first_unsent_seq = rfilter->next_send_seq;
 	    rfilter->next_send_seq++;
 	    p->sent = false;
-	    p->len += 3; /* For the header. */
+	    p->sacked = false;
+	    p->xmits = 0;
+	    p->len += rfilter->hdrlen;
 	    rfilter->nr_waiting_xmitpkt++;
 	}
     }
@@ -742,22 +1247,30 @@ relpkt_ul_write(struct relpkt_filter *rfilter,
     p = NULL;
     if (rfilter->send_init_pkt) {
 	rsg.buf = rfilter->init_pkt;
-	rsg.buflen = 5;
+	rsg.buflen = rfilter->init_pkt_len;
 	endbool = &rfilter->send_init_pkt;
-    } else if (rfilter->nr_waiting_xmitpkt) {
-	p = first_xmitpkt_to_send(rfilter);
+    } else if (xmitpkt_ready(rfilter)) {
+	p = xmitpkt_seq(rfilter, rfilter->first_unsent_seq);
 	rsg.buf = p->data;
 	rsg.buflen = p->len;
-	p->data[1] = rfilter->next_deliver_seq; /* Add the ack */
+	/* Add the ack */
+	relpkt_put_seq(rfilter, p->data + 1, rfilter->next_deliver_seq);
 	rfilter->send_ack_pkt = false;
     } else if (rfilter->send_resend_pkt) {
 	rsg.buf = rfilter->resend_pkt;
 	rsg.buflen = rfilter->resend_pkt_len;
 	endbool = &rfilter->send_resend_pkt;
+    } else if (rfilter->send_sack_pkt) {
+	rsg.buf = rfilter->sack_pkt;
+	rsg.buflen = relpkt_build_sack(rfilter);
+	endbool = &rfilter->send_sack_pkt;
+	/* It has the ack in it, too. */
+	rfilter->send_ack_pkt = false;
     } else if (rfilter->send_ack_pkt) {
-	rfilter->ack_pkt[1] = rfilter->next_deliver_seq;
+	relpkt_put_seq(rfilter, (unsigned char *) rfilter->ack_pkt + 1,
+		       rfilter->next_deliver_seq);
 	rsg.buf = rfilter->ack_pkt;
-	rsg.buflen = 3;
+	rsg.buflen = rfilter->hdrlen;
 	endbool = &rfilter->send_ack_pkt;
     } else if (rfilter->send_close_pkt) {
 	rsg.buf = rfilter->close_pkt;
@@ -795,10 +1308,23 @@ relpkt_ul_write(struct relpkt_filter *rfilter,
 		err = GE_TOOBIG;
 	    } else if (count != 0) {
 		if (p) {
+		    uint32_t seq = rfilter->first_unsent_seq;
+
 		    p->sent = true;
+		    p->xmits++;
+		    p->xmit_order = rfilter->xmit_count++;
 		    assert(rfilter->nr_waiting_xmitpkt);
 		    rfilter->nr_waiting_xmitpkt--;
 		    rfilter->send_since_timeout = true;
+		    if (rfilter->version >= RELPKT_VERSION_EXT) {
+			p->send_time = relpkt_now(rfilter);
+			if (rfilter->next_acked_seq == rfilter->xmit_high_seq)
+			    /* Nothing was outstanding, start timing now. */
+			    rfilter->rto_start = p->send_time;
+		    }
+		    if (!seq_before(seq, rfilter->xmit_high_seq))
+			rfilter->xmit_high_seq = seq + 1;
+		    find_first_unsent(rfilter);
 		} else {
 		    if (endbool)
 			*endbool = false;
@@ -825,8 +1351,8 @@ relpkt_ll_write(struct relpkt_filter *rfilter,
     int err = 0;
     static const char *eomaux[2] = { "eom", NULL };
     bool response;
-    uint8_t seq, endseq, pos, ppos;
-    unsigned int i;
+    uint32_t seq, endseq;
+    unsigned int i, pos, ppos;
     struct pkt *p;
     const char *proto_err_str = NULL;
 
@@ -871,32 +1397,22 @@ relpkt_ll_write(struct relpkt_filter *rfilter,
 
 	case RELPKT_WAITING_INIT:
 	    if (!response) {
-		rfilter->max_xmitpkt = buf[2];
-		if (rfilter->max_xmitpkt == 0) {
-		    proto_err_str = "rfilter->max_xmitpkt == 0";
+		if (relpkt_handle_init(rfilter, buf, buflen)) {
+		    proto_err_str = "invalid init";
 		    goto protocol_err;
 		}
-		if (rfilter->max_xmitpkt > rfilter->max_pkt)
-		    rfilter->max_xmitpkt = rfilter->max_pkt;
-		rfilter->max_xmit_pktsize = buf[3] << 8 | buf[4];
-		if (rfilter->max_xmit_pktsize > rfilter->max_pktsize)
-		    rfilter->max_xmit_pktsize = rfilter->max_pktsize;
 		send_init(rfilter, true);
-		rfilter->state = RELPKT_OPEN;
-		relpkt_filter_start_timer(rfilter);
+		relpkt_start(rfilter);
 	    }
 	    break;
 
 	case RELPKT_WAITING_INIT_RSP:
 	    if (response) {
-		rfilter->max_xmitpkt = buf[2];
-		if (rfilter->max_xmitpkt > rfilter->max_pkt)
-		    rfilter->max_xmitpkt = rfilter->max_pkt;
-		rfilter->max_xmit_pktsize = buf[3] << 8 | buf[4];
-		if (rfilter->max_xmit_pktsize > rfilter->max_pktsize)
-		    rfilter->max_xmit_pktsize = rfilter->max_pktsize;
-		rfilter->state = RELPKT_OPEN;
-		relpkt_filter_start_timer(rfilter);
+		if (relpkt_handle_init(rfilter, buf, buflen)) {
+		    proto_err_str = "invalid init response";
+		    goto protocol_err;
+		}
+		relpkt_start(rfilter);
 	    }
 	    break;
 
@@ -925,11 +1441,16 @@ relpkt_ll_write(struct relpkt_filter *rfilter,
 
 	case RELPKT_OPEN:
 	case RELPKT_WAITING_CLOSE_CLEAR:
-	    if (buflen > rfilter->max_pktsize + 3) {
-		proto_err_str = "buflen > rfilter->max_pktsize + 3";
+	    if (buflen < rfilter->hdrlen) {
+		proto_err_str = "buflen < rfilter->hdrlen";
+		goto protocol_err;
+	    }
+	    if (buflen > rfilter->max_pktsize + rfilter->hdrlen) {
+		proto_err_str = "buflen > rfilter->max_pktsize + hdrlen";
 		goto protocol_err;
 	    }
-	    if (handle_ack(rfilter, buf[1]))
+	    seq = relpkt_get_seq(rfilter, buf + 1, rfilter->next_acked_seq);
+	    if (handle_ack(rfilter, seq))
 		goto out_unlock;
 	    if (rfilter->state != RELPKT_OPEN) {
 		/* Only deliver data in open state */
@@ -941,28 +1462,44 @@ relpkt_ll_write(struct relpkt_filter *rfilter,
 		}
 		break;
 	    }
-	    if (buflen == 3) /* Just an ack */
+	    if (buflen == rfilter->hdrlen) /* Just an ack */
 		break;
-	    seq = buf[2];
+	    seq = relpkt_get_seq(rfilter, buf + 1 + rfilter->seqlen,
+				 rfilter->next_deliver_seq);
 	    pos = seq - rfilter->next_deliver_seq;
-	    if ((uint8_t) (seq - rfilter->next_deliver_seq) > rfilter->max_pkt)
-		break; /* Ignore it */
+	    if (pos >= rfilter->recv_window) {
+		/*
+		 * Probably a resend of something we already have, our
+		 * ack may have been lost.  Ignore it and ack again.
+		 */
+		send_ack(rfilter);
+		break;
+	    }
 	    ppos = recvpkt_pos(rfilter, pos);
 	    if (seq == rfilter->next_expected_seq) {
 		rfilter->next_expected_seq++;
 	    } else if (!seq_inside(seq, rfilter->next_deliver_seq,
 				  rfilter->next_expected_seq)) {
-		request_resend(rfilter, rfilter->next_expected_seq, seq - 1);
+		if (rfilter->version < RELPKT_VERSION_EXT)
+		    request_resend(rfilter, rfilter->next_expected_seq,
+				   seq - 1);
 		rfilter->next_expected_seq = seq + 1;
 	    }
 	    p = &(rfilter->recvpkts[ppos]);
 	    if (!p->ready) {
-		memcpy(p->data, buf + 3, buflen - 3);
-		p->len = buflen - 3;
+		memcpy(p->data, buf + rfilter->hdrlen, buflen - rfilter->hdrlen);
+		p->len = buflen - rfilter->hdrlen;
 		p->start = 0;
 		p->ready = true;
 		p->eom = buf[0] & 1;
 	    }
+	    /*
+	     * If there is a hole, every packet gets a selective ack
+	     * back so the sender can tell what was lost.
+	     */
+	    if (rfilter->version >= RELPKT_VERSION_EXT &&
+			!rfilter->recvpkts[rfilter->deliver_recvpkt].ready)
+		send_sack(rfilter);
 	    break;
 
 	default:
@@ -983,13 +1520,15 @@ relpkt_ll_write(struct relpkt_filter *rfilter,
 	case RELPKT_WAITING_CLOSE_RSP:
 	    buf++;
 	    buflen--;
-	    if (buflen % 2 != 0) { /* Should be pairs of sequence numbers. */
-		proto_err_str = "buflen % 2 != 0";
+	    /* Should be pairs of sequence numbers. */
+	    if (buflen % (2 * rfilter->seqlen) != 0) {
+		proto_err_str = "buflen % (2 * seqlen) != 0";
 		goto protocol_err;
 	    }
-	    for (i = 0; i < buflen; i += 2) {
-		seq = buf[i];
-		endseq = buf[i + 1];
+	    for (i = 0; i < buflen; i += 2 * rfilter->seqlen) {
+		seq = relpkt_get_seq(rfilter, buf + i, rfilter->next_acked_seq);
+		endseq = relpkt_get_seq(rfilter, buf + i + rfilter->seqlen,
+					rfilter->next_acked_seq);
 		if (!seq_inside(seq, rfilter->next_acked_seq,
 				rfilter->next_send_seq)) {
 		    proto_err_str = "seq_inside A";
@@ -1002,6 +1541,39 @@ relpkt_ll_write(struct relpkt_filter *rfilter,
 		}
 		resend_packets(rfilter, seq, endseq + 1);
 	    }
+	    relpkt_loss(rfilter);
+	    break;
+
+	default:
+	    assert(0);
+	}
+	break;
+
+    case RELPKT_MSG_SACK:
+	switch (rfilter->state) {
+	case RELPKT_CLOSED:
+	case RELPKT_WAITING_INIT:
+	case RELPKT_WAITING_INIT_RSP:
+	case RELPKT_REMCLOSED:
+	    break;
+
+	case RELPKT_OPEN:
+	case RELPKT_WAITING_CLOSE_CLEAR:
+	case RELPKT_WAITING_CLOSE_RSP:
+	    if (rfilter->version < RELPKT_VERSION_EXT) {
+		proto_err_str = "sack in version 0";
+		goto protocol_err;
+	    }
+	    seq = relpkt_get_seq(rfilter, buf + 1, rfilter->next_acked_seq);
+	    if (handle_ack(rfilter, seq))
+		break;
+	    relpkt_handle_sack(rfilter, buf + 3, buflen - 3);
+	    if (rfilter->state == RELPKT_WAITING_CLOSE_CLEAR &&
+			rfilter->next_acked_seq == rfilter->next_send_seq) {
+		/* No more data, we can close. */
+		rfilter->state = RELPKT_WAITING_CLOSE_RSP;
+		send_close(rfilter);
+	    }
 	    break;
 
 	default:
@@ -1090,13 +1662,24 @@ relpkt_filter_cleanup(struct relpkt_filter *rfilter)
     rfilter->timeouts_since_ack = 0;
     rfilter->next_acked_seq = 0;
     rfilter->next_send_seq = 0;
+    rfilter->first_unsent_seq = 0;
+    rfilter->xmit_high_seq = 0;
     rfilter->first_xmitpkt = 0;
     rfilter->nr_waiting_xmitpkt = 0;
+    rfilter->version = 0;
+    rfilter->seqlen = 1;
+    rfilter->hdrlen = 3;
+    rfilter->in_recovery = false;
+    rfilter->cwnd_acked = 0;
+    rfilter->nr_sacked = 0;
+    rfilter->srtt = 0;
+    rfilter->rttvar = 0;
     rfilter->send_init_pkt = false;
     rfilter->init_retry_count = 0;
     rfilter->send_close_pkt = false;
     rfilter->close_retry_count = 0;
     rfilter->send_resend_pkt = false;
+    rfilter->send_sack_pkt = false;
     rfilter->send_ack_pkt = false;
     for (i = 0; i < rfilter->max_pkt; i++) {
 	struct pkt *p = &rfilter->recvpkts[i];
@@ -1133,9 +1716,61 @@ relpkt_free(struct relpkt_filter *rfilter)
     rfilter->o->free(rfilter->o, rfilter);
 }
 
+/*
+ * Timeout handling for version 1.  The timer runs more often than the
+ * keepalive time, so check for retransmit timeouts each time and only
+ * do the keepalive handling when its time has come.
+ */
+static int
+relpkt_ext_timeout(struct relpkt_filter *rfilter)
+{
+    int64_t now = relpkt_now(rfilter);
+    unsigned int flight;
+
+    if (now >= rfilter->next_keepalive) {
+	rfilter->next_keepalive = now + gensio_time_to_usecs(&rfilter->timeout);
+	rfilter->timeouts_since_ack++;
+	if (rfilter->timeouts_since_ack > rfilter->max_timeouts) {
+	    rfilter->err = GE_TIMEDOUT;
+	    return GE_TIMEDOUT;
+	}
+
+	if (rfilter->send_since_timeout)
+	    rfilter->send_since_timeout = false;
+	else
+	    send_ack(rfilter);
+    }
+
+    flight = rfilter->xmit_high_seq - rfilter->next_acked_seq;
+    if (flight && now - rfilter->rto_start >= rfilter->rto) {
+	/*
+	 * Nothing acked for a whole retransmit timeout, assume
+	 * everything outstanding was lost.  Start over from a
+	 * congestion window of one and back off the timer.
+	 */
+	rfilter->ssthresh = flight / 2;
+	if (rfilter->ssthresh < 2)
+	    rfilter->ssthresh = 2;
+	rfilter->cwnd = 1;
+	rfilter->cwnd_acked = 0;
+	rfilter->in_recovery = false;
+	resend_packets(rfilter, rfilter->next_acked_seq,
+		       rfilter->next_send_seq);
+	rfilter->rto *= 2;
+	if (rfilter->rto > RELPKT_MAX_RTO)
+	    rfilter->rto = RELPKT_MAX_RTO;
+	rfilter->rto_start = now;
+    }
+    relpkt_filter_start_timer(rfilter);
+    return 0;
+}
+
 static int
 i_relpkt_filter_timeout(struct relpkt_filter *rfilter)
 {
+    if (rfilter->version >= RELPKT_VERSION_EXT)
+	return relpkt_ext_timeout(rfilter);
+
     rfilter->timeouts_since_ack++;
     if (rfilter->timeouts_since_ack > rfilter->max_timeouts) {
 	rfilter->err = GE_TIMEDOUT;
@@ -1248,7 +1883,7 @@ static struct gensio_filter *
 gensio_relpkt_filter_raw_alloc(struct gensio_os_funcs *o,
 			       gensiods max_pktsize, gensiods max_packets,
 			       bool server, gensio_time *timeout,
-			       unsigned int max_timeouts)
+			       unsigned int max_timeouts, bool extended)
 {
     struct relpkt_filter *rfilter;
     gensiods i;
@@ -1259,6 +1894,9 @@ gensio_relpkt_filter_raw_alloc(struct gensio_os_funcs *o,
 
     rfilter->o = o;
     rfilter->server = server;
+    rfilter->allow_ext = extended;
+    rfilter->seqlen = 1;
+    rfilter->hdrlen = 3;
 
     rfilter->lock = o->alloc_lock(o);
     if (!rfilter->lock)
@@ -1282,7 +1920,7 @@ gensio_relpkt_filter_raw_alloc(struct gensio_os_funcs *o,
     if (!rfilter->xmitpkts)
 	goto out_nomem;
     for (i = 0; i < max_packets; i++) {
-	rfilter->xmitpkts[i].data = o->zalloc(o, max_pktsize + 3);
+	rfilter->xmitpkts[i].data = o->zalloc(o, max_pktsize + RELPKT_MAX_HDR);
 	if (!rfilter->xmitpkts[i].data)
 	    goto out_nomem;
     }
@@ -1311,6 +1949,7 @@ gensio_relpkt_filter_alloc(struct gensio_pparm_info *p,
     gensiods max_packets = 16;
     gensio_time timeout = { 1, 0 };
     unsigned int max_timeouts = 5;
+    bool extended = true;
     char *str = NULL;
     int rv;
 
@@ -1345,12 +1984,26 @@ gensio_relpkt_filter_alloc(struct gensio_pparm_info *p,
 	    continue;
 	if (gensio_pparm_uint(p, args[i], "max_timeouts", &max_timeouts) > 0)
 	    continue;
+	if (gensio_pparm_bool(p, args[i], "extended", &extended) > 0)
+	    continue;
 	gensio_pparm_unknown_parm(p, args[i]);
 	return GE_INVAL;
     }
 
+    if (max_packets < 1 || max_packets > RELPKT_MAX_PACKETS) {
+	gensio_pparm_log(p, "max_packets must be from 1 to %d",
+			 RELPKT_MAX_PACKETS);
+	return GE_INVAL;
+    }
+    if (max_pktsize < 1 || max_pktsize > 65535 - RELPKT_MAX_HDR) {
+	gensio_pparm_log(p, "max_pktsize must be from 1 to %d",
+			 65535 - RELPKT_MAX_HDR);
+	return GE_INVAL;
+    }
+
     filter = gensio_relpkt_filter_raw_alloc(o, max_pktsize, max_packets,
-					    server, &timeout, max_timeouts);
+					    server, &timeout, max_timeouts,
+					    extended);
     if (!filter)
 	return GE_NOMEM;
 
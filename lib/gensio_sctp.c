@@ -36,6 +36,9 @@ struct sctp_data {
     struct gensio_addr *addr;
     struct gensio_addr *laddr; /* Local address, NULL if not set. */
 
+    /* Looks the remote up again on reopens, NULL if not from a string. */
+    struct gensio_netaddr_refresh *refresh;
+
     struct sctp_initmsg initmsg;
     struct sctp_sack_info sackinfo;
 
@@ -155,7 +158,15 @@ sctp_sub_open(void *handler_data, struct gensio_iod **iod,
 	      gensio_time *timeout)
 {
     struct sctp_data *tdata = handler_data;
+    struct gensio_addr *addr;
 
+    if (tdata->refresh) {
+	addr = gensio_netaddr_refresh_check(tdata->refresh);
+	if (addr) {
+	    gensio_addr_free(tdata->addr);
+	    tdata->addr = addr;
+	}
+    }
     return sctp_try_open(tdata, iod);
 }
 
@@ -168,6 +179,8 @@ sctp_free(void *handler_data)
 	gensio_addr_free(tdata->addr);
     if (tdata->laddr)
 	gensio_addr_free(tdata->laddr);
+    if (tdata->refresh)
+	gensio_netaddr_refresh_free(tdata->refresh);
     if (tdata->strind) {
 	unsigned int i;
 
@@ -387,12 +400,11 @@ static const struct gensio_fd_ll_ops sctp_fd_ll_ops = {
 };
 
 static int
-sctp_gensio_alloc(const void *gdata, const char * const args[],
-		  struct gensio_os_funcs *o,
-		  gensio_event cb, void *user_data,
-		  struct gensio **new_gensio)
+i_sctp_gensio_alloc(const struct gensio_addr *iai, const char * const args[],
+		    struct gensio_os_funcs *o,
+		    gensio_event cb, void *user_data, const char *str,
+		    struct gensio **new_gensio)
 {
-    const struct gensio_addr *iai = gdata;
     struct sctp_data *tdata = NULL;
     struct gensio *io;
     gensiods max_read_size = GENSIO_DEFAULT_BUF_SIZE;
@@ -491,6 +503,17 @@ sctp_gensio_alloc(const void *gdata, const char * const args[],
     tdata->nodelay = nodelay;
     tdata->reuseaddr = reuseaddr;
 
+    if (str) {
+	err = gensio_netaddr_refresh_alloc(o, str, false,
+					   GENSIO_NET_PROTOCOL_SCTP,
+					   &tdata->refresh);
+	if (err) {
+	    gensio_addr_free(tdata->addr);
+	    o->free(o, tdata);
+	    goto out_err;
+	}
+    }
+
     tdata->ll = fd_gensio_ll_alloc(o, NULL, &sctp_fd_ll_ops, tdata,
 				   max_read_size, false, false);
     if (!tdata->ll)
@@ -518,6 +541,8 @@ sctp_gensio_alloc(const void *gdata, const char * const args[],
 	} else {
 	    if (tdata->addr)
 		gensio_addr_free(tdata->addr);
+	    if (tdata->refresh)
+		gensio_netaddr_refresh_free(tdata->refresh);
 	    o->free(o, tdata);
 	}
     }
@@ -528,6 +553,16 @@ sctp_gensio_alloc(const void *gdata, const char * const args[],
     return err;
 }
 
+static int
+sctp_gensio_alloc(const void *gdata, const char * const args[],
+		  struct gensio_os_funcs *o,
+		  gensio_event cb, void *user_data,
+		  struct gensio **new_gensio)
+{
+    return i_sctp_gensio_alloc(gdata, args, o, cb, user_data, NULL,
+			       new_gensio);
+}
+
 static int
 str_to_sctp_gensio(const char *str, const char * const args[],
 		  struct gensio_os_funcs *o,
@@ -537,12 +572,12 @@ str_to_sctp_gensio(const char *str, const char * const args[],
     struct gensio_addr *addr;
     int err;
 
-    err = gensio_os_scan_netaddr(o, str, false, GENSIO_NET_PROTOCOL_SCTP,
-				 &addr);
+    err = gensio_scan_netaddr_cached(o, str, false, GENSIO_NET_PROTOCOL_SCTP,
+				     &addr);
     if (err)
 	return err;
 
-    err = sctp_gensio_alloc(addr, args, o, cb, user_data, new_gensio);
+    err = i_sctp_gensio_alloc(addr, args, o, cb, user_data, str, new_gensio);
     gensio_addr_free(addr);
 
     return err;
@@ -45,495 +45,7 @@ static void gensio_sound_devices_free(char **names, char **specs,
 static int gensio_sound_devices(struct gensio_os_funcs *o, const char *type,
 				char ***names, char ***specs, gensiods *count);
 
-enum gensio_sound_fmt_type {
-    GENSIO_SOUND_FMT_UNKNOWN = -1,
-
-    GENSIO_SOUND_FMT_DOUBLE = 0,
-    GENSIO_SOUND_FMT_MIN_USER = GENSIO_SOUND_FMT_DOUBLE,
-
-    GENSIO_SOUND_FMT_FLOAT = 1,
-    GENSIO_SOUND_FMT_S32 = 2,
-    GENSIO_SOUND_FMT_S24 = 3,
-    GENSIO_SOUND_FMT_S16 = 4,
-    GENSIO_SOUND_FMT_S8 = 5,
-
-    /*
-     * All the ones above this are supported on the user side.  The
-     * ones below are only supported on the PCM side, and only if the
-     * hardware supports it.
-     */
-    GENSIO_SOUND_FMT_MAX_USER = GENSIO_SOUND_FMT_S8,
-
-    GENSIO_SOUND_FMT_U32,
-    GENSIO_SOUND_FMT_U24,
-    GENSIO_SOUND_FMT_U16,
-    GENSIO_SOUND_FMT_U8,
-#if GENSIO_IS_BIG_ENDIAN
-    GENSIO_SOUND_FMT_DOUBLE_BE = GENSIO_SOUND_FMT_DOUBLE,
-    GENSIO_SOUND_FMT_FLOAT_BE = GENSIO_SOUND_FMT_FLOAT,
-    GENSIO_SOUND_FMT_S32_BE = GENSIO_SOUND_FMT_S32,
-    GENSIO_SOUND_FMT_U32_BE = GENSIO_SOUND_FMT_U32,
-    GENSIO_SOUND_FMT_S24_BE = GENSIO_SOUND_FMT_S24,
-    GENSIO_SOUND_FMT_U24_BE = GENSIO_SOUND_FMT_U24,
-    GENSIO_SOUND_FMT_S16_BE = GENSIO_SOUND_FMT_S16,
-    GENSIO_SOUND_FMT_U16_BE = GENSIO_SOUND_FMT_U16,
-    GENSIO_SOUND_FMT_DOUBLE_LE,
-    GENSIO_SOUND_FMT_FLOAT_LE,
-    GENSIO_SOUND_FMT_S32_LE,
-    GENSIO_SOUND_FMT_U32_LE,
-    GENSIO_SOUND_FMT_S24_LE,
-    GENSIO_SOUND_FMT_U24_LE,
-    GENSIO_SOUND_FMT_S16_LE,
-    GENSIO_SOUND_FMT_U16_LE,
-    GENSIO_SOUND_FMT_DOUBLE_ALT = GENSIO_SOUND_FMT_DOUBLE_LE,
-    GENSIO_SOUND_FMT_FLOAT_ALT = GENSIO_SOUND_FMT_FLOAT_LE,
-    GENSIO_SOUND_FMT_S32_ALT = GENSIO_SOUND_FMT_S32_LE,
-    GENSIO_SOUND_FMT_U32_ALT = GENSIO_SOUND_FMT_U32_LE,
-    GENSIO_SOUND_FMT_S24_ALT = GENSIO_SOUND_FMT_S24_LE,
-    GENSIO_SOUND_FMT_U24_ALT = GENSIO_SOUND_FMT_U24_LE,
-    GENSIO_SOUND_FMT_S16_ALT = GENSIO_SOUND_FMT_S16_LE,
-    GENSIO_SOUND_FMT_U16_ALT = GENSIO_SOUND_FMT_U16_LE,
-#else
-    GENSIO_SOUND_FMT_DOUBLE_BE,
-    GENSIO_SOUND_FMT_FLOAT_BE,
-    GENSIO_SOUND_FMT_S32_BE,
-    GENSIO_SOUND_FMT_U32_BE,
-    GENSIO_SOUND_FMT_S24_BE,
-    GENSIO_SOUND_FMT_U24_BE,
-    GENSIO_SOUND_FMT_S16_BE,
-    GENSIO_SOUND_FMT_U16_BE,
-    GENSIO_SOUND_FMT_DOUBLE_ALT = GENSIO_SOUND_FMT_DOUBLE_BE,
-    GENSIO_SOUND_FMT_FLOAT_ALT = GENSIO_SOUND_FMT_FLOAT_BE,
-    GENSIO_SOUND_FMT_S32_ALT = GENSIO_SOUND_FMT_S32_BE,
-    GENSIO_SOUND_FMT_U32_ALT = GENSIO_SOUND_FMT_U32_BE,
-    GENSIO_SOUND_FMT_S24_ALT = GENSIO_SOUND_FMT_S24_BE,
-    GENSIO_SOUND_FMT_U24_ALT = GENSIO_SOUND_FMT_U24_BE,
-    GENSIO_SOUND_FMT_S16_ALT = GENSIO_SOUND_FMT_S16_BE,
-    GENSIO_SOUND_FMT_U16_ALT = GENSIO_SOUND_FMT_U16_BE,
-    GENSIO_SOUND_FMT_DOUBLE_LE = GENSIO_SOUND_FMT_DOUBLE,
-    GENSIO_SOUND_FMT_FLOAT_LE = GENSIO_SOUND_FMT_FLOAT,
-    GENSIO_SOUND_FMT_S32_LE = GENSIO_SOUND_FMT_S32,
-    GENSIO_SOUND_FMT_U32_LE = GENSIO_SOUND_FMT_U32,
-    GENSIO_SOUND_FMT_S24_LE = GENSIO_SOUND_FMT_S24,
-    GENSIO_SOUND_FMT_U24_LE = GENSIO_SOUND_FMT_U24,
-    GENSIO_SOUND_FMT_S16_LE = GENSIO_SOUND_FMT_S16,
-    GENSIO_SOUND_FMT_U16_LE = GENSIO_SOUND_FMT_U16,
-#endif
-
-    GENSIO_SOUND_FMT_COUNT
-};
-
-struct sound_format_names {
-    const char *name;
-    enum gensio_sound_fmt_type format;
-};
-
-/* Used to convert from a string to a format enum value. */
-static struct sound_format_names sound_format_names[] = {
-    { "float64",	GENSIO_SOUND_FMT_DOUBLE },
-    { "float",		GENSIO_SOUND_FMT_FLOAT },
-    { "s32",		GENSIO_SOUND_FMT_S32 },
-    { "s24",		GENSIO_SOUND_FMT_S24 },
-    { "s16",		GENSIO_SOUND_FMT_S16 },
-    { "s8",		GENSIO_SOUND_FMT_S8 },
-    { "u32",		GENSIO_SOUND_FMT_U32 },
-    { "u24",		GENSIO_SOUND_FMT_U24 },
-    { "u16",		GENSIO_SOUND_FMT_U16 },
-    { "u8",		GENSIO_SOUND_FMT_U8 },
-    { "float64_be",	GENSIO_SOUND_FMT_DOUBLE_BE },
-    { "float_be",	GENSIO_SOUND_FMT_FLOAT_BE },
-    { "int32_be",	GENSIO_SOUND_FMT_S32_BE },
-    { "int24_be",	GENSIO_SOUND_FMT_S24_BE },
-    { "int16_be",	GENSIO_SOUND_FMT_S16_BE },
-    { "u32_be",		GENSIO_SOUND_FMT_U32_BE },
-    { "u24_be",		GENSIO_SOUND_FMT_U24_BE },
-    { "u16_be",		GENSIO_SOUND_FMT_U16_BE },
-    { "float64_le",	GENSIO_SOUND_FMT_DOUBLE_LE },
-    { "float_le",	GENSIO_SOUND_FMT_FLOAT_LE },
-    { "int32_le",	GENSIO_SOUND_FMT_S32_LE },
-    { "int24_le",	GENSIO_SOUND_FMT_S24_LE },
-    { "int16_le",	GENSIO_SOUND_FMT_S16_LE },
-    { "u32_le",		GENSIO_SOUND_FMT_U32_LE },
-    { "u24_le",		GENSIO_SOUND_FMT_U24_LE },
-    { "u16_le",		GENSIO_SOUND_FMT_U16_LE },
-    { "FLOAT64",	GENSIO_SOUND_FMT_DOUBLE },
-    { "FLOAT",		GENSIO_SOUND_FMT_FLOAT },
-    { "S32",		GENSIO_SOUND_FMT_S32 },
-    { "S24",		GENSIO_SOUND_FMT_S24 },
-    { "S16",		GENSIO_SOUND_FMT_S16 },
-    { "S8",		GENSIO_SOUND_FMT_S8 },
-    { "U32",		GENSIO_SOUND_FMT_U32 },
-    { "U24",		GENSIO_SOUND_FMT_U24 },
-    { "U16",		GENSIO_SOUND_FMT_U16 },
-    { "U8",		GENSIO_SOUND_FMT_U8 },
-    { "FLOAT64_BE",	GENSIO_SOUND_FMT_DOUBLE_BE },
-    { "FLOAT_BE",	GENSIO_SOUND_FMT_FLOAT_BE },
-    { "INT32_BE",	GENSIO_SOUND_FMT_S32_BE },
-    { "INT24_BE",	GENSIO_SOUND_FMT_S24_BE },
-    { "INT16_BE",	GENSIO_SOUND_FMT_S16_BE },
-    { "U32_BE",		GENSIO_SOUND_FMT_U32_BE },
-    { "U24_BE",		GENSIO_SOUND_FMT_U24_BE },
-    { "U16_BE",		GENSIO_SOUND_FMT_U16_BE },
-    { "FLOAT64_LE",	GENSIO_SOUND_FMT_DOUBLE_LE },
-    { "FLOAT_LE",	GENSIO_SOUND_FMT_FLOAT_LE },
-    { "INT32_LE",	GENSIO_SOUND_FMT_S32_LE },
-    { "INT24_LE",	GENSIO_SOUND_FMT_S24_LE },
-    { "INT16_LE",	GENSIO_SOUND_FMT_S16_LE },
-    { "U32_LE",		GENSIO_SOUND_FMT_U32_LE },
-    { "U24_LE",		GENSIO_SOUND_FMT_U24_LE },
-    { "U16_LE",		GENSIO_SOUND_FMT_U16_LE },
-    {}
-};
-
-struct sound_fmt_info {
-    unsigned int size; /* Size, in bytes, of the sample. */
-    bool host_bswap; /* Is this byte-swapped with respect to the host? */
-    bool isfloat;
-    uint32_t offset; /* If unsigned, convert to signed by subtracting this. */
-    float scale; /* Scale between offset value and float. */
-};
-
-static struct sound_fmt_info sound_fmt_info[] = {
-    [ GENSIO_SOUND_FMT_DOUBLE_BE ]	= { .size = sizeof(double),
-					    .host_bswap = GENSIO_IS_LITTLE_ENDIAN,
-					    .isfloat = true },
-    [ GENSIO_SOUND_FMT_FLOAT_BE ]	= { .size = sizeof(float),
-					    .host_bswap = GENSIO_IS_LITTLE_ENDIAN,
-					    .isfloat = true },
-    [ GENSIO_SOUND_FMT_S32_BE ]		= { .size = 4,
-					    .host_bswap = GENSIO_IS_LITTLE_ENDIAN,
-					    .scale = 2147483648. },
-    [ GENSIO_SOUND_FMT_S24_BE ]		= { .size = 3,
-					    .host_bswap = GENSIO_IS_LITTLE_ENDIAN,
-					    .scale = 8388608. },
-    [ GENSIO_SOUND_FMT_S16_BE ]		= { .size = 2,
-					    .host_bswap = GENSIO_IS_LITTLE_ENDIAN,
-					    .scale = 32768. },
-    [ GENSIO_SOUND_FMT_U32_BE ]		= { .size = 4,
-					    .host_bswap = GENSIO_IS_LITTLE_ENDIAN,
-					    .offset = 2147483648,
-					    .scale = 2147483648. },
-    [ GENSIO_SOUND_FMT_U24_BE ]		= { .size = 3,
-					    .host_bswap = GENSIO_IS_LITTLE_ENDIAN,
-					    .offset = 8388608,
-					    .scale = 8388608. },
-    [ GENSIO_SOUND_FMT_U16_BE ]		= { .size = 2,
-					    .host_bswap = GENSIO_IS_LITTLE_ENDIAN,
-					    .offset = 32768,
-					    .scale = 32768. },
-    [ GENSIO_SOUND_FMT_S8 ]		= { .size = 1,
-					    .scale = 128. },
-    [ GENSIO_SOUND_FMT_U8 ]		= { .size = 1, .offset = 128,
-					    .scale = 128. },
-    [ GENSIO_SOUND_FMT_DOUBLE_LE ]	= { .size = sizeof(double),
-					    .host_bswap = GENSIO_IS_BIG_ENDIAN,
-					    .isfloat = true },
-    [ GENSIO_SOUND_FMT_FLOAT_LE ]	= { .size = sizeof(float),
-					    .host_bswap = GENSIO_IS_BIG_ENDIAN,
-					    .isfloat = true },
-    [ GENSIO_SOUND_FMT_S32_LE ]		= { .size = 4,
-					    .host_bswap = GENSIO_IS_BIG_ENDIAN,
-					    .scale = 2147483648. },
-    [ GENSIO_SOUND_FMT_S24_LE ]		= { .size = 3,
-					    .host_bswap = GENSIO_IS_BIG_ENDIAN,
-					    .scale = 8388608. },
-    [ GENSIO_SOUND_FMT_S16_LE ]		= { .size = 2,
-					    .host_bswap = GENSIO_IS_BIG_ENDIAN,
-					    .scale = 32768. },
-    [ GENSIO_SOUND_FMT_U32_LE ]		= { .size = 4,
-					    .host_bswap = GENSIO_IS_BIG_ENDIAN,
-					    .offset = 2147483648,
-					    .scale = 2147483648. },
-    [ GENSIO_SOUND_FMT_U24_LE ]		= { .size = 3,
-					    .host_bswap = GENSIO_IS_BIG_ENDIAN,
-					    .offset = 8388608,
-					    .scale = 8388608. },
-    [ GENSIO_SOUND_FMT_U16_LE ]		= { .size = 2,
-					    .host_bswap = GENSIO_IS_BIG_ENDIAN,
-					    .offset = 32768,
-					    .scale = 32768. }
-};
-
-static int32_t
-get_int24(const unsigned char **in, unsigned int offset, bool host_bswap)
-{
-    int32_t v = 0;
-    bool big_endian = GENSIO_IS_BIG_ENDIAN ? !host_bswap : host_bswap;
-
-    if (big_endian) {
-	v = *(*in)++ << 16;
-	v |= *(*in)++ << 8;
-	v |= *(*in)++;
-    } else {
-	v = *(*in)++;
-	v |= *(*in)++ << 8;
-	v |= *(*in)++ << 16;
-    }
-
-    /* If offset is zero, that means the value is signed. */
-    if ((v & 0x800000) && !offset)
-	v |= 0xff << 24;
-
-    return v;
-}
-
-static int32_t
-get_int(const unsigned char **in, unsigned int size,
-	unsigned int offset, bool host_bswap)
-{
-    int32_t v = 0;
-
-    switch(size) {
-    case 4:
-	v = *((int32_t *) *in);
-	if (host_bswap)
-	    v = gensio_bswap_32(v);
-	(*in) += 4;
-	break;
-
-    case 3:
-	v = get_int24(in, offset, host_bswap);
-	break;
-
-    case 2:
-	v = *((int16_t *) *in);
-	if (host_bswap)
-	    v = gensio_bswap_16(v);
-	(*in) += 2;
-	break;
-
-    case 1:
-	v = *((int8_t *) *in);
-	(*in) += 1;
-	break;
-
-    default:
-	assert(0);
-    }
-
-    v -= offset;
-
-    return v;
-}
-
-static void
-put_int24(int32_t v, unsigned char **out, bool host_bswap)
-{
-    bool big_endian = GENSIO_IS_BIG_ENDIAN ? !host_bswap : host_bswap;
-
-    if (big_endian) {
-	*(*out)++ = v >> 16;
-	*(*out)++ = v >> 8;
-	*(*out)++ = v;
-    } else {
-	*(*out)++ = v;
-	*(*out)++ = v >> 8;
-	*(*out)++ = v >> 16;
-    }
-}
-
-static void
-put_int(int32_t v,
-	unsigned char **out, unsigned int size,
-	unsigned int offset, bool host_bswap)
-{
-    v += offset;
-
-    switch(size) {
-    case 4:
-	if (host_bswap)
-	    v = gensio_bswap_32(v);
-	*((int32_t *) *out) = v;
-	(*out) += 4;
-	break;
-
-    case 3:
-	put_int24(v, out, host_bswap);
-	break;
-
-    case 2:
-	if (host_bswap)
-	    v = gensio_bswap_16(v);
-	*((int16_t *) *out) = v;
-	(*out) += 2;
-	break;
-
-    case 1:
-	*((int8_t *) *out) = v;
-	(*out) += 1;
-	break;
-
-    default:
-	assert(0);
-    }
-}
-
-static void
-put_float(double v, unsigned char **out,
-	  unsigned int size, bool host_bswap)
-{
-    const void *data = *out;
-
-    if (size == 4) {
-	*((float *) data) = v;
-	if (host_bswap) {
-	    int32_t *iv = ((int32_t *) data);
-	    *iv = gensio_bswap_32(*((int32_t *) data));
-	}
-    } else if (size == 8) {
-	*((double *) data) = v;
-	if (host_bswap) {
-	    int64_t *iv = ((int64_t *) data);
-	    *iv = gensio_bswap_64(*((int64_t *) data));
-	}
-    } else {
-	assert(0);
-    }
-    *out += size;
-}
-
-static double
-get_float(const unsigned char **in, unsigned int size, bool host_bswap)
-{
-    double v = 0;
-
-    if (size == 4) {
-	char d[4];
-
-	memcpy(d, *in, 4);
-	if (host_bswap) {
-	    int32_t iv;
-
-	    memcpy(&iv, d, 4);
-	    iv = gensio_bswap_32(iv);
-	    memcpy(d, &iv, 4);
-	}
-	v = *((float *) d);
-    } else if (size == 8) {
-	char d[8];
-
-	memcpy(d, *in, 8);
-	if (host_bswap) {
-	    int64_t iv;
-
-	    memcpy(&iv, d, 8);
-	    iv = gensio_bswap_64(iv);
-	    memcpy(d, &iv, 8);
-	}
-	v = *((double *) d);
-    } else {
-	assert(0);
-    }
-    *in += size;
-
-    return v;
-}
-
-/*
- * This is used to convert between the user format and the format used
- * by the pcm side.
- */
-struct sound_cnv_info {
-    bool enabled;
-    /* PCM format.  Will be UNKNOWN if not set by user. */
-    enum gensio_sound_fmt_type pfmt;
-    enum gensio_sound_fmt_type ufmt;
-    gensiods pframesize; /* Size of a frame on the PCM side, in bytes. */
-    unsigned int usize; /* Sample size (in bytes) on the user side */
-    unsigned int psize; /* Sample size on the PCM side, in bytes */
-
-    /* Above values are always set.  Values below are only set if enabled. */
-
-    bool host_bswap;
-    uint32_t offset; /* Subtract/add this from/to the pcm/user to convert. */
-    float scale_in; /* Multiply by this to scale to -1.0 - 1.0 float, before offset. */
-    float scale_out; /* Multiply by this to scale from -1.0 - 1.0 float, after offset. */
-    void (*convin)(const unsigned char **in, unsigned char **out,
-		   struct sound_cnv_info *info);
-    void (*convout)(const unsigned char **in, unsigned char **out,
-		    struct sound_cnv_info *info);
-    unsigned char *buf; /* PCM buffer(s) */
-};
-
-static void
-conv_int_to_float_in(const unsigned char **in, unsigned char **out,
-		     struct sound_cnv_info *info)
-{
-    double v = get_int(in, info->psize, info->offset, info->host_bswap);
-
-    v *= info->scale_in;
-
-    put_float(v, out, info->usize, false);
-}
-
-static void
-conv_float_to_int_out(const unsigned char **in, unsigned char **out,
-		      struct sound_cnv_info *info)
-{
-    double v = get_float(in, info->usize, false);
-
-    v *= info->scale_out;
-
-    put_int(v + .5, out, info->psize, info->offset, info->host_bswap);
-}
-
-static void
-conv_float_to_int_in(const unsigned char **in, unsigned char **out,
-		     struct sound_cnv_info *info)
-{
-    double v = get_float(in, info->psize, info->host_bswap);
-
-    v *= info->scale_in;
-
-    put_int(v + .5, out, info->usize, 0, false);
-}
-
-static void
-conv_int_to_float_out(const unsigned char **in, unsigned char **out,
-		      struct sound_cnv_info *info)
-{
-    double v = get_float(in, info->usize, false);
-
-    v *= info->scale_out;
-
-    put_int(v, out, info->psize, info->offset, info->host_bswap);
-}
-
-static void
-conv_int_to_int_in(const unsigned char **in, unsigned char **out,
-		   struct sound_cnv_info *info)
-{
-    int32_t v = get_int(in, info->psize, info->offset, info->host_bswap);
-
-    put_int(v, out, info->usize, 0, false);
-}
-
-static void
-conv_int_to_int_out(const unsigned char **in, unsigned char **out,
-		   struct sound_cnv_info *info)
-{
-    int32_t v = get_int(in, info->usize, 0, false);
-
-    put_int(v, out, info->psize, info->offset, info->host_bswap);
-}
-
-static void
-conv_float_to_float_in(const unsigned char **in, unsigned char **out,
-		       struct sound_cnv_info *info)
-{
-    double v = get_float(in, info->psize, info->host_bswap);
-
-    put_float(v, out, info->usize, false);
-}
-
-static void
-conv_float_to_float_out(const unsigned char **in, unsigned char **out,
-			struct sound_cnv_info *info)
-{
-    double v = get_float(in, info->usize, false);
-
-    put_float(v, out, info->psize, info->host_bswap);
-}
+#include "gensio_sound_conv.h"
 
 struct sound_type {
     const char *name;
@@ -590,39 +102,8 @@ struct sound_info {
 static void
 setup_convv(struct sound_info *si, enum gensio_sound_fmt_type pfmt)
 {
-    enum gensio_sound_fmt_type ufmt = si->cnv.ufmt;
-    struct sound_fmt_info *uinfo, *pinfo;
-
-    si->cnv.pfmt = pfmt;
-
-    uinfo = &sound_fmt_info[ufmt];
-    pinfo = &sound_fmt_info[pfmt];
-
-    si->cnv.usize = uinfo->size;
-    si->cnv.psize = pinfo->size;
-    si->cnv.offset = pinfo->offset;
-    si->cnv.host_bswap = pinfo->host_bswap;
-
-    si->cnv.pframesize = (gensiods) pinfo->size * si->chans;
-
-    if (pinfo->isfloat && uinfo->isfloat) {
-	si->cnv.convin = conv_float_to_float_in;
-	si->cnv.convout = conv_float_to_float_out;
-    } else if (pinfo->isfloat) {
-	si->cnv.scale_out = 1 / pinfo->scale;
-	si->cnv.scale_in = pinfo->scale;
-	si->cnv.convin = conv_float_to_int_in;
-	si->cnv.convout = conv_int_to_float_out;
-    } else if (uinfo->isfloat) {
-	si->cnv.scale_in = 1 / pinfo->scale;
-	si->cnv.scale_out = pinfo->scale;
-	si->cnv.convin = conv_int_to_float_in;
-	si->cnv.convout = conv_float_to_int_out;
-    } else {
-	si->cnv.convin = conv_int_to_int_in;
-	si->cnv.convout = conv_int_to_int_out;
-    }
-
+    sound_cnv_setup(&si->cnv, pfmt);
+    si->cnv.pframesize = (gensiods) si->cnv.psize * si->chans;
     si->cnv.enabled = true;
 }
 
@@ -634,11 +115,7 @@ setup_conv(const char *ufmt, const char *pfmt, struct sound_info *si)
 
     if (si->cnv.ufmt == GENSIO_SOUND_FMT_UNKNOWN) {
 	/* Only do this if it hasn't been done. */
-	for (i = GENSIO_SOUND_FMT_MIN_USER;
-	     i <= GENSIO_SOUND_FMT_MAX_USER; i++) {
-	    if (strcmp(sound_format_names[i].name, ufmt) == 0)
-		break;
-	}
+	i = sound_fmt_lookup(ufmt);
 	if (i > GENSIO_SOUND_FMT_MAX_USER || i < GENSIO_SOUND_FMT_MIN_USER)
 	    return GE_INVAL;
 
@@ -655,13 +132,9 @@ setup_conv(const char *ufmt, const char *pfmt, struct sound_info *si)
     if (!pfmt)
 	return 0;
 
-    for (i = 0; i < GENSIO_SOUND_FMT_COUNT; i++) {
-	if (strcmp(sound_format_names[i].name, pfmt) == 0)
-	    break;
-    }
-    if (i >= GENSIO_SOUND_FMT_COUNT)
+    pfmtv = sound_fmt_lookup(pfmt);
+    if (pfmtv == GENSIO_SOUND_FMT_UNKNOWN)
 	return GE_INVAL;
-    pfmtv = i;
 
     if (si->cnv.ufmt == pfmtv)
 	return 0;
@@ -973,8 +446,11 @@ gensio_sound_ll_deferred_op(struct gensio_runner *runner, void *cbdata)
 	 */
 	if (oldread && soundll->read_enabled)
 	    gensio_sound_do_read_enable(soundll);
-	if (oldwrite && soundll->write_enabled)
+	if (oldwrite && soundll->write_enabled) {
 	    soundll->out.type->set_write_enable(&soundll->out, true);
+	    if (soundll->out.ready)
+		gensio_sound_sched_deferred_op(soundll);
+	}
 	break;
     }
 
@@ -1022,7 +498,6 @@ gensio_sound_api_default_write(struct sound_info *out, gensiods *rcount,
 
     for (i = 0; i < sglen; i++) {
 	const unsigned char *buf, *ibuf = NULL;
-	unsigned char *tbuf;
 	gensiods buflen, ibuflen = 0, j; /* Size in frames. */
 
 	if (!sg[i].buflen)
@@ -1032,13 +507,12 @@ gensio_sound_api_default_write(struct sound_info *out, gensiods *rcount,
 	    ibuf = sg[i].buf;
 	    ibuflen = sg[i].buflen / out->framesize;
 	moredata:
-	    tbuf = out->cnv.buf;
-	    for (j = 0; j < ibuflen && j < out->bufsize; j++) {
-		gensiods k;
-
-		for (k = 0; k < out->chans; k++)
-		    out->cnv.convout(&ibuf, &tbuf, &out->cnv);
-	    }
+	    j = ibuflen;
+	    if (j > out->bufsize)
+		j = out->bufsize;
+	    out->cnv.convout_buf(ibuf, out->cnv.buf, j * out->chans,
+				 &out->cnv);
+	    ibuf += j * out->framesize;
 	    if (j == ibuflen)
 		ibuf = NULL;
 	    else
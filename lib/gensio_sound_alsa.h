@@ -380,14 +380,9 @@ gensio_sound_alsa_do_read(struct sound_info *si)
 	si->len += rv;
 	assert(si->len <= si->bufsize);
 	if (si->len == si->bufsize) {
-	    if (si->cnv.enabled) {
-		const unsigned char *ibuf = si->cnv.buf;
-		unsigned char *obuf = si->buf;
-		gensiods i;
-
-		for (i = 0; i < si->bufsize * si->chans; i++)
-		    si->cnv.convin(&ibuf, &obuf, &si->cnv);
-	    }
+	    if (si->cnv.enabled)
+		si->cnv.convin_buf(si->cnv.buf, si->buf,
+				   si->bufsize * si->chans, &si->cnv);
 	    si->ready = true;
 	}
     }
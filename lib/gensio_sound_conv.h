@@ -0,0 +1,905 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2018  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * Sample format conversion between the user side and the PCM side of
+ * the sound gensio.
+ */
+
+#ifndef GENSIO_SOUND_CONV_H
+#define GENSIO_SOUND_CONV_H
+
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <gensio/gensio_types.h>
+#include <gensio/gensio_byteswap.h>
+
+enum gensio_sound_fmt_type {
+    GENSIO_SOUND_FMT_UNKNOWN = -1,
+
+    GENSIO_SOUND_FMT_DOUBLE = 0,
+    GENSIO_SOUND_FMT_MIN_USER = GENSIO_SOUND_FMT_DOUBLE,
+
+    GENSIO_SOUND_FMT_FLOAT = 1,
+    GENSIO_SOUND_FMT_S32 = 2,
+    GENSIO_SOUND_FMT_S24 = 3,
+    GENSIO_SOUND_FMT_S16 = 4,
+    GENSIO_SOUND_FMT_S8 = 5,
+
+    /*
+     * All the ones above this are supported on the user side.  The
+     * ones below are only supported on the PCM side, and only if the
+     * hardware supports it.
+     */
+    GENSIO_SOUND_FMT_MAX_USER = GENSIO_SOUND_FMT_S8,
+
+    GENSIO_SOUND_FMT_U32,
+    GENSIO_SOUND_FMT_U24,
+    GENSIO_SOUND_FMT_U16,
+    GENSIO_SOUND_FMT_U8,
+#if GENSIO_IS_BIG_ENDIAN
+    GENSIO_SOUND_FMT_DOUBLE_BE = GENSIO_SOUND_FMT_DOUBLE,
+    GENSIO_SOUND_FMT_FLOAT_BE = GENSIO_SOUND_FMT_FLOAT,
+    GENSIO_SOUND_FMT_S32_BE = GENSIO_SOUND_FMT_S32,
+    GENSIO_SOUND_FMT_U32_BE = GENSIO_SOUND_FMT_U32,
+    GENSIO_SOUND_FMT_S24_BE = GENSIO_SOUND_FMT_S24,
+    GENSIO_SOUND_FMT_U24_BE = GENSIO_SOUND_FMT_U24,
+    GENSIO_SOUND_FMT_S16_BE = GENSIO_SOUND_FMT_S16,
+    GENSIO_SOUND_FMT_U16_BE = GENSIO_SOUND_FMT_U16,
+    GENSIO_SOUND_FMT_DOUBLE_LE,
+    GENSIO_SOUND_FMT_FLOAT_LE,
+    GENSIO_SOUND_FMT_S32_LE,
+    GENSIO_SOUND_FMT_U32_LE,
+    GENSIO_SOUND_FMT_S24_LE,
+    GENSIO_SOUND_FMT_U24_LE,
+    GENSIO_SOUND_FMT_S16_LE,
+    GENSIO_SOUND_FMT_U16_LE,
+    GENSIO_SOUND_FMT_DOUBLE_ALT = GENSIO_SOUND_FMT_DOUBLE_LE,
+    GENSIO_SOUND_FMT_FLOAT_ALT = GENSIO_SOUND_FMT_FLOAT_LE,
+    GENSIO_SOUND_FMT_S32_ALT = GENSIO_SOUND_FMT_S32_LE,
+    GENSIO_SOUND_FMT_U32_ALT = GENSIO_SOUND_FMT_U32_LE,
+    GENSIO_SOUND_FMT_S24_ALT = GENSIO_SOUND_FMT_S24_LE,
+    GENSIO_SOUND_FMT_U24_ALT = GENSIO_SOUND_FMT_U24_LE,
+    GENSIO_SOUND_FMT_S16_ALT = GENSIO_SOUND_FMT_S16_LE,
+    GENSIO_SOUND_FMT_U16_ALT = GENSIO_SOUND_FMT_U16_LE,
+#else
+    GENSIO_SOUND_FMT_DOUBLE_BE,
+    GENSIO_SOUND_FMT_FLOAT_BE,
+    GENSIO_SOUND_FMT_S32_BE,
+    GENSIO_SOUND_FMT_U32_BE,
+    GENSIO_SOUND_FMT_S24_BE,
+    GENSIO_SOUND_FMT_U24_BE,
+    GENSIO_SOUND_FMT_S16_BE,
+    GENSIO_SOUND_FMT_U16_BE,
+    GENSIO_SOUND_FMT_DOUBLE_ALT = GENSIO_SOUND_FMT_DOUBLE_BE,
+    GENSIO_SOUND_FMT_FLOAT_ALT = GENSIO_SOUND_FMT_FLOAT_BE,
+    GENSIO_SOUND_FMT_S32_ALT = GENSIO_SOUND_FMT_S32_BE,
+    GENSIO_SOUND_FMT_U32_ALT = GENSIO_SOUND_FMT_U32_BE,
+    GENSIO_SOUND_FMT_S24_ALT = GENSIO_SOUND_FMT_S24_BE,
+    GENSIO_SOUND_FMT_U24_ALT = GENSIO_SOUND_FMT_U24_BE,
+    GENSIO_SOUND_FMT_S16_ALT = GENSIO_SOUND_FMT_S16_BE,
+    GENSIO_SOUND_FMT_U16_ALT = GENSIO_SOUND_FMT_U16_BE,
+    GENSIO_SOUND_FMT_DOUBLE_LE = GENSIO_SOUND_FMT_DOUBLE,
+    GENSIO_SOUND_FMT_FLOAT_LE = GENSIO_SOUND_FMT_FLOAT,
+    GENSIO_SOUND_FMT_S32_LE = GENSIO_SOUND_FMT_S32,
+    GENSIO_SOUND_FMT_U32_LE = GENSIO_SOUND_FMT_U32,
+    GENSIO_SOUND_FMT_S24_LE = GENSIO_SOUND_FMT_S24,
+    GENSIO_SOUND_FMT_U24_LE = GENSIO_SOUND_FMT_U24,
+    GENSIO_SOUND_FMT_S16_LE = GENSIO_SOUND_FMT_S16,
+    GENSIO_SOUND_FMT_U16_LE = GENSIO_SOUND_FMT_U16,
+#endif
+
+    GENSIO_SOUND_FMT_COUNT
+};
+
+struct sound_format_names {
+    const char *name;
+    enum gensio_sound_fmt_type format;
+};
+
+/* Used to convert from a string to a format enum value. */
+static struct sound_format_names sound_format_names[] = {
+    { "float64",	GENSIO_SOUND_FMT_DOUBLE },
+    { "float",		GENSIO_SOUND_FMT_FLOAT },
+    { "s32",		GENSIO_SOUND_FMT_S32 },
+    { "s24",		GENSIO_SOUND_FMT_S24 },
+    { "s16",		GENSIO_SOUND_FMT_S16 },
+    { "s8",		GENSIO_SOUND_FMT_S8 },
+    { "u32",		GENSIO_SOUND_FMT_U32 },
+    { "u24",		GENSIO_SOUND_FMT_U24 },
+    { "u16",		GENSIO_SOUND_FMT_U16 },
+    { "u8",		GENSIO_SOUND_FMT_U8 },
+    { "float64_be",	GENSIO_SOUND_FMT_DOUBLE_BE },
+    { "float_be",	GENSIO_SOUND_FMT_FLOAT_BE },
+    { "int32_be",	GENSIO_SOUND_FMT_S32_BE },
+    { "int24_be",	GENSIO_SOUND_FMT_S24_BE },
+    { "int16_be",	GENSIO_SOUND_FMT_S16_BE },
+    { "u32_be",		GENSIO_SOUND_FMT_U32_BE },
+    { "u24_be",		GENSIO_SOUND_FMT_U24_BE },
+    { "u16_be",		GENSIO_SOUND_FMT_U16_BE },
+    { "float64_le",	GENSIO_SOUND_FMT_DOUBLE_LE },
+    { "float_le",	GENSIO_SOUND_FMT_FLOAT_LE },
+    { "int32_le",	GENSIO_SOUND_FMT_S32_LE },
+    { "int24_le",	GENSIO_SOUND_FMT_S24_LE },
+    { "int16_le",	GENSIO_SOUND_FMT_S16_LE },
+    { "u32_le",		GENSIO_SOUND_FMT_U32_LE },
+    { "u24_le",		GENSIO_SOUND_FMT_U24_LE },
+    { "u16_le",		GENSIO_SOUND_FMT_U16_LE },
+    { "FLOAT64",	GENSIO_SOUND_FMT_DOUBLE },
+    { "FLOAT",		GENSIO_SOUND_FMT_FLOAT },
+    { "S32",		GENSIO_SOUND_FMT_S32 },
+    { "S24",		GENSIO_SOUND_FMT_S24 },
+    { "S16",		GENSIO_SOUND_FMT_S16 },
+    { "S8",		GENSIO_SOUND_FMT_S8 },
+    { "U32",		GENSIO_SOUND_FMT_U32 },
+    { "U24",		GENSIO_SOUND_FMT_U24 },
+    { "U16",		GENSIO_SOUND_FMT_U16 },
+    { "U8",		GENSIO_SOUND_FMT_U8 },
+    { "FLOAT64_BE",	GENSIO_SOUND_FMT_DOUBLE_BE },
+    { "FLOAT_BE",	GENSIO_SOUND_FMT_FLOAT_BE },
+    { "INT32_BE",	GENSIO_SOUND_FMT_S32_BE },
+    { "INT24_BE",	GENSIO_SOUND_FMT_S24_BE },
+    { "INT16_BE",	GENSIO_SOUND_FMT_S16_BE },
+    { "U32_BE",		GENSIO_SOUND_FMT_U32_BE },
+    { "U24_BE",		GENSIO_SOUND_FMT_U24_BE },
+    { "U16_BE",		GENSIO_SOUND_FMT_U16_BE },
+    { "FLOAT64_LE",	GENSIO_SOUND_FMT_DOUBLE_LE },
+    { "FLOAT_LE",	GENSIO_SOUND_FMT_FLOAT_LE },
+    { "INT32_LE",	GENSIO_SOUND_FMT_S32_LE },
+    { "INT24_LE",	GENSIO_SOUND_FMT_S24_LE },
+    { "INT16_LE",	GENSIO_SOUND_FMT_S16_LE },
+    { "U32_LE",		GENSIO_SOUND_FMT_U32_LE },
+    { "U24_LE",		GENSIO_SOUND_FMT_U24_LE },
+    { "U16_LE",		GENSIO_SOUND_FMT_U16_LE },
+    {}
+};
+
+struct sound_fmt_info {
+    unsigned int size; /* Size, in bytes, of the sample. */
+    bool host_bswap; /* Is this byte-swapped with respect to the host? */
+    bool isfloat;
+    uint32_t offset; /* If unsigned, convert to signed by subtracting this. */
+    float scale; /* Scale between offset value and float. */
+};
+
+static struct sound_fmt_info sound_fmt_info[] = {
+    [ GENSIO_SOUND_FMT_DOUBLE_BE ]	= { .size = sizeof(double),
+					    .host_bswap = GENSIO_IS_LITTLE_ENDIAN,
+					    .isfloat = true },
+    [ GENSIO_SOUND_FMT_FLOAT_BE ]	= { .size = sizeof(float),
+					    .host_bswap = GENSIO_IS_LITTLE_ENDIAN,
+					    .isfloat = true },
+    [ GENSIO_SOUND_FMT_S32_BE ]		= { .size = 4,
+					    .host_bswap = GENSIO_IS_LITTLE_ENDIAN,
+					    .scale = 2147483648. },
+    [ GENSIO_SOUND_FMT_S24_BE ]		= { .size = 3,
+					    .host_bswap = GENSIO_IS_LITTLE_ENDIAN,
+					    .scale = 8388608. },
+    [ GENSIO_SOUND_FMT_S16_BE ]		= { .size = 2,
+					    .host_bswap = GENSIO_IS_LITTLE_ENDIAN,
+					    .scale = 32768. },
+    [ GENSIO_SOUND_FMT_U32_BE ]		= { .size = 4,
+					    .host_bswap = GENSIO_IS_LITTLE_ENDIAN,
+					    .offset = 2147483648,
+					    .scale = 2147483648. },
+    [ GENSIO_SOUND_FMT_U24_BE ]		= { .size = 3,
+					    .host_bswap = GENSIO_IS_LITTLE_ENDIAN,
+					    .offset = 8388608,
+					    .scale = 8388608. },
+    [ GENSIO_SOUND_FMT_U16_BE ]		= { .size = 2,
+					    .host_bswap = GENSIO_IS_LITTLE_ENDIAN,
+					    .offset = 32768,
+					    .scale = 32768. },
+    [ GENSIO_SOUND_FMT_S8 ]		= { .size = 1,
+					    .scale = 128. },
+    [ GENSIO_SOUND_FMT_U8 ]		= { .size = 1, .offset = 128,
+					    .scale = 128. },
+    [ GENSIO_SOUND_FMT_DOUBLE_LE ]	= { .size = sizeof(double),
+					    .host_bswap = GENSIO_IS_BIG_ENDIAN,
+					    .isfloat = true },
+    [ GENSIO_SOUND_FMT_FLOAT_LE ]	= { .size = sizeof(float),
+					    .host_bswap = GENSIO_IS_BIG_ENDIAN,
+					    .isfloat = true },
+    [ GENSIO_SOUND_FMT_S32_LE ]		= { .size = 4,
+					    .host_bswap = GENSIO_IS_BIG_ENDIAN,
+					    .scale = 2147483648. },
+    [ GENSIO_SOUND_FMT_S24_LE ]		= { .size = 3,
+					    .host_bswap = GENSIO_IS_BIG_ENDIAN,
+					    .scale = 8388608. },
+    [ GENSIO_SOUND_FMT_S16_LE ]		= { .size = 2,
+					    .host_bswap = GENSIO_IS_BIG_ENDIAN,
+					    .scale = 32768. },
+    [ GENSIO_SOUND_FMT_U32_LE ]		= { .size = 4,
+					    .host_bswap = GENSIO_IS_BIG_ENDIAN,
+					    .offset = 2147483648,
+					    .scale = 2147483648. },
+    [ GENSIO_SOUND_FMT_U24_LE ]		= { .size = 3,
+					    .host_bswap = GENSIO_IS_BIG_ENDIAN,
+					    .offset = 8388608,
+					    .scale = 8388608. },
+    [ GENSIO_SOUND_FMT_U16_LE ]		= { .size = 2,
+					    .host_bswap = GENSIO_IS_BIG_ENDIAN,
+					    .offset = 32768,
+					    .scale = 32768. }
+};
+
+static int32_t
+get_int24(const unsigned char **in, unsigned int offset, bool host_bswap)
+{
+    int32_t v = 0;
+    bool big_endian = GENSIO_IS_BIG_ENDIAN ? !host_bswap : host_bswap;
+
+    if (big_endian) {
+	v = *(*in)++ << 16;
+	v |= *(*in)++ << 8;
+	v |= *(*in)++;
+    } else {
+	v = *(*in)++;
+	v |= *(*in)++ << 8;
+	v |= *(*in)++ << 16;
+    }
+
+    /* If offset is zero, that means the value is signed. */
+    if ((v & 0x800000) && !offset)
+	v |= 0xff << 24;
+
+    return v;
+}
+
+static int32_t
+get_int(const unsigned char **in, unsigned int size,
+	unsigned int offset, bool host_bswap)
+{
+    int32_t v = 0;
+
+    switch(size) {
+    case 4:
+	v = *((int32_t *) *in);
+	if (host_bswap)
+	    v = gensio_bswap_32(v);
+	(*in) += 4;
+	break;
+
+    case 3:
+	v = get_int24(in, offset, host_bswap);
+	break;
+
+    case 2:
+	v = *((uint16_t *) *in);
+	if (host_bswap)
+	    v = gensio_bswap_16(v);
+	/* If offset is zero, that means the value is signed. */
+	if (!offset)
+	    v = (int16_t) v;
+	(*in) += 2;
+	break;
+
+    case 1:
+	if (offset)
+	    v = *((uint8_t *) *in);
+	else
+	    v = *((int8_t *) *in);
+	(*in) += 1;
+	break;
+
+    default:
+	assert(0);
+    }
+
+    v -= offset;
+
+    return v;
+}
+
+static void
+put_int24(int32_t v, unsigned char **out, bool host_bswap)
+{
+    bool big_endian = GENSIO_IS_BIG_ENDIAN ? !host_bswap : host_bswap;
+
+    if (big_endian) {
+	*(*out)++ = v >> 16;
+	*(*out)++ = v >> 8;
+	*(*out)++ = v;
+    } else {
+	*(*out)++ = v;
+	*(*out)++ = v >> 8;
+	*(*out)++ = v >> 16;
+    }
+}
+
+static void
+put_int(int32_t v,
+	unsigned char **out, unsigned int size,
+	unsigned int offset, bool host_bswap)
+{
+    v += offset;
+
+    switch(size) {
+    case 4:
+	if (host_bswap)
+	    v = gensio_bswap_32(v);
+	*((int32_t *) *out) = v;
+	(*out) += 4;
+	break;
+
+    case 3:
+	put_int24(v, out, host_bswap);
+	break;
+
+    case 2:
+	if (host_bswap)
+	    v = gensio_bswap_16(v);
+	*((int16_t *) *out) = v;
+	(*out) += 2;
+	break;
+
+    case 1:
+	*((int8_t *) *out) = v;
+	(*out) += 1;
+	break;
+
+    default:
+	assert(0);
+    }
+}
+
+static void
+put_float(double v, unsigned char **out,
+	  unsigned int size, bool host_bswap)
+{
+    const void *data = *out;
+
+    if (size == 4) {
+	*((float *) data) = v;
+	if (host_bswap) {
+	    int32_t *iv = ((int32_t *) data);
+	    *iv = gensio_bswap_32(*((int32_t *) data));
+	}
+    } else if (size == 8) {
+	*((double *) data) = v;
+	if (host_bswap) {
+	    int64_t *iv = ((int64_t *) data);
+	    *iv = gensio_bswap_64(*((int64_t *) data));
+	}
+    } else {
+	assert(0);
+    }
+    *out += size;
+}
+
+static double
+get_float(const unsigned char **in, unsigned int size, bool host_bswap)
+{
+    double v = 0;
+
+    if (size == 4) {
+	char d[4];
+
+	memcpy(d, *in, 4);
+	if (host_bswap) {
+	    int32_t iv;
+
+	    memcpy(&iv, d, 4);
+	    iv = gensio_bswap_32(iv);
+	    memcpy(d, &iv, 4);
+	}
+	v = *((float *) d);
+    } else if (size == 8) {
+	char d[8];
+
+	memcpy(d, *in, 8);
+	if (host_bswap) {
+	    int64_t iv;
+
+	    memcpy(&iv, d, 8);
+	    iv = gensio_bswap_64(iv);
+	    memcpy(d, &iv, 8);
+	}
+	v = *((double *) d);
+    } else {
+	assert(0);
+    }
+    *in += size;
+
+    return v;
+}
+
+/*
+ * Scale a -1.0 - 1.0 float to an integer, rounding to the nearest
+ * value (halves go up) and clipping to what the integer can hold.
+ * NaNs come out as the lowest value.
+ */
+static int32_t
+float_to_int(double v, double scale)
+{
+    double t = v * scale + .5;
+    int32_t i;
+
+    if (t >= scale)
+	return scale - 1;
+    if (!(t >= -scale))
+	return -scale;
+    i = t;
+    if (i > t)
+	i--;
+    return i;
+}
+
+/*
+ * Scale an integer of one size to another, keeping the top bits.
+ */
+static int32_t
+int_to_int(int32_t v, unsigned int from_size, unsigned int to_size)
+{
+    if (to_size > from_size)
+	return (int32_t) ((uint32_t) v << ((to_size - from_size) * 8));
+    return v >> ((from_size - to_size) * 8);
+}
+
+/*
+ * This is used to convert between the user format and the format used
+ * by the pcm side.
+ */
+struct sound_cnv_info {
+    bool enabled;
+    /* PCM format.  Will be UNKNOWN if not set by user. */
+    enum gensio_sound_fmt_type pfmt;
+    enum gensio_sound_fmt_type ufmt;
+    gensiods pframesize; /* Size of a frame on the PCM side, in bytes. */
+    unsigned int usize; /* Sample size (in bytes) on the user side */
+    unsigned int psize; /* Sample size on the PCM side, in bytes */
+
+    /* Above values are always set.  Values below are only set if enabled. */
+
+    bool host_bswap;
+    uint32_t offset; /* Subtract/add this from/to the pcm/user to convert. */
+    float scale_in; /* Multiply by this to scale to -1.0 - 1.0 float, before offset. */
+    float scale_out; /* Multiply by this to scale from -1.0 - 1.0 float, after offset. */
+    void (*convin)(const unsigned char **in, unsigned char **out,
+		   struct sound_cnv_info *info);
+    void (*convout)(const unsigned char **in, unsigned char **out,
+		    struct sound_cnv_info *info);
+
+    /*
+     * Convert nsamples samples in one go.  These are picked for the
+     * formats at setup time, for the common formats they are done with
+     * vectors, otherwise they just call convin/convout for each sample.
+     */
+    void (*convin_buf)(const unsigned char *in, unsigned char *out,
+		       gensiods nsamples, struct sound_cnv_info *info);
+    void (*convout_buf)(const unsigned char *in, unsigned char *out,
+			gensiods nsamples, struct sound_cnv_info *info);
+    unsigned char *buf; /* PCM buffer(s) */
+};
+
+static void
+conv_int_to_float_in(const unsigned char **in, unsigned char **out,
+		     struct sound_cnv_info *info)
+{
+    double v = get_int(in, info->psize, info->offset, info->host_bswap);
+
+    v *= info->scale_in;
+
+    put_float(v, out, info->usize, false);
+}
+
+static void
+conv_float_to_int_out(const unsigned char **in, unsigned char **out,
+		      struct sound_cnv_info *info)
+{
+    double v = get_float(in, info->usize, false);
+
+    put_int(float_to_int(v, info->scale_out), out, info->psize, info->offset,
+	    info->host_bswap);
+}
+
+static void
+conv_float_to_int_in(const unsigned char **in, unsigned char **out,
+		     struct sound_cnv_info *info)
+{
+    double v = get_float(in, info->psize, info->host_bswap);
+
+    put_int(float_to_int(v, info->scale_in), out, info->usize, 0, false);
+}
+
+static void
+conv_int_to_float_out(const unsigned char **in, unsigned char **out,
+		      struct sound_cnv_info *info)
+{
+    double v = get_int(in, info->usize, 0, false);
+
+    v *= info->scale_out;
+
+    put_float(v, out, info->psize, info->host_bswap);
+}
+
+static void
+conv_int_to_int_in(const unsigned char **in, unsigned char **out,
+		   struct sound_cnv_info *info)
+{
+    int32_t v = get_int(in, info->psize, info->offset, info->host_bswap);
+
+    v = int_to_int(v, info->psize, info->usize);
+    put_int(v, out, info->usize, 0, false);
+}
+
+static void
+conv_int_to_int_out(const unsigned char **in, unsigned char **out,
+		   struct sound_cnv_info *info)
+{
+    int32_t v = get_int(in, info->usize, 0, false);
+
+    v = int_to_int(v, info->usize, info->psize);
+    put_int(v, out, info->psize, info->offset, info->host_bswap);
+}
+
+static void
+conv_float_to_float_in(const unsigned char **in, unsigned char **out,
+		       struct sound_cnv_info *info)
+{
+    double v = get_float(in, info->psize, info->host_bswap);
+
+    put_float(v, out, info->usize, false);
+}
+
+static void
+conv_float_to_float_out(const unsigned char **in, unsigned char **out,
+			struct sound_cnv_info *info)
+{
+    double v = get_float(in, info->usize, false);
+
+    put_float(v, out, info->psize, info->host_bswap);
+}
+
+static void
+conv_buf_in(const unsigned char *in, unsigned char *out, gensiods nsamples,
+	    struct sound_cnv_info *info)
+{
+    while (nsamples-- > 0)
+	info->convin(&in, &out, info);
+}
+
+static void
+conv_buf_out(const unsigned char *in, unsigned char *out, gensiods nsamples,
+	     struct sound_cnv_info *info)
+{
+    while (nsamples-- > 0)
+	info->convout(&in, &out, info);
+}
+
+/*
+ * Whole buffer conversions for the common formats, done with GCC
+ * vector extensions so they turn into whatever the CPU has (SSE2,
+ * NEON, etc.).  Each does as many whole vectors as it can and leaves
+ * the rest to the per-sample conversion, and gives exactly the same
+ * answers as the per-sample conversion.  The user side is always in
+ * host order.  The buffers may not be aligned, so everything goes
+ * through memcpy.
+ */
+#define SOUND_CNV_VLANES 4
+typedef uint16_t sound_cnv_vu16 __attribute__ ((vector_size (8)));
+typedef int16_t sound_cnv_vs16 __attribute__ ((vector_size (8)));
+typedef uint32_t sound_cnv_vu32 __attribute__ ((vector_size (16)));
+typedef int32_t sound_cnv_vs32 __attribute__ ((vector_size (16)));
+typedef float sound_cnv_vf __attribute__ ((vector_size (16)));
+typedef double sound_cnv_vd __attribute__ ((vector_size (32)));
+
+/*
+ * The vectors are passed by pointer, passing vectors bigger than the
+ * CPU's by value changes the ABI and gets a warning.
+ */
+static inline void
+sound_cnv_bswap16(sound_cnv_vu16 *v)
+{
+    *v = (*v << 8) | (*v >> 8);
+}
+
+static inline void
+sound_cnv_bswap32(sound_cnv_vu32 *v)
+{
+    *v = ((*v << 24) | ((*v & 0xff00) << 8) | ((*v >> 8) & 0xff00) |
+	  (*v >> 24));
+}
+
+/*
+ * The vector version of float_to_int(), for scale up to 2^31, max is
+ * scale - 1.  This is done in single precision, adding .5 in single
+ * precision would round wrong for big values, so it rounds toward
+ * zero and then fixes it up from the fraction that was dropped, which
+ * is exact.  The compares give -1 for true, so they work as masks.
+ */
+static inline void
+sound_cnv_float_to_int(const sound_cnv_vf *v, float scale, int32_t max,
+		       sound_cnv_vs32 *r)
+{
+    sound_cnv_vf x = *v * scale, frac;
+    sound_cnv_vs32 hi, lo, i;
+
+    hi = x >= scale - .5f;
+    lo = ~(x >= -scale); /* NaNs end up here */
+    x = (sound_cnv_vf) ((sound_cnv_vs32) x & ~(hi | lo));
+    i = __builtin_convertvector(x, sound_cnv_vs32);
+    frac = x - __builtin_convertvector(i, sound_cnv_vf);
+    i += frac < -.5f;
+    i -= frac >= .5f;
+    *r = (i & ~(hi | lo)) | (max & hi) | ((-max - 1) & lo);
+}
+
+static void
+conv_s16_to_float_in_buf(const unsigned char *in, unsigned char *out,
+			 gensiods nsamples, struct sound_cnv_info *info)
+{
+    sound_cnv_vu16 u;
+    sound_cnv_vf f;
+    gensiods i;
+
+    for (i = 0; i + SOUND_CNV_VLANES <= nsamples; i += SOUND_CNV_VLANES) {
+	memcpy(&u, in, sizeof(u));
+	if (info->host_bswap)
+	    sound_cnv_bswap16(&u);
+	f = __builtin_convertvector(__builtin_convertvector((sound_cnv_vs16) u,
+							   sound_cnv_vs32),
+				    sound_cnv_vf);
+	f *= info->scale_in;
+	memcpy(out, &f, sizeof(f));
+	in += sizeof(u);
+	out += sizeof(f);
+    }
+    conv_buf_in(in, out, nsamples - i, info);
+}
+
+static void
+conv_float_to_s16_out_buf(const unsigned char *in, unsigned char *out,
+			  gensiods nsamples, struct sound_cnv_info *info)
+{
+    sound_cnv_vu16 u;
+    sound_cnv_vs32 v;
+    sound_cnv_vf f;
+    gensiods i;
+
+    for (i = 0; i + SOUND_CNV_VLANES <= nsamples; i += SOUND_CNV_VLANES) {
+	memcpy(&f, in, sizeof(f));
+	sound_cnv_float_to_int(&f, info->scale_out, INT16_MAX, &v);
+	u = (sound_cnv_vu16) __builtin_convertvector(v, sound_cnv_vs16);
+	if (info->host_bswap)
+	    sound_cnv_bswap16(&u);
+	memcpy(out, &u, sizeof(u));
+	in += sizeof(f);
+	out += sizeof(u);
+    }
+    conv_buf_out(in, out, nsamples - i, info);
+}
+
+static void
+conv_s32_to_float_in_buf(const unsigned char *in, unsigned char *out,
+			 gensiods nsamples, struct sound_cnv_info *info)
+{
+    sound_cnv_vu32 u;
+    sound_cnv_vf f;
+    gensiods i;
+
+    for (i = 0; i + SOUND_CNV_VLANES <= nsamples; i += SOUND_CNV_VLANES) {
+	memcpy(&u, in, sizeof(u));
+	if (info->host_bswap)
+	    sound_cnv_bswap32(&u);
+	/* Scaling by a power of two, so this rounds like the double math. */
+	f = __builtin_convertvector((sound_cnv_vs32) u, sound_cnv_vf);
+	f *= info->scale_in;
+	memcpy(out, &f, sizeof(f));
+	in += sizeof(u);
+	out += sizeof(f);
+    }
+    conv_buf_in(in, out, nsamples - i, info);
+}
+
+static void
+conv_float_to_s32_out_buf(const unsigned char *in, unsigned char *out,
+			  gensiods nsamples, struct sound_cnv_info *info)
+{
+    sound_cnv_vu32 u;
+    sound_cnv_vs32 v;
+    sound_cnv_vf f;
+    gensiods i;
+
+    for (i = 0; i + SOUND_CNV_VLANES <= nsamples; i += SOUND_CNV_VLANES) {
+	memcpy(&f, in, sizeof(f));
+	sound_cnv_float_to_int(&f, info->scale_out, INT32_MAX, &v);
+	u = (sound_cnv_vu32) v;
+	if (info->host_bswap)
+	    sound_cnv_bswap32(&u);
+	memcpy(out, &u, sizeof(u));
+	in += sizeof(f);
+	out += sizeof(u);
+    }
+    conv_buf_out(in, out, nsamples - i, info);
+}
+
+/* These return the number of samples done, the caller does the rest. */
+static inline gensiods
+sound_cnv_double_to_float(const unsigned char *in, unsigned char *out,
+			  gensiods nsamples)
+{
+    sound_cnv_vd d;
+    sound_cnv_vf f;
+    gensiods i;
+
+    for (i = 0; i + SOUND_CNV_VLANES <= nsamples; i += SOUND_CNV_VLANES) {
+	memcpy(&d, in + i * sizeof(double), sizeof(d));
+	f = __builtin_convertvector(d, sound_cnv_vf);
+	memcpy(out + i * sizeof(float), &f, sizeof(f));
+    }
+    return i;
+}
+
+static inline gensiods
+sound_cnv_float_to_double(const unsigned char *in, unsigned char *out,
+			  gensiods nsamples)
+{
+    sound_cnv_vd d;
+    sound_cnv_vf f;
+    gensiods i;
+
+    for (i = 0; i + SOUND_CNV_VLANES <= nsamples; i += SOUND_CNV_VLANES) {
+	memcpy(&f, in + i * sizeof(float), sizeof(f));
+	d = __builtin_convertvector(f, sound_cnv_vd);
+	memcpy(out + i * sizeof(double), &d, sizeof(d));
+    }
+    return i;
+}
+
+static inline gensiods
+sound_cnv_float_bswap(const unsigned char *in, unsigned char *out,
+		      gensiods nsamples)
+{
+    sound_cnv_vu32 u;
+    gensiods i;
+
+    for (i = 0; i + SOUND_CNV_VLANES <= nsamples; i += SOUND_CNV_VLANES) {
+	memcpy(&u, in + i * sizeof(float), sizeof(u));
+	sound_cnv_bswap32(&u);
+	memcpy(out + i * sizeof(float), &u, sizeof(u));
+    }
+    return i;
+}
+
+static void
+conv_double_to_float_in_buf(const unsigned char *in, unsigned char *out,
+			    gensiods nsamples, struct sound_cnv_info *info)
+{
+    gensiods i = sound_cnv_double_to_float(in, out, nsamples);
+
+    conv_buf_in(in + i * sizeof(double), out + i * sizeof(float),
+		nsamples - i, info);
+}
+
+static void
+conv_float_to_double_out_buf(const unsigned char *in, unsigned char *out,
+			     gensiods nsamples, struct sound_cnv_info *info)
+{
+    gensiods i = sound_cnv_float_to_double(in, out, nsamples);
+
+    conv_buf_out(in + i * sizeof(float), out + i * sizeof(double),
+		 nsamples - i, info);
+}
+
+static void
+conv_float_to_double_in_buf(const unsigned char *in, unsigned char *out,
+			    gensiods nsamples, struct sound_cnv_info *info)
+{
+    gensiods i = sound_cnv_float_to_double(in, out, nsamples);
+
+    conv_buf_in(in + i * sizeof(float), out + i * sizeof(double),
+		nsamples - i, info);
+}
+
+static void
+conv_double_to_float_out_buf(const unsigned char *in, unsigned char *out,
+			     gensiods nsamples, struct sound_cnv_info *info)
+{
+    gensiods i = sound_cnv_double_to_float(in, out, nsamples);
+
+    conv_buf_out(in + i * sizeof(double), out + i * sizeof(float),
+		 nsamples - i, info);
+}
+
+static void
+conv_float_bswap_in_buf(const unsigned char *in, unsigned char *out,
+			gensiods nsamples, struct sound_cnv_info *info)
+{
+    gensiods i = sound_cnv_float_bswap(in, out, nsamples);
+
+    conv_buf_in(in + i * sizeof(float), out + i * sizeof(float),
+		nsamples - i, info);
+}
+
+static void
+conv_float_bswap_out_buf(const unsigned char *in, unsigned char *out,
+			 gensiods nsamples, struct sound_cnv_info *info)
+{
+    gensiods i = sound_cnv_float_bswap(in, out, nsamples);
+
+    conv_buf_out(in + i * sizeof(float), out + i * sizeof(float),
+		 nsamples - i, info);
+}
+
+/*
+ * Set up info to convert between info->ufmt and pfmt.  This fills in
+ * everything but pframesize and enabled.
+ */
+static void
+sound_cnv_setup(struct sound_cnv_info *info, enum gensio_sound_fmt_type pfmt)
+{
+    enum gensio_sound_fmt_type ufmt = info->ufmt;
+    struct sound_fmt_info *uinfo, *pinfo;
+
+    info->pfmt = pfmt;
+
+    uinfo = &sound_fmt_info[ufmt];
+    pinfo = &sound_fmt_info[pfmt];
+
+    info->usize = uinfo->size;
+    info->psize = pinfo->size;
+    info->offset = pinfo->offset;
+    info->host_bswap = pinfo->host_bswap;
+
+    if (pinfo->isfloat && uinfo->isfloat) {
+	info->convin = conv_float_to_float_in;
+	info->convout = conv_float_to_float_out;
+    } else if (pinfo->isfloat) {
+	info->scale_in = uinfo->scale;
+	info->scale_out = 1 / uinfo->scale;
+	info->convin = conv_float_to_int_in;
+	info->convout = conv_int_to_float_out;
+    } else if (uinfo->isfloat) {
+	info->scale_in = 1 / pinfo->scale;
+	info->scale_out = pinfo->scale;
+	info->convin = conv_int_to_float_in;
+	info->convout = conv_float_to_int_out;
+    } else {
+	info->convin = conv_int_to_int_in;
+	info->convout = conv_int_to_int_out;
+    }
+
+    info->convin_buf = conv_buf_in;
+    info->convout_buf = conv_buf_out;
+    if (ufmt == GENSIO_SOUND_FMT_FLOAT) {
+	if (!pinfo->isfloat && !pinfo->offset && pinfo->size == 2) {
+	    info->convin_buf = conv_s16_to_float_in_buf;
+	    info->convout_buf = conv_float_to_s16_out_buf;
+	} else if (!pinfo->isfloat && !pinfo->offset && pinfo->size == 4) {
+	    info->convin_buf = conv_s32_to_float_in_buf;
+	    info->convout_buf = conv_float_to_s32_out_buf;
+	} else if (pinfo->isfloat && pinfo->size == 8 && !pinfo->host_bswap) {
+	    info->convin_buf = conv_double_to_float_in_buf;
+	    info->convout_buf = conv_float_to_double_out_buf;
+	} else if (pinfo->isfloat && pinfo->size == 4 && pinfo->host_bswap) {
+	    info->convin_buf = conv_float_bswap_in_buf;
+	    info->convout_buf = conv_float_bswap_out_buf;
+	}
+    } else if (ufmt == GENSIO_SOUND_FMT_DOUBLE) {
+	if (pinfo->isfloat && pinfo->size == 4 && !pinfo->host_bswap) {
+	    info->convin_buf = conv_float_to_double_in_buf;
+	    info->convout_buf = conv_double_to_float_out_buf;
+	}
+    }
+}
+
+/* Returns GENSIO_SOUND_FMT_UNKNOWN if not found. */
+static enum gensio_sound_fmt_type
+sound_fmt_lookup(const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; sound_format_names[i].name; i++) {
+	if (strcmp(sound_format_names[i].name, name) == 0)
+	    return sound_format_names[i].format;
+    }
+    return GENSIO_SOUND_FMT_UNKNOWN;
+}
+
+#endif /* GENSIO_SOUND_CONV_H */
@@ -41,14 +41,9 @@ gensio_sound_file_api_next_read(struct sound_info *si)
 	return;
     }
 
-    if (si->cnv.enabled) {
-	const unsigned char *ibuf = si->cnv.buf;
-	unsigned char *obuf = si->buf;
-	gensiods i;
-
-	for (i = 0; i < si->bufsize * si->chans; i++)
-	    si->cnv.convin(&ibuf, &obuf, &si->cnv);
-    }
+    if (si->cnv.enabled)
+	si->cnv.convin_buf(si->cnv.buf, si->buf, si->bufsize * si->chans,
+			   &si->cnv);
     si->len = si->bufsize;
     si->ready = true;
 }
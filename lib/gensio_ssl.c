@@ -25,6 +25,7 @@
 #include <gensio/gensio_class.h>
 #include <gensio/gensio_err.h>
 #include <gensio/gensio_time.h>
+#include <gensio/gensio_list.h>
 
 #ifdef _WIN32
 /* On Windows you can use / or \. */
@@ -33,6 +34,9 @@
 #define DIRSEPS "/"
 #endif
 
+/* The most an SSL record adds to the data it carries. */
+#define SSL_RECORD_OVERHEAD 128
+
 struct gensio_ssl_filter_data {
     struct gensio_os_funcs *o;
     bool is_client;
@@ -41,25 +45,143 @@ struct gensio_ssl_filter_data {
     char *certfile;
     gensiods max_read_size;
     gensiods max_write_size;
+    unsigned int coalesce;
     bool allow_authfail;
     bool clientauth;
+    bool resume;
+    bool tickets;
+    unsigned int session_cache;
 
     /* Amount of time in which the connection process must complete. */
     gensio_time con_timeout;
 };
 
+/*
+ * Process-wide cache of client sessions, so a client that connects to
+ * the same place again can resume its session instead of doing a full
+ * handshake.  Sessions are keyed by the CA, certificate and key files
+ * and the remote address of the child.  When it fills up the least
+ * recently used session is dropped.
+ */
+#define GSSL_CLIENT_CACHE_MAX 256
+
+struct gssl_sess_entry {
+    struct gensio_link link;
+    char *key;
+    SSL_SESSION *sess;
+};
+
+static struct gensio_os_funcs *sess_o;
+static struct gensio_lock *sess_lock;
+static struct gensio_list sess_list;
+static unsigned int sess_count;
+static unsigned long sess_hits, sess_misses;
+
+static struct gensio_once gensio_ssl_init_once;
+
+static void
+gssl_sess_entry_free(struct gssl_sess_entry *e)
+{
+    SSL_SESSION_free(e->sess);
+    sess_o->free(sess_o, e->key);
+    sess_o->free(sess_o, e);
+}
+
+static void
+gssl_cleanup_mem(void)
+{
+    struct gensio_link *l, *l2;
+
+    gensio_list_for_each_safe(&sess_list, l, l2) {
+	struct gssl_sess_entry *e = gensio_container_of(l,
+							struct gssl_sess_entry,
+							link);
+
+	gensio_list_rm(&sess_list, l);
+	gssl_sess_entry_free(e);
+    }
+    sess_count = 0;
+    sess_hits = 0;
+    sess_misses = 0;
+    sess_o->free_lock(sess_lock);
+    sess_lock = NULL;
+    sess_o->free_funcs(sess_o);
+    sess_o = NULL;
+    memset(&gensio_ssl_init_once, 0, sizeof(gensio_ssl_init_once));
+}
+
+static struct gensio_class_cleanup gssl_class_cleanup = {
+    .cleanup = gssl_cleanup_mem
+};
+
 static void
 gensio_do_ssl_init(void *cb_data)
 {
+    struct gensio_os_funcs *o = cb_data;
+
     SSL_library_init();
-}
 
-static struct gensio_once gensio_ssl_init_once;
+    /* Without the lock there is no client cache, not fatal. */
+    gensio_list_init(&sess_list);
+    sess_lock = o->alloc_lock(o);
+    if (sess_lock) {
+	sess_o = o->get_funcs(o);
+	gensio_register_class_cleanup(&gssl_class_cleanup);
+    }
+}
 
 static void
 gensio_ssl_initialize(struct gensio_os_funcs *o)
 {
-    o->call_once(o, &gensio_ssl_init_once, gensio_do_ssl_init, NULL);
+    o->call_once(o, &gensio_ssl_init_once, gensio_do_ssl_init, o);
+}
+
+/*
+ * An SSL_CTX shared by all the connections from an accepter so they
+ * share the server session cache and ticket keys, with the counts of
+ * resumed and full handshakes.
+ */
+struct gssl_shared_ctx {
+    struct gensio_os_funcs *o;
+    struct gensio_lock *lock;
+    unsigned int refcount;
+    SSL_CTX *ctx;
+    unsigned long hits;
+    unsigned long misses;
+};
+
+static void
+gssl_shared_ctx_ref(struct gssl_shared_ctx *shared)
+{
+    shared->o->lock(shared->lock);
+    shared->refcount++;
+    shared->o->unlock(shared->lock);
+}
+
+static void
+gssl_shared_ctx_get_stats(struct gssl_shared_ctx *shared,
+			  unsigned long *hits, unsigned long *misses)
+{
+    shared->o->lock(shared->lock);
+    *hits = shared->hits;
+    *misses = shared->misses;
+    shared->o->unlock(shared->lock);
+}
+
+static void
+gssl_shared_ctx_deref(struct gssl_shared_ctx *shared)
+{
+    struct gensio_os_funcs *o = shared->o;
+    unsigned int count;
+
+    o->lock(shared->lock);
+    count = --shared->refcount;
+    o->unlock(shared->lock);
+    if (count == 0) {
+	SSL_CTX_free(shared->ctx);
+	o->free_lock(shared->lock);
+	o->free(o, shared);
+    }
 }
 
 struct ssl_filter {
@@ -101,17 +223,25 @@ struct ssl_filter {
     /*
      * This is data from the user waiting to be sent to SSL_write().  This
      * is required because if SSL_write() return that it needs I/O, it must
-     * be called again with exactly the same data.
+     * be called again with exactly the same data.  When nothing is
+     * pending the user's buffer is passed to SSL_write() directly and
+     * only copied here if that happens, so the SSL needs
+     * SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER.
      */
     unsigned char *write_data;
     gensiods max_write_size;
     gensiods write_data_len;
 
-    /* This is data from BIO_read() waiting to be sent to the lower layer. */
+    /*
+     * This is data from BIO_read() waiting to be sent to the lower layer.
+     * It holds up to coalesce records so a big user write goes down
+     * to the lower layer in one write instead of one per record.
+     */
     unsigned char *xmit_buf;
     gensiods xmit_buf_pos;
     gensiods xmit_buf_len;
     gensiods max_xmit_buf;
+    unsigned int coalesce;
 
     /*
      * SSL has asked for something.
@@ -125,6 +255,21 @@ struct ssl_filter {
      * and consistency with certauth.
      */
     char *username;
+
+    /* The gensio this filter is in, from setup. */
+    struct gensio *io;
+
+    /*
+     * Session resumption.  On a client sess_prefix is the file part
+     * of the cache key and sess_key is the whole key, set when the
+     * connection starts if the child has a remote address.  On a
+     * server shared is the accepter's context if there is one.
+     */
+    bool resume;
+    bool reused;
+    char *sess_prefix;
+    char *sess_key;
+    struct gssl_shared_ctx *shared;
 };
 
 #define filter_to_ssl(v) ((struct ssl_filter *) gensio_filter_get_user_data(v))
@@ -270,6 +415,131 @@ ssl_verify_cb(int preverify_ok, X509_STORE_CTX *x509_ctx)
     return 1;
 }
 
+static struct gssl_sess_entry *
+gssl_sess_find(const char *key)
+{
+    struct gensio_link *l;
+
+    gensio_list_for_each(&sess_list, l) {
+	struct gssl_sess_entry *e = gensio_container_of(l,
+							struct gssl_sess_entry,
+							link);
+
+	if (strcmp(e->key, key) == 0)
+	    return e;
+    }
+    return NULL;
+}
+
+/*
+ * Called by OpenSSL when a client gets a session it can resume later.
+ * With TLS 1.3 that's after the handshake, when a ticket comes in.
+ * Returns 1 if it kept the reference to sess.
+ */
+static int
+gssl_new_session(SSL *ssl, SSL_SESSION *sess)
+{
+    struct ssl_filter *sfilter = SSL_get_app_data(ssl);
+    struct gssl_sess_entry *e;
+    int rv = 0;
+
+    if (!sfilter || !sfilter->sess_key || !sess_lock)
+	return 0;
+
+    sess_o->lock(sess_lock);
+    e = gssl_sess_find(sfilter->sess_key);
+    if (e) {
+	SSL_SESSION_free(e->sess);
+	e->sess = sess;
+	gensio_list_rm(&sess_list, &e->link);
+	gensio_list_add_head(&sess_list, &e->link);
+	rv = 1;
+	goto out_unlock;
+    }
+
+    e = sess_o->zalloc(sess_o, sizeof(*e));
+    if (!e)
+	goto out_unlock;
+    e->key = gensio_strdup(sess_o, sfilter->sess_key);
+    if (!e->key) {
+	sess_o->free(sess_o, e);
+	goto out_unlock;
+    }
+    e->sess = sess;
+    gensio_list_add_head(&sess_list, &e->link);
+    if (++sess_count > GSSL_CLIENT_CACHE_MAX) {
+	struct gensio_link *l = gensio_list_last(&sess_list);
+
+	gensio_list_rm(&sess_list, l);
+	gssl_sess_entry_free(gensio_container_of(l, struct gssl_sess_entry,
+						 link));
+	sess_count--;
+    }
+    rv = 1;
+ out_unlock:
+    sess_o->unlock(sess_lock);
+    return rv;
+}
+
+/*
+ * Build the cache key from the child's remote address and offer a
+ * cached session for it, if there is one.  Children without a remote
+ * address don't get sessions cached.
+ */
+static void
+gssl_client_set_session(struct ssl_filter *sfilter)
+{
+    struct gensio *child = gensio_get_child(sfilter->io, 1);
+    struct gssl_sess_entry *e;
+    char raddr[200];
+    gensiods len = sizeof(raddr);
+
+    /* Don't skip verification against a CA the user gave us. */
+    if (!child || !sess_lock || sfilter->verify_store)
+	return;
+    strcpy(raddr, "0");
+    if (gensio_control(child, GENSIO_CONTROL_DEPTH_FIRST, GENSIO_CONTROL_GET,
+		       GENSIO_CONTROL_RADDR, raddr, &len))
+	return;
+
+    sfilter->sess_key = gensio_alloc_sprintf(sfilter->o, "%s,%s",
+					     sfilter->sess_prefix, raddr);
+    if (!sfilter->sess_key)
+	return;
+
+    sess_o->lock(sess_lock);
+    e = gssl_sess_find(sfilter->sess_key);
+    if (e) {
+	SSL_set_session(sfilter->ssl, e->sess);
+	gensio_list_rm(&sess_list, &e->link);
+	gensio_list_add_head(&sess_list, &e->link);
+    }
+    sess_o->unlock(sess_lock);
+}
+
+static void
+gssl_count_resume(struct ssl_filter *sfilter)
+{
+    struct gssl_shared_ctx *shared = sfilter->shared;
+
+    sfilter->reused = SSL_session_reused(sfilter->ssl);
+    if (shared) {
+	shared->o->lock(shared->lock);
+	if (sfilter->reused)
+	    shared->hits++;
+	else
+	    shared->misses++;
+	shared->o->unlock(shared->lock);
+    } else if (sfilter->sess_key) {
+	sess_o->lock(sess_lock);
+	if (sfilter->reused)
+	    sess_hits++;
+	else
+	    sess_misses++;
+	sess_o->unlock(sess_lock);
+    }
+}
+
 static int
 ssl_check_open_done(struct gensio_filter *filter, struct gensio *io)
 {
@@ -279,6 +549,8 @@ ssl_check_open_done(struct gensio_filter *filter, struct gensio *io)
     const char *auxdata[] = { NULL, NULL };
 
     ssl_lock(sfilter);
+    if (sfilter->resume)
+	gssl_count_resume(sfilter);
     if (sfilter->expect_peer_cert) {
 	sfilter->remcert = SSL_get_peer_certificate(sfilter->ssl);
 	if (!sfilter->remcert) {
@@ -516,7 +788,9 @@ ssl_ul_write(struct gensio_filter *filter,
 {
     struct ssl_filter *sfilter = filter_to_ssl(filter);
     int err = 0;
-    gensiods i;
+    gensiods i, nbufs = 0;
+    const unsigned char *direct = NULL;
+    gensiods direct_len = 0;
 
     ssl_lock(sfilter);
     if (sfilter->err) {
@@ -541,6 +815,27 @@ ssl_ul_write(struct gensio_filter *filter,
 	if (rcount)
 	    *rcount = 0;
     } else {
+	for (i = 0; i < sglen; i++) {
+	    if (isg[i].buflen) {
+		direct = isg[i].buf;
+		direct_len = isg[i].buflen;
+		nbufs++;
+	    }
+	}
+	if (nbufs == 1 && sfilter->xmit_buf_len == 0) {
+	    /*
+	     * The usual case, one buffer and nothing waiting to go out.
+	     * Encrypt straight from the user's buffer, it only needs to
+	     * be copied if SSL_write() has to be retried.  Take up to
+	     * coalesce records worth, see below.
+	     */
+	    if (direct_len > sfilter->max_write_size * sfilter->coalesce)
+		direct_len = sfilter->max_write_size * sfilter->coalesce;
+	    if (rcount)
+		*rcount = direct_len;
+	    goto restart;
+	}
+	direct = NULL;
 	for (i = 0; i < sglen; i++) {
 	    gensiods buflen = isg[i].buflen;
 
@@ -571,7 +866,62 @@ ssl_ul_write(struct gensio_filter *filter,
 	}
     }
 
-    if (!err && sfilter->xmit_buf_len == 0 && sfilter->write_data_len > 0) {
+    if (!err && sfilter->xmit_buf_len == 0 && direct) {
+	gensiods done = 0, len;
+	int rv, rdlen;
+
+	/*
+	 * Write the data a record at a time, pulling each record out of
+	 * the BIO into xmit_buf behind the previous one, so they all go
+	 * to the lower layer in one write.  Stop early if the BIO didn't
+	 * give everything up or there's no room for another record, the
+	 * user just gets a smaller count.
+	 */
+	sfilter->want_read = false;
+	sfilter->want_write = false;
+	while (done < direct_len) {
+	    len = direct_len - done;
+	    if (len > sfilter->max_write_size)
+		len = sfilter->max_write_size;
+	    rv = SSL_write(sfilter->ssl, direct + done, len);
+	    if (rv <= 0) {
+		err = ssl_handle_err(sfilter, rv, "SSL write");
+		if (!err) {
+		    /* SSL_write() has to be retried, keep the data. */
+		    memcpy(sfilter->write_data, direct + done, len);
+		    sfilter->write_data_len = len;
+		    done += len;
+		}
+		break;
+	    }
+	    assert((gensiods) rv == len);
+	    done += len;
+
+	    rdlen = BIO_read(sfilter->io_bio,
+			     sfilter->xmit_buf + sfilter->xmit_buf_len,
+			     sfilter->max_xmit_buf - sfilter->xmit_buf_len);
+	    if (rdlen <= 0) {
+		if (!BIO_should_retry(sfilter->io_bio)) {
+		    gssl_log_err(sfilter, "Failed BIO read");
+		    err = GE_COMMERR;
+		}
+		break;
+	    }
+	    sfilter->xmit_buf_len += rdlen;
+	    if (BIO_pending(sfilter->io_bio) > 0 ||
+		    (sfilter->max_xmit_buf - sfilter->xmit_buf_len <
+		     sfilter->max_write_size + SSL_RECORD_OVERHEAD))
+		break;
+	}
+	if (!err && rcount)
+	    *rcount = done;
+	direct = NULL;
+	if (!err && sfilter->xmit_buf_len) {
+	    sfilter->xmit_buf_pos = 0;
+	    goto restart;
+	}
+    } else if (!err && sfilter->xmit_buf_len == 0 &&
+	       sfilter->write_data_len > 0) {
 	sfilter->want_read = false;
 	sfilter->want_write = false;
 	err = SSL_write(sfilter->ssl, sfilter->write_data,
@@ -739,6 +1089,9 @@ ssl_setup(struct gensio_filter *filter, struct gensio *io)
     sfilter->ssl = SSL_new(sfilter->ctx);
     if (!sfilter->ssl)
 	return GE_NOMEM;
+    SSL_set_mode(sfilter->ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    SSL_set_app_data(sfilter->ssl, sfilter);
+    sfilter->io = io;
 
     /* The BIO has to be large enough to hold a full SSL key transaction. */
     if (bio_size < 4096)
@@ -753,10 +1106,13 @@ ssl_setup(struct gensio_filter *filter, struct gensio *io)
 
     SSL_set_bio(sfilter->ssl, sfilter->ssl_bio, sfilter->ssl_bio);
 
-    if (sfilter->is_client)
+    if (sfilter->is_client) {
 	SSL_set_connect_state(sfilter->ssl);
-    else
+	if (sfilter->resume)
+	    gssl_client_set_session(sfilter);
+    } else {
 	SSL_set_accept_state(sfilter->ssl);
+    }
 
     return 0;
 }
@@ -788,6 +1144,10 @@ ssl_cleanup(struct gensio_filter *filter)
     sfilter->write_data_len = 0;
     sfilter->connected = false;
     sfilter->shutdown_success = false;
+    sfilter->reused = false;
+    if (sfilter->sess_key)
+	sfilter->o->free(sfilter->o, sfilter->sess_key);
+    sfilter->sess_key = NULL;
 }
 
 static void
@@ -802,8 +1162,14 @@ sfilter_free(struct ssl_filter *sfilter)
     if (sfilter->io_bio)
 	/* Just free one BIO to free both parts of the pair. */
 	BIO_free(sfilter->io_bio);
-    if (sfilter->ctx)
+    if (sfilter->shared)
+	gssl_shared_ctx_deref(sfilter->shared);
+    else if (sfilter->ctx)
 	SSL_CTX_free(sfilter->ctx);
+    if (sfilter->sess_prefix)
+	sfilter->o->free(sfilter->o, sfilter->sess_prefix);
+    if (sfilter->sess_key)
+	sfilter->o->free(sfilter->o, sfilter->sess_key);
     if (sfilter->lock)
 	sfilter->o->free_lock(sfilter->lock);
     if (sfilter->read_data) {
@@ -1023,6 +1389,30 @@ ssl_filter_control(struct gensio_filter *filter, bool get, int op, char *data,
 			    (unsigned long) sfilter->max_write_size);
 	return 0;
 
+    case GENSIO_CONTROL_SESSION_REUSED:
+	if (!get)
+	    return GE_NOTSUP;
+	*datalen = snprintf(data, *datalen, "%d", sfilter->reused);
+	return 0;
+
+    case GENSIO_CONTROL_SESSION_STATS: {
+	unsigned long hits = 0, misses = 0;
+
+	/* Handshakes are only counted with resume on. */
+	if (!get || !sfilter->resume)
+	    return GE_NOTSUP;
+	if (sfilter->shared) {
+	    gssl_shared_ctx_get_stats(sfilter->shared, &hits, &misses);
+	} else if (sfilter->is_client && sess_lock) {
+	    sess_o->lock(sess_lock);
+	    hits = sess_hits;
+	    misses = sess_misses;
+	    sess_o->unlock(sess_lock);
+	}
+	*datalen = snprintf(data, *datalen, "%lu %lu", hits, misses);
+	return 0;
+    }
+
     default:
 	return GE_NOTSUP;
     }
@@ -1093,10 +1483,16 @@ static int gensio_ssl_filter_func(struct gensio_filter *filter, int op,
 #define X509_STORE_CTX_get0_chain(ctx) ((ctx)->chain)
 #endif
 
+/*
+ * The SSL_CTX may be shared between connections, so the filter comes
+ * from the SSL, not cb_data.
+ */
 static int
 gensio_ssl_cert_verify(X509_STORE_CTX *ctx, void *cb_data)
 {
-    struct ssl_filter *sfilter = cb_data;
+    int ssl_ex_idx = SSL_get_ex_data_X509_STORE_CTX_idx();
+    SSL *s = X509_STORE_CTX_get_ex_data(ctx, ssl_ex_idx);
+    struct ssl_filter *sfilter = SSL_get_app_data(s);
     X509_STORE_CTX *nctx = NULL;
     X509 *cert = X509_STORE_CTX_get0_cert(ctx);
     int rv;
@@ -1116,8 +1512,6 @@ gensio_ssl_cert_verify(X509_STORE_CTX *ctx, void *cb_data)
 
     if (sfilter->verify_store) {
 	STACK_OF(X509) *cert_chain = X509_STORE_CTX_get0_chain(ctx);
-	int ssl_ex_idx = SSL_get_ex_data_X509_STORE_CTX_idx();
-	SSL *s = X509_STORE_CTX_get_ex_data(ctx, ssl_ex_idx);
 	X509_VERIFY_PARAM *param;
 
 	rv = -1;
@@ -1165,6 +1559,7 @@ gensio_ssl_filter_raw_alloc(struct gensio_os_funcs *o,
 			    bool allow_authfail,
 			    gensiods max_read_size,
 			    gensiods max_write_size,
+			    unsigned int coalesce,
 			    gensio_time con_timeout)
 {
     struct ssl_filter *sfilter;
@@ -1177,12 +1572,11 @@ gensio_ssl_filter_raw_alloc(struct gensio_os_funcs *o,
     sfilter->is_client = is_client;
     sfilter->max_write_size = max_write_size;
     sfilter->max_read_size = max_read_size;
+    sfilter->coalesce = coalesce;
     sfilter->expect_peer_cert = expect_peer_cert;
     sfilter->allow_authfail = allow_authfail;
     sfilter->con_timeout = con_timeout;
 
-    SSL_CTX_set_cert_verify_callback(ctx, gensio_ssl_cert_verify, sfilter);
-
     sfilter->lock = o->alloc_lock(o);
     if (!sfilter->lock)
 	goto out_nomem;
@@ -1195,7 +1589,8 @@ gensio_ssl_filter_raw_alloc(struct gensio_os_funcs *o,
     if (!sfilter->write_data)
 	goto out_nomem;
 
-    sfilter->max_xmit_buf = sfilter->max_write_size + 128;
+    sfilter->max_xmit_buf = ((sfilter->max_write_size + SSL_RECORD_OVERHEAD)
+			     * sfilter->coalesce);
     if (sfilter->max_xmit_buf < 1024)
 	sfilter->max_xmit_buf = 1024; /* Enough room for the protocol. */
     sfilter->xmit_buf = o->zalloc(o, sfilter->max_xmit_buf);
@@ -1239,6 +1634,9 @@ gensio_ssl_filter_config(struct gensio_pparm_info *p,
     data->is_client = default_is_client;
     data->max_write_size = SSL3_RT_MAX_PLAIN_LENGTH;
     data->max_read_size = SSL3_RT_MAX_PLAIN_LENGTH;
+    data->coalesce = 4;
+    data->tickets = true;
+    data->session_cache = 1024;
 
     rv = gensio_get_default(o, "ssl", "allow-authfail", false,
 			    GENSIO_DEFAULT_BOOL, NULL, &ival);
@@ -1250,6 +1648,11 @@ gensio_ssl_filter_config(struct gensio_pparm_info *p,
     if (rv)
 	return rv;
     data->clientauth = ival;
+    rv = gensio_get_default(o, "ssl", "resume", false,
+			    GENSIO_DEFAULT_BOOL, NULL, &ival);
+    if (rv)
+	return rv;
+    data->resume = ival;
 
     rv = gensio_get_default(o, "ssl", "mode", false,
 			    GENSIO_DEFAULT_STR, &str, NULL);
@@ -1302,6 +1705,8 @@ gensio_ssl_filter_config(struct gensio_pparm_info *p,
 	    continue;
 	if (gensio_pparm_ds(p, args[i], "writebuf", &data->max_write_size) > 0)
 	    continue;
+	if (gensio_pparm_uint(p, args[i], "coalesce", &data->coalesce) > 0)
+	    continue;
 	if (gensio_pparm_boolv(p, args[i], "mode", "client", "server",
 				  &data->is_client) > 0)
 	    continue;
@@ -1311,6 +1716,13 @@ gensio_ssl_filter_config(struct gensio_pparm_info *p,
 	if (gensio_pparm_bool(p, args[i], "clientauth",
 				 &data->clientauth) > 0)
 	    continue;
+	if (gensio_pparm_bool(p, args[i], "resume", &data->resume) > 0)
+	    continue;
+	if (gensio_pparm_bool(p, args[i], "tickets", &data->tickets) > 0)
+	    continue;
+	if (gensio_pparm_uint(p, args[i], "session-cache",
+			      &data->session_cache) > 0)
+	    continue;
 	if (gensio_pparm_time(p, args[i], "con-timeout", 's',
 			      &data->con_timeout) > 0)
 	    continue;
@@ -1321,6 +1733,19 @@ gensio_ssl_filter_config(struct gensio_pparm_info *p,
 	goto out_err;
     }
 
+    if (data->coalesce < 1 || data->coalesce > 64) {
+	gensio_pparm_slog(p, "coalesce must be from 1 to 64");
+	rv = GE_INVAL;
+	goto out_err;
+    }
+
+    /*
+     * A resumed session skips certificate verification, so a server
+     * that checks client certificates always does a full handshake.
+     */
+    if (!data->is_client && data->clientauth)
+	data->resume = false;
+
     if (!data->keyfile) {
 	rv = gensio_get_default(o, "ssl", "key", false, GENSIO_DEFAULT_STR,
 				&data->keyfile, NULL);
@@ -1389,28 +1814,21 @@ gensio_ssl_filter_config_free(struct gensio_ssl_filter_data *data)
 }
 
 static int
-gensio_ssl_filter_alloc(struct gensio_ssl_filter_data *data,
-			struct gensio_filter **rfilter)
+gensio_ssl_ctx_alloc(struct gensio_ssl_filter_data *data, SSL_CTX **rctx)
 {
-    struct gensio_os_funcs *o = data->o;
     SSL_CTX *ctx = NULL;
-    struct gensio_filter *filter;
-    bool expect_peer_cert;
     int rv = GE_INVAL;
 
-    gensio_ssl_initialize(o);
+    gensio_ssl_initialize(data->o);
 
-    if (data->is_client) {
-	expect_peer_cert = true;
+    if (data->is_client)
 	ctx = SSL_CTX_new(SSLv23_client_method());
-    } else {
-	expect_peer_cert = data->clientauth;
+    else
 	ctx = SSL_CTX_new(SSLv23_server_method());
-    }
     if (!ctx)
 	return GE_NOMEM;
 
-    if (!data->is_client && expect_peer_cert)
+    if (!data->is_client && data->clientauth)
 	/*
 	 * In server mode, the certificate will not be requested unless
 	 * mode is SSL_VERIFY_PEER.  But in that mode, it terminates
@@ -1421,6 +1839,34 @@ gensio_ssl_filter_alloc(struct gensio_ssl_filter_data *data,
 	 * or fails.  We will do that in the check open call.
 	 */
 	SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, ssl_verify_cb);
+    SSL_CTX_set_cert_verify_callback(ctx, gensio_ssl_cert_verify, NULL);
+
+    if (data->is_client) {
+	if (data->resume) {
+	    /* We keep the sessions, see gssl_new_session(). */
+	    SSL_CTX_set_session_cache_mode(ctx, (SSL_SESS_CACHE_CLIENT |
+					SSL_SESS_CACHE_NO_INTERNAL_STORE));
+	    SSL_CTX_sess_set_new_cb(ctx, gssl_new_session);
+	}
+    } else if (data->resume) {
+	SSL_CTX_set_session_id_context(ctx, (const unsigned char *) "gensio",
+				       6);
+	if (data->session_cache) {
+	    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+	    SSL_CTX_sess_set_cache_size(ctx, data->session_cache);
+	} else {
+	    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+	}
+	if (!data->tickets)
+	    SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+    } else {
+	/* Nothing could use them, don't bother. */
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+	SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	SSL_CTX_set_num_tickets(ctx, 0);
+#endif
+    }
 
     if (data->CAfilepath && data->CAfilepath[0]) {
 	char *CAfile = NULL, *CApath = NULL;
@@ -1454,24 +1900,99 @@ gensio_ssl_filter_alloc(struct gensio_ssl_filter_data *data,
 	}
     }
 
+    *rctx = ctx;
+    return 0;
+
+ err:
+    SSL_CTX_free(ctx);
+    return rv;
+}
+
+static int
+gssl_shared_ctx_alloc(struct gensio_ssl_filter_data *data,
+		      struct gssl_shared_ctx **rshared)
+{
+    struct gensio_os_funcs *o = data->o;
+    struct gssl_shared_ctx *shared;
+    int rv;
+
+    shared = o->zalloc(o, sizeof(*shared));
+    if (!shared)
+	return GE_NOMEM;
+    shared->o = o;
+    shared->refcount = 1;
+    shared->lock = o->alloc_lock(o);
+    if (!shared->lock) {
+	o->free(o, shared);
+	return GE_NOMEM;
+    }
+    rv = gensio_ssl_ctx_alloc(data, &shared->ctx);
+    if (rv) {
+	o->free_lock(shared->lock);
+	o->free(o, shared);
+	return rv;
+    }
+    *rshared = shared;
+    return 0;
+}
+
+/*
+ * Allocate a filter.  If shared is set, the filter uses its SSL_CTX
+ * and takes a reference to it, otherwise it gets its own SSL_CTX.
+ */
+static int
+gensio_ssl_filter_alloc(struct gensio_ssl_filter_data *data,
+			struct gssl_shared_ctx *shared,
+			struct gensio_filter **rfilter)
+{
+    struct gensio_os_funcs *o = data->o;
+    SSL_CTX *ctx = NULL;
+    struct gensio_filter *filter;
+    struct ssl_filter *sfilter;
+    bool expect_peer_cert = data->is_client || data->clientauth;
+    int rv;
+
+    if (shared) {
+	ctx = shared->ctx;
+    } else {
+	rv = gensio_ssl_ctx_alloc(data, &ctx);
+	if (rv)
+	    return rv;
+    }
+
     filter = gensio_ssl_filter_raw_alloc(o, data->is_client, ctx,
 					 expect_peer_cert,
 					 data->allow_authfail,
 					 data->max_read_size,
 					 data->max_write_size,
+					 data->coalesce,
 					 data->con_timeout);
     if (!filter) {
-	rv = GE_NOMEM;
-	goto err;
+	if (!shared)
+	    SSL_CTX_free(ctx);
+	return GE_NOMEM;
     }
 
+    sfilter = filter_to_ssl(filter);
+    if (shared) {
+	/* Freeing the filter now drops the reference, not the SSL_CTX. */
+	gssl_shared_ctx_ref(shared);
+	sfilter->shared = shared;
+    }
+    sfilter->resume = data->resume;
+    if (data->is_client && data->resume) {
+	sfilter->sess_prefix = gensio_alloc_sprintf(o, "%s,%s,%s",
+				data->CAfilepath ? data->CAfilepath : "",
+				data->certfile ? data->certfile : "",
+				data->keyfile ? data->keyfile : "");
+	if (!sfilter->sess_prefix) {
+	    gensio_filter_free(filter);
+	    return GE_NOMEM;
+	}
+    }
 
     *rfilter = filter;
     return 0;
-
- err:
-    SSL_CTX_free(ctx);
-    return rv;
 }
 
 static int
@@ -1502,7 +2023,7 @@ ssl_gensio_alloc2(struct gensio *child, const char *const args[],
     if (err)
 	goto out_err;
 
-    err = gensio_ssl_filter_alloc(data, &filter);
+    err = gensio_ssl_filter_alloc(data, NULL, &filter);
     gensio_ssl_filter_config_free(data);
     if (err)
 	goto out_err;
@@ -1577,6 +2098,13 @@ struct sslna_data {
     struct gensio_accepter *acc;
     struct gensio_ssl_filter_data *data;
     struct gensio_os_funcs *o;
+    struct gensio_lock *lock;
+
+    /*
+     * With resume, all the connections use this so they can resume
+     * each other's sessions.  Allocated with the first connection.
+     */
+    struct gssl_shared_ctx *shared;
 };
 
 static void
@@ -1584,6 +2112,10 @@ sslna_free(void *acc_data)
 {
     struct sslna_data *nadata = acc_data;
 
+    if (nadata->shared)
+	gssl_shared_ctx_deref(nadata->shared);
+    if (nadata->lock)
+	nadata->o->free_lock(nadata->lock);
     gensio_ssl_filter_config_free(nadata->data);
     nadata->o->free(nadata->o, nadata);
 }
@@ -1607,8 +2139,42 @@ sslna_new_child(void *acc_data, void **finish_data,
 		struct gensio_filter **filter)
 {
     struct sslna_data *nadata = acc_data;
+    int rv = 0;
+
+    if (!nadata->data->resume)
+	return gensio_ssl_filter_alloc(nadata->data, NULL, filter);
+
+    nadata->o->lock(nadata->lock);
+    if (!nadata->shared)
+	rv = gssl_shared_ctx_alloc(nadata->data, &nadata->shared);
+    if (!rv)
+	rv = gensio_ssl_filter_alloc(nadata->data, nadata->shared, filter);
+    nadata->o->unlock(nadata->lock);
 
-    return gensio_ssl_filter_alloc(nadata->data, filter);
+    return rv;
+}
+
+static int
+sslna_control(struct sslna_data *nadata, bool get, unsigned int option,
+	      char *data, gensiods *datalen)
+{
+    unsigned long hits = 0, misses = 0;
+
+    switch (option) {
+    case GENSIO_ACC_CONTROL_SESSION_STATS:
+	/* Handshakes are only counted with resume on. */
+	if (!get || !nadata->data->resume)
+	    return GE_NOTSUP;
+	nadata->o->lock(nadata->lock);
+	if (nadata->shared)
+	    gssl_shared_ctx_get_stats(nadata->shared, &hits, &misses);
+	nadata->o->unlock(nadata->lock);
+	*datalen = snprintf(data, *datalen, "%lu %lu", hits, misses);
+	return 0;
+
+    default:
+	return GE_NOTSUP;
+    }
 }
 
 static int
@@ -1660,6 +2226,10 @@ gensio_gensio_acc_ssl_cb(void *acc_data, int op, void *data1, void *data2,
     case GENSIO_GENSIO_ACC_FINISH_PARENT:
 	return sslna_finish_parent(acc_data, data1, data2);
 
+    case GENSIO_GENSIO_ACC_CONTROL:
+	return sslna_control(acc_data, *((bool *) data1),
+			     *((unsigned int *) data4), data2, data3);
+
     case GENSIO_GENSIO_ACC_FREE:
 	sslna_free(acc_data);
 	return 0;
@@ -1701,6 +2271,9 @@ ssl_gensio_accepter_alloc(struct gensio_accepter *child,
     }
 
     nadata->o = o;
+    nadata->lock = o->alloc_lock(o);
+    if (!nadata->lock)
+	goto out_nomem;
 
     err = gensio_gensio_accepter_alloc(child, o, "ssl", cb, user_data,
 				       gensio_gensio_acc_ssl_cb, nadata,
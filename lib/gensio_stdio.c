@@ -1023,6 +1023,7 @@ stdion_control(struct gensio *io, bool get, unsigned int option,
 	return 0;
 
     case GENSIO_CONTROL_IOD:
+    case GENSIO_CONTROL_RAW_IOD:
 	if (!get)
 	    return GE_NOTSUP;
 	if (*datalen != sizeof(void *))
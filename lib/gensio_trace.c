@@ -17,6 +17,32 @@
 #include <gensio/gensio_ll_gensio.h>
 #include <gensio/gensio_acc_gensio.h>
 #include <gensio/argvutils.h>
+#include <gensio/gensio_atomics.h>
+#include <gensio/gensio_trace.h>
+
+/*
+ * Binary tracing hands records to a writer thread through a ring.
+ * The ring uses atomics on its own memory, so it needs real atomics;
+ * without them (or without threads) binary records are written
+ * directly.
+ */
+#if GENSIO_HAS_STDC_ATOMICS || GENSIO_HAS_GCC_ATOMICS
+#define TRACE_HAVE_RING 1
+#else
+#define TRACE_HAVE_RING 0
+#endif
+
+#define TRACE_DEFAULT_RINGSIZE	(1 << 20)
+#define TRACE_MIN_RINGSIZE	4096
+#define TRACE_MAX_RINGSIZE	(1 << 30)
+
+/*
+ * Each ring entry starts with an 8 byte prefix: a commit word holding
+ * the entry size (zero until the entry is complete) and the length of
+ * the file record that follows.  Entries are 8 byte aligned so the
+ * prefix never wraps.
+ */
+#define TRACE_RING_PREFIX	8
 
 enum trace_dir {
     DIR_NONE,
@@ -40,8 +66,34 @@ struct trace_filter {
     bool tr_stdout;
     bool tr_stderr;
     const char *modeflag;
+    bool binary;
 
     FILE *tr;
+
+#if TRACE_HAVE_RING
+    /*
+     * Producers reserve space by moving head, fill in the entry, then
+     * set its commit word.  The writer thread consumes committed
+     * entries at tail, clears them, and moves tail.  Positions are
+     * free running, ringsize is a power of two.
+     */
+    gensio_atomic_uint *ring;
+    unsigned int ringsize;
+    gensio_atomic_uint head;
+    gensio_atomic_uint tail;
+    gensio_atomic_uint dropped;
+    gensio_atomic_uint waiting;
+    gensio_atomic_uint shutdown;
+    struct gensio_norun_waiter *waiter;
+    struct gensio_thread *thread;
+#endif
+};
+
+static const char *trace_op_str[] = {
+    [GENSIO_TRACE_OP_READ] = "Read",
+    [GENSIO_TRACE_OP_WRITE] = "Write",
+    [GENSIO_TRACE_OP_B4READ] = "b4Read",
+    [GENSIO_TRACE_OP_B4WRITE] = "b4Write",
 };
 
 #define filter_to_trace(v) ((struct trace_filter *) \
@@ -83,10 +135,233 @@ trace_check_open_done(struct gensio_filter *filter, struct gensio *io)
     return 0;
 }
 
+static void
+trace_bin_hdr(unsigned char *hdr, unsigned int op, int err, gensiods len,
+	      gensio_time *time)
+{
+    uint64_t secs = time->secs;
+    unsigned int i;
+
+    memset(hdr, 0, GENSIO_TRACE_HDR_SIZE);
+    for (i = 0; i < 4; i++) {
+	hdr[i] = len >> (i * 8);
+	hdr[16 + i] = ((uint32_t) time->nsecs) >> (i * 8);
+	hdr[20 + i] = ((uint32_t) err) >> (i * 8);
+    }
+    hdr[4] = op;
+    for (i = 0; i < 8; i++)
+	hdr[8 + i] = secs >> (i * 8);
+}
+
+#if TRACE_HAVE_RING
+static void
+trace_ring_put(struct trace_filter *tfilter, unsigned int pos,
+	       const unsigned char *data, unsigned int len)
+{
+    unsigned char *r = (unsigned char *) tfilter->ring;
+    unsigned int off = pos & (tfilter->ringsize - 1);
+    unsigned int n = tfilter->ringsize - off;
+
+    if (n > len)
+	n = len;
+    memcpy(r + off, data, n);
+    if (n < len)
+	memcpy(r, data + n, len - n);
+}
+
+/*
+ * Copy a record into the ring.  This never blocks, if there is no
+ * room the record is counted as dropped and the writer thread notes
+ * that in the trace.
+ */
+static void
+trace_ring_add(struct trace_filter *tfilter, const unsigned char *hdr,
+	       gensiods written, const struct gensio_sg *sg, gensiods sglen)
+{
+    unsigned int need, h, t, pos, one = 1;
+    gensio_atomic_uint *commit;
+    gensiods i, len;
+
+    if (written > tfilter->ringsize)
+	goto out_drop;
+    need = (TRACE_RING_PREFIX + GENSIO_TRACE_HDR_SIZE + written + 7) & ~7;
+    if (need > tfilter->ringsize)
+	goto out_drop;
+
+    h = gensio_atomic_get_mo(&tfilter->head, gensio_mo_relaxed);
+    do {
+	t = gensio_atomic_get_mo(&tfilter->tail, gensio_mo_acquire);
+	if (need > tfilter->ringsize - (h - t))
+	    goto out_drop;
+    } while (!gensio_atomic_cas_mo(&tfilter->head, &h, h + need,
+				   gensio_mo_relaxed, gensio_mo_relaxed));
+
+    pos = h + TRACE_RING_PREFIX;
+    trace_ring_put(tfilter, pos, hdr, GENSIO_TRACE_HDR_SIZE);
+    pos += GENSIO_TRACE_HDR_SIZE;
+    for (i = 0; i < sglen && written > 0; i++, written -= len, pos += len) {
+	if (sg[i].buflen > written)
+	    len = written;
+	else
+	    len = sg[i].buflen;
+	trace_ring_put(tfilter, pos, sg[i].buf, len);
+    }
+
+    commit = &tfilter->ring[(h & (tfilter->ringsize - 1))
+			    / sizeof(*tfilter->ring)];
+    gensio_atomic_set_mo(commit + 1, pos - h - TRACE_RING_PREFIX,
+			 gensio_mo_relaxed);
+    gensio_atomic_set(commit, need);
+
+    if (gensio_atomic_cas(&tfilter->waiting, &one, 0))
+	gensio_os_norun_waiter_wake(tfilter->waiter);
+    return;
+
+ out_drop:
+    gensio_atomic_add_mo(&tfilter->dropped, 1, gensio_mo_relaxed);
+}
+
+static void
+trace_ring_write(struct trace_filter *tfilter, unsigned int pos,
+		 unsigned int len, bool clear)
+{
+    unsigned char *r = (unsigned char *) tfilter->ring;
+    unsigned int off = pos & (tfilter->ringsize - 1);
+    unsigned int n = tfilter->ringsize - off;
+
+    if (n > len)
+	n = len;
+    if (clear) {
+	memset(r + off, 0, n);
+	memset(r, 0, len - n);
+    } else {
+	fwrite(r + off, 1, n, tfilter->tr);
+	fwrite(r, 1, len - n, tfilter->tr);
+    }
+}
+
+static void
+trace_ring_thread(void *data)
+{
+    struct trace_filter *tfilter = data;
+    struct gensio_os_funcs *o = tfilter->o;
+    unsigned char hdr[GENSIO_TRACE_HDR_SIZE];
+    unsigned int t, need, len, dropped, one = 1;
+    gensio_atomic_uint *commit;
+    gensio_time time;
+
+    t = gensio_atomic_get(&tfilter->tail);
+    for (;;) {
+	dropped = gensio_atomic_get_mo(&tfilter->dropped, gensio_mo_relaxed);
+	if (dropped) {
+	    gensio_atomic_sub_mo(&tfilter->dropped, dropped, gensio_mo_relaxed);
+	    o->get_monotonic_time(o, &time);
+	    trace_bin_hdr(hdr, GENSIO_TRACE_OP_DROPPED, dropped, 0, &time);
+	    fwrite(hdr, 1, sizeof(hdr), tfilter->tr);
+	}
+
+	commit = &tfilter->ring[(t & (tfilter->ringsize - 1))
+				/ sizeof(*tfilter->ring)];
+	need = gensio_atomic_get(commit);
+	if (need == 0) {
+	    /* Caught up, this is the only place the output is flushed. */
+	    fflush(tfilter->tr);
+	    gensio_atomic_set(&tfilter->waiting, 1);
+	    if (gensio_atomic_get(commit) == 0 &&
+			!gensio_atomic_get(&tfilter->shutdown)) {
+		gensio_os_norun_waiter_wait(tfilter->waiter);
+	    } else if (!gensio_atomic_cas(&tfilter->waiting, &one, 0)) {
+		/* Someone took the waiting flag, eat their wakeup. */
+		gensio_os_norun_waiter_wait(tfilter->waiter);
+	    }
+	    if (gensio_atomic_get(commit) == 0 &&
+			gensio_atomic_get(&tfilter->shutdown) &&
+			!gensio_atomic_get(&tfilter->dropped))
+		break;
+	    continue;
+	}
+
+	len = gensio_atomic_get_mo(commit + 1, gensio_mo_relaxed);
+	trace_ring_write(tfilter, t + TRACE_RING_PREFIX, len, false);
+	trace_ring_write(tfilter, t, need, true);
+	t += need;
+	gensio_atomic_set_mo(&tfilter->tail, t, gensio_mo_release);
+    }
+}
+
+static int
+trace_ring_start(struct trace_filter *tfilter)
+{
+    struct gensio_os_funcs *o = tfilter->o;
+    int err;
+
+    gensio_atomic_set(&tfilter->shutdown, 0);
+    gensio_atomic_set(&tfilter->waiting, 0);
+    err = gensio_os_new_thread(o, trace_ring_thread, tfilter,
+			       &tfilter->thread);
+    if (err == GE_NOTSUP)
+	/* No threads, write directly. */
+	err = 0;
+    return err;
+}
+
+static void
+trace_ring_stop(struct trace_filter *tfilter)
+{
+    unsigned int one = 1;
+
+    if (!tfilter->thread)
+	return;
+    gensio_atomic_set(&tfilter->shutdown, 1);
+    if (gensio_atomic_cas(&tfilter->waiting, &one, 0))
+	gensio_os_norun_waiter_wake(tfilter->waiter);
+    gensio_os_wait_thread(tfilter->thread);
+    tfilter->thread = NULL;
+}
+#endif
+
+static void
+trace_bin_data(unsigned int op, struct trace_filter *tfilter,
+	       int err, gensiods written,
+	       const struct gensio_sg *sg, gensiods sglen)
+{
+    unsigned char hdr[GENSIO_TRACE_HDR_SIZE];
+    struct gensio_os_funcs *o = tfilter->o;
+    gensio_time time;
+    gensiods i, len;
+
+    if (err)
+	written = 0;
+    else if (written == 0)
+	return;
+
+    o->get_monotonic_time(o, &time);
+    trace_bin_hdr(hdr, op, err, written, &time);
+
+#if TRACE_HAVE_RING
+    if (tfilter->thread) {
+	trace_ring_add(tfilter, hdr, written, sg, sglen);
+	return;
+    }
+#endif
+
+    trace_lock(tfilter);
+    fwrite(hdr, 1, sizeof(hdr), tfilter->tr);
+    for (i = 0; i < sglen && written > 0; i++, written -= len) {
+	if (sg[i].buflen > written)
+	    len = written;
+	else
+	    len = sg[i].buflen;
+	fwrite(sg[i].buf, 1, len, tfilter->tr);
+    }
+    trace_unlock(tfilter);
+}
+
 static int
 trace_try_connect(struct gensio_filter *filter, gensio_time *timeout)
 {
     struct trace_filter *tfilter = filter_to_trace(filter);
+    long pos;
 
     if (tfilter->tr_stdout) {
 	tfilter->tr = stdout;
@@ -97,6 +372,18 @@ trace_try_connect(struct gensio_filter *filter, gensio_time *timeout)
 	if (!tfilter->tr)
 	    return GE_PERM;
     }
+
+    if (tfilter->binary && tfilter->tr) {
+	/* Only put the magic at the start of the file. */
+	fseek(tfilter->tr, 0, SEEK_END);
+	pos = ftell(tfilter->tr);
+	if (pos <= 0)
+	    fwrite(GENSIO_TRACE_MAGIC, 1, GENSIO_TRACE_MAGIC_LEN, tfilter->tr);
+#if TRACE_HAVE_RING
+	if (tfilter->ring)
+	    return trace_ring_start(tfilter);
+#endif
+    }
     return 0;
 }
 
@@ -107,7 +394,7 @@ trace_try_disconnect(struct gensio_filter *filter, gensio_time *timeout)
 }
 
 static void
-trace_data(const char *op, struct trace_filter *tfilter,
+trace_data(unsigned int opnum, struct trace_filter *tfilter,
 	   int err, gensiods written,
 	   const struct gensio_sg *sg, gensiods sglen)
 {
@@ -116,10 +403,16 @@ trace_data(const char *op, struct trace_filter *tfilter,
     struct gensio_os_funcs *o = tfilter->o;
     FILE *f = tfilter->tr;
     bool raw = tfilter->raw;
+    const char *op = trace_op_str[opnum];
 
     if (!f)
 	return;
 
+    if (tfilter->binary) {
+	trace_bin_data(opnum, tfilter, err, written, sg, sglen);
+	return;
+    }
+
     trace_lock(tfilter);
     o->get_monotonic_time(o, &time);
     if (err) {
@@ -169,7 +462,7 @@ trace_ul_write(struct gensio_filter *filter,
 
 	for (i = 0; i < sglen; i++)
 	    count += sg[i].buflen;
-	trace_data("b4Write", tfilter, err, count, sg, sglen);
+	trace_data(GENSIO_TRACE_OP_B4WRITE, tfilter, err, count, sg, sglen);
     }
 
     if (tfilter->block == DIR_WRITE || tfilter->block == DIR_BOTH) {
@@ -185,7 +478,7 @@ trace_ul_write(struct gensio_filter *filter,
 
     err = handler(cb_data, &count, sg, sglen, auxdata);
     if (tfilter->dir == DIR_WRITE || tfilter->dir == DIR_BOTH)
-	trace_data("Write", tfilter, err, count, sg, sglen);
+	trace_data(GENSIO_TRACE_OP_WRITE, tfilter, err, count, sg, sglen);
     if (!err && rcount)
 	*rcount = count;
 
@@ -206,7 +499,7 @@ trace_ll_write(struct gensio_filter *filter,
     if (tfilter->b4dir == DIR_READ || tfilter->b4dir == DIR_BOTH) {
 	struct gensio_sg sg = {buf, buflen};
 
-	trace_data("b4Read", tfilter, err, buflen, &sg, 1);
+	trace_data(GENSIO_TRACE_OP_B4READ, tfilter, err, buflen, &sg, 1);
     }
 
     if (tfilter->block == DIR_READ || tfilter->block == DIR_BOTH) {
@@ -219,7 +512,7 @@ trace_ll_write(struct gensio_filter *filter,
     if (tfilter->dir == DIR_READ || tfilter->dir == DIR_BOTH) {
 	struct gensio_sg sg = {buf, buflen};
 
-	trace_data("Read", tfilter, err, count, &sg, 1);
+	trace_data(GENSIO_TRACE_OP_READ, tfilter, err, count, &sg, 1);
     }
     if (!err && rcount)
 	*rcount = count;
@@ -238,14 +531,30 @@ trace_filter_cleanup(struct gensio_filter *filter)
 {
     struct trace_filter *tfilter = filter_to_trace(filter);
 
+#if TRACE_HAVE_RING
+    trace_ring_stop(tfilter);
+#endif
     if (!tfilter->tr_stdout && !tfilter->tr_stderr && tfilter->tr)
 	fclose(tfilter->tr);
+    else if (tfilter->tr)
+	fflush(tfilter->tr);
     tfilter->tr = NULL;
 }
 
 static void
 tfilter_free(struct trace_filter *tfilter)
 {
+#if TRACE_HAVE_RING
+    if (tfilter->waiter)
+	gensio_os_free_norun_waiter(tfilter->waiter);
+    if (tfilter->ring)
+	tfilter->o->free(tfilter->o, tfilter->ring);
+    gensio_atomic_cleanup(&tfilter->head);
+    gensio_atomic_cleanup(&tfilter->tail);
+    gensio_atomic_cleanup(&tfilter->dropped);
+    gensio_atomic_cleanup(&tfilter->waiting);
+    gensio_atomic_cleanup(&tfilter->shutdown);
+#endif
     if (tfilter->lock)
 	tfilter->o->free_lock(tfilter->lock);
     if (tfilter->filter)
@@ -320,7 +629,8 @@ static struct gensio_filter *
 gensio_trace_filter_raw_alloc(struct gensio_os_funcs *o, enum trace_dir dir,
 			      enum trace_dir b4dir, enum trace_dir block,
 			      bool raw, const char *filename, bool tr_stdout,
-			      bool tr_stderr, const char *modeflag)
+			      bool tr_stderr, const char *modeflag,
+			      bool binary, gensiods ringsize)
 {
     struct trace_filter *tfilter;
 
@@ -344,11 +654,41 @@ gensio_trace_filter_raw_alloc(struct gensio_os_funcs *o, enum trace_dir dir,
     tfilter->tr_stdout = tr_stdout;
     tfilter->tr_stderr = tr_stderr;
     tfilter->modeflag = modeflag;
+    tfilter->binary = binary;
 
     tfilter->lock = o->alloc_lock(o);
     if (!tfilter->lock)
 	goto out_nomem;
 
+#if TRACE_HAVE_RING
+    if (binary && (filename || tr_stdout || tr_stderr)) {
+	unsigned int size = TRACE_MIN_RINGSIZE;
+
+	while (size < ringsize && size < TRACE_MAX_RINGSIZE)
+	    size <<= 1;
+	tfilter->ringsize = size;
+	tfilter->ring = o->zalloc(o, size);
+	if (!tfilter->ring)
+	    goto out_nomem;
+	tfilter->waiter = gensio_os_alloc_norun_waiter(o);
+	if (!tfilter->waiter) {
+	    /* No threads, the records get written directly. */
+	    o->free(o, tfilter->ring);
+	    tfilter->ring = NULL;
+	}
+	if (gensio_atomic_init(o, &tfilter->head, 0))
+	    goto out_nomem;
+	if (gensio_atomic_init(o, &tfilter->tail, 0))
+	    goto out_nomem;
+	if (gensio_atomic_init(o, &tfilter->dropped, 0))
+	    goto out_nomem;
+	if (gensio_atomic_init(o, &tfilter->waiting, 0))
+	    goto out_nomem;
+	if (gensio_atomic_init(o, &tfilter->shutdown, 0))
+	    goto out_nomem;
+    }
+#endif
+
     tfilter->filter = gensio_filter_alloc_data(o, gensio_trace_filter_func,
 					       tfilter);
     if (!tfilter->filter)
@@ -379,6 +719,8 @@ gensio_trace_filter_alloc(struct gensio_pparm_info *p,
     int dir = DIR_NONE, b4dir = DIR_NONE;
     int block = DIR_NONE;
     bool raw = false, tr_stdout = false, tr_stderr = false, tbool;
+    bool binary = false;
+    gensiods ringsize = TRACE_DEFAULT_RINGSIZE;
     const char *filename = NULL;
     unsigned int i;
     const char *modeflag = "a";
@@ -392,6 +734,10 @@ gensio_trace_filter_alloc(struct gensio_pparm_info *p,
 	    continue;
 	if (gensio_pparm_bool(p, args[i], "raw", &raw) > 0)
 	    continue;
+	if (gensio_pparm_bool(p, args[i], "binary", &binary) > 0)
+	    continue;
+	if (gensio_pparm_ds(p, args[i], "ringsize", &ringsize) > 0)
+	    continue;
 	if (gensio_pparm_value(p, args[i], "file", &filename) > 0)
 	    continue;
 	if (gensio_pparm_bool(p, args[i], "stdout", &tr_stdout) > 0)
@@ -407,8 +753,14 @@ gensio_trace_filter_alloc(struct gensio_pparm_info *p,
 	return GE_INVAL;
     }
 
+    if (raw && binary) {
+	gensio_pparm_slog(p, "raw and binary cannot both be set");
+	return GE_INVAL;
+    }
+
     filter = gensio_trace_filter_raw_alloc(o, dir, b4dir, block, raw, filename,
-					   tr_stdout, tr_stderr, modeflag);
+					   tr_stdout, tr_stderr, modeflag,
+					   binary, ringsize);
     if (!filter)
 	return GE_NOMEM;
 
@@ -8,10 +8,13 @@
 #include "config.h"
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <gensio/gensio_os_funcs.h>
 #include <gensio/gensio_class.h>
 #include <gensio/gensio_err.h>
+#include <gensio/gensio_control.h>
 #include <gensio/gensio_ll_fd.h>
 
 enum fd_state {
@@ -19,9 +22,24 @@ enum fd_state {
      * fd is not operational
      *
      * open -> FD_IN_OPEN (set fds)
+     * open, sub_open() waiting -> FD_IN_OPEN_WAIT
      */
     FD_CLOSED,
 
+    /*
+     * An open has been requested, but sub_open() is waiting on
+     * something (like a name lookup) before it can create the fd.
+     * There is no fd yet.
+     *
+     * sub_open ready
+     *   if open success
+     *     -> FD_IN_OPEN (set fds)
+     *   else
+     *     -> FD_CLOSED (report open err)
+     * close -> FD_IN_CLOSE
+     */
+    FD_IN_OPEN_WAIT,
+
     /*
      * An open has been requested, but is not yet complete.
      *
@@ -127,6 +145,11 @@ struct fd_ll {
     gensio_ll_open_done open_done;
     void *open_data;
     int open_err;
+    /*
+     * Held while sub_open() is waiting, so the fdll and handler data
+     * stay around until gensio_fd_ll_sub_open_ready() is called.
+     */
+    bool open_wait_ref;
 
     gensio_ll_close_done close_done;
     void *close_data;
@@ -135,6 +158,26 @@ struct fd_ll {
 
     unsigned char *read_data;
     gensiods read_data_size;
+    /*
+     * If read_data_max is larger than read_data_min, the read buffer
+     * grows toward read_data_max while reads fill it, and shrinks
+     * back toward read_data_min when they don't.  read_data is from
+     * malloc(), it never needs to be zeroed.
+     */
+    gensiods read_data_min;
+    gensiods read_data_max;
+    /* Small reads in a row, see fd_adapt_read_buf(). */
+    unsigned int read_small_count;
+    /*
+     * After a read that fills the buffer, keep reading until this
+     * many bytes have been read before going back to the selector.
+     * 0 means one read per read ready.
+     */
+    gensiods read_batch;
+    /* Read ready calls, read calls, and bytes read, for statistics. */
+    unsigned long long stat_read_events;
+    unsigned long long stat_reads;
+    unsigned long long stat_read_bytes;
     gensiods read_data_len;
     gensiods read_data_pos;
     const char *const *auxdata;
@@ -176,7 +219,7 @@ static void fd_finish_free(struct fd_ll *fdll)
     if (fdll->deferred_op_runner)
 	fdll->o->free_runner(fdll->deferred_op_runner);
     if (fdll->read_data)
-	fdll->o->free(fdll->o, fdll->read_data);
+	free(fdll->read_data);
     if (fdll->ops)
 	fdll->ops->free(fdll->handler_data);
     fdll->o->free(fdll->o, fdll);
@@ -492,6 +535,51 @@ fd_start_close(struct fd_ll *fdll)
     fd_set_state(fdll, FD_IN_CLOSE);
 }
 
+/* How many reads in a row have to be small before the buffer shrinks. */
+#define FD_READ_SHRINK_COUNT 8
+
+/*
+ * Called with the lock held and no read data pending after a read of
+ * count bytes.  A full buffer means more is probably waiting, so
+ * double the buffer.  Reads that use less than a quarter of it mean
+ * the burst is over, so an idle connection doesn't keep a big buffer
+ * around.  But traffic that is bursty would bounce between sizes if
+ * one small read shrank it, so halve it only after several small
+ * reads in a row.
+ */
+static void
+fd_adapt_read_buf(struct fd_ll *fdll, gensiods count)
+{
+    gensiods newsize = fdll->read_data_size;
+    unsigned char *newbuf;
+
+    if (count >= fdll->read_data_size / 4) {
+	fdll->read_small_count = 0;
+	if (count < fdll->read_data_size || newsize >= fdll->read_data_max)
+	    return;
+	newsize *= 2;
+	if (newsize > fdll->read_data_max)
+	    newsize = fdll->read_data_max;
+    } else {
+	if (newsize <= fdll->read_data_min)
+	    return;
+	if (++fdll->read_small_count < FD_READ_SHRINK_COUNT)
+	    return;
+	fdll->read_small_count = 0;
+	newsize /= 2;
+	if (newsize < fdll->read_data_min)
+	    newsize = fdll->read_data_min;
+    }
+
+    /* The old data has been delivered, no need to copy or zero. */
+    newbuf = malloc(newsize);
+    if (!newbuf)
+	return; /* Just keep using the old one. */
+    free(fdll->read_data);
+    fdll->read_data = newbuf;
+    fdll->read_data_size = newsize;
+}
+
 static void
 fd_handle_incoming(struct fd_ll *fdll,
 		   int (*doread)(struct gensio_iod *iod, void *buf, gensiods count,
@@ -500,31 +588,61 @@ fd_handle_incoming(struct fd_ll *fdll,
 		   const char **auxdata, void *cb_data)
 {
     int err = 0;
-    gensiods count;
+    gensiods count, size, batched = 0;
+    const char **orig_auxdata = auxdata;
+    bool did_read, more;
 
     fd_lock_and_ref(fdll);
     if (fdll->in_read || fdll->state == FD_ERR_WAIT ||
 		fdll->state == FD_OPEN_ERR_WAIT)
 	goto out_disable;
     fdll->in_read = true;
-
-    if (!fdll->read_data_len) {
-	fd_unlock(fdll);
-	err = doread(fdll->iod, fdll->read_data, fdll->read_data_size, &count,
-		     &auxdata, cb_data);
-	fd_lock(fdll);
-	if (!err) {
-	    fdll->read_data_len = count;
-	    fdll->auxdata = auxdata;
+    fdll->stat_read_events++;
+
+    do {
+	count = 0;
+	did_read = false;
+	size = fdll->read_data_size;
+	auxdata = orig_auxdata;
+	if (!fdll->read_data_len) {
+	    fd_unlock(fdll);
+	    err = doread(fdll->iod, fdll->read_data, size, &count,
+			 &auxdata, cb_data);
+	    fd_lock(fdll);
+	    fdll->stat_reads++;
+	    if (!err) {
+		fdll->read_data_len = count;
+		fdll->auxdata = auxdata;
+		fdll->stat_read_bytes += count;
+		batched += count;
+		did_read = true;
+	    }
 	}
-    }
 
-    fd_deliver_read_data(fdll, err);
+	fd_deliver_read_data(fdll, err);
+
+	if (did_read && !fdll->read_data_len &&
+		fdll->read_data_max > fdll->read_data_min)
+	    fd_adapt_read_buf(fdll, count);
+
+	/*
+	 * A read that fills the buffer probably left more data behind,
+	 * so read again without going back through the selector, as
+	 * long as the user took all the data and still wants more.  A
+	 * short read most likely emptied it, stop there instead of
+	 * spending a call to get EAGAIN.  The batch limit keeps one
+	 * busy fd from starving the others.
+	 */
+	more = (did_read && count == size && batched < fdll->read_batch &&
+		fdll->state == FD_OPEN && fdll->read_enabled &&
+		!fdll->read_data_len);
+    } while (more);
 
     if (err) {
 	switch(fdll->state) {
 	case FD_IN_OPEN:
 	case FD_IN_OPEN_RETRY:
+	case FD_IN_OPEN_WAIT:
 	case FD_OPEN_ERR_WAIT:
 	case FD_CLOSED:
 	    assert(0); /* Should not be possible. */
@@ -907,7 +1025,17 @@ fd_open(struct gensio_ll *ll, gensio_ll_open_done done, void *open_data)
 
     err = fdll->ops->sub_open(fdll->handler_data, &fdll->iod,
 			      &timeout);
-    if (err == GE_INPROGRESS || err == GE_RETRY || err == 0) {
+    if (err == GE_INPROGRESS && !fdll->iod) {
+	/* sub_open() will call gensio_fd_ll_sub_open_ready() later. */
+	if (!fdll->open_wait_ref) {
+	    fdll->open_wait_ref = true;
+	    fd_ref(fdll);
+	}
+	fdll->open_done = done;
+	fdll->open_data = open_data;
+	fd_set_state(fdll, FD_IN_OPEN_WAIT);
+	fd_ref(fdll);
+    } else if (err == GE_INPROGRESS || err == GE_RETRY || err == 0) {
 	int err2 = fd_setup_handlers(fdll);
 	if (err2) {
 	    err = err2;
@@ -936,6 +1064,52 @@ fd_open(struct gensio_ll *ll, gensio_ll_open_done done, void *open_data)
     return err;
 }
 
+void
+gensio_fd_ll_sub_open_ready(struct gensio_ll *ll)
+{
+    struct fd_ll *fdll = ll_to_fd(ll);
+    int err, err2;
+    gensio_time timeout;
+
+    fd_lock(fdll);
+    /* The wait ref is lost at the end. */
+    assert(fdll->open_wait_ref);
+    fdll->open_wait_ref = false;
+    if (fdll->state != FD_IN_OPEN_WAIT)
+	/* Closed while waiting, the next open will call sub_open(). */
+	goto out_unlock;
+
+    err = fdll->ops->sub_open(fdll->handler_data, &fdll->iod, &timeout);
+    if (err == GE_INPROGRESS && !fdll->iod) {
+	/* Still waiting. */
+	fdll->open_wait_ref = true;
+	fd_ref(fdll);
+	goto out_unlock;
+    }
+    if (err == GE_INPROGRESS || err == GE_RETRY || err == 0) {
+	err2 = fd_setup_handlers(fdll);
+	if (err2) {
+	    fdll->o->close(&fdll->iod);
+	    err = err2;
+	} else if (err == 0) {
+	    fd_finish_open(fdll, 0);
+	} else {
+	    if (err == GE_RETRY)
+		fd_start_timer(fdll, &timeout);
+	    fd_set_state(fdll, FD_IN_OPEN);
+	    fdll->o->set_write_handler(fdll->iod, true);
+	    fdll->o->set_except_handler(fdll->iod, true);
+	    err = 0;
+	}
+    }
+    if (err) {
+	fd_deref(fdll);
+	fd_finish_open(fdll, err);
+    }
+ out_unlock:
+    fd_deref_and_unlock(fdll);
+}
+
 static int
 fd_setup_handlers(struct fd_ll *fdll)
 {
@@ -958,6 +1132,7 @@ static int fd_close(struct gensio_ll *ll, gensio_ll_close_done done,
     switch(fdll->state) {
     case FD_IN_OPEN:
     case FD_IN_OPEN_RETRY:
+    case FD_IN_OPEN_WAIT:
 	fdll->open_err = GE_LOCALCLOSED;
 	/* Fallthrough */
     case FD_OPEN_ERR_WAIT:
@@ -1061,6 +1236,39 @@ static int fd_control(struct gensio_ll *ll, bool get, unsigned int option,
 {
     struct fd_ll *fdll = ll_to_fd(ll);
 
+    if (option == GENSIO_CONTROL_READ_STATS) {
+	if (!get)
+	    return GE_NOTSUP;
+	fd_lock(fdll);
+	*datalen = snprintf(data, *datalen, "%llu %llu %llu",
+			    fdll->stat_read_events, fdll->stat_reads,
+			    fdll->stat_read_bytes);
+	fd_unlock(fdll);
+	return 0;
+    }
+
+    if (option == GENSIO_CONTROL_READBUF) {
+	gensiods size;
+
+	if (!get)
+	    return GE_NOTSUP;
+	fd_lock(fdll);
+	size = fdll->read_data_size;
+	fd_unlock(fdll);
+	*datalen = snprintf(data, *datalen, "%lu", (unsigned long) size);
+	return 0;
+    }
+
+    if (option == GENSIO_CONTROL_RAW_IOD) {
+	/* Only one iod, reads and writes both use it. */
+	if (!get)
+	    return GE_NOTSUP;
+	if (*datalen != sizeof(void *))
+	    return GE_INVAL;
+	memcpy(data, &fdll->iod, sizeof(void *));
+	return 0;
+    }
+
     if (!fdll->ops->control)
 	return GE_NOTSUP;
 
@@ -1137,6 +1345,27 @@ gensio_ll_fd_func(struct gensio_ll *ll, int op, gensiods *count,
     }
 }
 
+void
+gensio_fd_ll_set_readbuf_max(struct gensio_ll *ll, gensiods max_read_size)
+{
+    struct fd_ll *fdll = ll_to_fd(ll);
+
+    fd_lock(fdll);
+    if (fdll->read_data_min > 0)
+	fdll->read_data_max = max_read_size;
+    fd_unlock(fdll);
+}
+
+void
+gensio_fd_ll_set_read_batch(struct gensio_ll *ll, gensiods batch_size)
+{
+    struct fd_ll *fdll = ll_to_fd(ll);
+
+    fd_lock(fdll);
+    fdll->read_batch = batch_size;
+    fd_unlock(fdll);
+}
+
 void *
 gensio_fd_ll_get_handler_data(struct gensio_ll *ll)
 {
@@ -1185,8 +1414,9 @@ fd_gensio_ll_alloc(struct gensio_os_funcs *o,
 	goto out_nomem;
 
     fdll->read_data_size = max_read_size;
+    fdll->read_data_min = max_read_size;
     if (max_read_size > 0) {
-	fdll->read_data = o->zalloc(o, max_read_size);
+	fdll->read_data = malloc(max_read_size);
 	if (!fdll->read_data)
 	    goto out_nomem;
     }
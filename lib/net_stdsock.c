@@ -911,6 +911,141 @@ gensio_addr_addrinfo_alloc_recvfrom(struct gensio_os_funcs *o)
 				     true);
 }
 
+/*
+ * Fill in the length and family of a received address.
+ */
+static void
+gensio_stdsock_recv_addr(struct gensio_addr *addr, taddrlen len)
+{
+    struct addrinfo *ai = gensio_addr_addrinfo_get_curr(addr);
+
+    if (len == 0) {
+	/*
+	 * This happens when receiving an AF_UNIX datagram socket
+	 * where the other end isn't bound.  Just create a socket
+	 * with the family set and no path.
+	 */
+	ai->ai_addrlen = sizeof(ai->ai_addr->sa_family);
+	ai->ai_addr->sa_family = AF_UNIX;
+    } else {
+	ai->ai_addrlen = len;
+    }
+    ai->ai_family = ai->ai_addr->sa_family;
+}
+
+#ifdef HAVE_RECVMSG
+/*
+ * Pull the interface index and destination address out of the
+ * control messages and put them into the next entries in addr.
+ */
+static void
+gensio_stdsock_recv_extrainfo(struct gensio_addr *addr, struct msghdr *hdr)
+{
+    struct cmsghdr *cmsg;
+    struct addrinfo *ai;
+
+#ifdef IP_PKTINFO
+    for (cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+	if (cmsg->cmsg_level == IPPROTO_IP &&
+		    cmsg->cmsg_type == IP_PKTINFO) {
+	    struct in_pktinfo *pi;
+
+	    pi = (struct in_pktinfo *) CMSG_DATA(cmsg);
+	    if (gensio_addr_next(addr)) {
+		struct sockaddr *inaddr;
+
+		ai = gensio_addr_addrinfo_get_curr(addr);
+		ai->ai_family = GENSIO_AF_IFINDEX;
+		inaddr = (struct sockaddr *) ai->ai_addr;
+		inaddr->sa_family = GENSIO_AF_IFINDEX;
+		*((unsigned int *) inaddr->sa_data) = pi->ipi_ifindex;
+	    }
+	    if (gensio_addr_next(addr)) {
+		struct sockaddr_in *inaddr;
+
+		ai = gensio_addr_addrinfo_get_curr(addr);
+		ai->ai_family = AF_INET;
+		inaddr = (struct sockaddr_in *) ai->ai_addr;
+		inaddr->sin_family = AF_INET;
+		inaddr->sin_port = 0;
+		inaddr->sin_addr = pi->ipi_addr;
+	    }
+	}
+    }
+#elif defined(IP_RECVIF) && defined(IP_RECVDSTADDR)
+    for (cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+	if (cmsg->cmsg_level == IPPROTO_IP &&
+		    cmsg->cmsg_type == IP_RECVIF) {
+	    uint16_t *iptr;
+	    struct sockaddr *inaddr;
+
+	    /*
+	     * There's no docs on this that I could find, but the
+	     * value seems to be in the second 16-bit value in the
+	     * data.  Not sure if it will work on big endian, or
+	     * if this is even right.
+	     */
+	    iptr = (uint16_t *) CMSG_DATA(cmsg);
+	    if (gensio_addr_next(addr)) {
+		ai = gensio_addr_addrinfo_get_curr(addr);
+		ai->ai_family = GENSIO_AF_IFINDEX;
+		inaddr = (struct sockaddr *) ai->ai_addr;
+		inaddr->sa_family = GENSIO_AF_IFINDEX;
+		*((unsigned int *) inaddr->sa_data) = iptr[1];
+	    }
+	}
+    }
+    for (cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+	if (cmsg->cmsg_level == IPPROTO_IP &&
+		   cmsg->cmsg_type == IP_RECVDSTADDR) {
+	    struct sockaddr_in *inaddr;
+
+	    if (gensio_addr_next(addr)) {
+		struct in_addr *iptr;
+
+		iptr = (struct in_addr *) CMSG_DATA(cmsg);
+		ai = gensio_addr_addrinfo_get_curr(addr);
+		ai->ai_family = AF_INET;
+		inaddr = (struct sockaddr_in *) ai->ai_addr;
+		inaddr->sin_family = AF_INET;
+		inaddr->sin_port = 0;
+		inaddr->sin_addr = *iptr;
+	    }
+	}
+    }
+#endif
+#ifdef IPV6_RECVPKTINFO
+    for (cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+	if (cmsg->cmsg_level == IPPROTO_IPV6 &&
+		    cmsg->cmsg_type == IPV6_PKTINFO) {
+	    struct in6_pktinfo *pi;
+
+	    pi = (struct in6_pktinfo *) CMSG_DATA(cmsg);
+	    if (gensio_addr_next(addr)) {
+		struct sockaddr *inaddr;
+
+		ai = gensio_addr_addrinfo_get_curr(addr);
+		ai->ai_family = GENSIO_AF_IFINDEX;
+		inaddr = (struct sockaddr *) ai->ai_addr;
+		inaddr->sa_family = GENSIO_AF_IFINDEX;
+		*((unsigned int *) inaddr->sa_data) = pi->ipi6_ifindex;
+	    }
+	    if (gensio_addr_next(addr)) {
+		struct sockaddr_in6 *inaddr;
+
+		ai = gensio_addr_addrinfo_get_curr(addr);
+		ai->ai_family = AF_INET6;
+		inaddr = (struct sockaddr_in6 *) ai->ai_addr;
+		memset(inaddr, 0, sizeof(*inaddr));
+		inaddr->sin6_family = AF_INET6;
+		inaddr->sin6_addr = pi->ipi6_addr;
+	    }
+	}
+    }
+#endif
+}
+#endif
+
 static int
 gensio_stdsock_recvfrom(struct gensio_iod *iod,
 			void *buf, gensiods buflen, gensiods *rcount,
@@ -956,18 +1091,7 @@ gensio_stdsock_recvfrom(struct gensio_iod *iod,
     rv = recvfrom(o->iod_get_fd(iod), buf, buflen, flags, ai->ai_addr, &len);
 #endif
     if (rv >= 0) {
-	if (len == 0) {
-	    /*
-	     * This happens when receiving an AF_UNIX datagram socket
-	     * where the other end isn't bound.  Just create a socket
-	     * with the family set and no path.
-	     */
-	    ai->ai_addrlen = sizeof(ai->ai_addr->sa_family);
-	    ai->ai_addr->sa_family = AF_UNIX;
-	} else {
-	    ai->ai_addrlen = len;
-	}
-	ai->ai_family = ai->ai_addr->sa_family;
+	gensio_stdsock_recv_addr(addr, len);
     } else {
 	if (sock_errno == SOCK_EINTR)
 	    goto retry;
@@ -977,115 +1101,119 @@ gensio_stdsock_recvfrom(struct gensio_iod *iod,
 	    err = sock_errno;
     }
 #ifdef HAVE_RECVMSG
-    if (!err && gsi->extrainfo) {
-	struct cmsghdr *cmsg;
+    if (!err && gsi->extrainfo)
+	gensio_stdsock_recv_extrainfo(addr, &hdr);
+#endif
+    gensio_addr_rewind(addr);
+    if (!err && rcount)
+	*rcount = rv;
+    return gensio_os_err_to_err(o, err);
+}
 
-#ifdef IP_PKTINFO
-	for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
-	    if (cmsg->cmsg_level == IPPROTO_IP &&
-			cmsg->cmsg_type == IP_PKTINFO) {
-		struct in_pktinfo *pi;
-
-		pi = (struct in_pktinfo *) CMSG_DATA(cmsg);
-		if (gensio_addr_next(addr)) {
-		    struct sockaddr *inaddr;
-
-		    ai = gensio_addr_addrinfo_get_curr(addr);
-		    ai->ai_family = GENSIO_AF_IFINDEX;
-		    inaddr = (struct sockaddr *) ai->ai_addr;
-		    inaddr->sa_family = GENSIO_AF_IFINDEX;
-		    *((unsigned int *) inaddr->sa_data) = pi->ipi_ifindex;
-		}
-		if (gensio_addr_next(addr)) {
-		    struct sockaddr_in *inaddr;
-
-		    ai = gensio_addr_addrinfo_get_curr(addr);
-		    ai->ai_family = AF_INET;
-		    inaddr = (struct sockaddr_in *) ai->ai_addr;
-		    inaddr->sin_family = AF_INET;
-		    inaddr->sin_port = 0;
-		    inaddr->sin_addr = pi->ipi_addr;
-		}
-	    }
-	}
-#elif defined(IP_RECVIF) && defined(IP_RECVDSTADDR)
-	for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
-	    if (cmsg->cmsg_level == IPPROTO_IP &&
-			cmsg->cmsg_type == IP_RECVIF) {
-		uint16_t *iptr;
-		struct sockaddr *inaddr;
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+/* The most messages handled by one recvmfrom() or sendmto() call. */
+#define GENSIO_STDSOCK_MAX_MMSG	64
 
-		/*
-		 * There's no docs on this that I could find, but the
-		 * value seems to be in the second 16-bit value in the
-		 * data.  Not sure if it will work on big endian, or
-		 * if this is even right.
-		 */
-		iptr = (uint16_t *) CMSG_DATA(cmsg);
-		if (gensio_addr_next(addr)) {
-		    ai = gensio_addr_addrinfo_get_curr(addr);
-		    ai->ai_family = GENSIO_AF_IFINDEX;
-		    inaddr = (struct sockaddr *) ai->ai_addr;
-		    inaddr->sa_family = GENSIO_AF_IFINDEX;
-		    *((unsigned int *) inaddr->sa_data) = iptr[1];
-		}
-	    }
-	}
-	for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
-	    if (cmsg->cmsg_level == IPPROTO_IP &&
-		       cmsg->cmsg_type == IP_RECVDSTADDR) {
-		struct sockaddr_in *inaddr;
+static int
+gensio_stdsock_recvmfrom(struct gensio_iod *iod, struct gensio_msg *msgs,
+			 unsigned int nmsgs, unsigned int *nrecv, int flags)
+{
+    struct gensio_os_funcs *o = iod->f;
+    struct gensio_stdsock_info *gsi;
+    struct mmsghdr hdrs[GENSIO_STDSOCK_MAX_MMSG];
+    struct iovec iovs[GENSIO_STDSOCK_MAX_MMSG];
+    unsigned char ctrlinfo[GENSIO_STDSOCK_MAX_MMSG][128];
+    struct addrinfo *ai;
+    unsigned int i;
+    int rv, err;
 
-		if (gensio_addr_next(addr)) {
-		    struct in_addr *iptr;
+    if (do_errtrig())
+	return GE_NOMEM;
 
-		    iptr = (struct in_addr *) CMSG_DATA(cmsg);
-		    ai = gensio_addr_addrinfo_get_curr(addr);
-		    ai->ai_family = AF_INET;
-		    inaddr = (struct sockaddr_in *) ai->ai_addr;
-		    inaddr->sin_family = AF_INET;
-		    inaddr->sin_port = 0;
-		    inaddr->sin_addr = *iptr;
-		}
-	    }
-	}
-#endif
-#ifdef IPV6_RECVPKTINFO
-	for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
-	    if (cmsg->cmsg_level == IPPROTO_IPV6 &&
-			cmsg->cmsg_type == IPV6_PKTINFO) {
-		struct in6_pktinfo *pi;
-
-		pi = (struct in6_pktinfo *) CMSG_DATA(cmsg);
-		if (gensio_addr_next(addr)) {
-		    struct sockaddr *inaddr;
-
-		    ai = gensio_addr_addrinfo_get_curr(addr);
-		    ai->ai_family = GENSIO_AF_IFINDEX;
-		    inaddr = (struct sockaddr *) ai->ai_addr;
-		    inaddr->sa_family = GENSIO_AF_IFINDEX;
-		    *((unsigned int *) inaddr->sa_data) = pi->ipi6_ifindex;
-		}
-		if (gensio_addr_next(addr)) {
-		    struct sockaddr_in6 *inaddr;
-
-		    ai = gensio_addr_addrinfo_get_curr(addr);
-		    ai->ai_family = AF_INET6;
-		    inaddr = (struct sockaddr_in6 *) ai->ai_addr;
-		    memset(inaddr, 0, sizeof(*inaddr));
-		    inaddr->sin6_family = AF_INET6;
-		    inaddr->sin6_addr = pi->ipi6_addr;
-		}
-	    }
+    err = o->iod_control(iod, GENSIO_IOD_CONTROL_SOCKINFO, true,
+			 (intptr_t) &gsi);
+    if (err)
+	return err;
+
+    if (nmsgs > GENSIO_STDSOCK_MAX_MMSG)
+	nmsgs = GENSIO_STDSOCK_MAX_MMSG;
+    memset(hdrs, 0, nmsgs * sizeof(*hdrs));
+    for (i = 0; i < nmsgs; i++) {
+	gensio_addr_rewind(msgs[i].addr);
+	ai = gensio_addr_addrinfo_get_curr(msgs[i].addr);
+	hdrs[i].msg_hdr.msg_name = ai->ai_addr;
+	hdrs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+	iovs[i].iov_base = msgs[i].buf;
+	iovs[i].iov_len = msgs[i].buflen;
+	hdrs[i].msg_hdr.msg_iov = &iovs[i];
+	hdrs[i].msg_hdr.msg_iovlen = 1;
+	if (gsi->extrainfo) {
+	    hdrs[i].msg_hdr.msg_control = ctrlinfo[i];
+	    hdrs[i].msg_hdr.msg_controllen = sizeof(ctrlinfo[i]);
 	}
-#endif
     }
-#endif
-    gensio_addr_rewind(addr);
-    if (!err && rcount)
-	*rcount = rv;
-    return gensio_os_err_to_err(o, err);
+
+ retry:
+    rv = recvmmsg(o->iod_get_fd(iod), hdrs, nmsgs, flags, NULL);
+    if (rv < 0) {
+	if (errno == EINTR)
+	    goto retry;
+	if (errno != EWOULDBLOCK && errno != EAGAIN)
+	    return gensio_os_err_to_err(o, errno);
+	rv = 0;
+    }
+
+    for (i = 0; i < (unsigned int) rv; i++) {
+	gensio_stdsock_recv_addr(msgs[i].addr, hdrs[i].msg_hdr.msg_namelen);
+	if (gsi->extrainfo)
+	    gensio_stdsock_recv_extrainfo(msgs[i].addr, &hdrs[i].msg_hdr);
+	gensio_addr_rewind(msgs[i].addr);
+	msgs[i].count = hdrs[i].msg_len;
+    }
+    *nrecv = rv;
+    return 0;
+}
+
+static int
+gensio_stdsock_sendmto(struct gensio_iod *iod, struct gensio_msg *msgs,
+		       unsigned int nmsgs, unsigned int *nsent, int gflags)
+{
+    struct gensio_os_funcs *o = iod->f;
+    struct mmsghdr hdrs[GENSIO_STDSOCK_MAX_MMSG];
+    struct addrinfo *ai;
+    unsigned int i;
+    int rv, flags = (gflags & GENSIO_MSG_OOB) ? MSG_OOB : 0;
+
+    if (do_errtrig())
+	return GE_NOMEM;
+
+    if (nmsgs > GENSIO_STDSOCK_MAX_MMSG)
+	nmsgs = GENSIO_STDSOCK_MAX_MMSG;
+    memset(hdrs, 0, nmsgs * sizeof(*hdrs));
+    for (i = 0; i < nmsgs; i++) {
+	ai = gensio_addr_addrinfo_get_curr(msgs[i].addr);
+	hdrs[i].msg_hdr.msg_name = (void *) ai->ai_addr;
+	hdrs[i].msg_hdr.msg_namelen = ai->ai_addrlen;
+	hdrs[i].msg_hdr.msg_iov = (struct iovec *) msgs[i].sg;
+	hdrs[i].msg_hdr.msg_iovlen = msgs[i].sglen;
+    }
+
+ retry:
+    rv = sendmmsg(o->iod_get_fd(iod), hdrs, nmsgs, flags);
+    if (rv < 0) {
+	if (errno == EINTR)
+	    goto retry;
+	if (errno != EWOULDBLOCK && errno != EAGAIN)
+	    return gensio_os_err_to_err(o, errno);
+	rv = 0;
+    }
+
+    for (i = 0; i < (unsigned int) rv; i++)
+	msgs[i].count = hdrs[i].msg_len;
+    *nsent = rv;
+    return 0;
 }
+#endif
 
 static int
 gensio_stdsock_accept(struct gensio_iod *iod,
@@ -2418,6 +2546,17 @@ gensio_setup_listen_socket(struct gensio_os_funcs *o,
 	}
     }
 
+    if (opensock_flags & GENSIO_OPENSOCK_REUSEPORT) {
+#ifdef SO_REUSEPORT
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT,
+		       (void *) &optval, sizeof(optval)) == -1)
+	    goto out_err;
+#else
+	rv = GE_NOTSUP;
+	goto out;
+#endif
+    }
+
     if (check_ipv6_only(family, sockproto, flags, fd) == -1)
 	goto out_err;
 #if !HAVE_WORKING_PORT0
@@ -2511,7 +2650,7 @@ gensio_setup_listen_socket(struct gensio_os_funcs *o,
 	    goto out;
     }
 
-    if (do_listen && listen(fd, 5) != 0)
+    if (do_listen && listen(fd, SOMAXCONN) != 0)
 	goto out_err;
 
  out:
@@ -2545,6 +2684,10 @@ gensio_stdsock_set_os_funcs(struct gensio_os_funcs *o)
     o->sendto = gensio_stdsock_sendto;
     o->addr_alloc_recvfrom = gensio_addr_addrinfo_alloc_recvfrom;
     o->recvfrom = gensio_stdsock_recvfrom;
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+    o->recvmfrom = gensio_stdsock_recvmfrom;
+    o->sendmto = gensio_stdsock_sendmto;
+#endif
     o->accept = gensio_stdsock_accept;
     o->socket_open = gensio_stdsock_socket_open;
     o->socket_set_setup = gensio_stdsock_socket_set_setup;
@@ -42,6 +42,17 @@ struct gensio_data {
     int wake_sig;
     struct gensio_os_proc_data *pdata;
     struct gensio_memtrack *mtrack;
+
+    /*
+     * For sharded os handlers, see gensio_unix_funcs_alloc_shard().
+     * Shards point to the os handler they were allocated from in
+     * shard_parent and hold a reference to it.  The parent keeps the
+     * list of all shards (including itself as the first one) in
+     * shards, protected by its reflock.
+     */
+    struct gensio_os_funcs *shard_parent;
+    struct gensio_os_funcs **shards;
+    unsigned int num_shards;
 };
 
 static void *
@@ -1089,6 +1100,24 @@ gensio_unix_free_funcs(struct gensio_os_funcs *f)
 	defoshnd = NULL;
     UNLOCK(&defos_lock);
 
+    if (d->shard_parent) {
+	struct gensio_data *pd = d->shard_parent->user_data;
+	unsigned int i;
+
+	LOCK(&pd->reflock);
+	for (i = 0; i < pd->num_shards; i++) {
+	    if (pd->shards[i] == f) {
+		pd->num_shards--;
+		pd->shards[i] = pd->shards[pd->num_shards];
+		break;
+	    }
+	}
+	UNLOCK(&pd->reflock);
+	gensio_unix_free_funcs(d->shard_parent);
+    }
+    if (d->shards)
+	free(d->shards);
+
     gensio_stdsock_cleanup(f);
     gensio_memtrack_cleanup(d->mtrack);
     if (d->freesel)
@@ -1699,9 +1728,37 @@ gensio_unix_control(struct gensio_os_funcs *o, int func, void *data,
     struct gensio_data *d = o->user_data;
 
     switch (func) {
-    case GENSIO_CONTROL_SET_PROC_DATA:
+    case GENSIO_CONTROL_SET_PROC_DATA: {
+	unsigned int i;
+
 	d->pdata = data;
+	LOCK(&d->reflock);
+	for (i = 0; i < d->num_shards; i++) {
+	    struct gensio_data *sd = d->shards[i]->user_data;
+
+	    sd->pdata = data;
+	}
+	UNLOCK(&d->reflock);
+	return 0;
+    }
+
+    case GENSIO_CONTROL_GET_SHARDS: {
+	struct gensio_os_funcs **shards = data;
+	unsigned int i;
+
+	if (d->shard_parent)
+	    d = d->shard_parent->user_data;
+	LOCK(&d->reflock);
+	if (d->num_shards == 0) {
+	    UNLOCK(&d->reflock);
+	    return GE_NOTSUP;
+	}
+	for (i = 0; shards && i < d->num_shards && i < *datalen; i++)
+	    shards[i] = d->shards[i];
+	*datalen = d->num_shards;
+	UNLOCK(&d->reflock);
 	return 0;
+    }
 
     default:
 	return GE_NOTSUP;
@@ -2573,6 +2630,48 @@ gensio_unix_funcs_alloc(struct selector_s *sel, int wake_sig,
     return i_gensio_unix_funcs_alloc(sel, wake_sig, 0, ro);
 }
 
+int
+gensio_unix_funcs_alloc_shard(struct gensio_os_funcs *o,
+			      struct gensio_os_funcs **rshard)
+{
+    struct gensio_data *d = o->user_data, *sd;
+    struct gensio_os_funcs *shard, **shards;
+    int rv;
+
+    if (d->shard_parent) {
+	o = d->shard_parent;
+	d = o->user_data;
+    }
+
+    rv = i_gensio_unix_funcs_alloc(NULL, d->wake_sig, d->flags, &shard);
+    if (rv)
+	return rv;
+    if (!shard)
+	return GE_NOMEM;
+    sd = shard->user_data;
+    sd->pdata = d->pdata;
+
+    LOCK(&d->reflock);
+    shards = realloc(d->shards, (d->num_shards + 2) * sizeof(*shards));
+    if (!shards) {
+	UNLOCK(&d->reflock);
+	gensio_unix_free_funcs(shard);
+	return GE_NOMEM;
+    }
+    d->shards = shards;
+    if (d->num_shards == 0)
+	/* The parent is always the first shard. */
+	d->shards[d->num_shards++] = o;
+    d->shards[d->num_shards++] = shard;
+    assert(d->refcount > 0);
+    d->refcount++;
+    sd->shard_parent = o;
+    UNLOCK(&d->reflock);
+
+    *rshard = shard;
+    return 0;
+}
+
 struct gensio_os_funcs *
 gensio_selector_alloc(struct selector_s *sel, int wake_sig)
 {
@@ -19,12 +19,14 @@
 #include <sys/time.h>
 #include <time.h>
 #include <sys/types.h>
+#include <sys/resource.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <stdio.h>
 #include <syslog.h>
 #include <string.h>
+#include <stdbool.h>
 #include <assert.h>
 
 /*
@@ -54,6 +56,13 @@
 #define SEL_FD_DEL 0
 #define SEL_FD_MOD 0
 #endif
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <stdint.h>
+#endif
 #include "errtrig.h"
 
 #ifndef EBADFD
@@ -102,9 +111,6 @@ typedef struct fd_control_s
        deletion. */
     fd_state_t       *state;
 
-    /* Link in the hash list. */
-    struct fd_control_s *next;
-
     /* Handlers for various events on an fd. */
     void             *data; /* Passed to the handlers */
     sel_fd_handler_t handle_read;
@@ -121,10 +127,25 @@ typedef struct fd_control_s
     /* On kevent, some I/O types don't handle EXCEPT, track that. */
     enum { SEL_RDWR = 0, SEL_RDWR_NOEXC } iodir;
 
-#ifdef HAVE_EPOLL_PWAIT
+#if defined(HAVE_EPOLL_PWAIT) || defined(HAVE_IO_URING)
     /* See the comment in process_fds_epoll() on the use of this. */
     uint32_t saved_events;
 #endif
+
+#ifdef HAVE_EPOLL_PWAIT
+    /* See the comment on sel_update_fd_epoll_lt() for how these are used. */
+    uint32_t epoll_events;
+    char epoll_in_set;
+    char epoll_busy;
+    char epoll_contended;
+#endif
+
+#ifdef HAVE_IO_URING
+    /* See the comment on sel_update_fd_uring() for how these are used. */
+    uint32_t uring_gen;
+    uint32_t uring_events;
+    char uring_armed;
+#endif
 } fd_control_t;
 
 typedef struct heap_val_s
@@ -156,6 +177,11 @@ typedef struct heap_val_s
 
     sel_timeout_handler_t done_handler;
     void *done_cb_data;
+
+    /* For the timer wheel, see sel_wheel_add(). */
+    uint64_t wheel_tick;
+    unsigned int wheel_slot;
+    struct sel_timer_s *wheel_next, **wheel_pprev;
 } heap_val_t;
 
 typedef struct theap_s theap_t;
@@ -192,6 +218,224 @@ heap_cmp_key(heap_val_t *v1, heap_val_t *v2)
 
 #include "heap.h"
 
+/*
+ * An optional hierarchical timer wheel, used instead of the heap if
+ * GENSIO_SELECTOR_TIMERS is set to "wheel".  Starting and stopping a
+ * timer is O(1), which matters with large numbers of timers that are
+ * mostly stopped before they expire (like retransmit timers).
+ *
+ * Time is kept in ticks of SEL_WHEEL_TICK_US microseconds, and a
+ * timer's expiry is rounded up to a tick, so timers may go off up to
+ * a tick late but never early.  There are SEL_WHEEL_LEVELS levels of
+ * SEL_WHEEL_SIZE slots.  Level 0 slots hold timers for a single tick,
+ * each slot on level n covers SEL_WHEEL_SIZE^n ticks.  When the
+ * current tick reaches the start of a slot on level n > 0, the timers
+ * in it are moved ("cascaded") down to lower levels.  Timers too far
+ * out for the top level are put in the last top level slot and
+ * cascaded again later.  A bitmask of occupied slots on each level
+ * lets us find the next thing to do without scanning empty slots.
+ *
+ * Timers that are already due are put on the expired list, which
+ * process_timers() empties as a batch.
+ */
+#define SEL_WHEEL_TICK_US	1000
+#define SEL_WHEEL_BITS		6
+#define SEL_WHEEL_SIZE		(1 << SEL_WHEEL_BITS)
+#define SEL_WHEEL_MASK		(SEL_WHEEL_SIZE - 1)
+#define SEL_WHEEL_LEVELS	4
+#define SEL_WHEEL_EXPIRED	(SEL_WHEEL_LEVELS * SEL_WHEEL_SIZE)
+#define SEL_WHEEL_LEVEL_SHIFT(l) ((l) * SEL_WHEEL_BITS)
+#define SEL_WHEEL_MAX_TICKS \
+    (((uint64_t) 1 << SEL_WHEEL_LEVEL_SHIFT(SEL_WHEEL_LEVELS)) - 1)
+
+struct sel_wheel_s {
+    /* All ticks before this have been processed. */
+    uint64_t curr_tick;
+
+    /* The slots, plus one extra for the expired list. */
+    struct sel_timer_s *slots[SEL_WHEEL_EXPIRED + 1];
+
+    /* Bitmask of non-empty slots per level. */
+    uint64_t occupied[SEL_WHEEL_LEVELS];
+};
+
+static uint64_t
+sel_wheel_timeval_to_tick(const struct timeval *tv)
+{
+    return ((uint64_t) tv->tv_sec * (1000000 / SEL_WHEEL_TICK_US) +
+	    (tv->tv_usec + SEL_WHEEL_TICK_US - 1) / SEL_WHEEL_TICK_US);
+}
+
+static void
+sel_wheel_tick_to_timeval(uint64_t tick, struct timeval *tv)
+{
+    tv->tv_sec = tick / (1000000 / SEL_WHEEL_TICK_US);
+    tv->tv_usec = (tick % (1000000 / SEL_WHEEL_TICK_US)) * SEL_WHEEL_TICK_US;
+}
+
+static void
+sel_wheel_init(struct sel_wheel_s *w)
+{
+    struct timeval now;
+
+    memset(w, 0, sizeof(*w));
+    sel_get_monotonic_time(&now);
+    w->curr_tick = now.tv_sec * (uint64_t) (1000000 / SEL_WHEEL_TICK_US) +
+	now.tv_usec / SEL_WHEEL_TICK_US;
+}
+
+static void
+sel_wheel_link(struct sel_wheel_s *w, sel_timer_t *timer, unsigned int slot)
+{
+    sel_timer_t **head = &w->slots[slot];
+
+    timer->val.wheel_slot = slot;
+    timer->val.wheel_next = *head;
+    if (*head)
+	(*head)->val.wheel_pprev = &timer->val.wheel_next;
+    timer->val.wheel_pprev = head;
+    *head = timer;
+    if (slot < SEL_WHEEL_EXPIRED)
+	w->occupied[slot >> SEL_WHEEL_BITS] |=
+	    (uint64_t) 1 << (slot & SEL_WHEEL_MASK);
+}
+
+/* Put the timer in the right slot for its tick. */
+static void
+sel_wheel_place(struct sel_wheel_s *w, sel_timer_t *timer)
+{
+    uint64_t tick = timer->val.wheel_tick, delta;
+    unsigned int level;
+
+    if (tick < w->curr_tick) {
+	sel_wheel_link(w, timer, SEL_WHEEL_EXPIRED);
+	return;
+    }
+
+    delta = tick - w->curr_tick;
+    if (delta > SEL_WHEEL_MAX_TICKS) {
+	/* Too far out, it will get cascaded until it fits. */
+	tick = w->curr_tick + SEL_WHEEL_MAX_TICKS;
+	delta = SEL_WHEEL_MAX_TICKS;
+    }
+    for (level = 0; level < SEL_WHEEL_LEVELS - 1; level++) {
+	if (delta < (uint64_t) 1 << SEL_WHEEL_LEVEL_SHIFT(level + 1))
+	    break;
+    }
+    sel_wheel_link(w, timer, (level << SEL_WHEEL_BITS) |
+		   ((tick >> SEL_WHEEL_LEVEL_SHIFT(level)) & SEL_WHEEL_MASK));
+}
+
+static void
+sel_wheel_add(struct sel_wheel_s *w, sel_timer_t *timer)
+{
+    timer->val.wheel_tick = sel_wheel_timeval_to_tick(&timer->val.timeout);
+    sel_wheel_place(w, timer);
+}
+
+static void
+sel_wheel_remove(struct sel_wheel_s *w, sel_timer_t *timer)
+{
+    unsigned int slot = timer->val.wheel_slot;
+
+    *timer->val.wheel_pprev = timer->val.wheel_next;
+    if (timer->val.wheel_next)
+	timer->val.wheel_next->val.wheel_pprev = timer->val.wheel_pprev;
+    if (slot < SEL_WHEEL_EXPIRED && !w->slots[slot])
+	w->occupied[slot >> SEL_WHEEL_BITS] &=
+	    ~((uint64_t) 1 << (slot & SEL_WHEEL_MASK));
+}
+
+/* Remove all the timers from a slot and put them where they belong now. */
+static void
+sel_wheel_cascade(struct sel_wheel_s *w, unsigned int slot)
+{
+    sel_timer_t *timer = w->slots[slot], *next;
+
+    w->slots[slot] = NULL;
+    w->occupied[slot >> SEL_WHEEL_BITS] &=
+	~((uint64_t) 1 << (slot & SEL_WHEEL_MASK));
+    for (; timer; timer = next) {
+	next = timer->val.wheel_next;
+	sel_wheel_place(w, timer);
+    }
+}
+
+/*
+ * Return the next tick at or after curr_tick where something needs to
+ * be done, either expiring level 0 timers or cascading a higher
+ * level.  Returns UINT64_MAX if the wheel is empty.
+ */
+static uint64_t
+sel_wheel_next_tick(struct sel_wheel_s *w)
+{
+    uint64_t next = UINT64_MAX, base, tick, bits;
+    unsigned int level, shift, curr, d;
+
+    for (level = 0; level < SEL_WHEEL_LEVELS; level++) {
+	bits = w->occupied[level];
+	if (!bits)
+	    continue;
+	shift = SEL_WHEEL_LEVEL_SHIFT(level);
+	base = w->curr_tick >> shift;
+	curr = base & SEL_WHEEL_MASK;
+	/*
+	 * Find the first occupied slot at or after the current one.  For
+	 * levels above 0, if we are past the start of the current slot,
+	 * it was already cascaded, so anything in it is for the next
+	 * time around.
+	 */
+	if (level > 0 && (base << shift) != w->curr_tick)
+	    curr = (curr + 1) & SEL_WHEEL_MASK, base++;
+	bits = (bits >> curr) | (curr ? bits << (SEL_WHEEL_SIZE - curr) : 0);
+	d = __builtin_ctzll(bits);
+	tick = (base + d) << shift;
+	if (tick < next)
+	    next = tick;
+    }
+    return next;
+}
+
+/* Move everything that is due at the given time to the expired list. */
+static void
+sel_wheel_advance(struct sel_wheel_s *w, const struct timeval *now)
+{
+    uint64_t end = (now->tv_sec * (uint64_t) (1000000 / SEL_WHEEL_TICK_US) +
+		    now->tv_usec / SEL_WHEEL_TICK_US);
+    uint64_t tick;
+    unsigned int level, slot;
+    sel_timer_t *timer, *next;
+
+    while (w->curr_tick <= end) {
+	tick = sel_wheel_next_tick(w);
+	if (tick > end) {
+	    w->curr_tick = end + 1;
+	    break;
+	}
+	w->curr_tick = tick;
+
+	/* Cascade from the top down so things fall all the way through. */
+	for (level = SEL_WHEEL_LEVELS - 1; level > 0; level--) {
+	    if (tick & (((uint64_t) 1 << SEL_WHEEL_LEVEL_SHIFT(level)) - 1))
+		continue;
+	    slot = ((level << SEL_WHEEL_BITS) |
+		    ((tick >> SEL_WHEEL_LEVEL_SHIFT(level)) & SEL_WHEEL_MASK));
+	    if (w->slots[slot])
+		sel_wheel_cascade(w, slot);
+	}
+
+	w->curr_tick = tick + 1;
+	slot = tick & SEL_WHEEL_MASK;
+	timer = w->slots[slot];
+	w->slots[slot] = NULL;
+	w->occupied[0] &= ~((uint64_t) 1 << slot);
+	for (; timer; timer = next) {
+	    next = timer->val.wheel_next;
+	    sel_wheel_link(w, timer, SEL_WHEEL_EXPIRED);
+	}
+    }
+}
+
 /* Used to build a list of threads that may need to be woken if a
    timer on the top of the heap changes, or an FD is added/removed.
    See i_wake_sel_thread() for more info. */
@@ -221,10 +465,26 @@ typedef struct sel_wait_list_s
     struct sel_wait_list_s *next, *prev;
 } sel_wait_list_t;
 
+/*
+ * File descriptors are kept in a two-level table indexed directly by
+ * the fd number.  The top level is an array of pointers to chunks of
+ * SEL_FD_CHUNK_SIZE fd control structures.  Chunks are allocated when
+ * an fd in them is first set and never move, so a pointer to an fd
+ * control structure stays valid while the fd lock is released to call
+ * a handler.  Only the top level array is reallocated when it needs to
+ * grow, and that is only accessed with the fd lock held.
+ */
+#define SEL_FD_CHUNK_SHIFT	8
+#define SEL_FD_CHUNK_SIZE	(1 << SEL_FD_CHUNK_SHIFT)
+#define SEL_FD_CHUNK_MASK	(SEL_FD_CHUNK_SIZE - 1)
+/* Don't preallocate more than this many fd table entries. */
+#define SEL_FD_MAX_INIT		(1 << 20)
+
 struct selector_s
 {
-    /* This is an hash table of file descriptors. */
-    fd_control_t *fds[FD_SETSIZE];
+    /* The fd table, see above. */
+    fd_control_t **fd_chunks;
+    unsigned int num_fd_chunks;
 
     /* If something is deleted, we increment this count.  This way when
        a select/epoll returns a non-timeout, we know that we need to ignore
@@ -236,6 +496,9 @@ struct selector_s
     /* The timer heap. */
     theap_t timer_heap;
 
+    /* If non-NULL, use the timer wheel instead of timer_heap. */
+    struct sel_wheel_s *timer_wheel;
+
     /* This is a list of items waiting to be woken up because they are
        sitting in a select.  See i_wake_sel_thread() for more info. */
     sel_wait_list_t wait_list;
@@ -247,9 +510,22 @@ struct selector_s
 
     int wake_sig;
 
-    /* Used for epoll and kevent.  -1 otherwise. */
+    /* Used for epoll, kevent, and io_uring.  -1 otherwise. */
     int evfd;
 
+#ifdef HAVE_EPOLL_PWAIT
+    /* Use level-triggered epoll instead of EPOLLONESHOT. */
+    bool epoll_lt;
+#endif
+
+#ifdef HAVE_IO_URING
+    /* If non-NULL, io_uring is used instead of epoll. */
+    struct sel_uring_s *uring;
+
+    /* Number of threads waiting in io_uring_enter(). */
+    unsigned int uring_waiters;
+#endif
+
     sel_lock_t *(*sel_lock_alloc)(void *cb_data);
     void (*sel_lock_free)(sel_lock_t *);
     void (*sel_lock)(sel_lock_t *);
@@ -407,8 +683,12 @@ static void
 wake_timer_sel_thread(struct selector_s *sel, volatile sel_timer_t *old_top,
 		      struct timeval *new_timeout)
 {
-    if (old_top != theap_get_top(&sel->timer_heap))
-	/* If the top value changed, restart the waiting threads if required. */
+    /*
+     * If the top value changed, restart the waiting threads if required.
+     * The wheel doesn't track the top, but i_wake_sel_thread() only
+     * wakes threads that would wait too long.
+     */
+    if (sel->timer_wheel || old_top != theap_get_top(&sel->timer_heap))
 	i_wake_sel_thread(sel, new_timeout);
 }
 
@@ -455,7 +735,468 @@ init_fd(fd_control_t *fd)
     fd->except_enabled = 0;
 }
 
+#ifdef HAVE_IO_URING
+/*
+ * io_uring based event handling.  Each fd with something enabled has
+ * a single oneshot IORING_OP_POLL_ADD outstanding, which works like
+ * EPOLLONESHOT: once it fires it is not rearmed until the handlers
+ * have returned.  The difference from epoll is that adding, changing,
+ * and rearming a poll does not require its own syscall.  The
+ * submission entries are queued in the ring and are handed to the
+ * kernel by the next thread that waits for events, in the same
+ * io_uring_enter() call as the wait.  If a thread is already waiting,
+ * or the fd is being removed, the entries are submitted immediately.
+ */
+#define SEL_URING_ENTRIES	1024
+
+/* The user_data for POLL_REMOVE operations, these are ignored. */
+#define SEL_URING_REMOVE_DATA	UINT64_MAX
+
+struct sel_uring_s
+{
+    int fd;
+
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int sq_entries;
+    struct io_uring_sqe *sqes;
+
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    /* Don't generate completions for successful POLL_REMOVEs. */
+    bool skip_remove_cqe;
+
+    /*
+     * Completions taken off the ring to make room when the kernel
+     * refused a submit because the completion ring was full, see
+     * sel_uring_get_sqe().  These are older than anything in the
+     * ring, so they are handled first.
+     */
+    struct io_uring_cqe *backlog;
+    unsigned int backlog_pos;
+    unsigned int backlog_len;
+    unsigned int backlog_size;
+
+    void *sq_ring;
+    size_t sq_ring_sz;
+    void *cq_ring;
+    size_t cq_ring_sz;
+    size_t sqes_sz;
+};
+
+static int
+sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+		   unsigned int flags, void *arg, size_t argsz)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+		   arg, argsz);
+}
+
+static void
+sel_uring_free(struct sel_uring_s *u)
+{
+    if (u->backlog)
+	free(u->backlog);
+    if (u->sqes)
+	munmap(u->sqes, u->sqes_sz);
+    if (u->cq_ring && u->cq_ring != u->sq_ring)
+	munmap(u->cq_ring, u->cq_ring_sz);
+    if (u->sq_ring)
+	munmap(u->sq_ring, u->sq_ring_sz);
+    if (u->fd >= 0)
+	close(u->fd);
+    free(u);
+}
+
+static void *
+sel_uring_mmap(struct sel_uring_s *u, size_t size, off_t offset)
+{
+    void *p;
+
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+	     u->fd, offset);
+    if (p == MAP_FAILED)
+	return NULL;
+    return p;
+}
+
+static int
+sel_uring_alloc(struct sel_uring_s **ru)
+{
+    struct sel_uring_s *u;
+    struct io_uring_params p;
+    int err;
+
+    u = sel_alloc(sizeof(*u));
+    if (!u)
+	return ENOMEM;
+
+    memset(&p, 0, sizeof(p));
+    u->fd = sys_io_uring_setup(SEL_URING_ENTRIES, &p);
+    if (u->fd < 0)
+	goto out_err;
+
+    /* We need the sigmask and timeout in io_uring_enter(). */
+    if (!(p.features & IORING_FEAT_EXT_ARG)) {
+	errno = ENOSYS;
+	goto out_err;
+    }
+#ifdef IOSQE_CQE_SKIP_SUCCESS
+    u->skip_remove_cqe = !!(p.features & IORING_FEAT_CQE_SKIP);
+#endif
+
+    u->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    u->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+	if (u->cq_ring_sz > u->sq_ring_sz)
+	    u->sq_ring_sz = u->cq_ring_sz;
+	u->cq_ring_sz = u->sq_ring_sz;
+    }
+    u->sq_ring = sel_uring_mmap(u, u->sq_ring_sz, IORING_OFF_SQ_RING);
+    if (!u->sq_ring)
+	goto out_err;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+	u->cq_ring = u->sq_ring;
+    } else {
+	u->cq_ring = sel_uring_mmap(u, u->cq_ring_sz, IORING_OFF_CQ_RING);
+	if (!u->cq_ring)
+	    goto out_err;
+    }
+    u->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = sel_uring_mmap(u, u->sqes_sz, IORING_OFF_SQES);
+    if (!u->sqes)
+	goto out_err;
+
+    u->sq_head = (unsigned int *) ((char *) u->sq_ring + p.sq_off.head);
+    u->sq_tail = (unsigned int *) ((char *) u->sq_ring + p.sq_off.tail);
+    u->sq_mask = (unsigned int *) ((char *) u->sq_ring + p.sq_off.ring_mask);
+    u->sq_array = (unsigned int *) ((char *) u->sq_ring + p.sq_off.array);
+    u->sq_entries = p.sq_entries;
+    u->cq_head = (unsigned int *) ((char *) u->cq_ring + p.cq_off.head);
+    u->cq_tail = (unsigned int *) ((char *) u->cq_ring + p.cq_off.tail);
+    u->cq_mask = (unsigned int *) ((char *) u->cq_ring + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *) ((char *) u->cq_ring + p.cq_off.cqes);
+
+    *ru = u;
+    return 0;
+
+ out_err:
+    err = errno;
+    sel_uring_free(u);
+    return err;
+}
+
+/* Number of queued entries the kernel has not consumed yet. */
+static unsigned int
+sel_uring_sq_pending(struct sel_uring_s *u)
+{
+    return *u->sq_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+}
+
+static bool
+sel_uring_cq_ready(struct sel_uring_s *u)
+{
+    return *u->cq_head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Returns 0 or the errno from io_uring_enter().  On EINTR, EAGAIN or
+ * EBUSY the entries stay in the ring and get submitted on the next
+ * io_uring_enter().  Anything else should only fail due to system
+ * problems, like epoll_ctl().
+ */
+static int
+sel_uring_submit(struct sel_uring_s *u)
+{
+    unsigned int pending = sel_uring_sq_pending(u);
+
+    if (!pending)
+	return 0;
+    if (sys_io_uring_enter(u->fd, pending, 0, 0, NULL, 0) < 0) {
+	if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+	    perror("io_uring_enter");
+	    assert(0);
+	}
+	return errno;
+    }
+    return 0;
+}
+
+static fd_control_t *get_fd(struct selector_s *sel, int fd);
+
+/*
+ * Must be called with the sel fd lock held.  Make sure the backlog can
+ * hold a completion for each of nfds fds, so sel_uring_reap() never
+ * has to allocate.
+ */
+static int
+sel_uring_backlog_reserve(struct sel_uring_s *u, unsigned int nfds)
+{
+    struct io_uring_cqe *nb;
+    unsigned int size;
+
+    if (nfds <= u->backlog_size)
+	return 0;
+    size = u->backlog_size ? u->backlog_size : 64;
+    while (size < nfds)
+	size *= 2;
+    nb = realloc(u->backlog, size * sizeof(*nb));
+    if (!nb)
+	return ENOMEM;
+    u->backlog = nb;
+    u->backlog_size = size;
+    return 0;
+}
+
+/*
+ * Must be called with the sel fd lock held.  Is the completion for the
+ * poll currently armed on its fd?
+ */
+static bool
+sel_uring_cqe_current(struct selector_s *sel, uint64_t data)
+{
+    fd_control_t *fdc;
+
+    if (data == SEL_URING_REMOVE_DATA)
+	return false;
+    fdc = get_fd(sel, (int) (data & 0xffffffff));
+    return fdc && fdc->uring_armed && fdc->uring_gen == (uint32_t) (data >> 32);
+}
+
+/*
+ * Must be called with the sel fd lock held.  Move everything in the
+ * completion ring to the backlog.  Completions for removes and for
+ * polls that have been replaced are dropped here, and the ones already
+ * in the backlog that have gone stale are dropped, too, so the backlog
+ * holds at most one completion for each armed fd.
+ * sel_uring_backlog_reserve() has made room for that when the fd was
+ * added.
+ */
+static void
+sel_uring_reap(struct selector_s *sel, struct sel_uring_s *u)
+{
+    struct io_uring_cqe *cqe;
+    unsigned int head, i, j;
+
+    for (i = u->backlog_pos, j = 0; i < u->backlog_len; i++) {
+	if (sel_uring_cqe_current(sel, u->backlog[i].user_data))
+	    u->backlog[j++] = u->backlog[i];
+    }
+    u->backlog_pos = 0;
+    u->backlog_len = j;
+
+    while (sel_uring_cq_ready(u)) {
+	head = *u->cq_head;
+	cqe = &u->cqes[head & *u->cq_mask];
+	if (sel_uring_cqe_current(sel, cqe->user_data)) {
+	    assert(u->backlog_len < u->backlog_size);
+	    u->backlog[u->backlog_len++] = *cqe;
+	}
+	__atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+    }
+}
+
+/* Must be called with the sel fd lock held. */
+static struct io_uring_sqe *
+sel_uring_get_sqe(struct selector_s *sel, struct sel_uring_s *u)
+{
+    struct io_uring_sqe *sqe;
+    unsigned int idx;
+
+    while (sel_uring_sq_pending(u) >= u->sq_entries) {
+	/*
+	 * The ring is full, push it to the kernel to make room.  If the
+	 * completion ring is full the kernel won't take any more until
+	 * it's emptied, and process_fds_uring() can't run while we hold
+	 * the lock, so move the completions out of the way.
+	 */
+	if (sel_uring_submit(u) == EBUSY)
+	    sel_uring_reap(sel, u);
+    }
+
+    idx = *u->sq_tail & *u->sq_mask;
+    sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_array[idx] = idx;
+    return sqe;
+}
+
+static void
+sel_uring_commit_sqe(struct sel_uring_s *u)
+{
+    __atomic_store_n(u->sq_tail, *u->sq_tail + 1, __ATOMIC_RELEASE);
+}
+
+static uint64_t
+sel_uring_data(fd_control_t *fdc)
+{
+    return ((uint64_t) fdc->uring_gen << 32) | (uint32_t) fdc->fd;
+}
+
+/*
+ * Must be called with the sel fd lock held.
+ *
+ * An fd has at most one poll outstanding, uring_armed is set when it
+ * does and uring_events holds the poll mask it was armed with.  The
+ * user_data of the poll holds the fd in the lower 32 bits and
+ * uring_gen in the upper 32 bits.  uring_gen is bumped every time a
+ * poll is queued for the fd, so completions from polls that have been
+ * removed or replaced can be recognized and ignored.
+ */
+static int
+sel_update_fd_uring(struct selector_s *sel, fd_control_t *fdc, int op)
+{
+    struct sel_uring_s *u = sel->uring;
+    struct io_uring_sqe *sqe;
+    uint32_t events = 0;
+
+    if (op != SEL_FD_DEL) {
+	if (fdc->saved_events) {
+	    /* See the comment in process_fds_epoll() on saved_events. */
+	    if (fdc->read_enabled || fdc->except_enabled) {
+		fdc->saved_events = 0;
+		if (fdc->read_enabled)
+		    events |= POLLIN;
+		if (fdc->except_enabled)
+		    events |= POLLPRI;
+	    }
+	} else {
+	    if (fdc->read_enabled)
+		events |= POLLIN;
+	    if (fdc->write_enabled)
+		events |= POLLOUT;
+	    if (fdc->except_enabled)
+		events |= POLLPRI;
+	}
+    }
+
+    if (fdc->uring_armed) {
+	if (events == fdc->uring_events)
+	    return 0;
+	sqe = sel_uring_get_sqe(sel, u);
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = sel_uring_data(fdc);
+	sqe->user_data = SEL_URING_REMOVE_DATA;
+#ifdef IOSQE_CQE_SKIP_SUCCESS
+	if (u->skip_remove_cqe)
+	    sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+#endif
+	sel_uring_commit_sqe(u);
+	fdc->uring_armed = 0;
+    }
+
+    if (events) {
+	fdc->uring_gen++;
+	sqe = sel_uring_get_sqe(sel, u);
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fdc->fd;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	sqe->poll32_events = (events << 16) | (events >> 16);
+#else
+	sqe->poll32_events = events;
+#endif
+	sqe->user_data = sel_uring_data(fdc);
+	sel_uring_commit_sqe(u);
+	fdc->uring_armed = 1;
+	fdc->uring_events = events;
+    }
+
+    /*
+     * A poll holds a reference to the file, so removals must be pushed
+     * right away or a close of the fd would be delayed.  If a thread is
+     * waiting it won't see the new entries, so push those, too.
+     */
+    if (op == SEL_FD_DEL || sel->uring_waiters)
+	sel_uring_submit(u);
+
+    return 0;
+}
+#endif
+
 #ifdef HAVE_EPOLL_PWAIT
+/*
+ * Level-triggered epoll.  Instead of EPOLLONESHOT, an fd is left armed
+ * after an event, so handling an event does not need an epoll_ctl()
+ * to rearm it.  epoll_ctl() is only called when the set of enabled
+ * events changes.  epoll_events holds the mask the fd is registered
+ * with and epoll_in_set is true if it is in the epoll set.
+ *
+ * Since the fd stays armed, another thread may get an event for it
+ * while its handler is running (epoll_busy is set).  In that case
+ * that thread sets epoll_contended and takes the fd out of the epoll
+ * set, and the thread running the handler puts it back when it is
+ * done.  So only one thread handles an fd at a time, like oneshot, but
+ * the extra epoll_ctl() calls are only done on contention.
+ *
+ * Edge-triggered epoll is not used because the handlers do not read
+ * until EAGAIN, data left behind would never generate another event.
+ *
+ * With nothing enabled the fd is taken out of the set, or EPOLLHUP and
+ * EPOLLERR, which are always reported, would fire continuously.
+ */
+static int
+sel_update_fd_epoll_lt(struct selector_s *sel, fd_control_t *fdc, int op)
+{
+    struct epoll_event event;
+    uint32_t events = 0;
+    int rv;
+
+    if (op != SEL_FD_DEL && !(fdc->epoll_busy && fdc->epoll_contended)) {
+	if (fdc->saved_events) {
+	    /* See the comment in process_fds_epoll() on saved_events. */
+	    if (fdc->read_enabled || fdc->except_enabled) {
+		fdc->saved_events = 0;
+		if (fdc->read_enabled)
+		    events |= EPOLLIN;
+		if (fdc->except_enabled)
+		    events |= EPOLLPRI;
+	    }
+	} else {
+	    if (fdc->read_enabled)
+		events |= EPOLLIN;
+	    if (fdc->write_enabled)
+		events |= EPOLLOUT;
+	    if (fdc->except_enabled)
+		events |= EPOLLPRI;
+	}
+    }
+
+    if (!events) {
+	if (!fdc->epoll_in_set)
+	    return 0;
+	op = EPOLL_CTL_DEL;
+	fdc->epoll_in_set = 0;
+    } else {
+	if (fdc->epoll_in_set && fdc->epoll_events == events)
+	    return 0;
+	op = fdc->epoll_in_set ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+	fdc->epoll_in_set = 1;
+    }
+    fdc->epoll_events = events;
+
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.fd = fdc->fd;
+    rv = epoll_ctl(sel->evfd, op, fdc->fd, &event);
+    if (rv) {
+	perror("epoll_ctl");
+	assert(0);
+    }
+    return 0;
+}
+
 static int
 sel_update_fd(struct selector_s *sel, fd_control_t *fdc, int op)
 {
@@ -465,6 +1206,13 @@ sel_update_fd(struct selector_s *sel, fd_control_t *fdc, int op)
     if (sel->evfd < 0)
 	return 1;
 
+#ifdef HAVE_IO_URING
+    if (sel->uring)
+	return sel_update_fd_uring(sel, fdc, op);
+#endif
+    if (sel->epoll_lt)
+	return sel_update_fd_epoll_lt(sel, fdc, op);
+
     memset(&event, 0, sizeof(event));
     event.events = EPOLLONESHOT;
     event.data.fd = fdc->fd;
@@ -561,6 +1309,10 @@ sel_update_fd(struct selector_s *sel, fd_control_t *fdc, int op)
 static int
 sel_update_fd(struct selector_s *sel, fd_control_t *fdc, int op)
 {
+#ifdef HAVE_IO_URING
+    if (sel->uring)
+	return sel_update_fd_uring(sel, fdc, op);
+#endif
     return 1;
 }
 #endif
@@ -579,11 +1331,51 @@ finish_oldstate(sel_runner_t *runner, void *cbdata)
 static fd_control_t *
 get_fd(struct selector_s *sel, int fd)
 {
-    fd_control_t *fdc = sel->fds[fd % FD_SETSIZE];
+    unsigned int chunk = (unsigned int) fd >> SEL_FD_CHUNK_SHIFT;
+
+    if (chunk >= sel->num_fd_chunks || !sel->fd_chunks[chunk])
+	return NULL;
+    return &sel->fd_chunks[chunk][fd & SEL_FD_CHUNK_MASK];
+}
+
+/*
+ * Like get_fd(), but allocate the table space for the fd if it is not
+ * there.  Must be called with sel fd lock held.
+ */
+static fd_control_t *
+get_fd_alloc(struct selector_s *sel, int fd)
+{
+    unsigned int chunk = (unsigned int) fd >> SEL_FD_CHUNK_SHIFT, i;
+    fd_control_t *fdcs;
+
+    if (chunk >= sel->num_fd_chunks) {
+	unsigned int new_num = sel->num_fd_chunks * 2;
+	fd_control_t **new_chunks;
+
+	if (new_num <= chunk)
+	    new_num = chunk + 1;
+	new_chunks = sel_alloc(new_num * sizeof(*new_chunks));
+	if (!new_chunks)
+	    return NULL;
+	if (sel->fd_chunks) {
+	    memcpy(new_chunks, sel->fd_chunks,
+		   sel->num_fd_chunks * sizeof(*new_chunks));
+	    free(sel->fd_chunks);
+	}
+	sel->fd_chunks = new_chunks;
+	sel->num_fd_chunks = new_num;
+    }
 
-    while (fdc && fdc->fd != fd)
-	fdc = fdc->next;
-    return fdc;
+    if (!sel->fd_chunks[chunk]) {
+	fdcs = sel_alloc(SEL_FD_CHUNK_SIZE * sizeof(*fdcs));
+	if (!fdcs)
+	    return NULL;
+	for (i = 0; i < SEL_FD_CHUNK_SIZE; i++)
+	    fdcs[i].fd = (chunk << SEL_FD_CHUNK_SHIFT) + i;
+	sel->fd_chunks[chunk] = fdcs;
+    }
+
+    return &sel->fd_chunks[chunk][fd & SEL_FD_CHUNK_MASK];
 }
 
 static void
@@ -624,25 +1416,29 @@ sel_set_fd_handlers(struct selector_s *sel,
     state->done_runner.sel = sel;
 
     sel_fd_lock(sel);
-    fdc = get_fd(sel, fd);
+    fdc = get_fd_alloc(sel, fd);
     if (!fdc) {
-	fdc = sel_alloc(sizeof(*fdc));
-	if (!fdc) {
-	    sel_fd_unlock(sel);
-	    free(state);
-	    return ENOMEM;
-	}
-	fdc->fd = fd;
-	/* Add it to the list. */
-	fdc->next = sel->fds[fd % FD_SETSIZE];
-	sel->fds[fd % FD_SETSIZE] = fdc;
+	sel_fd_unlock(sel);
+	free(state);
+	return ENOMEM;
+    }
+
+#ifdef HAVE_IO_URING
+    /* Make room for its completion now, reaping them can't fail. */
+    if (sel->uring && !fdc->state &&
+	    sel_uring_backlog_reserve(sel->uring,
+				      (fd > sel->maxfd ? fd : sel->maxfd) + 1)) {
+	sel_fd_unlock(sel);
+	free(state);
+	return ENOMEM;
     }
+#endif
 
     if (fdc->state) {
 	oldstate = fdc->state;
 	olddata = fdc->data;
 	added = 0;
-#ifdef HAVE_EPOLL_PWAIT
+#if defined(HAVE_EPOLL_PWAIT) || defined(HAVE_IO_URING)
 	fdc->saved_events = 0;
 #endif
 	sel->fd_del_count++;
@@ -693,7 +1489,7 @@ i_sel_clear_fd_handler(struct selector_s *sel, int fd, int rpt)
 	fdc->state = NULL;
 
 	sel_update_fd(sel, fdc, SEL_FD_DEL);
-#ifdef HAVE_EPOLL_PWAIT
+#if defined(HAVE_EPOLL_PWAIT) || defined(HAVE_IO_URING)
 	fdc->saved_events = 0;
 #endif
 	sel->fd_del_count++;
@@ -708,9 +1504,12 @@ i_sel_clear_fd_handler(struct selector_s *sel, int fd, int rpt)
 
     /* Move maxfd down if necessary. */
     if (fd == sel->maxfd) {
-	while (sel->maxfd >= 0 && (!sel->fds[sel->maxfd] ||
-				   !sel->fds[sel->maxfd]->state))
+	while (sel->maxfd >= 0) {
+	    fdc = get_fd(sel, sel->maxfd);
+	    if (fdc && fdc->state)
+		break;
 	    sel->maxfd--;
+	}
     }
 
     if (oldstate) {
@@ -901,6 +1700,97 @@ sel_alloc_timer(struct selector_s     *sel,
     return 0;
 }
 
+/*
+ * Timer queue operations, these use either the heap or the wheel.
+ * They must be called with the timer lock held.
+ */
+static void
+sel_timerq_add(struct selector_s *sel, sel_timer_t *timer)
+{
+    if (sel->timer_wheel)
+	sel_wheel_add(sel->timer_wheel, timer);
+    else
+	theap_add(&sel->timer_heap, timer);
+    timer->val.in_heap = 1;
+}
+
+static void
+sel_timerq_remove(struct selector_s *sel, sel_timer_t *timer)
+{
+    if (sel->timer_wheel)
+	sel_wheel_remove(sel->timer_wheel, timer);
+    else
+	theap_remove(&sel->timer_heap, timer);
+    timer->val.in_heap = 0;
+}
+
+/* Return a timer that has expired at now, or NULL if none. */
+static sel_timer_t *
+sel_timerq_get_expired(struct selector_s *sel, struct timeval *now)
+{
+    sel_timer_t *timer;
+
+    if (sel->timer_wheel) {
+	timer = sel->timer_wheel->slots[SEL_WHEEL_EXPIRED];
+	if (!timer) {
+	    sel_wheel_advance(sel->timer_wheel, now);
+	    timer = sel->timer_wheel->slots[SEL_WHEEL_EXPIRED];
+	}
+	return timer;
+    }
+
+    timer = theap_get_top(&sel->timer_heap);
+    if (timer && cmp_timeval(now, &timer->val.timeout) >= 0)
+	return timer;
+    return NULL;
+}
+
+/*
+ * Get the time when the timers next need attention.  For the wheel
+ * this may be before any timer expires, when it needs to cascade.
+ * Returns false if there are no timers.
+ */
+static bool
+sel_timerq_next(struct selector_s *sel, struct timeval *next)
+{
+    sel_timer_t *timer;
+
+    if (sel->timer_wheel) {
+	uint64_t tick;
+
+	if (sel->timer_wheel->slots[SEL_WHEEL_EXPIRED])
+	    tick = sel->timer_wheel->curr_tick;
+	else
+	    tick = sel_wheel_next_tick(sel->timer_wheel);
+	if (tick == UINT64_MAX)
+	    return false;
+	sel_wheel_tick_to_timeval(tick, next);
+	return true;
+    }
+
+    timer = theap_get_top(&sel->timer_heap);
+    if (!timer)
+	return false;
+    *next = timer->val.timeout;
+    return true;
+}
+
+/* Return any timer in the queue, for cleanup. */
+static sel_timer_t *
+sel_timerq_get_any(struct selector_s *sel)
+{
+    unsigned int i;
+
+    if (sel->timer_wheel) {
+	for (i = 0; i <= SEL_WHEEL_EXPIRED; i++) {
+	    if (sel->timer_wheel->slots[i])
+		return sel->timer_wheel->slots[i];
+	}
+	return NULL;
+    }
+    return theap_get_top(&sel->timer_heap);
+}
+
 static int
 sel_stop_timer_i(struct selector_s *sel, sel_timer_t *timer)
 {
@@ -915,10 +1805,8 @@ sel_stop_timer_i(struct selector_s *sel, sel_timer_t *timer)
      * is used to signal a timer restart on return from a timer
      * handler.)  So make sure it's not in the heap.
      */
-    if (timer->val.in_heap) {
-	theap_remove(&sel->timer_heap, timer);
-	timer->val.in_heap = 0;
-    }
+    if (timer->val.in_heap)
+	sel_timerq_remove(sel, timer);
     timer->val.stopped = 1;
 
     return rv;
@@ -960,11 +1848,9 @@ sel_start_timer(sel_timer_t    *timer,
 
     timer->val.timeout = *timeout;
 
-    if (!timer->val.in_handler) {
+    if (!timer->val.in_handler)
 	/* Wait until the handler returns to start the timer. */
-	theap_add(&sel->timer_heap, timer);
-	timer->val.in_heap = 1;
-    }
+	sel_timerq_add(sel, timer);
     timer->val.stopped = 0;
 
     wake_timer_sel_thread(sel, old_top, timeout);
@@ -1014,13 +1900,12 @@ sel_stop_timer_with_done(sel_timer_t *timer,
      * heap with an immediate timeout so it will be processed now.
      */
     timer->val.in_handler = 1;
-    if (timer->val.in_heap) {
-	theap_remove(&sel->timer_heap, timer);
-	timer->val.in_heap = 0;
-    }
-    sel_get_monotonic_time(&timer->val.timeout);
-    theap_add(&sel->timer_heap, timer);
-    timer->val.in_heap = 1;
+    if (timer->val.in_heap)
+	sel_timerq_remove(sel, timer);
+    /* A zero time is always expired, even for the wheel. */
+    timer->val.timeout.tv_sec = 0;
+    timer->val.timeout.tv_usec = 0;
+    sel_timerq_add(sel, timer);
 
  out_unlock:
     sel_timer_unlock(sel);
@@ -1049,14 +1934,13 @@ process_timers(struct selector_s       *sel,
 	       volatile struct timeval *timeout,
 	       struct timeval          *abstime)
 {
-    struct timeval now;
+    struct timeval now, next;
     sel_timer_t    *timer;
 
-    timer = theap_get_top(&sel->timer_heap);
     sel_get_monotonic_time(&now);
-    while (timer && cmp_timeval(&now, &timer->val.timeout) >= 0) {
-	theap_remove(&(sel->timer_heap), timer);
-	timer->val.in_heap = 0;
+    timer = sel_timerq_get_expired(sel, &now);
+    while (timer) {
+	sel_timerq_remove(sel, timer);
 	timer->val.stopped = 1;
 
 	/*
@@ -1084,13 +1968,11 @@ process_timers(struct selector_s       *sel,
 	timer->val.in_handler = 0;
 	if (timer->val.freed)
 	    free(timer);
-	else if (!timer->val.stopped) {
+	else if (!timer->val.stopped)
 	    /* We were restarted while in the handler. */
-	    theap_add(&sel->timer_heap, timer);
-	    timer->val.in_heap = 1;
-	}
+	    sel_timerq_add(sel, timer);
 
-	timer = theap_get_top(&sel->timer_heap);
+	timer = sel_timerq_get_expired(sel, &now);
     }
 
     if (*count) {
@@ -1098,11 +1980,11 @@ process_timers(struct selector_s       *sel,
 	timeout->tv_sec = 0;
 	timeout->tv_usec = 0;
 	*abstime = now;
-    } else if (timer) {
-	diff_timeval((struct timeval *) timeout,
-		     (struct timeval *) &timer->val.timeout,
-		     &now);
-	*abstime = timer->val.timeout;
+    } else if (sel_timerq_next(sel, &next)) {
+	if (cmp_timeval(&next, &now) < 0)
+	    next = now;
+	diff_timeval((struct timeval *) timeout, &next, &now);
+	*abstime = next;
     } else {
 	/* No timers, just set a long time. */
 	timeout->tv_sec = 100000;
@@ -1376,7 +2258,202 @@ process_fds(struct selector_s *sel, sel_wait_list_t *item, sigset_t *isigmask)
     return err;
 }
 
+#ifdef HAVE_IO_URING
+/* Must be called with the sel fd lock held. */
+static unsigned int
+sel_uring_cqe_count(struct sel_uring_s *u)
+{
+    return (u->backlog_len - u->backlog_pos) +
+	(__atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE) - *u->cq_head);
+}
+
+/*
+ * Must be called with the sel fd lock held.  Take the next completion,
+ * returns false if there isn't one.
+ */
+static bool
+sel_uring_next_cqe(struct sel_uring_s *u, uint64_t *data, int *res)
+{
+    struct io_uring_cqe *cqe;
+    unsigned int head;
+
+    if (u->backlog_pos < u->backlog_len) {
+	/* Handle these first, they came before anything in the ring. */
+	cqe = &u->backlog[u->backlog_pos++];
+	if (u->backlog_pos == u->backlog_len)
+	    u->backlog_pos = u->backlog_len = 0;
+	*data = cqe->user_data;
+	*res = cqe->res;
+	return true;
+    }
+
+    if (!sel_uring_cq_ready(u))
+	return false;
+    head = *u->cq_head;
+    cqe = &u->cqes[head & *u->cq_mask];
+    *data = cqe->user_data;
+    *res = cqe->res;
+    __atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/*
+ * Must be called with the sel fd lock held, it is dropped while the
+ * handlers run.
+ */
+static void
+sel_uring_handle_cqe(struct selector_s *sel, uint64_t data, int res)
+{
+    fd_control_t *fdc;
+    uint32_t events;
+
+    if (!sel_uring_cqe_current(sel, data))
+	/* From a remove or a poll that was removed or replaced. */
+	return;
+    fdc = get_fd(sel, (int) (data & 0xffffffff));
+    fdc->uring_armed = 0;
+
+    if (res < 0)
+	/* The poll itself failed, report it as an error on the fd. */
+	events = POLLERR;
+    else
+	events = res;
+    if (events & (POLLHUP | POLLERR)) {
+	/*
+	 * Like epoll, poll always reports these.  Don't rearm for
+	 * them unless asked, see the comment in process_fds_epoll().
+	 */
+	fdc->saved_events = events & (POLLHUP | POLLERR);
+	events |= POLLIN;
+    }
+    if (events & (POLLIN | POLLHUP))
+	handle_selector_call(sel, fdc, NULL, fdc->read_enabled,
+			     fdc->handle_read);
+    if (events & POLLOUT)
+	handle_selector_call(sel, fdc, NULL, fdc->write_enabled,
+			     fdc->handle_write);
+    if (events & (POLLPRI | POLLERR))
+	handle_selector_call(sel, fdc, NULL, fdc->except_enabled,
+			     fdc->handle_except);
+
+    /* Rearm the event.  Remember it could have been deleted in the handler. */
+    if (fdc->state)
+	sel_update_fd(sel, fdc, SEL_FD_MOD);
+}
+
+static int
+process_fds_uring(struct selector_s *sel, sel_wait_list_t *item,
+		  sigset_t *isigmask)
+{
+    struct sel_uring_s *u = sel->uring;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    sigset_t sigmask;
+    unsigned int count, to_submit;
+    uint64_t data;
+    int rv, res, old_errno;
+    bool timed_out = false;
+
+    setup_my_sigmask(&sigmask, isigmask);
+    if (sel->wake_sig)
+	sigdelset(&sigmask, sel->wake_sig);
+
+    sel_fd_lock(sel);
+    if (!sel_uring_cqe_count(u)) {
+	memset(&arg, 0, sizeof(arg));
+	ts.tv_sec = item->wait_time.ts.tv_sec;
+	ts.tv_nsec = item->wait_time.ts.tv_nsec;
+	arg.sigmask = (uintptr_t) &sigmask;
+	arg.sigmask_sz = _NSIG / 8;
+	arg.ts = (uintptr_t) &ts;
+
+	/* Submit anything queued in the same call as the wait. */
+	to_submit = sel_uring_sq_pending(u);
+	sel->uring_waiters++;
+	sel_fd_unlock(sel);
+	rv = sys_io_uring_enter(u->fd, to_submit, 1,
+				IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+				&arg, sizeof(arg));
+	old_errno = errno;
+	sel_fd_lock(sel);
+	sel->uring_waiters--;
+	if (rv < 0) {
+	    if (old_errno != ETIME) {
+		sel_fd_unlock(sel);
+		errno = old_errno;
+		return -1;
+	    }
+	    timed_out = true;
+	}
+    }
+
+    count = sel_uring_cqe_count(u);
+    if (!count) {
+	sel_fd_unlock(sel);
+	/*
+	 * All waiting threads are woken on a completion, if another
+	 * thread took it that is not a timeout.
+	 */
+	return timed_out ? 0 : 1;
+    }
+
+    /*
+     * Handle everything that had completed when we got here, but not
+     * what completes while doing that, or a busy fd could keep this
+     * thread from ever getting back to the timers and runners.
+     */
+    while (count-- > 0 && sel_uring_next_cqe(u, &data, &res))
+	sel_uring_handle_cqe(sel, data, res);
+
+    sel_fd_unlock(sel);
+    return 1;
+}
+
+static int
+sel_setup_forked_uring(struct selector_s *sel)
+{
+    struct sel_uring_s *u;
+    fd_control_t *fdc;
+    int i, rv;
+
+    /* The rings are shared memory, the child must have its own. */
+    rv = sel_uring_alloc(&u);
+    if (rv)
+	return rv;
+    rv = sel_uring_backlog_reserve(u, sel->maxfd + 1);
+    if (rv) {
+	sel_uring_free(u);
+	return rv;
+    }
+    sel_uring_free(sel->uring);
+    sel->uring = u;
+    sel->evfd = u->fd;
+
+    for (i = 0; i <= sel->maxfd; i++) {
+	fdc = get_fd(sel, i);
+	if (!fdc)
+	    continue;
+	fdc->uring_armed = 0;
+	if (fdc->state)
+	    sel_update_fd(sel, fdc, SEL_FD_ADD);
+    }
+    return 0;
+}
+#endif
+
 #ifdef HAVE_EPOLL_PWAIT
+static int
+sel_epoll_timeout(sel_wait_list_t *item)
+{
+    if (item->wait_time.ts.tv_sec > 600)
+	 /* Don't wait over 10 minutes, to work around an old epoll bug
+	    and avoid issues with timeout overflowing on 64-bit systems,
+	    which is much larger that 10 minutes, but who cares. */
+	return 600 * 1000;
+    return ((item->wait_time.ts.tv_sec * 1000) +
+	    (item->wait_time.ts.tv_nsec + 999999) / 1000000);
+}
+
 static int
 process_fds_epoll(struct selector_s *sel, sel_wait_list_t *item,
 		  sigset_t *isigmask)
@@ -1390,14 +2467,7 @@ process_fds_epoll(struct selector_s *sel, sel_wait_list_t *item,
 
     setup_my_sigmask(&sigmask, isigmask);
 
-    if (item->wait_time.ts.tv_sec > 600)
-	 /* Don't wait over 10 minutes, to work around an old epoll bug
-	    and avoid issues with timeout overflowing on 64-bit systems,
-	    which is much larger that 10 minutes, but who cares. */
-	timeout = 600 * 1000;
-    else
-	timeout = ((item->wait_time.ts.tv_sec * 1000) +
-		   (item->wait_time.ts.tv_nsec + 999999) / 1000000);
+    timeout = sel_epoll_timeout(item);
 
     if (sel->wake_sig)
 	sigdelset(&sigmask, sel->wake_sig);
@@ -1452,11 +2522,97 @@ process_fds_epoll(struct selector_s *sel, sel_wait_list_t *item,
     return rv;
 }
 
+/*
+ * Level-triggered version of the above, see sel_update_fd_epoll_lt().
+ * Since nothing needs to be rearmed, this can handle more than one
+ * event per call.
+ */
+#define SEL_EPOLL_LT_EVENTS 16
+
+static int
+process_fds_epoll_lt(struct selector_s *sel, sel_wait_list_t *item,
+		     sigset_t *isigmask)
+{
+    int rv, i;
+    struct epoll_event events[SEL_EPOLL_LT_EVENTS];
+    uint32_t ev;
+    sigset_t sigmask;
+    fd_control_t *fdc;
+    unsigned long entry_fd_del_count;
+
+    setup_my_sigmask(&sigmask, isigmask);
+    if (sel->wake_sig)
+	sigdelset(&sigmask, sel->wake_sig);
+    sel_fd_lock(sel);
+    entry_fd_del_count = sel->fd_del_count;
+    sel_fd_unlock(sel);
+    rv = epoll_pwait(sel->evfd, events, SEL_EPOLL_LT_EVENTS,
+		     sel_epoll_timeout(item), &sigmask);
+    if (rv <= 0)
+	return rv;
+
+    sel_fd_lock(sel);
+    for (i = 0; i < rv; i++) {
+	if (entry_fd_del_count != sel->fd_del_count)
+	    /*
+	     * Something was deleted from the FD set, the rest may be
+	     * from an old fd.  Anything still valid will be reported
+	     * again since the fds are still armed.
+	     */
+	    break;
+	valid_fd(sel, events[i].data.fd, &fdc);
+	if (!fdc->epoll_in_set)
+	    /* Taken out of the set after the event was reported. */
+	    continue;
+	if (fdc->epoll_busy) {
+	    /* Another thread is handling it, let it rearm it. */
+	    fdc->epoll_contended = 1;
+	    sel_update_fd(sel, fdc, SEL_FD_MOD);
+	    continue;
+	}
+
+	ev = events[i].events;
+	if (ev & (EPOLLHUP | EPOLLERR)) {
+	    /* See the comment in process_fds_epoll() on this. */
+	    fdc->saved_events = ev & (EPOLLHUP | EPOLLERR);
+	    ev |= EPOLLIN;
+	}
+	fdc->epoll_busy = 1;
+	if (ev & (EPOLLIN | EPOLLHUP))
+	    handle_selector_call(sel, fdc, NULL, fdc->read_enabled,
+				 fdc->handle_read);
+	if (ev & EPOLLOUT)
+	    handle_selector_call(sel, fdc, NULL, fdc->write_enabled,
+				 fdc->handle_write);
+	if (ev & (EPOLLPRI | EPOLLERR))
+	    handle_selector_call(sel, fdc, NULL, fdc->except_enabled,
+				 fdc->handle_except);
+	fdc->epoll_busy = 0;
+	fdc->epoll_contended = 0;
+
+	/*
+	 * Only does an epoll_ctl() if the enables changed, there was
+	 * contention, or on a hangup.  If the handlers were cleared,
+	 * that already took it out of the set.
+	 */
+	if (fdc->state)
+	    sel_update_fd(sel, fdc, SEL_FD_MOD);
+    }
+    sel_fd_unlock(sel);
+
+    return rv;
+}
+
 int
 sel_setup_forked_process(struct selector_s *sel)
 {
     int i;
 
+#ifdef HAVE_IO_URING
+    if (sel->uring)
+	return sel_setup_forked_uring(sel);
+#endif
+
     /*
      * More epoll stupidity.  In a forked process we must create a new
      * epoll because the epoll state is shared between a parent and a
@@ -1471,8 +2627,11 @@ sel_setup_forked_process(struct selector_s *sel)
     }
 
     for (i = 0; i <= sel->maxfd; i++) {
-	fd_control_t *fdc = sel->fds[i];
-	if (fdc && fdc->state)
+	fd_control_t *fdc = get_fd(sel, i);
+	if (!fdc)
+	    continue;
+	fdc->epoll_in_set = 0;
+	if (fdc->state)
 	    sel_update_fd(sel, fdc, SEL_FD_ADD);
     }
     return 0;
@@ -1619,7 +2778,7 @@ sel_setup_forked_process(struct selector_s *sel)
 	return errno;
     }
     for (i = 0; i <= sel->maxfd; i++) {
-	fd_control_t *fdc = sel->fds[i];
+	fd_control_t *fdc = get_fd(sel, i);
 	if (fdc && fdc->state)
 	    sel_update_fd(sel, fdc, SEL_FD_ADD);
     }
@@ -1629,6 +2788,10 @@ sel_setup_forked_process(struct selector_s *sel)
 int
 sel_setup_forked_process(struct selector_s *sel)
 {
+#ifdef HAVE_IO_URING
+    if (sel->uring)
+	return sel_setup_forked_uring(sel);
+#endif
     /* Nothing to do. */
     return 0;
 }
@@ -1685,8 +2848,15 @@ sel_select_intr_sigmask(struct selector_s *sel,
 			  &wake_time);
 	sel_timer_unlock(sel);
 
+#ifdef HAVE_IO_URING
+	if (sel->uring)
+	    err = process_fds_uring(sel, &wait_entry, sigmask);
+	else
+#endif
 #ifdef HAVE_EPOLL_PWAIT
-	if (sel->evfd >= 0)
+	if (sel->evfd >= 0 && sel->epoll_lt)
+	    err = process_fds_epoll_lt(sel, &wait_entry, sigmask);
+	else if (sel->evfd >= 0)
 	    err = process_fds_epoll(sel, &wait_entry, sigmask);
 	else
 #endif
@@ -1794,6 +2964,47 @@ sel_select_loop(struct selector_s *sel,
     }
 }
 
+/*
+ * The event mechanism may be chosen at runtime with the GENSIO_SELECTOR
+ * environment variable, set to "select", "epoll", "epoll_lt" (level
+ * triggered epoll, see sel_update_fd_epoll_lt()), "kevent" or
+ * "io_uring".  If it is not set, or the mechanism is not available,
+ * the default for the platform is used.
+ */
+enum sel_evtype { SEL_EV_DEFAULT, SEL_EV_SELECT, SEL_EV_EPOLL,
+		  SEL_EV_EPOLL_LT, SEL_EV_URING };
+
+static enum sel_evtype
+sel_get_evtype(void)
+{
+    const char *s = getenv("GENSIO_SELECTOR");
+
+    if (!s)
+#ifdef DEFAULT_IO_URING
+	return SEL_EV_URING;
+#else
+	return SEL_EV_DEFAULT;
+#endif
+    if (strcmp(s, "select") == 0)
+	return SEL_EV_SELECT;
+    if (strcmp(s, "epoll") == 0 || strcmp(s, "kevent") == 0)
+	return SEL_EV_EPOLL;
+    if (strcmp(s, "epoll_lt") == 0)
+	return SEL_EV_EPOLL_LT;
+    if (strcmp(s, "io_uring") == 0)
+	return SEL_EV_URING;
+    return SEL_EV_DEFAULT;
+}
+
+/* The timer wheel is used if GENSIO_SELECTOR_TIMERS is "wheel". */
+static bool
+sel_use_timer_wheel(void)
+{
+    const char *s = getenv("GENSIO_SELECTOR_TIMERS");
+
+    return s && strcmp(s, "wheel") == 0;
+}
+
 /* Initialize the select code. */
 int
 sel_alloc_selector_thread(struct selector_s **new_selector, int wake_sig,
@@ -1806,6 +3017,8 @@ sel_alloc_selector_thread(struct selector_s **new_selector, int wake_sig,
     struct selector_s *sel;
     int rv;
     sigset_t sigset;
+    enum sel_evtype evtype;
+    struct rlimit rl;
 
     sel = sel_alloc(sizeof(*sel));
     if (!sel)
@@ -1827,19 +3040,45 @@ sel_alloc_selector_thread(struct selector_s **new_selector, int wake_sig,
     FD_ZERO((fd_set *) (fd_set *) &sel->write_set);
     FD_ZERO((fd_set *) (fd_set *) &sel->except_set);
 
-    memset(sel->fds, 0, sizeof(sel->fds));
+    /* Size the fd table for the number of fds the process may open. */
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY &&
+		rl.rlim_cur < SEL_FD_MAX_INIT)
+	sel->num_fd_chunks = ((rl.rlim_cur + SEL_FD_CHUNK_SIZE - 1)
+			      >> SEL_FD_CHUNK_SHIFT);
+    else
+	sel->num_fd_chunks = SEL_FD_MAX_INIT >> SEL_FD_CHUNK_SHIFT;
+    if (sel->num_fd_chunks == 0)
+	sel->num_fd_chunks = 1;
+    sel->fd_chunks = sel_alloc(sel->num_fd_chunks * sizeof(*sel->fd_chunks));
+    if (!sel->fd_chunks) {
+	free(sel);
+	return ENOMEM;
+    }
 
     theap_init(&sel->timer_heap);
+    if (sel_use_timer_wheel()) {
+	sel->timer_wheel = sel_alloc(sizeof(*sel->timer_wheel));
+	if (!sel->timer_wheel) {
+	    free(sel->fd_chunks);
+	    free(sel);
+	    return ENOMEM;
+	}
+	sel_wheel_init(sel->timer_wheel);
+    }
 
     if (sel->sel_lock_alloc) {
 	sel->timer_lock = sel->sel_lock_alloc(cb_data);
 	if (!sel->timer_lock) {
+	    free(sel->timer_wheel);
+	    free(sel->fd_chunks);
 	    free(sel);
 	    return ENOMEM;
 	}
 	sel->fd_lock = sel->sel_lock_alloc(cb_data);
 	if (!sel->fd_lock) {
 	    sel->sel_lock_free(sel->fd_lock);
+	    free(sel->timer_wheel);
+	    free(sel->fd_chunks);
 	    free(sel);
 	    return ENOMEM;
 	}
@@ -1853,20 +3092,41 @@ sel_alloc_selector_thread(struct selector_s **new_selector, int wake_sig,
 	    sel->sel_lock_free(sel->fd_lock);
 		sel->sel_lock_free(sel->timer_lock);
 	}
+	free(sel->timer_wheel);
+	free(sel->fd_chunks);
 	free(sel);
 	return rv;
     }
 
     sel->evfd = -1;
+    evtype = sel_get_evtype();
+#ifdef HAVE_IO_URING
+    if (evtype == SEL_EV_URING) {
+	rv = sel_uring_alloc(&sel->uring);
+	if (rv)
+	    syslog(LOG_ERR, "Unable to set up io_uring, falling back: %s",
+		   strerror(rv));
+	else
+	    sel->evfd = sel->uring->fd;
+    }
+#endif
 #ifdef HAVE_EPOLL_PWAIT
-    sel->evfd = epoll_create(32768);
-    if (sel->evfd == -1)
-	syslog(LOG_ERR, "Unable to set up epoll, falling back to select: %m");
+    if (sel->evfd == -1 && evtype != SEL_EV_SELECT) {
+	sel->evfd = epoll_create(32768);
+	if (sel->evfd == -1)
+	    syslog(LOG_ERR,
+		   "Unable to set up epoll, falling back to select: %m");
+	else
+	    sel->epoll_lt = evtype == SEL_EV_EPOLL_LT;
+    }
 #endif
 #ifdef USE_KEVENT
-    sel->evfd = kqueue();
-    if (sel->evfd == -1)
-	syslog(LOG_ERR, "Unable to set up kevent, falling back to select: %m");
+    if (sel->evfd == -1 && evtype != SEL_EV_SELECT) {
+	sel->evfd = kqueue();
+	if (sel->evfd == -1)
+	    syslog(LOG_ERR,
+		   "Unable to set up kevent, falling back to select: %m");
+    }
 #endif
 
     *new_selector = sel;
@@ -1887,25 +3147,35 @@ sel_free_selector(struct selector_s *sel)
     sel_timer_t *elem;
     unsigned int i;
 
-    elem = theap_get_top(&(sel->timer_heap));
+    elem = sel_timerq_get_any(sel);
     while (elem) {
-	theap_remove(&(sel->timer_heap), elem);
-	elem->val.in_heap = 0;
+	sel_timerq_remove(sel, elem);
 	free(elem);
-	elem = theap_get_top(&(sel->timer_heap));
+	elem = sel_timerq_get_any(sel);
     }
+    if (sel->timer_wheel)
+	free(sel->timer_wheel);
+#ifdef HAVE_IO_URING
+    if (sel->uring)
+	sel_uring_free(sel->uring);
+    else
+#endif
     if (sel->evfd >= 0)
 	close(sel->evfd);
-    for (i = 0; i < FD_SETSIZE; i++) {
-	while (sel->fds[i]) {
-	    fd_control_t *fdc = sel->fds[i];
-
-	    sel->fds[i] = fdc->next;
-	    if (fdc->state)
-		free(fdc->state);
-	    free(fdc);
+    for (i = 0; i < sel->num_fd_chunks; i++) {
+	fd_control_t *fdcs = sel->fd_chunks[i];
+	unsigned int j;
+
+	if (!fdcs)
+	    continue;
+	for (j = 0; j < SEL_FD_CHUNK_SIZE; j++) {
+	    if (fdcs[j].state)
+		free(fdcs[j].state);
 	}
+	free(fdcs);
     }
+    if (sel->fd_chunks)
+	free(sel->fd_chunks);
     if (sel->fd_lock)
 	sel->sel_lock_free(sel->fd_lock);
     if (sel->timer_lock)
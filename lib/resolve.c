@@ -0,0 +1,654 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2024  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * Name resolution that does not block the caller.
+ *
+ * Looking up a host name goes through getaddrinfo(), which can take a
+ * long time if the resolver is slow.  That stalls everything running
+ * on the thread that does it.  The code here keeps a process-wide
+ * cache of scanned addresses and has a small pool of worker threads
+ * that do lookups and report the result back through a runner.
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include <gensio/gensio.h>
+#include <gensio/gensio_class.h>
+#include <gensio/gensio_os_funcs.h>
+#include <gensio/gensio_osops.h>
+#include <gensio/gensio_list.h>
+
+#include "resolve.h"
+
+/* The most addresses kept in the cache, the least recently used go. */
+#define GENSIO_ADDR_CACHE_MAX 256
+
+/* The most worker threads doing lookups. */
+#define GENSIO_RESOLVE_MAX_THREADS 4
+
+struct addr_cache_entry {
+    struct gensio_link link;
+    char *key;
+    struct gensio_addr *addr;
+    int64_t expires; /* In seconds of monotonic time. */
+};
+
+enum netaddr_op_state {
+    /* Waiting for a worker, or for the runner if there are no workers. */
+    NETADDR_OP_QUEUED,
+    /* The lookup is being done. */
+    NETADDR_OP_RUNNING,
+    /* The runner is scheduled to report the result. */
+    NETADDR_OP_DONE,
+    /* The done callback is being called. */
+    NETADDR_OP_IN_CB
+};
+
+struct gensio_netaddr_op {
+    struct gensio_link link;
+    struct gensio_os_funcs *o;
+    struct gensio_runner *runner;
+    enum netaddr_op_state state;
+    bool queued; /* On the worker queue. */
+    bool cancelled;
+
+    char *str;
+    bool listen;
+    int protocol;
+
+    int err;
+    struct gensio_addr *addr;
+
+    gensio_netaddr_done done;
+    void *cb_data;
+};
+
+static struct gensio_once resolve_once;
+static int resolve_init_rv;
+
+/* All allocations held by the cache and workers come from res_o. */
+static struct gensio_os_funcs *res_o;
+static struct gensio_lock *res_lock;
+
+static struct gensio_list cache_list; /* Most recently used first. */
+static unsigned int cache_count;
+static unsigned long cache_hits, cache_misses;
+
+static struct gensio_list op_queue;
+static unsigned int op_queue_len;
+static struct gensio_norun_waiter *res_waiter;
+static struct gensio_thread *res_threads[GENSIO_RESOLVE_MAX_THREADS];
+static unsigned int res_nthreads;
+static unsigned int res_idle;
+static bool res_shutdown;
+
+static void
+addr_cache_entry_free(struct addr_cache_entry *e)
+{
+    gensio_addr_free(e->addr);
+    res_o->free(res_o, e->key);
+    res_o->free(res_o, e);
+}
+
+static void
+netaddr_op_free(struct gensio_netaddr_op *op)
+{
+    struct gensio_os_funcs *o = op->o;
+
+    if (op->addr)
+	gensio_addr_free(op->addr);
+    o->free_runner(op->runner);
+    o->free(o, op->str);
+    o->free(o, op);
+}
+
+void
+gensio_resolve_cleanup_mem(void)
+{
+    struct gensio_link *l, *l2;
+    unsigned int i;
+
+    if (!res_lock)
+	return;
+
+    res_o->lock(res_lock);
+    res_shutdown = true;
+    res_o->unlock(res_lock);
+    for (i = 0; i < res_nthreads; i++)
+	gensio_os_norun_waiter_wake(res_waiter);
+    for (i = 0; i < res_nthreads; i++)
+	gensio_os_wait_thread(res_threads[i]);
+    res_nthreads = 0;
+    res_idle = 0;
+    res_shutdown = false;
+
+    gensio_list_for_each_safe(&op_queue, l, l2) {
+	struct gensio_netaddr_op *op =
+	    gensio_container_of(l, struct gensio_netaddr_op, link);
+
+	gensio_list_rm(&op_queue, l);
+	netaddr_op_free(op);
+    }
+    op_queue_len = 0;
+
+    gensio_list_for_each_safe(&cache_list, l, l2) {
+	struct addr_cache_entry *e =
+	    gensio_container_of(l, struct addr_cache_entry, link);
+
+	gensio_list_rm(&cache_list, l);
+	addr_cache_entry_free(e);
+    }
+    cache_count = 0;
+    cache_hits = 0;
+    cache_misses = 0;
+
+    if (res_waiter)
+	gensio_os_free_norun_waiter(res_waiter);
+    res_waiter = NULL;
+    res_o->free_lock(res_lock);
+    res_lock = NULL;
+    res_o->free_funcs(res_o);
+    res_o = NULL;
+    memset(&resolve_once, 0, sizeof(resolve_once));
+}
+
+static void
+resolve_init(void *cb_data)
+{
+    struct gensio_os_funcs *o = cb_data;
+
+    gensio_list_init(&cache_list);
+    gensio_list_init(&op_queue);
+    res_lock = o->alloc_lock(o);
+    if (!res_lock) {
+	resolve_init_rv = GE_NOMEM;
+	return;
+    }
+    /* Without a waiter there are no workers, lookups run in the runner. */
+    res_waiter = gensio_os_alloc_norun_waiter(o);
+    res_o = o->get_funcs(o);
+    resolve_init_rv = 0;
+}
+
+static int
+resolve_initialize(struct gensio_os_funcs *o)
+{
+    o->call_once(o, &resolve_once, resolve_init, o);
+    return resolve_init_rv;
+}
+
+static int
+get_cache_time(struct gensio_os_funcs *o, int *cache_time)
+{
+    return gensio_get_default(o, NULL, "addr-cache-time", false,
+			      GENSIO_DEFAULT_INT, NULL, cache_time);
+}
+
+static int64_t
+now_secs(struct gensio_os_funcs *o)
+{
+    gensio_time now;
+
+    o->get_monotonic_time(o, &now);
+    return now.secs;
+}
+
+/* Called with res_lock held. */
+static struct addr_cache_entry *
+addr_cache_find(const char *key)
+{
+    struct gensio_link *l;
+
+    gensio_list_for_each(&cache_list, l) {
+	struct addr_cache_entry *e =
+	    gensio_container_of(l, struct addr_cache_entry, link);
+
+	if (strcmp(e->key, key) == 0)
+	    return e;
+    }
+    return NULL;
+}
+
+/* Called with res_lock held. */
+static void
+addr_cache_add(struct addr_cache_entry *ne)
+{
+    struct addr_cache_entry *e;
+
+    e = addr_cache_find(ne->key);
+    if (e) {
+	/* Someone else looked it up at the same time, use the newer one. */
+	gensio_list_rm(&cache_list, &e->link);
+	addr_cache_entry_free(e);
+	cache_count--;
+    }
+    gensio_list_add_head(&cache_list, &ne->link);
+    cache_count++;
+    if (cache_count > GENSIO_ADDR_CACHE_MAX) {
+	e = gensio_container_of(gensio_list_last(&cache_list),
+				struct addr_cache_entry, link);
+	gensio_list_rm(&cache_list, &e->link);
+	addr_cache_entry_free(e);
+	cache_count--;
+    }
+}
+
+/*
+ * Scan the address, using the cache.  This may block in the resolver,
+ * so it is run from the workers for async lookups.
+ */
+static int
+netaddr_lookup(struct gensio_os_funcs *o, const char *str, bool listen,
+	       int protocol, struct gensio_addr **raddr)
+{
+    struct addr_cache_entry *e;
+    struct gensio_addr *addr, *naddr;
+    int cache_time, err;
+    int64_t now;
+    char *key;
+
+    err = get_cache_time(o, &cache_time);
+    if (err)
+	return err;
+    if (cache_time == 0)
+	return gensio_os_scan_netaddr(o, str, listen, protocol, raddr);
+
+    key = gensio_alloc_sprintf(res_o, "%d,%d,%s", listen, protocol, str);
+    if (!key)
+	return GE_NOMEM;
+
+    now = now_secs(o);
+    res_o->lock(res_lock);
+    e = addr_cache_find(key);
+    if (e && e->expires > now) {
+	gensio_list_rm(&cache_list, &e->link);
+	gensio_list_add_head(&cache_list, &e->link);
+	cache_hits++;
+	addr = gensio_addr_dup(e->addr);
+	res_o->unlock(res_lock);
+	res_o->free(res_o, key);
+	if (!addr)
+	    return GE_NOMEM;
+	*raddr = addr;
+	return 0;
+    }
+    if (e) {
+	gensio_list_rm(&cache_list, &e->link);
+	addr_cache_entry_free(e);
+	cache_count--;
+    }
+    cache_misses++;
+    res_o->unlock(res_lock);
+
+    err = gensio_os_scan_netaddr(res_o, str, listen, protocol, &addr);
+    if (err)
+	goto out_err;
+
+    naddr = gensio_addr_dup(addr);
+    if (!naddr) {
+	err = GE_NOMEM;
+	goto out_err_addr;
+    }
+
+    e = res_o->zalloc(res_o, sizeof(*e));
+    if (!e) {
+	err = GE_NOMEM;
+	gensio_addr_free(naddr);
+	goto out_err_addr;
+    }
+    e->key = key;
+    e->addr = addr;
+    e->expires = now + cache_time;
+    res_o->lock(res_lock);
+    addr_cache_add(e);
+    res_o->unlock(res_lock);
+
+    *raddr = naddr;
+    return 0;
+
+ out_err_addr:
+    gensio_addr_free(addr);
+ out_err:
+    res_o->free(res_o, key);
+    return err;
+}
+
+int
+gensio_scan_netaddr_cached(struct gensio_os_funcs *o, const char *str,
+			   bool listen, int protocol,
+			   struct gensio_addr **raddr)
+{
+    int err;
+
+    err = resolve_initialize(o);
+    if (err)
+	return err;
+    return netaddr_lookup(o, str, listen, protocol, raddr);
+}
+
+void
+gensio_netaddr_cache_stats(unsigned long *hits, unsigned long *misses)
+{
+    if (!res_lock) {
+	*hits = 0;
+	*misses = 0;
+	return;
+    }
+    res_o->lock(res_lock);
+    *hits = cache_hits;
+    *misses = cache_misses;
+    res_o->unlock(res_lock);
+}
+
+/* Called with res_lock held. */
+static void
+netaddr_op_finish(struct gensio_netaddr_op *op, int err,
+		  struct gensio_addr *addr)
+{
+    op->err = err;
+    op->addr = addr;
+    if (op->cancelled) {
+	netaddr_op_free(op);
+    } else {
+	op->state = NETADDR_OP_DONE;
+	op->o->run(op->runner);
+    }
+}
+
+static void
+resolve_thread(void *data)
+{
+    struct gensio_netaddr_op *op;
+    struct gensio_addr *addr = NULL;
+    int err;
+
+    res_o->lock(res_lock);
+    for (;;) {
+	while (!res_shutdown && gensio_list_empty(&op_queue)) {
+	    res_idle++;
+	    res_o->unlock(res_lock);
+	    gensio_os_norun_waiter_wait(res_waiter);
+	    res_o->lock(res_lock);
+	    res_idle--;
+	}
+	if (res_shutdown)
+	    break;
+
+	op = gensio_container_of(gensio_list_first(&op_queue),
+				 struct gensio_netaddr_op, link);
+	gensio_list_rm(&op_queue, &op->link);
+	op_queue_len--;
+	op->queued = false;
+	op->state = NETADDR_OP_RUNNING;
+	res_o->unlock(res_lock);
+
+	err = netaddr_lookup(op->o, op->str, op->listen, op->protocol, &addr);
+
+	res_o->lock(res_lock);
+	netaddr_op_finish(op, err, err ? NULL : addr);
+    }
+    res_o->unlock(res_lock);
+}
+
+static void
+netaddr_op_runner(struct gensio_runner *runner, void *cb_data)
+{
+    struct gensio_netaddr_op *op = cb_data;
+    struct gensio_addr *addr = NULL;
+    int err;
+
+    res_o->lock(res_lock);
+    if (op->state == NETADDR_OP_QUEUED) {
+	/* No workers, do it here. */
+	if (op->cancelled) {
+	    res_o->unlock(res_lock);
+	    netaddr_op_free(op);
+	    return;
+	}
+	op->state = NETADDR_OP_RUNNING;
+	res_o->unlock(res_lock);
+	err = netaddr_lookup(op->o, op->str, op->listen, op->protocol, &addr);
+	res_o->lock(res_lock);
+	op->err = err;
+	op->addr = err ? NULL : addr;
+    }
+    if (op->cancelled) {
+	res_o->unlock(res_lock);
+	netaddr_op_free(op);
+	return;
+    }
+    op->state = NETADDR_OP_IN_CB;
+    res_o->unlock(res_lock);
+
+    addr = op->addr;
+    op->addr = NULL;
+    op->done(op->o, op->err, addr, op->cb_data);
+    netaddr_op_free(op);
+}
+
+/* Called with res_lock held, returns true if no worker could be had. */
+static bool
+resolve_get_worker(void)
+{
+    int err;
+
+    if (!res_waiter)
+	return true;
+    if (op_queue_len > res_idle && res_nthreads < GENSIO_RESOLVE_MAX_THREADS) {
+	err = gensio_os_new_thread(res_o, resolve_thread, NULL,
+				   &res_threads[res_nthreads]);
+	if (!err)
+	    res_nthreads++;
+    }
+    return res_nthreads == 0;
+}
+
+int
+gensio_scan_netaddr_async(struct gensio_os_funcs *o, const char *str,
+			  bool listen, int protocol,
+			  gensio_netaddr_done done, void *cb_data,
+			  struct gensio_netaddr_op **rop)
+{
+    struct gensio_netaddr_op *op;
+    int err;
+
+    err = resolve_initialize(o);
+    if (err)
+	return err;
+
+    op = o->zalloc(o, sizeof(*op));
+    if (!op)
+	return GE_NOMEM;
+    op->o = o;
+    op->listen = listen;
+    op->protocol = protocol;
+    op->done = done;
+    op->cb_data = cb_data;
+    op->state = NETADDR_OP_QUEUED;
+    op->str = gensio_strdup(o, str);
+    if (!op->str)
+	goto out_nomem;
+    op->runner = o->alloc_runner(o, netaddr_op_runner, op);
+    if (!op->runner)
+	goto out_nomem;
+
+    res_o->lock(res_lock);
+    gensio_list_add_tail(&op_queue, &op->link);
+    op_queue_len++;
+    if (resolve_get_worker()) {
+	gensio_list_rm(&op_queue, &op->link);
+	op_queue_len--;
+	o->run(op->runner);
+    } else {
+	op->queued = true;
+	gensio_os_norun_waiter_wake(res_waiter);
+    }
+    if (rop)
+	*rop = op;
+    res_o->unlock(res_lock);
+
+    return 0;
+
+ out_nomem:
+    if (op->str)
+	o->free(o, op->str);
+    o->free(o, op);
+    return GE_NOMEM;
+}
+
+int
+gensio_scan_netaddr_cancel(struct gensio_netaddr_op *op)
+{
+    int rv = 0;
+
+    res_o->lock(res_lock);
+    if (op->state == NETADDR_OP_IN_CB) {
+	rv = GE_INUSE;
+    } else if (op->queued) {
+	gensio_list_rm(&op_queue, &op->link);
+	op_queue_len--;
+	netaddr_op_free(op);
+    } else {
+	/* The worker or runner will free it. */
+	op->cancelled = true;
+    }
+    res_o->unlock(res_lock);
+
+    return rv;
+}
+
+struct gensio_netaddr_refresh {
+    struct gensio_os_funcs *o;
+    struct gensio_lock *lock;
+
+    char *str;
+    bool listen;
+    int protocol;
+
+    int64_t next; /* Don't look it up again before this time. */
+    struct gensio_netaddr_op *op;
+    struct gensio_addr *addr; /* Waiting for the next check. */
+    bool freed;
+};
+
+static void
+netaddr_refresh_finish_free(struct gensio_netaddr_refresh *r)
+{
+    struct gensio_os_funcs *o = r->o;
+
+    if (r->addr)
+	gensio_addr_free(r->addr);
+    o->free_lock(r->lock);
+    o->free(o, r->str);
+    o->free(o, r);
+}
+
+int
+gensio_netaddr_refresh_alloc(struct gensio_os_funcs *o, const char *str,
+			     bool listen, int protocol,
+			     struct gensio_netaddr_refresh **rr)
+{
+    struct gensio_netaddr_refresh *r;
+    int cache_time, err;
+
+    err = get_cache_time(o, &cache_time);
+    if (err)
+	return err;
+    if (cache_time == 0) {
+	/* Refreshing is off, the address is never looked up again. */
+	*rr = NULL;
+	return 0;
+    }
+
+    r = o->zalloc(o, sizeof(*r));
+    if (!r)
+	return GE_NOMEM;
+    r->o = o;
+    r->listen = listen;
+    r->protocol = protocol;
+    /* The address was just scanned by the caller. */
+    r->next = now_secs(o) + cache_time;
+    r->str = gensio_strdup(o, str);
+    if (!r->str)
+	goto out_nomem;
+    r->lock = o->alloc_lock(o);
+    if (!r->lock)
+	goto out_nomem;
+
+    *rr = r;
+    return 0;
+
+ out_nomem:
+    if (r->str)
+	o->free(o, r->str);
+    o->free(o, r);
+    return GE_NOMEM;
+}
+
+static void
+netaddr_refresh_done(struct gensio_os_funcs *o, int err,
+		     struct gensio_addr *addr, void *cb_data)
+{
+    struct gensio_netaddr_refresh *r = cb_data;
+    int cache_time;
+
+    o->lock(r->lock);
+    r->op = NULL;
+    if (r->freed) {
+	o->unlock(r->lock);
+	if (addr)
+	    gensio_addr_free(addr);
+	netaddr_refresh_finish_free(r);
+	return;
+    }
+    if (!err) {
+	if (r->addr)
+	    gensio_addr_free(r->addr);
+	r->addr = addr;
+    }
+    /* On failure keep the old address and try again later. */
+    if (get_cache_time(o, &cache_time))
+	cache_time = 0;
+    r->next = now_secs(o) + cache_time;
+    o->unlock(r->lock);
+}
+
+struct gensio_addr *
+gensio_netaddr_refresh_check(struct gensio_netaddr_refresh *r)
+{
+    struct gensio_os_funcs *o = r->o;
+    struct gensio_addr *addr;
+
+    o->lock(r->lock);
+    addr = r->addr;
+    r->addr = NULL;
+    if (!r->op && now_secs(o) >= r->next)
+	/* If this fails, it's tried again on the next check. */
+	gensio_scan_netaddr_async(o, r->str, r->listen, r->protocol,
+				  netaddr_refresh_done, r, &r->op);
+    o->unlock(r->lock);
+
+    return addr;
+}
+
+void
+gensio_netaddr_refresh_free(struct gensio_netaddr_refresh *r)
+{
+    struct gensio_os_funcs *o = r->o;
+
+    o->lock(r->lock);
+    if (r->op && gensio_scan_netaddr_cancel(r->op) == GE_INUSE) {
+	/* The done callback is waiting on the lock, let it free. */
+	r->freed = true;
+	o->unlock(r->lock);
+	return;
+    }
+    o->unlock(r->lock);
+    netaddr_refresh_finish_free(r);
+}
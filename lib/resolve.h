@@ -0,0 +1,17 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2024  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef GENSIO_RESOLVE_H
+#define GENSIO_RESOLVE_H
+
+/*
+ * Stop the lookup workers and free the address cache, from
+ * gensio_cleanup_mem().
+ */
+void gensio_resolve_cleanup_mem(void);
+
+#endif /* GENSIO_RESOLVE_H */
@@ -1718,7 +1718,7 @@ iodev_gensio_alloc(const void *gdata, const char * const args[],
     struct sterm_data *sdata = o->zalloc(o, sizeof(*sdata));
     int err;
     char *comma;
-    gensiods max_read_size = GENSIO_DEFAULT_BUF_SIZE;
+    gensiods max_read_size, readbuf_max, read_batch;
     int i, ival;
     bool lock_set = false, dummy = false, wronly = false, rdonly = false;
     const char *s;
@@ -1753,10 +1753,29 @@ iodev_gensio_alloc(const void *gdata, const char * const args[],
 			     GENSIO_DEFAULT_INT, NULL, &sdata->char_drain_wait);
     if (err)
 	goto out_err;
+    err = gensio_get_default(o, "serialdev", "readbuf", false,
+			     GENSIO_DEFAULT_INT, NULL, &ival);
+    if (err)
+	goto out_err;
+    max_read_size = ival;
+    err = gensio_get_default(o, "serialdev", "readbuf-max", false,
+			     GENSIO_DEFAULT_INT, NULL, &ival);
+    if (err)
+	goto out_err;
+    readbuf_max = ival;
+    err = gensio_get_default(o, "serialdev", "readbatch", false,
+			     GENSIO_DEFAULT_INT, NULL, &ival);
+    if (err)
+	goto out_err;
+    read_batch = ival;
 
     for (i = 0; args && args[i]; i++) {
 	if (gensio_pparm_ds(&p, args[i], "readbuf", &max_read_size) > 0)
 	    continue;
+	if (gensio_pparm_ds(&p, args[i], "readbuf-max", &readbuf_max) > 0)
+	    continue;
+	if (gensio_pparm_ds(&p, args[i], "readbatch", &read_batch) > 0)
+	    continue;
 	if (gensio_pparm_bool(&p, args[i], "wronly", &wronly) > 0)
 	    continue;
 	if (gensio_pparm_bool(&p, args[i], "rdonly", &rdonly) > 0)
@@ -1885,6 +1904,10 @@ iodev_gensio_alloc(const void *gdata, const char * const args[],
 				   sdata->read_only);
     if (!sdata->ll)
 	goto out_nomem;
+    /* The flags are kept at the buffer's midpoint, so it can't change. */
+    if (!o->read_flags)
+	gensio_fd_ll_set_readbuf_max(sdata->ll, readbuf_max);
+    gensio_fd_ll_set_read_batch(sdata->ll, read_batch);
 
     /*
      * After this point, freeing the ll or io will free sdata through
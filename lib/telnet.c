@@ -256,7 +256,22 @@ process_telnet_data(unsigned char *outdata, unsigned int outlen,
 	    td->telnet_cmd[td->telnet_cmd_pos++] = TN_IAC;
 	    td->suboption_iac = 0;
 	} else {
-	    outdata[j++] = indata[i];
+	    /*
+	     * Plain data, copy everything up to the next IAC in one
+	     * go.  memchr is generally much faster than checking a
+	     * byte at a time.
+	     */
+	    unsigned int len = *inlen - i;
+	    unsigned char *iac;
+
+	    if (len > outlen - j)
+		len = outlen - j;
+	    iac = memchr(indata + i, TN_IAC, len);
+	    if (iac)
+		len = iac - (indata + i);
+	    memcpy(outdata + j, indata + i, len);
+	    j += len;
+	    i += len - 1; /* The loop adds one. */
 	}
     }
 
@@ -270,24 +285,31 @@ unsigned int
 process_telnet_xmit(unsigned char *outdata, unsigned int outlen,
 		    const unsigned char **indata, size_t *r_inlen)
 {
-    unsigned int i, j = 0;
+    unsigned int i = 0, j = 0, len;
     unsigned int inlen = *r_inlen;
-    const unsigned char *ibuf = *indata;
-
-    /* Double the IACs on a telnet transmit stream. */
-    for (i = 0; i < inlen; i++) {
-	if (ibuf[i] == TN_IAC) {
-	    if (outlen < 2)
-		    break;
-	    outdata[j++] = TN_IAC;
-	    outdata[j++] = TN_IAC;
-	    outlen -= 2;
-	} else {
-	    if (outlen < 1)
-		break;
-	    outdata[j++] = ibuf[i];
-	    outlen--;
-	}
+    const unsigned char *ibuf = *indata, *iac;
+
+    /*
+     * Double the IACs on a telnet transmit stream.  Copy everything up
+     * to the next IAC in one go, then handle the IAC.
+     */
+    while (i < inlen) {
+	len = inlen - i;
+	if (len > outlen)
+	    len = outlen;
+	iac = memchr(ibuf + i, TN_IAC, len);
+	if (iac)
+	    len = iac - (ibuf + i);
+	memcpy(outdata + j, ibuf + i, len);
+	i += len;
+	j += len;
+	outlen -= len;
+	if (!iac || outlen < 2)
+	    break;
+	outdata[j++] = TN_IAC;
+	outdata[j++] = TN_IAC;
+	outlen -= 2;
+	i++;
     }
 
     *indata = ibuf + i;
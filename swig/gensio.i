@@ -420,6 +420,13 @@ struct waiter { };
 %constant int GENSIO_CONTROL_IN_FORMAT = GENSIO_CONTROL_IN_FORMAT;
 %constant int GENSIO_CONTROL_OUT_FORMAT = GENSIO_CONTROL_OUT_FORMAT;
 %constant int GENSIO_CONTROL_DRAIN_COUNT = GENSIO_CONTROL_DRAIN_COUNT;
+%constant int GENSIO_CONTROL_PRIORITY = GENSIO_CONTROL_PRIORITY;
+%constant int GENSIO_CONTROL_WEIGHT = GENSIO_CONTROL_WEIGHT;
+%constant int GENSIO_CONTROL_SESSION_REUSED = GENSIO_CONTROL_SESSION_REUSED;
+%constant int GENSIO_CONTROL_SESSION_STATS = GENSIO_CONTROL_SESSION_STATS;
+%constant int GENSIO_CONTROL_RAW_IOD = GENSIO_CONTROL_RAW_IOD;
+%constant int GENSIO_CONTROL_READBUF = GENSIO_CONTROL_READBUF;
+%constant int GENSIO_CONTROL_READ_STATS = GENSIO_CONTROL_READ_STATS;
 
 %constant int GENSIO_CONTROL_SER_MODEMSTATE = GENSIO_CONTROL_SER_MODEMSTATE;
 %constant int GENSIO_CONTROL_SER_SEND_MODEMSTATE = GENSIO_CONTROL_SER_SEND_MODEMSTATE;
@@ -1083,6 +1090,7 @@ struct waiter { };
 %constant int GENSIO_ACC_CONTROL_LADDR = GENSIO_ACC_CONTROL_LADDR;
 %constant int GENSIO_ACC_CONTROL_LPORT = GENSIO_ACC_CONTROL_LPORT;
 %constant int GENSIO_ACC_CONTROL_TCPDNAME = GENSIO_ACC_CONTROL_TCPDNAME;
+%constant int GENSIO_ACC_CONTROL_SESSION_STATS = GENSIO_ACC_CONTROL_SESSION_STATS;
 
 %extend gensio_accepter {
     gensio_accepter(struct gensio_os_funcs *o, char *str, swig_cb *handler) {
@@ -0,0 +1,797 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2024  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * An AFSK receive benchmark.  It plays a WAV file through
+ *
+ *   afskmdm(tx=false),sound(type=file,...),<file>
+ *
+ * as fast as the decoder will take it and reports the number of sound
+ * samples decoded per second and the number of frames received.  Give
+ * a recording with -f, 16 bit integer and 32 bit float WAV files are
+ * supported.  The file sound type does not know about WAV headers, so
+ * the sample data is copied to a temporary file first, in host byte
+ * order.
+ *
+ * Without -f it generates a 48000 samples/sec 1200 baud AFSK
+ * recording of -n random AX.25 sized frames with noise of amplitude
+ * -N (the signal's amplitude is .5).  -o moves both tones up (or
+ * down, if negative) by that many Hz, like a mistuned transmitter.
+ * -w writes that to a WAV file so it can be looked at or used with -f
+ * later.
+ *
+ * -d runs that many decoders at once on the same file, each with its
+ * own stack and each listening 100Hz further off the real tones,
+ * alternating up and down.  With -m they are all in one stack instead, using the
+ * decoders option of afskmdm to share the input and filtering, and
+ * each frame should only be received once.
+ *
+ * It also times the DFT bin code from lib/fskdft.h on its own, the
+ * vector version against the plain scalar one.
+ *
+ * With -c it is run as a test.  It then checks that every generated
+ * frame is received by every decoder (or every stack with -m) once,
+ * in order, with the right contents, and that the vector and scalar DFT code give the same power values, to
+ * within rounding, for real and complex data.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <math.h>
+#include <complex.h>
+#include <gensio/gensio.h>
+#include <gensio/gensio_os_funcs.h>
+#include "../lib/crc.h"
+#include "../lib/fskdft.h"
+#include "benchutil.h"
+
+#define RATE		48000
+#define BAUD		1200
+#define MARK		2200.
+#define SPACE		1200.
+#define SHIFT		100. /* Tone offset between decoders. */
+
+static struct gensio_waiter *waiter;
+
+struct frame {
+    unsigned char data[256];
+    unsigned int len;
+};
+
+static struct frame *frames;
+static float tone_offset;
+static unsigned int nframes = 100;
+
+struct decoder {
+    struct gensio *io;
+    unsigned int next; /* The frame we expect next. */
+    unsigned int nrecv;
+    unsigned int nbad; /* Frames that aren't ours. */
+    bool done;
+};
+
+static struct decoder *decoders;
+static unsigned int ndecoders = 1, nstacks = 1, ndone;
+static bool shared;
+
+/*
+ * WAV file generation.
+ */
+struct gen {
+    FILE *f;
+    unsigned long long nsamples;
+    double phase;
+    unsigned int level;
+    unsigned int ones;
+    float noise;
+};
+
+static void
+gen_sample(struct gen *g, float v)
+{
+    int16_t s;
+    unsigned char b[2];
+
+    v += g->noise * (2.0 * rand() / RAND_MAX - 1.0);
+    if (v > 1.0)
+	v = 1.0;
+    else if (v < -1.0)
+	v = -1.0;
+    s = v * 32767;
+    b[0] = s & 0xff;
+    b[1] = (s >> 8) & 0xff;
+    fwrite(b, 1, 2, g->f);
+    g->nsamples++;
+}
+
+static void
+gen_silence(struct gen *g, unsigned int n)
+{
+    while (n--)
+	gen_sample(g, 0);
+}
+
+/*
+ * Send a bit the way afskmdm does by default, inverted and
+ * differential, so a 0 changes the tone and a 1 leaves it alone.
+ */
+static void
+gen_bit(struct gen *g, unsigned int bit)
+{
+    double freq;
+    unsigned int i;
+
+    if (!bit)
+	g->level = !g->level;
+    freq = (g->level ? MARK : SPACE) + tone_offset;
+    for (i = 0; i < RATE / BAUD; i++) {
+	gen_sample(g, .5 * sin(g->phase));
+	g->phase += 2 * M_PI * freq / RATE;
+	if (g->phase > 2 * M_PI)
+	    g->phase -= 2 * M_PI;
+    }
+}
+
+static void
+gen_byte(struct gen *g, unsigned char byte, bool stuff)
+{
+    unsigned int i, bit;
+
+    for (i = 0; i < 8; i++, byte >>= 1) {
+	bit = byte & 1;
+	gen_bit(g, bit);
+	if (!stuff)
+	    continue;
+	if (bit) {
+	    if (++g->ones == 5) {
+		gen_bit(g, 0);
+		g->ones = 0;
+	    }
+	} else {
+	    g->ones = 0;
+	}
+    }
+}
+
+static void
+gen_frame(struct gen *g, struct frame *f)
+{
+    unsigned int i;
+    uint16_t crc = 0xffff;
+
+    for (i = 0; i < 20; i++)
+	gen_byte(g, 0x7e, false);
+    g->ones = 0;
+    for (i = 0; i < f->len; i++)
+	gen_byte(g, f->data[i], true);
+    crc16_ccitt(f->data, f->len, &crc);
+    crc ^= 0xffff;
+    gen_byte(g, crc & 0xff, true);
+    gen_byte(g, crc >> 8, true);
+    for (i = 0; i < 3; i++)
+	gen_byte(g, 0x7e, false);
+    gen_silence(g, RATE / 20);
+}
+
+static void
+put_le(unsigned char *p, uint32_t v, unsigned int size)
+{
+    unsigned int i;
+
+    for (i = 0; i < size; i++, v >>= 8)
+	p[i] = v & 0xff;
+}
+
+static void
+write_wav_header(FILE *f, unsigned long long nsamples)
+{
+    unsigned char h[44];
+
+    memcpy(h, "RIFF", 4);
+    put_le(h + 4, 36 + nsamples * 2, 4);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put_le(h + 16, 16, 4);
+    put_le(h + 20, 1, 2); /* PCM */
+    put_le(h + 22, 1, 2); /* channels */
+    put_le(h + 24, RATE, 4);
+    put_le(h + 28, RATE * 2, 4);
+    put_le(h + 32, 2, 2);
+    put_le(h + 34, 16, 2);
+    memcpy(h + 36, "data", 4);
+    put_le(h + 40, nsamples * 2, 4);
+    fwrite(h, 1, sizeof(h), f);
+}
+
+/*
+ * Generate the frames and the WAV file holding them.  The header is
+ * written once the length is known.
+ */
+static int
+generate(const char *fname, float noise)
+{
+    struct gen g;
+    unsigned int i, j;
+
+    memset(&g, 0, sizeof(g));
+    g.noise = noise;
+    g.f = fopen(fname, "w+");
+    if (!g.f) {
+	perror(fname);
+	return 1;
+    }
+    frames = calloc(nframes, sizeof(*frames));
+    if (!frames) {
+	fprintf(stderr, "Out of memory\n");
+	return 1;
+    }
+    write_wav_header(g.f, 0);
+    gen_silence(&g, RATE / 10);
+    for (i = 0; i < nframes; i++) {
+	frames[i].len = 16 + rand() % 200;
+	for (j = 0; j < frames[i].len; j++)
+	    frames[i].data[j] = rand();
+	gen_frame(&g, &frames[i]);
+    }
+    /* The last partial sound buffer is not delivered, pad it. */
+    gen_silence(&g, RATE / 2);
+    rewind(g.f);
+    write_wav_header(g.f, g.nsamples);
+    fclose(g.f);
+    return 0;
+}
+
+static uint32_t
+get_le(const unsigned char *p, unsigned int size)
+{
+    uint32_t v = 0;
+
+    while (size--)
+	v = (v << 8) | p[size];
+    return v;
+}
+
+static bool
+big_endian(void)
+{
+    uint16_t v = 1;
+
+    return *((unsigned char *) &v) == 0;
+}
+
+/*
+ * Find the format and sample data in a WAV file and copy the samples
+ * to a temporary file the sound gensio can read.
+ */
+static int
+wav_to_raw(const char *fname, const char *rawname, unsigned int *rate,
+	   unsigned int *chans, const char **pformat,
+	   unsigned long long *nframes_out)
+{
+    FILE *f, *out = NULL;
+    unsigned char h[40], buf[4096];
+    uint32_t size, left;
+    unsigned int fmt = 0, bits = 0;
+    size_t n;
+    int rv = 1;
+
+    f = fopen(fname, "r");
+    if (!f) {
+	perror(fname);
+	return 1;
+    }
+    if (fread(h, 1, 12, f) != 12 || memcmp(h, "RIFF", 4) != 0 ||
+		memcmp(h + 8, "WAVE", 4) != 0) {
+	fprintf(stderr, "%s is not a WAV file\n", fname);
+	goto out;
+    }
+    for (;;) {
+	if (fread(h, 1, 8, f) != 8) {
+	    fprintf(stderr, "%s: No data in WAV file\n", fname);
+	    goto out;
+	}
+	size = get_le(h + 4, 4);
+	if (memcmp(h, "fmt ", 4) == 0) {
+	    if (size < 16 || size > sizeof(h) || fread(h, 1, size, f) != size)
+		goto bad_fmt;
+	    fmt = get_le(h, 2);
+	    if (fmt == 0xfffe && size >= 26)
+		fmt = get_le(h + 24, 2); /* WAVE_FORMAT_EXTENSIBLE */
+	    *chans = get_le(h + 2, 2);
+	    *rate = get_le(h + 4, 4);
+	    bits = get_le(h + 14, 2);
+	    if (size & 1)
+		fgetc(f);
+	} else if (memcmp(h, "data", 4) == 0) {
+	    break;
+	} else {
+	    fseek(f, size + (size & 1), SEEK_CUR);
+	}
+    }
+    if (fmt == 1 && bits == 16) {
+	*pformat = "s16";
+    } else if (fmt == 3 && bits == 32) {
+	*pformat = "float";
+    } else {
+    bad_fmt:
+	fprintf(stderr, "%s: Only 16 bit integer or 32 bit float supported\n",
+		fname);
+	goto out;
+    }
+    *nframes_out = size / (bits / 8 * *chans);
+
+    out = fopen(rawname, "w");
+    if (!out) {
+	perror(rawname);
+	goto out;
+    }
+    for (left = size; left > 0; left -= n) {
+	n = fread(buf, 1, left < sizeof(buf) ? left : sizeof(buf), f);
+	if (n == 0)
+	    break;
+	if (big_endian()) {
+	    unsigned int i, j, ssize = bits / 8;
+	    unsigned char t;
+
+	    for (i = 0; i + ssize <= n; i += ssize) {
+		for (j = 0; j < ssize / 2; j++) {
+		    t = buf[i + j];
+		    buf[i + j] = buf[i + ssize - j - 1];
+		    buf[i + ssize - j - 1] = t;
+		}
+	    }
+	}
+	fwrite(buf, 1, n, out);
+    }
+    rv = 0;
+ out:
+    if (out)
+	fclose(out);
+    fclose(f);
+    return rv;
+}
+
+static int
+io_event(struct gensio *io, void *user_data, int event, int err,
+	 unsigned char *buf, gensiods *buflen, const char *const *auxdata)
+{
+    struct decoder *d = user_data;
+    struct frame *f;
+    unsigned int i;
+
+    if (event != GENSIO_EVENT_READ)
+	return GE_NOTSUP;
+
+    if (err) {
+	if (!d->done) {
+	    d->done = true;
+	    gensio_set_read_callback_enable(io, false);
+	    if (++ndone == nstacks)
+		gensio_os_funcs_wake(o, waiter);
+	}
+	return 0;
+    }
+
+    if (frames) {
+	/*
+	 * The frame must be the next one, or we missed some.  Only
+	 * the first stack is listening on the right tones, the others
+	 * may miss frames.  A frame we already got is an error, but
+	 * noise will sometimes make a frame with a good CRC, so just
+	 * count those.
+	 */
+	for (i = 0; i < nframes; i++) {
+	    f = &frames[i];
+	    if (*buflen == f->len && memcmp(buf, f->data, f->len) == 0)
+		break;
+	}
+	if (i == nframes) {
+	    d->nbad++;
+	    return 0;
+	}
+	if (i < d->next) {
+	    if (errs++ < 10)
+		fprintf(stderr, "Decoder %u got frame %u again\n",
+			(unsigned int) (d - decoders), i);
+	    return 0;
+	}
+	if (d == decoders && i > d->next) {
+	    if (errs++ < 10)
+		fprintf(stderr, "Decoder 0 missed frames %u to %u\n",
+			d->next, i - 1);
+	}
+	d->next = i + 1;
+    }
+    d->nrecv++;
+    return 0;
+}
+
+static int
+decode(const char *rawname, unsigned int rate, unsigned int chans,
+       const char *pformat, unsigned long long nsamples)
+{
+    char str[512];
+    unsigned int i;
+    gensio_time start, end;
+    double secs;
+    int rv;
+
+    nstacks = shared ? 1 : ndecoders;
+    decoders = calloc(nstacks, sizeof(*decoders));
+    if (!decoders) {
+	fprintf(stderr, "Out of memory\n");
+	return 1;
+    }
+    for (i = 0; i < nstacks; i++) {
+	/*
+	 * Separate stacks get the same tone offsets the decoders
+	 * option would give them, so they do the same work.
+	 */
+	float shift = SHIFT * ((i + 1) / 2) * (i % 2 ? 1 : -1);
+
+	if (shared)
+	    snprintf(str, sizeof(str), "afskmdm(tx=false,decoders=%u,"
+		     "decoder-shift=%g),", ndecoders, SHIFT);
+	else
+	    snprintf(str, sizeof(str), "afskmdm(tx=false,mark=%g,space=%g),",
+		     MARK + shift, SPACE + shift);
+	snprintf(str + strlen(str), sizeof(str) - strlen(str),
+		 "sound(type=file,inchans=%u,inrate=%u,informat=float,"
+		 "inpformat=%s),%s", chans, rate, pformat, rawname);
+	rv = str_to_gensio(str, o, io_event, &decoders[i], &decoders[i].io);
+	if (rv) {
+	    fprintf(stderr, "Unable to allocate %s: %s\n", str,
+		    gensio_err_to_str(rv));
+	    /* No fsk or sound gensio in this build. */
+	    return rv == GE_NOTSUP || rv == GE_INVAL ? 77 : 1;
+	}
+    }
+
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    for (i = 0; i < nstacks; i++) {
+	rv = gensio_open_s(decoders[i].io);
+	if (rv) {
+	    fprintf(stderr, "Unable to open decoder: %s\n",
+		    gensio_err_to_str(rv));
+	    return 1;
+	}
+	gensio_set_read_callback_enable(decoders[i].io, true);
+    }
+    gensio_os_funcs_wait(o, waiter, 1, NULL);
+    gensio_os_funcs_get_monotonic_time(o, &end);
+    secs = tv_diff(&end, &start);
+
+    for (i = 0; i < nstacks; i++) {
+	printf("%s %u: %u frames received", shared ? "stack" : "decoder", i,
+	       decoders[i].nrecv);
+	if (frames) {
+	    printf(" of %u", nframes);
+	    if (i == 0 && decoders[i].nrecv != nframes)
+		errs++;
+	}
+	if (decoders[i].nbad)
+	    printf(", %u bad frames", decoders[i].nbad);
+	printf("\n");
+	gensio_close_s(decoders[i].io);
+	gensio_free(decoders[i].io);
+    }
+    printf("%u decoders%s: %llu samples in %.2f seconds,"
+	   " %.0f samples/sec per decoder, %.1fx real time\n",
+	   ndecoders, shared ? " sharing one stack" : "", nsamples, secs,
+	   nsamples * ndecoders / secs, nsamples / secs / rate);
+    free(decoders);
+    return 0;
+}
+
+/*
+ * The DFT code on its own.  This sets up the same tables afskmdm
+ * does at 48000 samples/sec, 1200 baud.
+ */
+#define DFT_BITSIZE	(RATE / BAUD)
+#define DFT_EDGE	(DFT_BITSIZE / 10)
+#define DFT_WORKSIZE	(DFT_BITSIZE + 2 * DFT_EDGE)
+#define DFT_EXTRA	(2 * DFT_EDGE + 1)
+
+struct dfttest {
+    bool is_complex;
+    struct dftbins d;
+    float *tabs[2];
+    float buf[DFT_WORKSIZE * 2];
+    float firstv[DFT_EDGE * 4];
+};
+
+/*
+ * The way the DFT bins were done before, one bin at a time, to check
+ * against and compare speed with.
+ */
+static void
+ref_dftbin(struct dfttest *t, float *dftbin, float *buf,
+	   float *power, float *maxp)
+{
+    float *csin = dftbin;
+    float *ccos = dftbin + 2 * DFT_BITSIZE;
+    float psin = 0, pcos = 0;
+    unsigned int i, ppos = 0, fpos;
+
+    for (i = 0; i < DFT_EDGE * 2; i++, csin++, ccos++) {
+	t->firstv[i * 2] = *csin * buf[i];
+	t->firstv[i * 2 + 1] = *ccos * buf[i];
+	psin += t->firstv[i * 2];
+	pcos += t->firstv[i * 2 + 1];
+    }
+    for (; i < DFT_BITSIZE; i++, csin++, ccos++) {
+	psin += *csin * buf[i];
+	pcos += *ccos * buf[i];
+    }
+    power[ppos] = psin * psin + pcos * pcos;
+    *maxp = power[ppos];
+    ppos++;
+    for (fpos = 0; i < DFT_WORKSIZE; i++, fpos++, ppos++) {
+	psin -= t->firstv[fpos * 2];
+	pcos -= t->firstv[fpos * 2 + 1];
+	psin += *csin++ * buf[i];
+	pcos += *ccos++ * buf[i];
+	power[ppos] = psin * psin + pcos * pcos;
+	if (power[ppos] > *maxp)
+	    *maxp = power[ppos];
+    }
+}
+
+static void
+ref_dftbinc(struct dfttest *t, float *in_dftbin, float *in_buf,
+	    float *power, float *maxp)
+{
+    float complex *cwave = (float complex *) in_dftbin;
+    float complex *buf = (float complex *) in_buf;
+    float complex pow = 0;
+    float complex *firstv = (float complex *) t->firstv;
+    unsigned int i, ppos = 0, fpos;
+
+    for (i = 0; i < DFT_EDGE * 2; i++, cwave++) {
+	firstv[i] = *cwave * buf[i];
+	pow += firstv[i];
+    }
+    for (; i < DFT_BITSIZE; i++, cwave++)
+	pow += *cwave * buf[i];
+    power[ppos] = cabsf(pow);
+    *maxp = power[ppos];
+    ppos++;
+    for (fpos = 0; i < DFT_WORKSIZE; i++, fpos++, cwave++, ppos++) {
+	pow -= firstv[fpos];
+	pow += *cwave * buf[i];
+	power[ppos] = cabsf(pow);
+	if (power[ppos] > *maxp)
+	    *maxp = power[ppos];
+    }
+}
+
+static void
+ref_dftbins(struct dfttest *t, float **power, float *maxp)
+{
+    unsigned int i;
+
+    for (i = 0; i < 2; i++) {
+	if (t->is_complex)
+	    ref_dftbinc(t, t->tabs[i], t->buf, power[i], &maxp[i]);
+	else
+	    ref_dftbin(t, t->tabs[i], t->buf, power[i], &maxp[i]);
+    }
+}
+
+static bool
+dft_setup(struct dfttest *t, bool is_complex)
+{
+    double freq[2] = { SPACE, MARK };
+    float complex *cbuf = (float complex *) t->buf;
+    unsigned int i, j;
+
+    memset(t, 0, sizeof(*t));
+    t->is_complex = is_complex;
+    for (i = 0; i < 2; i++) {
+	t->tabs[i] = calloc(4 * DFT_BITSIZE, sizeof(float));
+	if (!t->tabs[i])
+	    return true;
+	for (j = 0; j < 2 * DFT_BITSIZE; j++) {
+	    double v = 2 * M_PI * freq[i] * j / RATE;
+
+	    if (is_complex) {
+		((float complex *) t->tabs[i])[j] = cexp(-I * v);
+	    } else {
+		t->tabs[i][j] = sin(v);
+		t->tabs[i][j + 2 * DFT_BITSIZE] = cos(v);
+	    }
+	}
+    }
+    for (i = 0; i < DFT_WORKSIZE; i++) {
+	if (is_complex)
+	    cbuf[i] = CMPLXF(2.0 * rand() / RAND_MAX - 1.0,
+			     2.0 * rand() / RAND_MAX - 1.0);
+	else
+	    t->buf[i] = 2.0 * rand() / RAND_MAX - 1.0;
+    }
+    return dftbins_setup(o, &t->d, is_complex, 2, t->tabs,
+			 DFT_BITSIZE, DFT_EDGE);
+}
+
+static void
+dft_cleanup(struct dfttest *t)
+{
+    dftbins_cleanup(o, &t->d);
+    free(t->tabs[0]);
+    free(t->tabs[1]);
+}
+
+/*
+ * The vector code adds in a different order, so it rounds a little
+ * differently.  The powers are compared to each other, so compare the
+ * difference against the biggest one.
+ */
+static void
+dft_check(void)
+{
+    struct dfttest t;
+    float vpow[2][DFT_EXTRA], spow[2][DFT_EXTRA];
+    float *vp[2] = { vpow[0], vpow[1] }, *sp[2] = { spow[0], spow[1] };
+    float vmax[2], smax[2], err;
+    unsigned int loop, is_complex, i, j;
+
+    for (is_complex = 0; is_complex < 2; is_complex++) {
+	for (loop = 0; loop < 100; loop++) {
+	    if (dft_setup(&t, is_complex)) {
+		fprintf(stderr, "Out of memory\n");
+		errs++;
+		return;
+	    }
+	    dftbins_calc(&t.d, t.buf, vp, vmax);
+	    ref_dftbins(&t, sp, smax);
+	    for (i = 0; i < 2; i++) {
+		err = fabsf(vmax[i] - smax[i]);
+		for (j = 0; j < DFT_EXTRA; j++) {
+		    if (fabsf(vpow[i][j] - spow[i][j]) > err)
+			err = fabsf(vpow[i][j] - spow[i][j]);
+		}
+		if (err > smax[i] * 1e-4 && errs++ < 10)
+		    fprintf(stderr, "%s DFT vector/scalar mismatch, bin %u:"
+			    " off by %g, max %g\n",
+			    is_complex ? "complex" : "real", i, err, smax[i]);
+	    }
+	    dft_cleanup(&t);
+	}
+    }
+}
+
+static double
+dft_bench(bool is_complex, bool vec, unsigned int seconds)
+{
+    struct dfttest t;
+    float pow[2][DFT_EXTRA], *p[2] = { pow[0], pow[1] }, maxp[2];
+    gensio_time start, now;
+    unsigned long long bits = 0;
+    unsigned int i;
+    double secs;
+
+    if (dft_setup(&t, is_complex))
+	return 0;
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    do {
+	for (i = 0; i < 1000; i++) {
+	    if (vec)
+		dftbins_calc(&t.d, t.buf, p, maxp);
+	    else
+		ref_dftbins(&t, p, maxp);
+	}
+	bits += 1000;
+	gensio_os_funcs_get_monotonic_time(o, &now);
+	secs = tv_diff(&now, &start);
+    } while (secs < seconds);
+    dft_cleanup(&t);
+
+    /* Samples processed, a bit's worth each time. */
+    return bits * DFT_BITSIZE / secs;
+}
+
+static const char *usage =
+    "[-c] [-f <wavfile>] [-w <wavfile>] [-n <frames>] [-N <noise>] [-o <hz>]"
+    " [-d <decoders>] [-m] [-t <seconds>]";
+
+int
+main(int argc, char *argv[])
+{
+    const char *fname = NULL, *wname = NULL, *pformat;
+    char rawname[] = "/tmp/afskbenchXXXXXX";
+    char genname[] = "/tmp/afskbenchwavXXXXXX";
+    unsigned int rate, chans, is_complex;
+    unsigned long long nsamples;
+    float noise = .1;
+    double vrate, srate;
+    int rv, fd;
+
+    while ((rv = bench_getopt(argc, argv, "cf:w:n:N:o:d:mt:", usage)) != -1) {
+	switch (rv) {
+	case 'f':
+	    fname = optarg;
+	    break;
+	case 'w':
+	    wname = optarg;
+	    break;
+	case 'n':
+	    nframes = strtoul(optarg, NULL, 0);
+	    break;
+	case 'N':
+	    noise = strtod(optarg, NULL);
+	    break;
+	case 'o':
+	    tone_offset = strtod(optarg, NULL);
+	    break;
+	case 'd':
+	    ndecoders = strtoul(optarg, NULL, 0);
+	    break;
+	case 'm':
+	    shared = true;
+	    break;
+	}
+    }
+    if (ndecoders < 1 || (check_it && fname))
+	bench_help(argv[0], usage);
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv) {
+	fprintf(stderr, "Could not allocate OS handler: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    waiter = gensio_os_funcs_alloc_waiter(o);
+    if (!waiter) {
+	fprintf(stderr, "Could not allocate waiter\n");
+	return 1;
+    }
+
+    if (check_it)
+	dft_check();
+    for (is_complex = 0; is_complex < 2; is_complex++) {
+	vrate = dft_bench(is_complex, true, seconds);
+	srate = dft_bench(is_complex, false, seconds);
+	printf("%s DFT bins: vector %.0f samples/sec, scalar %.0f"
+	       " samples/sec, %.2fx\n", is_complex ? "complex" : "real",
+	       vrate, srate, vrate / srate);
+    }
+
+    if (!fname) {
+	fd = mkstemp(genname);
+	if (fd == -1) {
+	    perror(genname);
+	    return 1;
+	}
+	close(fd);
+	fname = wname ? wname : genname;
+	if (generate(fname, noise))
+	    return 1;
+    }
+
+    fd = mkstemp(rawname);
+    if (fd == -1) {
+	perror(rawname);
+	return 1;
+    }
+    close(fd);
+    rv = wav_to_raw(fname, rawname, &rate, &chans, &pformat, &nsamples);
+    if (!rv)
+	rv = decode(rawname, rate, chans, pformat, nsamples);
+    unlink(rawname);
+    unlink(genname);
+
+    gensio_os_funcs_free_waiter(o, waiter);
+    gensio_os_funcs_free(o);
+
+    if (rv)
+	return rv;
+    return bench_errs("errors");
+}
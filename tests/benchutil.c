@@ -0,0 +1,74 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gensio/gensio.h>
+#include "benchutil.h"
+
+struct gensio_os_funcs *o;
+bool check_it;
+unsigned int seconds;
+unsigned int errs;
+
+int
+bench_getopt(int argc, char *argv[], const char *opts, const char *usage)
+{
+    int rv;
+
+    for (;;) {
+	rv = getopt(argc, argv, opts);
+	switch (rv) {
+	case 'c':
+	    check_it = true;
+	    break;
+
+	case 't':
+	    seconds = strtoul(optarg, NULL, 0);
+	    break;
+
+	case '?':
+	case ':':
+	    bench_help(argv[0], usage);
+
+	default:
+	    return rv;
+	}
+    }
+}
+
+void
+bench_help(const char *name, const char *usage)
+{
+    fprintf(stderr, "%s %s\n", name, usage);
+    exit(1);
+}
+
+int
+bench_errs(const char *what)
+{
+    if (!errs)
+	return 0;
+    fprintf(stderr, "%u %s\n", errs, what);
+    return 1;
+}
+
+double
+tv_diff(gensio_time *end, gensio_time *start)
+{
+    return (end->secs - start->secs) +
+	(end->nsecs - start->nsecs) / 1000000000.0;
+}
+
+void
+tick(struct gensio_timer *t, void *cb_data)
+{
+    gensio_os_funcs_wake(o, cb_data);
+}
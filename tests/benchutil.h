@@ -0,0 +1,58 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * Things all the *bench programs need.  A bench takes -c to run as a
+ * test, the *check scripts do that, and it then counts anything that
+ * is wrong in errs.  Most also take -t <seconds> for how long to run
+ * each benchmark.
+ */
+
+#ifndef GENSIO_TESTS_BENCHUTIL_H
+#define GENSIO_TESTS_BENCHUTIL_H
+#include <stdbool.h>
+#include <gensio/gensio_types.h>
+
+/* The OS handler, for the benches that use one. */
+extern struct gensio_os_funcs *o;
+
+/* Set by -c. */
+extern bool check_it;
+
+/* Set by -t, set the default before calling bench_getopt(). */
+extern unsigned int seconds;
+
+/* The number of things that were wrong. */
+extern unsigned int errs;
+
+/*
+ * Like getopt(), but -c and -t are handled here if they are in opts,
+ * they are not returned.  An unknown option calls bench_help().
+ */
+int bench_getopt(int argc, char *argv[], const char *opts,
+		 const char *usage);
+
+/* Print "<name> <usage>" and exit. */
+void bench_help(const char *name, const char *usage);
+
+/*
+ * If there were errors, print how many and what they were and return
+ * 1, otherwise return 0.  For returning from main().
+ */
+int bench_errs(const char *what);
+
+/* end - start in seconds. */
+double tv_diff(gensio_time *end, gensio_time *start);
+
+/*
+ * A timer handler that wakes the waiter passed as its cb_data.  A
+ * waiter won't wake up if the I/O has nothing to do, so benches that
+ * wait for a fixed time use this.
+ */
+void tick(struct gensio_timer *t, void *cb_data);
+
+#endif /* GENSIO_TESTS_BENCHUTIL_H */
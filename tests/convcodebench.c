@@ -0,0 +1,323 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2024  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * A Viterbi decoder benchmark for lib/convcode.c.  It encodes a
+ * random block of -s bits, flips about 2% of the encoded bits, then
+ * decodes it over and over for -t seconds, first with the vector
+ * (SIMD) trellis code and then with the scalar code.  It reports
+ * decoded bits per second for both.
+ *
+ * The code is set with -k and -p like the convcode gensio, it
+ * defaults to the K=7 0171/0133 code.  -u does soft decoding with
+ * random uncertainties, -r does a recursive code, and -w sets the
+ * trellis width.
+ *
+ * With -c it is run as a test.  It then decodes random blocks with
+ * all combinations of K from 3 to 10, one to three polynomials,
+ * recursive, soft decoding, trellis width and tail, and checks that
+ * the vector and scalar code give exactly the same output bits, the
+ * same error count, and the same output uncertainties.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gensio/gensio.h>
+#include <gensio/gensio_os_funcs.h>
+#include "../lib/convcode.h"
+#include "benchutil.h"
+
+
+/* Some reasonable codes for each K, and a third polynomial for 1/3. */
+static convcode_state polys_for_k[][3] = {
+    [3] = { 07, 05, 06 },
+    [4] = { 017, 015, 013 },
+    [5] = { 023, 035, 037 },
+    [6] = { 053, 075, 047 },
+    [7] = { 0171, 0133, 0165 },
+    [8] = { 0371, 0247, 0225 },
+    [9] = { 0753, 0561, 0711 },
+    [10] = { 01545, 01167, 01335 },
+};
+
+struct decode_result {
+    unsigned char *out;
+    unsigned int *out_uncertainty;
+    unsigned int num_errs;
+    int rv;
+};
+
+struct test_data {
+    unsigned int nbits;
+    unsigned int enc_bits;
+    unsigned char *data;
+    unsigned char *enc;
+    uint8_t *uncertainty;
+};
+
+
+static void
+fill_random(unsigned char *buf, unsigned int len)
+{
+    unsigned int i;
+
+    for (i = 0; i < len; i++)
+	buf[i] = rand();
+}
+
+/*
+ * Make random data, encode it, and put in errors.  With uncertainty,
+ * flipped bits get a high uncertainty and the rest a low one.
+ */
+static int
+setup_data(struct convcode *ce, struct test_data *t, unsigned int nbits,
+	   bool do_uncertainty)
+{
+    unsigned int i;
+
+    t->nbits = nbits;
+    t->data = calloc(1, (nbits + 7) / 8);
+    t->enc = calloc(1, (nbits + 16) * ce->num_polys / 8 + 1);
+    t->uncertainty = calloc(1, (nbits + 16) * ce->num_polys + 1);
+    if (!t->data || !t->enc || !t->uncertainty)
+	return 1;
+    fill_random(t->data, (nbits + 7) / 8);
+    convencode_block(ce, t->data, nbits, t->enc, &t->enc_bits);
+
+    for (i = 0; i < t->enc_bits; i++) {
+	bool flip = rand() % 50 == 0;
+
+	if (flip)
+	    t->enc[i / 8] ^= 1 << (i % 8);
+	if (do_uncertainty)
+	    t->uncertainty[i] = flip ? 25 + rand() % 25 : rand() % 25;
+    }
+    return 0;
+}
+
+static void
+free_data(struct test_data *t)
+{
+    free(t->data);
+    free(t->enc);
+    free(t->uncertainty);
+}
+
+static int
+decode(struct convcode *ce, struct test_data *t, bool do_uncertainty,
+       bool want_uncertainty, struct decode_result *r)
+{
+    memset(r->out, 0, (t->nbits + 7) / 8);
+    reinit_convdecode(ce);
+    return convdecode_block(ce, t->enc, t->enc_bits,
+			    do_uncertainty ? t->uncertainty : NULL,
+			    r->out,
+			    want_uncertainty ? r->out_uncertainty : NULL,
+			    &r->num_errs);
+}
+
+static void
+check_one(unsigned int k, unsigned int npolys, bool recursive,
+	  bool do_uncertainty, unsigned int width, bool do_tail)
+{
+    struct convcode *ce;
+    struct test_data t;
+    struct decode_result r[2];
+    unsigned int nbits = 200 + rand() % 100, i;
+    bool want_uncertainty = width == 0;
+
+    memset(r, 0, sizeof(r));
+    ce = alloc_convcode(o, k, polys_for_k[k], npolys, nbits + 16, width,
+			do_tail, recursive, do_uncertainty, NULL, NULL);
+    if (!ce) {
+	fprintf(stderr, "Could not allocate convcode k=%u\n", k);
+	errs++;
+	return;
+    }
+    if (setup_data(ce, &t, nbits, do_uncertainty))
+	goto out_nomem;
+    for (i = 0; i < 2; i++) {
+	r[i].out = calloc(1, (nbits + 7) / 8);
+	r[i].out_uncertainty = calloc(nbits + 16, sizeof(unsigned int));
+	if (!r[i].out || !r[i].out_uncertainty)
+	    goto out_nomem;
+    }
+
+    if (!convdecode_set_simd(ce, true) && k >= 5) {
+	fprintf(stderr, "Vector decode not used for k=%u\n", k);
+	errs++;
+    }
+    r[0].rv = decode(ce, &t, do_uncertainty, want_uncertainty, &r[0]);
+    convdecode_set_simd(ce, false);
+    r[1].rv = decode(ce, &t, do_uncertainty, want_uncertainty, &r[1]);
+
+    if (r[0].rv != r[1].rv || r[0].num_errs != r[1].num_errs ||
+		memcmp(r[0].out, r[1].out, (nbits + 7) / 8) != 0 ||
+		memcmp(r[0].out_uncertainty, r[1].out_uncertainty,
+		       (nbits + 16) * sizeof(unsigned int)) != 0) {
+	if (errs < 10)
+	    fprintf(stderr, "Mismatch k=%u polys=%u recursive=%d"
+		    " uncertainty=%d width=%u tail=%d: errors %u/%u\n",
+		    k, npolys, recursive, do_uncertainty, width, do_tail,
+		    r[0].num_errs, r[1].num_errs);
+	errs++;
+    }
+    goto out;
+
+ out_nomem:
+    fprintf(stderr, "Out of memory\n");
+    errs++;
+ out:
+    for (i = 0; i < 2; i++) {
+	free(r[i].out);
+	free(r[i].out_uncertainty);
+    }
+    free_data(&t);
+    free_convcode(ce);
+}
+
+static void
+check(void)
+{
+    unsigned int k, npolys, flags, loop;
+
+    for (loop = 0; loop < 2; loop++) {
+	for (k = 3; k <= 10; k++) {
+	    for (npolys = 1; npolys <= 3; npolys++) {
+		for (flags = 0; flags < 16; flags++) {
+		    unsigned int width = 0;
+
+		    if (flags & 4)
+			width = (1 << (k - 1)) / 2;
+		    /* Recursive needs an output polynomial. */
+		    if ((flags & 1) && npolys < 2)
+			continue;
+		    check_one(k, npolys, flags & 1, flags & 2, width,
+			      flags & 8);
+		}
+	    }
+	}
+    }
+}
+
+static double
+bench(struct convcode *ce, struct test_data *t, bool do_uncertainty,
+      unsigned int seconds)
+{
+    struct decode_result r;
+    gensio_time start, now;
+    unsigned long long bits = 0;
+    double secs;
+
+    r.out = calloc(1, (t->nbits + 7) / 8);
+    if (!r.out)
+	return 0;
+
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    do {
+	decode(ce, t, do_uncertainty, false, &r);
+	bits += t->nbits;
+	gensio_os_funcs_get_monotonic_time(o, &now);
+	secs = ((now.secs - start.secs) +
+		(now.nsecs - start.nsecs) / 1000000000.0);
+    } while (secs < seconds);
+    free(r.out);
+
+    return bits / secs;
+}
+
+static const char *usage =
+    "[-c] [-k <k>] [-p <poly> [-p <poly> ...]] [-r] [-u] [-w <width>]"
+    " [-s <bits>] [-t <seconds>]";
+
+int
+main(int argc, char *argv[])
+{
+    convcode_state polys[CONVCODE_MAX_POLYNOMIALS];
+    unsigned int k = 7, npolys = 0, width = 0, nbits = 8192;
+    bool recursive = false, do_uncertainty = false, simd;
+    struct convcode *ce;
+    struct test_data t;
+    double vrate, srate;
+    int rv;
+
+    while ((rv = bench_getopt(argc, argv, "ck:p:ruw:s:t:", usage)) != -1) {
+	switch (rv) {
+	case 'k':
+	    k = strtoul(optarg, NULL, 0);
+	    break;
+	case 'p':
+	    if (npolys >= CONVCODE_MAX_POLYNOMIALS)
+		bench_help(argv[0], usage);
+	    polys[npolys++] = strtoul(optarg, NULL, 0);
+	    break;
+	case 'r':
+	    recursive = true;
+	    break;
+	case 'u':
+	    do_uncertainty = true;
+	    break;
+	case 'w':
+	    width = strtoul(optarg, NULL, 0);
+	    break;
+	case 's':
+	    nbits = strtoul(optarg, NULL, 0);
+	    break;
+	}
+    }
+    if (k < CONVCODE_MIN_K || k > CONVCODE_MAX_K || nbits < 1)
+	bench_help(argv[0], usage);
+    if (npolys == 0) {
+	if (k >= sizeof(polys_for_k) / sizeof(polys_for_k[0])) {
+	    fprintf(stderr, "No default polynomials for k=%u, use -p\n", k);
+	    return 1;
+	}
+	polys[0] = polys_for_k[k][0];
+	polys[1] = polys_for_k[k][1];
+	npolys = 2;
+    }
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv) {
+	fprintf(stderr, "Could not allocate OS handler: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+
+    if (check_it)
+	check();
+
+    ce = alloc_convcode(o, k, polys, npolys, nbits + k * npolys, width,
+			true, recursive, do_uncertainty, NULL, NULL);
+    if (!ce) {
+	fprintf(stderr, "Invalid code parameters\n");
+	return 1;
+    }
+    if (setup_data(ce, &t, nbits, do_uncertainty)) {
+	fprintf(stderr, "Out of memory\n");
+	return 1;
+    }
+
+    simd = convdecode_set_simd(ce, true);
+    vrate = bench(ce, &t, do_uncertainty, seconds);
+    convdecode_set_simd(ce, false);
+    srate = bench(ce, &t, do_uncertainty, seconds);
+    printf("k=%u polys=%u%s%s width=%u: vector%s %.0f bits/sec,"
+	   " scalar %.0f bits/sec, %.2fx\n", k, npolys,
+	   recursive ? " recursive" : "", do_uncertainty ? " soft" : "",
+	   width ? width : 1 << (k - 1), simd ? "" : " (not used)",
+	   vrate, srate, vrate / srate);
+
+    free_data(&t);
+    free_convcode(ce);
+    gensio_os_funcs_free(o);
+
+    return bench_errs("decode mismatches");
+}
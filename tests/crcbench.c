@@ -0,0 +1,216 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2024  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * A benchmark and cross check for the CRCs in lib/crc.c.  It builds
+ * the plain bytewise tables from the polynomials, the way the CRC
+ * code used to work, and compares crc16_ccitt() and crc16_xmodem()
+ * against that.  Then it reports the number of bytes per second
+ * each does on a buffer of -s bytes (the default is a typical AX.25
+ * frame size) for -t seconds.
+ *
+ * With -c it is run as a test.  It then also checks the standard
+ * check values and lots of random buffers at every alignment and
+ * length up to a few blocks, including doing a buffer in pieces, and
+ * fails if anything doesn't match.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include "../lib/crc.h"
+#include "benchutil.h"
+
+static uint16_t ref_ccitt_table[256], ref_xmodem_table[256];
+
+static void
+ref_setup(void)
+{
+    unsigned int i, j;
+    uint16_t c;
+
+    for (i = 0; i < 256; i++) {
+	c = i;
+	for (j = 0; j < 8; j++)
+	    c = (c & 1) ? (c >> 1) ^ 0x8408 : c >> 1;
+	ref_ccitt_table[i] = c;
+
+	c = i << 8;
+	for (j = 0; j < 8; j++)
+	    c = (c & 0x8000) ? (c << 1) ^ 0x1021 : c << 1;
+	ref_xmodem_table[i] = c;
+    }
+}
+
+static void
+ref_ccitt(const unsigned char *buf, unsigned int len, uint16_t *icrc)
+{
+    unsigned int i;
+    uint16_t crc = *icrc;
+
+    for (i = 0; i < len; i++)
+	crc = (crc >> 8) ^ ref_ccitt_table[(crc ^ buf[i]) & 0xff];
+    *icrc = crc;
+}
+
+static void
+ref_xmodem(const unsigned char *buf, unsigned int len, uint16_t *icrc)
+{
+    unsigned int i;
+    uint16_t crc = *icrc;
+
+    for (i = 0; i < len; i++)
+	crc = (crc << 8) ^ ref_xmodem_table[((crc >> 8) ^ buf[i]) & 0xff];
+    *icrc = crc;
+}
+
+typedef void (*crcfn)(const unsigned char *buf, unsigned int len,
+		      uint16_t *icrc);
+
+static struct {
+    const char *name;
+    crcfn fn;
+    crcfn ref;
+    uint16_t init;
+    uint16_t xorout;
+    uint16_t check; /* CRC of "123456789" */
+} crcs[] = {
+    { "ccitt", crc16_ccitt, ref_ccitt, 0xffff, 0xffff, 0x906e },
+    { "xmodem", crc16_xmodem, ref_xmodem, 0, 0, 0x31c3 },
+    { NULL }
+};
+
+
+static void
+check_one(unsigned int n, const unsigned char *buf, unsigned int len)
+{
+    uint16_t crc = crcs[n].init, ref = crcs[n].init, part = crcs[n].init;
+    unsigned int i, plen;
+
+    crcs[n].fn(buf, len, &crc);
+    crcs[n].ref(buf, len, &ref);
+    /* Doing it in odd sized pieces must give the same answer. */
+    for (i = 0; i < len; i += plen) {
+	plen = (i * 7 % 13) + 1;
+	if (plen > len - i)
+	    plen = len - i;
+	crcs[n].fn(buf + i, plen, &part);
+    }
+    if (crc != ref || part != ref) {
+	if (errs++ < 10)
+	    fprintf(stderr, "%s mismatch, len %u, align %u: got %4.4x,"
+		    " in pieces %4.4x, expected %4.4x\n", crcs[n].name, len,
+		    (unsigned int) ((uintptr_t) buf & 7), crc, part, ref);
+    }
+}
+
+static void
+check(void)
+{
+    unsigned char buf[512 + 8];
+    unsigned int n, i, len, align, loop;
+    uint16_t crc;
+
+    for (n = 0; crcs[n].name; n++) {
+	crc = crcs[n].init;
+	crcs[n].fn((unsigned char *) "123456789", 9, &crc);
+	crc ^= crcs[n].xorout;
+	if (crc != crcs[n].check) {
+	    fprintf(stderr, "%s check value is %4.4x, expected %4.4x\n",
+		    crcs[n].name, crc, crcs[n].check);
+	    errs++;
+	}
+    }
+
+    for (loop = 0; loop < 20; loop++) {
+	for (i = 0; i < sizeof(buf); i++)
+	    buf[i] = rand();
+	for (n = 0; crcs[n].name; n++) {
+	    for (align = 0; align < 8; align++) {
+		for (len = 0; len <= 64; len++)
+		    check_one(n, buf + align, len);
+		check_one(n, buf + align, 512);
+	    }
+	}
+    }
+}
+
+static double
+bench(crcfn fn, const unsigned char *buf, unsigned int size,
+      unsigned int seconds)
+{
+    unsigned long long bytes = 0;
+    unsigned int i;
+    clock_t start, now;
+    uint16_t crc = 0;
+    double secs;
+
+    start = clock();
+    do {
+	for (i = 0; i < 1000; i++)
+	    fn(buf, size, &crc);
+	bytes += 1000ULL * size;
+	now = clock();
+	secs = (double) (now - start) / CLOCKS_PER_SEC;
+    } while (secs < seconds);
+
+    /* Keep the compiler from throwing it all away. */
+    if (crc == 0x1234 && buf[0] == 0x56)
+	printf(" ");
+    return bytes / secs;
+}
+
+static const char *usage = "[-c] [-s <size>] [-t <seconds>]";
+
+int
+main(int argc, char *argv[])
+{
+    unsigned int size = 256, i, n;
+    unsigned char *buf;
+    double ref_rate, rate;
+    int rv;
+
+    while ((rv = bench_getopt(argc, argv, "cs:t:", usage)) != -1) {
+	switch (rv) {
+	case 's':
+	    size = strtoul(optarg, NULL, 0);
+	    break;
+	}
+    }
+    if (size < 1)
+	bench_help(argv[0], usage);
+
+    buf = malloc(size);
+    if (!buf) {
+	fprintf(stderr, "Out of memory\n");
+	return 1;
+    }
+    for (i = 0; i < size; i++)
+	buf[i] = rand();
+
+    ref_setup();
+    if (check_it)
+	check();
+    else
+	for (n = 0; crcs[n].name; n++)
+	    check_one(n, buf, size);
+
+    for (n = 0; crcs[n].name; n++) {
+	ref_rate = bench(crcs[n].ref, buf, size, seconds);
+	rate = bench(crcs[n].fn, buf, size, seconds);
+	printf("%s: %u byte buffers, bytewise %.0f MB/sec,"
+	       " slice by 8 %.0f MB/sec, %.2fx\n", crcs[n].name, size,
+	       ref_rate / 1000000, rate / 1000000, rate / ref_rate);
+    }
+
+    free(buf);
+    return bench_errs("CRC mismatches");
+}
@@ -0,0 +1,347 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * A benchmark for the write paths of the msgdelim and ssl filters.
+ * Both write straight from the user's buffers when they can and copy
+ * the data when they can't.  It streams a pattern through
+ * msgdelim,tcp in -m byte messages and then through ssl,tcp in -w
+ * byte writes, for -t seconds each, and reports the bytes per second
+ * received.
+ *
+ * Each filter is run twice, first with every write in one buffer,
+ * which the filter writes from directly, and then with every write
+ * split into -g pieces.  msgdelim copies a message that is in more
+ * than 15 pieces (counting the escapes for 254s) and ssl copies
+ * anything in more than one, so the second run is the copy path.
+ *
+ * The receiver checks the data.  -l <n> puts a ratelimit gensio that
+ * takes n bytes at a time under the sending filter, so writes to the
+ * filter's child come up short in the middle of the data.  -b <n>
+ * sets the sending ssl's readbuf, which sets the size of its BIO.
+ * With -b 1024 a full sized SSL record doesn't fit in the BIO and
+ * SSL_write() has to be retried.  It exits with an error if any data
+ * was wrong.
+ *
+ * The keys come from the directory given with -k, "ca" by default,
+ * which is where make_keys puts them.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gensio/gensio.h>
+#include <gensio/gensio_os_funcs.h>
+#include "benchutil.h"
+
+/* A prime, so the pattern doesn't line up with any buffer size. */
+#define PATTERN_SIZE 65521
+static unsigned char pattern[PATTERN_SIZE];
+
+#define MAX_PIECES 64
+
+static struct gensio_waiter *waiter;
+static struct gensio *srv_io;
+static unsigned long long wpos, rpos, bad;
+static gensiods wsize;
+static unsigned int pieces;
+
+static const char *usage =
+    "[-k <keydir>] [-m <msgsize>] [-w <writesize>] [-g <pieces>]"
+    " [-l <ratelimit len>] [-b <ssl readbuf>] [-t <seconds>]";
+
+static int
+srv_event(struct gensio *io, void *user_data, int event, int err,
+	  unsigned char *buf, gensiods *buflen, const char *const *auxdata)
+{
+    gensiods pos, len, ppos;
+
+    switch (event) {
+    case GENSIO_EVENT_READ:
+	if (err) {
+	    gensio_set_read_callback_enable(io, false);
+	    return 0;
+	}
+	for (pos = 0; pos < *buflen; pos += len) {
+	    ppos = (rpos + pos) % PATTERN_SIZE;
+	    len = *buflen - pos;
+	    if (len > PATTERN_SIZE - ppos)
+		len = PATTERN_SIZE - ppos;
+	    if (memcmp(buf + pos, pattern + ppos, len) != 0) {
+		if (!bad)
+		    fprintf(stderr, "Data mismatch at about %llu\n",
+			    rpos + pos);
+		bad++;
+	    }
+	}
+	rpos += *buflen;
+	return 0;
+
+    default:
+	return GE_NOTSUP;
+    }
+}
+
+static int
+acc_event(struct gensio_accepter *acc, void *user_data, int event,
+	  void *data)
+{
+    struct gensio *io = data;
+
+    if (event != GENSIO_ACC_EVENT_NEW_CONNECTION)
+	return GE_NOTSUP;
+
+    srv_io = io;
+    gensio_set_callback(io, srv_event, NULL);
+    gensio_set_read_callback_enable(io, true);
+    gensio_os_funcs_wake(o, waiter);
+    return 0;
+}
+
+static int
+cl_event(struct gensio *io, void *user_data, int event, int err,
+	 unsigned char *buf, gensiods *buflen, const char *const *auxdata)
+{
+    struct gensio_sg sg[MAX_PIECES];
+    gensiods i, count, len, ppos, piece;
+
+    switch (event) {
+    case GENSIO_EVENT_READ:
+	return 0;
+
+    case GENSIO_EVENT_WRITE_READY:
+	do {
+	    ppos = wpos % PATTERN_SIZE;
+	    len = wsize;
+	    if (len > PATTERN_SIZE - ppos)
+		len = PATTERN_SIZE - ppos;
+	    piece = (len + pieces - 1) / pieces;
+	    for (i = 0; len > 0; i++) {
+		sg[i].buf = pattern + ppos;
+		sg[i].buflen = len < piece ? len : piece;
+		ppos += sg[i].buflen;
+		len -= sg[i].buflen;
+	    }
+	    if (gensio_write_sg(io, &count, sg, i, NULL)) {
+		gensio_set_write_callback_enable(io, false);
+		return 0;
+	    }
+	    wpos += count;
+	} while (count > 0);
+	return 0;
+
+    default:
+	return GE_NOTSUP;
+    }
+}
+
+/*
+ * Run one transfer.  The client and server strings are the filter
+ * part of the stack, the client's has a %s for where the ratelimit
+ * goes.  Returns true on failure.
+ */
+static bool
+transfer(const char *name, const char *srvstr, const char *clstr,
+	 const char *ratelimit, unsigned int seconds,
+	 struct gensio_timer *timer)
+{
+    struct gensio_accepter *acc;
+    struct gensio *io;
+    gensio_time start, now, timeout;
+    char str[500], filter[400], port[20];
+    gensiods len;
+    int rv;
+
+    srv_io = NULL;
+    wpos = 0;
+    rpos = 0;
+    bad = 0;
+
+    snprintf(str, sizeof(str), "%s,tcp(nodelay),127.0.0.1,0", srvstr);
+    rv = str_to_gensio_accepter(str, o, acc_event, NULL, &acc);
+    if (!rv)
+	rv = gensio_acc_startup(acc);
+    if (rv) {
+	fprintf(stderr, "Could not start accepter %s: %s\n", str,
+		gensio_err_to_str(rv));
+	return true;
+    }
+    strcpy(port, "0");
+    len = sizeof(port);
+    rv = gensio_acc_control(acc, GENSIO_CONTROL_DEPTH_FIRST, true,
+			    GENSIO_ACC_CONTROL_LPORT, port, &len);
+    if (rv) {
+	fprintf(stderr, "Could not get accepter port: %s\n",
+		gensio_err_to_str(rv));
+	return true;
+    }
+
+    snprintf(filter, sizeof(filter), clstr, ratelimit);
+    snprintf(str, sizeof(str), "%s,tcp(nodelay),127.0.0.1,%s", filter, port);
+    rv = str_to_gensio(str, o, cl_event, NULL, &io);
+    if (!rv)
+	rv = gensio_open_s(io);
+    if (rv) {
+	fprintf(stderr, "Could not open %s: %s\n", str,
+		gensio_err_to_str(rv));
+	return true;
+    }
+    timeout.secs = 5;
+    timeout.nsecs = 0;
+    if (!srv_io)
+	gensio_os_funcs_wait(o, waiter, 1, &timeout);
+    if (!srv_io) {
+	fprintf(stderr, "Server never got the connection\n");
+	return true;
+    }
+
+    gensio_set_write_callback_enable(io, true);
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    do {
+	timeout.secs = 0;
+	timeout.nsecs = 100000000;
+	gensio_os_funcs_start_timer(o, timer, &timeout);
+	gensio_os_funcs_wait(o, waiter, 1, NULL);
+	gensio_os_funcs_get_monotonic_time(o, &now);
+    } while (tv_diff(&now, &start) < seconds);
+    gensio_set_write_callback_enable(io, false);
+
+    /* Let what was written arrive so all of it gets checked. */
+    while (rpos < wpos && !bad) {
+	timeout.secs = 0;
+	timeout.nsecs = 10000000;
+	gensio_os_funcs_start_timer(o, timer, &timeout);
+	gensio_os_funcs_wait(o, waiter, 1, NULL);
+	gensio_os_funcs_get_monotonic_time(o, &now);
+	if (tv_diff(&now, &start) > seconds + 10)
+	    break;
+    }
+
+    printf("%s, %u piece writes: %llu bytes in %.3f seconds,"
+	   " %.2f MB/sec\n", name, pieces, rpos, tv_diff(&now, &start),
+	   rpos / tv_diff(&now, &start) / 1000000.0);
+    if (bad) {
+	fprintf(stderr, "%llu bad reads\n", bad);
+	errs++;
+    }
+    if (rpos != wpos) {
+	fprintf(stderr, "Wrote %llu bytes, got %llu\n", wpos, rpos);
+	errs++;
+    }
+
+    gensio_close_s(io);
+    gensio_free(io);
+    gensio_close_s(srv_io);
+    gensio_free(srv_io);
+    gensio_acc_shutdown_s(acc);
+    gensio_acc_free(acc);
+    return false;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct gensio_os_proc_data *proc_data;
+    struct gensio_timer *timer;
+    const char *keydir = "ca";
+    unsigned int split = 32, i;
+    gensiods msgsize = 1024, writesize = 65536, rlen = 0, readbuf = 0;
+    char srvstr[400], clstr[400], ratelimit[100] = "", sslbuf[40] = "";
+    int rv;
+
+    while ((rv = bench_getopt(argc, argv, "k:m:w:g:l:b:t:", usage)) != -1) {
+	switch (rv) {
+	case 'k':
+	    keydir = optarg;
+	    break;
+	case 'm':
+	    msgsize = strtoul(optarg, NULL, 0);
+	    break;
+	case 'w':
+	    writesize = strtoul(optarg, NULL, 0);
+	    break;
+	case 'g':
+	    split = strtoul(optarg, NULL, 0);
+	    break;
+	case 'l':
+	    rlen = strtoul(optarg, NULL, 0);
+	    break;
+	case 'b':
+	    readbuf = strtoul(optarg, NULL, 0);
+	    break;
+	}
+    }
+    if (msgsize < 1 || writesize < 1 || split < 2 || split > MAX_PIECES ||
+		seconds < 1)
+	bench_help(argv[0], usage);
+
+    for (i = 0; i < PATTERN_SIZE; i++)
+	pattern[i] = (i * 7) ^ (i >> 8);
+
+    if (rlen)
+	snprintf(ratelimit, sizeof(ratelimit),
+		 ",ratelimit(xmit_len=%lu,xmit_delay=1u)",
+		 (unsigned long) rlen);
+    if (readbuf)
+	snprintf(sslbuf, sizeof(sslbuf), ",readbuf=%lu",
+		 (unsigned long) readbuf);
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv) {
+	fprintf(stderr, "Could not allocate OS handler: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    rv = gensio_os_proc_setup(o, &proc_data);
+    if (rv) {
+	fprintf(stderr, "Could not setup process: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    waiter = gensio_os_funcs_alloc_waiter(o);
+    if (!waiter) {
+	fprintf(stderr, "Could not allocate waiter\n");
+	return 1;
+    }
+    /*
+     * Under load the wait never times out because there is always
+     * something to do, so use a timer to wake it up.
+     */
+    timer = gensio_os_funcs_alloc_timer(o, tick, waiter);
+    if (!timer) {
+	fprintf(stderr, "Could not allocate timer\n");
+	return 1;
+    }
+
+    wsize = msgsize;
+    snprintf(srvstr, sizeof(srvstr), "msgdelim(readbuf=%lu,writebuf=%lu)",
+	     (unsigned long) msgsize, (unsigned long) msgsize);
+    snprintf(clstr, sizeof(clstr), "%s%%s", srvstr);
+    for (pieces = 1; pieces <= split; pieces += split - 1) {
+	if (transfer("msgdelim over TCP", srvstr, clstr, ratelimit,
+		     seconds, timer))
+	    return 1;
+    }
+
+    wsize = writesize;
+    snprintf(srvstr, sizeof(srvstr), "ssl(key=%s/key.pem,cert=%s/cert.pem)",
+	     keydir, keydir);
+    snprintf(clstr, sizeof(clstr), "ssl(CA=%s/CA.pem%s)%%s", keydir, sslbuf);
+    for (pieces = 1; pieces <= split; pieces += split - 1) {
+	if (transfer("ssl over TCP", srvstr, clstr, ratelimit,
+		     seconds, timer))
+	    return 1;
+    }
+
+    gensio_os_funcs_free_timer(o, timer);
+    gensio_os_funcs_free_waiter(o, waiter);
+    gensio_os_proc_cleanup(proc_data);
+    gensio_os_funcs_free(o);
+    return bench_errs("filter transfer errors");
+}
@@ -0,0 +1,444 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2024  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * A throughput benchmark for the mux gensio against the number of
+ * open channels.  It starts a mux over TCP accepter, connects to it,
+ * and opens a number of channels (-n).  Only the last few channels
+ * opened (-a) send data, the rest sit idle, so the result shows what
+ * the idle channels cost the active ones.  Every message received has
+ * to be matched to its channel, so if that depends on the number of
+ * channels the throughput goes down as channels are added.  It
+ * reports the messages and bytes received per second.
+ *
+ * With -S it tests scheduling instead.  It opens one channel that
+ * sends small messages that are echoed back, and -a bulk channels
+ * that send as fast as they can with a weight of 1, 2, 3, etc.  The
+ * small message channel gets the priority given with -p (default 1).
+ * Before the bulk channels start, it times the small messages on the
+ * idle link.  It reports the throughput of each bulk channel and the
+ * round trip time of the small messages, idle and under load.
+ *
+ * With -c it checks that the data received on each channel is correct
+ * and that every active channel got data, and with -S that some small
+ * messages got through.  With a priority, it also checks that the
+ * small messages' average round trip under load is no more than
+ * PING_LOAD_FACTOR times the idle one.  That compares two times taken
+ * on the same machine in the same run, and the bound is generous, so
+ * with enough bulk channels it only fails if the small messages wait
+ * behind the bulk data.  How the bandwidth splits by weight depends
+ * on the machine, so that is only reported.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gensio/gensio.h>
+#include <gensio/gensio_os_funcs.h>
+#include "benchutil.h"
+
+struct chan {
+    struct gensio *io;
+    unsigned char wseq;
+    unsigned char rseq;
+    unsigned long long count;
+};
+
+static struct chan *chans;
+static unsigned int nchans = 100, nsrv_chans;
+static unsigned int msgsize = 64;
+static unsigned long long msgs, bytes, bad;
+static struct gensio_waiter *waiter;
+static bool sched, running, ping_out;
+static gensio_time ping_start;
+static unsigned long long pings;
+static double ping_total, ping_max;
+
+/* Small message round trips to time on the idle link. */
+#define IDLE_PINGS 100
+
+/*
+ * With priority a small message only waits for the data already handed
+ * to the child, that's about twice the idle time.  Without it, it waits
+ * for a round of all the bulk channels, with 16 of them that's over 30
+ * times.
+ */
+#define PING_LOAD_FACTOR 20
+
+static void
+send_ping(void)
+{
+    unsigned char data[16];
+
+    memset(data, 0, sizeof(data));
+    gensio_os_funcs_get_monotonic_time(o, &ping_start);
+    if (gensio_write(chans[0].io, NULL, data, sizeof(data), NULL) == 0)
+	ping_out = true;
+}
+
+static int
+srv_event(struct gensio *io, void *user_data, int event, int err,
+	  unsigned char *buf, gensiods *buflen, const char *const *auxdata)
+{
+    struct chan *c = user_data;
+    struct gensio *nio;
+    gensiods i;
+
+    switch (event) {
+    case GENSIO_EVENT_READ:
+	if (err) {
+	    gensio_set_read_callback_enable(io, false);
+	    return 0;
+	}
+	if (!c)
+	    return 0;
+	if (sched && c == &chans[0]) {
+	    /* Echo the small messages. */
+	    gensio_write(io, NULL, buf, *buflen, NULL);
+	    return 0;
+	}
+	for (i = 0; i < *buflen; i++) {
+	    if (buf[i] != c->rseq++) {
+		bad++;
+		c->rseq = buf[i] + 1;
+	    }
+	}
+	c->count += *buflen;
+	bytes += *buflen;
+	msgs++;
+	return 0;
+
+    case GENSIO_EVENT_NEW_CHANNEL:
+	nio = (struct gensio *) buf;
+	if (nsrv_chans >= nchans)
+	    return GE_INUSE;
+	/* Server channels are numbered in the order they were opened. */
+	gensio_set_callback(nio, srv_event, &chans[nsrv_chans++]);
+	gensio_set_read_callback_enable(nio, true);
+	return 0;
+
+    default:
+	return GE_NOTSUP;
+    }
+}
+
+static int
+acc_event(struct gensio_accepter *acc, void *user_data, int event,
+	  void *data)
+{
+    struct gensio *io = data;
+
+    if (event != GENSIO_ACC_EVENT_NEW_CONNECTION)
+	return GE_NOTSUP;
+
+    /* The first channel is not used for data. */
+    gensio_set_callback(io, srv_event, NULL);
+    gensio_set_read_callback_enable(io, true);
+    return 0;
+}
+
+static int
+cl_event(struct gensio *io, void *user_data, int event, int err,
+	 unsigned char *buf, gensiods *buflen, const char *const *auxdata)
+{
+    struct chan *c = user_data;
+    unsigned char data[65536];
+    gensiods i, count;
+    gensio_time now;
+    double t;
+
+    switch (event) {
+    case GENSIO_EVENT_READ:
+	if (err) {
+	    gensio_set_read_callback_enable(io, false);
+	    return 0;
+	}
+	if (sched && c == &chans[0]) {
+	    gensio_os_funcs_get_monotonic_time(o, &now);
+	    t = tv_diff(&now, &ping_start);
+	    ping_total += t;
+	    if (t > ping_max)
+		ping_max = t;
+	    pings++;
+	    ping_out = false;
+	    if (running)
+		send_ping();
+	    else
+		gensio_os_funcs_wake(o, waiter);
+	}
+	return 0;
+
+    case GENSIO_EVENT_WRITE_READY:
+	/* Fill up the channel's buffer so it always has data to send. */
+	do {
+	    for (i = 0; i < msgsize; i++)
+		data[i] = c->wseq + i;
+	    if (gensio_write(io, &count, data, msgsize, NULL)) {
+		gensio_set_write_callback_enable(io, false);
+		return 0;
+	    }
+	    c->wseq += count;
+	} while (count == msgsize);
+	return 0;
+
+    default:
+	return GE_NOTSUP;
+    }
+}
+
+static const char *usage =
+    "[-c] [-S] [-n <channels>] [-a <active>] [-s <size>] [-p <priority>]"
+    " [-t <seconds>]";
+
+int
+main(int argc, char *argv[])
+{
+    unsigned int nactive = 4, priority = 1, i;
+    unsigned long long idle_pings = 0;
+    double idle_avg = 0;
+    struct gensio_os_proc_data *proc_data;
+    struct gensio_accepter *acc;
+    struct gensio *mux;
+    struct gensio_timer *timer;
+    gensio_time start, now, timeout;
+    char str[200], port[20], args[50];
+    const char *cargs[2] = { args, NULL };
+    const char *bufsizes = "readbuf=4096,writebuf=1024";
+    const char *link = "";
+    gensiods len;
+    int rv;
+
+    seconds = 5;
+    while ((rv = bench_getopt(argc, argv, "cSn:a:s:p:t:", usage)) != -1) {
+	switch (rv) {
+	case 'S':
+	    sched = true;
+	    break;
+
+	case 'n':
+	    nchans = strtoul(optarg, NULL, 0);
+	    break;
+	case 'a':
+	    nactive = strtoul(optarg, NULL, 0);
+	    break;
+	case 's':
+	    msgsize = strtoul(optarg, NULL, 0);
+	    break;
+	case 'p':
+	    priority = strtoul(optarg, NULL, 0);
+	    break;
+	}
+    }
+    if (nchans < 1 || nchans > 65535 || msgsize < 1 || msgsize > 65536)
+	bench_help(argv[0], usage);
+    if (nactive > nchans)
+	nactive = nchans;
+    if (sched) {
+	/*
+	 * The mux can only schedule what it has not handed to the
+	 * child yet, so rate limit the client's transmit to make the
+	 * mux the bottleneck.  Bigger buffers so the bulk channels are
+	 * limited by the scheduler, not by their windows.
+	 */
+	nchans = nactive + 1;
+	bufsizes = "readbuf=65536,writebuf=16384";
+	link = "ratelimit(xmit_len=16384,xmit_delay=1m),";
+	if (msgsize < 900)
+	    msgsize = 4096;
+    }
+
+    chans = calloc(nchans, sizeof(*chans));
+    if (!chans) {
+	fprintf(stderr, "Out of memory\n");
+	return 1;
+    }
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv) {
+	fprintf(stderr, "Could not allocate OS handler: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    rv = gensio_os_proc_setup(o, &proc_data);
+    if (rv) {
+	fprintf(stderr, "Could not setup process: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    waiter = gensio_os_funcs_alloc_waiter(o);
+    if (!waiter) {
+	fprintf(stderr, "Could not allocate waiter\n");
+	return 1;
+    }
+    /*
+     * Under load the wait never times out because there is always
+     * something to do, so use a timer to wake it up.
+     */
+    timer = gensio_os_funcs_alloc_timer(o, tick, waiter);
+    if (!timer) {
+	fprintf(stderr, "Could not allocate timer\n");
+	return 1;
+    }
+
+    /* Keep the buffers small so lots of channels don't use much memory. */
+    snprintf(str, sizeof(str),
+	     "mux(max_channels=%u,%s),tcp(nodelay),127.0.0.1,0",
+	     nchans + 1, bufsizes);
+    rv = str_to_gensio_accepter(str, o, acc_event, NULL, &acc);
+    if (!rv)
+	rv = gensio_acc_startup(acc);
+    if (rv) {
+	fprintf(stderr, "Could not start accepter %s: %s\n", str,
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    strcpy(port, "0");
+    len = sizeof(port);
+    rv = gensio_acc_control(acc, GENSIO_CONTROL_DEPTH_FIRST, true,
+			    GENSIO_ACC_CONTROL_LPORT, port, &len);
+    if (rv) {
+	fprintf(stderr, "Could not get accepter port: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+
+    snprintf(str, sizeof(str),
+	     "mux(max_channels=%u,%s),%stcp(nodelay),127.0.0.1,%s",
+	     nchans + 1, bufsizes, link, port);
+    rv = str_to_gensio(str, o, cl_event, NULL, &mux);
+    if (!rv)
+	rv = gensio_open_s(mux);
+    if (rv) {
+	fprintf(stderr, "Could not open mux %s: %s\n", str,
+		gensio_err_to_str(rv));
+	return 1;
+    }
+
+    for (i = 0; i < nchans; i++) {
+	if (!sched)
+	    args[0] = '\0';
+	else if (i == 0)
+	    snprintf(args, sizeof(args), "priority=%u", priority);
+	else
+	    snprintf(args, sizeof(args), "weight=%u", i);
+	rv = gensio_alloc_channel(mux, args[0] ? cargs : NULL, cl_event,
+				  &chans[i], &chans[i].io);
+	if (!rv)
+	    rv = gensio_open_s(chans[i].io);
+	if (rv) {
+	    fprintf(stderr, "Could not open channel %u: %s\n", i,
+		    gensio_err_to_str(rv));
+	    return 1;
+	}
+    }
+
+    if (sched) {
+	gensio_set_read_callback_enable(chans[0].io, true);
+	running = true;
+	send_ping();
+	gensio_os_funcs_get_monotonic_time(o, &start);
+	do {
+	    timeout.secs = 0;
+	    timeout.nsecs = 100000000;
+	    gensio_os_funcs_start_timer(o, timer, &timeout);
+	    gensio_os_funcs_wait(o, waiter, 1, NULL);
+	    gensio_os_funcs_get_monotonic_time(o, &now);
+	} while (pings < IDLE_PINGS && tv_diff(&now, &start) < seconds);
+	idle_pings = pings;
+	if (pings)
+	    idle_avg = ping_total / pings;
+	pings = 0;
+	ping_total = 0;
+	ping_max = 0;
+    }
+    for (i = nchans - nactive; i < nchans; i++)
+	gensio_set_write_callback_enable(chans[i].io, true);
+
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    do {
+	timeout.secs = 0;
+	timeout.nsecs = 100000000;
+	gensio_os_funcs_start_timer(o, timer, &timeout);
+	gensio_os_funcs_wait(o, waiter, 1, NULL);
+	gensio_os_funcs_get_monotonic_time(o, &now);
+    } while (tv_diff(&now, &start) < seconds);
+
+    for (i = nchans - nactive; i < nchans; i++)
+	gensio_set_write_callback_enable(chans[i].io, false);
+    if (sched) {
+	/* Let the last small message come back before closing. */
+	running = false;
+	gensio_os_funcs_stop_timer(o, timer);
+	timeout.secs = 5;
+	timeout.nsecs = 0;
+	if (ping_out)
+	    gensio_os_funcs_wait(o, waiter, 1, &timeout);
+    }
+
+    printf("%u channels, %u active: %llu messages in %.3f seconds,"
+	   " %.0f messages/sec, %.2f MB/sec\n", nchans, nactive, msgs,
+	   tv_diff(&now, &start), msgs / tv_diff(&now, &start),
+	   bytes / tv_diff(&now, &start) / 1000000.0);
+    if (sched) {
+	for (i = 1; i < nchans; i++)
+	    printf("  weight %u: %.2f MB/sec, %.1f%% of the data\n", i,
+		   chans[i].count / tv_diff(&now, &start) / 1000000.0,
+		   bytes ? chans[i].count * 100.0 / bytes : 0);
+	printf("  idle small messages: %llu round trips, average %.3f ms\n",
+	       idle_pings, idle_avg * 1000);
+	printf("  priority %u small messages: %llu round trips,"
+	       " average %.3f ms, max %.3f ms\n", priority, pings,
+	       pings ? ping_total / pings * 1000 : 0, ping_max * 1000);
+    }
+
+    if (check_it) {
+	if (bad) {
+	    fprintf(stderr, "%llu bad bytes received\n", bad);
+	    errs++;
+	}
+	if (nsrv_chans != nchans) {
+	    fprintf(stderr, "Got %u channels, expected %u\n",
+		    nsrv_chans, nchans);
+	    errs++;
+	}
+	for (i = nchans - nactive; i < nchans; i++) {
+	    if (chans[i].count == 0) {
+		fprintf(stderr, "Channel %u never got any data\n", i);
+		errs++;
+	    }
+	}
+	if (sched && (pings == 0 || idle_pings == 0)) {
+	    fprintf(stderr, "No small messages got through\n");
+	    errs++;
+	} else if (sched && priority > 0 &&
+		   ping_total / pings > idle_avg * PING_LOAD_FACTOR) {
+	    fprintf(stderr, "Small messages took %.3f ms under load, more"
+		    " than %d times the %.3f ms idle\n",
+		    ping_total / pings * 1000, PING_LOAD_FACTOR,
+		    idle_avg * 1000);
+	    errs++;
+	}
+    }
+
+    for (i = 0; i < nchans; i++) {
+	gensio_close_s(chans[i].io);
+	gensio_free(chans[i].io);
+    }
+    gensio_close_s(mux);
+    gensio_free(mux);
+    gensio_acc_shutdown_s(acc);
+    gensio_acc_free(acc);
+    gensio_os_funcs_free_timer(o, timer);
+    gensio_os_funcs_free_waiter(o, waiter);
+    gensio_os_proc_cleanup(proc_data);
+    gensio_os_funcs_free(o);
+    free(chans);
+
+    return bench_errs("mux errors");
+}
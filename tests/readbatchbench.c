@@ -0,0 +1,304 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * A benchmark for read batching.  It sends data as fast as it can over
+ * a loopback tcp connection for -t seconds in -s byte writes, first
+ * with readbatch=0 on the receiver, so it does one read each time the
+ * socket is readable, then with readbatch set to -b.  For each it
+ * reports the MB/sec and, from GENSIO_CONTROL_READ_STATS, the read
+ * ready events and read calls per MB.  Every read ready costs a
+ * selector wakeup and a re-arm of the descriptor, so the two together
+ * are about the number of system calls per MB.
+ *
+ * With -c it is run as a test.  It then checks that the data arrives
+ * correctly and that without batching there is one read per event.
+ * How much batching saves depends on how far the receiver falls
+ * behind, so that is only reported.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gensio/gensio.h>
+#include <gensio/gensio_os_funcs.h>
+#include "benchutil.h"
+
+static struct gensio_waiter *waiter;
+
+/* A prime, so the pattern doesn't line up with any buffer size. */
+#define PATTERN_SIZE 65521
+static unsigned char *pattern;
+
+struct rcv {
+    struct gensio *io;
+    unsigned long long count;
+    unsigned long long wait_for;
+    bool bad;
+};
+
+static const char *usage =
+    "[-c] [-s <writesize>] [-t <seconds>] [-b <readbatch>]";
+
+static int
+rcv_event(struct gensio *io, void *user_data, int event, int err,
+	  unsigned char *buf, gensiods *buflen,
+	  const char *const *auxdata)
+{
+    struct rcv *r = user_data;
+    gensiods pos, len;
+
+    if (err) {
+	if (err != GE_REMCLOSE) {
+	    fprintf(stderr, "Receive error: %s\n", gensio_err_to_str(err));
+	    r->bad = true;
+	}
+	gensio_set_read_callback_enable(io, false);
+	gensio_os_funcs_wake(o, waiter);
+	return 0;
+    }
+    if (event != GENSIO_EVENT_READ)
+	return GE_NOTSUP;
+
+    for (pos = 0; !r->bad && pos < *buflen; pos += len) {
+	gensiods ppos = (r->count + pos) % PATTERN_SIZE;
+
+	len = *buflen - pos;
+	if (len > PATTERN_SIZE - ppos)
+	    len = PATTERN_SIZE - ppos;
+	if (memcmp(buf + pos, pattern + ppos, len) != 0) {
+	    fprintf(stderr, "Data mismatch at about %llu\n", r->count + pos);
+	    r->bad = true;
+	}
+    }
+    r->count += *buflen;
+    if (r->wait_for && r->count >= r->wait_for) {
+	r->wait_for = 0;
+	gensio_os_funcs_wake(o, waiter);
+    }
+    return 0;
+}
+
+static int
+acc_event(struct gensio_accepter *accepter, void *user_data,
+	  int event, void *data)
+{
+    struct rcv *r = user_data;
+
+    if (event != GENSIO_ACC_EVENT_NEW_CONNECTION)
+	return GE_NOTSUP;
+
+    r->io = data;
+    gensio_set_callback(r->io, rcv_event, r);
+    gensio_set_read_callback_enable(r->io, true);
+    gensio_os_funcs_wake(o, waiter);
+    return 0;
+}
+
+/* Send len bytes of the pattern starting at *pos. */
+static int
+send_data(struct gensio *io, unsigned long long *pos, gensiods len)
+{
+    gensio_time timeout = { 10, 0 };
+    gensiods ppos, wlen;
+    int rv = 0;
+
+    while (!rv && len > 0) {
+	ppos = *pos % PATTERN_SIZE;
+	wlen = len;
+	if (wlen > PATTERN_SIZE - ppos)
+	    wlen = PATTERN_SIZE - ppos;
+	rv = gensio_write_s(io, NULL, pattern + ppos, wlen, &timeout);
+	*pos += wlen;
+	len -= wlen;
+    }
+    if (rv)
+	fprintf(stderr, "Write failed: %s\n", gensio_err_to_str(rv));
+    return rv;
+}
+
+/* Wait for the receiver to get everything sent so far. */
+static int
+wait_rcv(struct rcv *r, unsigned long long sent)
+{
+    gensio_time timeout = { 10, 0 };
+    int rv = 0;
+
+    while (!rv && r->count < sent) {
+	r->wait_for = sent;
+	rv = gensio_os_funcs_wait(o, waiter, 1, &timeout);
+    }
+    if (rv)
+	fprintf(stderr, "Data never arrived, got %llu of %llu\n",
+		r->count, sent);
+    return rv;
+}
+
+/*
+ * Run the transfer with the given readbatch on the receiver and
+ * return the read ready events and read calls per MB.
+ */
+static void
+bench(const char *desc, gensiods read_batch, unsigned int seconds,
+      gensiods wrsize, double *events_per_mb, double *reads_per_mb)
+{
+    struct gensio_accepter *acc;
+    struct gensio *io;
+    struct rcv r;
+    gensio_time timeout = { 10, 0 }, start, now;
+    unsigned long long sent = 0, events = 0, reads = 0, bytes = 0;
+    char port[30], str[100];
+    gensiods len;
+    double elapsed;
+    int rv;
+
+    memset(&r, 0, sizeof(r));
+
+    snprintf(str, sizeof(str), "tcp(readbatch=%lu),127.0.0.1,0",
+	     (unsigned long) read_batch);
+    rv = str_to_gensio_accepter(str, o, acc_event, &r, &acc);
+    if (!rv)
+	rv = gensio_acc_startup(acc);
+    if (rv) {
+	fprintf(stderr, "Could not start accepter: %s\n",
+		gensio_err_to_str(rv));
+	exit(1);
+    }
+    strcpy(port, "0");
+    len = sizeof(port);
+    rv = gensio_acc_control(acc, GENSIO_CONTROL_DEPTH_FIRST, true,
+			    GENSIO_ACC_CONTROL_LPORT, port, &len);
+    if (rv) {
+	fprintf(stderr, "Could not get accepter port: %s\n",
+		gensio_err_to_str(rv));
+	exit(1);
+    }
+
+    snprintf(str, sizeof(str), "tcp,127.0.0.1,%s", port);
+    rv = str_to_gensio(str, o, NULL, NULL, &io);
+    if (!rv)
+	rv = gensio_open_s(io);
+    if (!rv)
+	rv = gensio_set_sync(io);
+    /* Wait for the accept, it may have already happened. */
+    if (!rv)
+	rv = gensio_os_funcs_wait(o, waiter, 1, &timeout);
+    if (rv) {
+	fprintf(stderr, "Could not connect to %s: %s\n", str,
+		gensio_err_to_str(rv));
+	exit(1);
+    }
+
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    do {
+	if (send_data(io, &sent, wrsize) || r.bad)
+	    goto out_err;
+	gensio_os_funcs_get_monotonic_time(o, &now);
+    } while (now.secs - start.secs < seconds ||
+	     (now.secs - start.secs == seconds && now.nsecs < start.nsecs));
+    if (wait_rcv(&r, sent))
+	goto out_err;
+    gensio_os_funcs_get_monotonic_time(o, &now);
+    elapsed = tv_diff(&now, &start);
+
+    len = sizeof(str);
+    rv = gensio_control(r.io, 0, GENSIO_CONTROL_GET,
+			GENSIO_CONTROL_READ_STATS, str, &len);
+    if (rv || sscanf(str, "%llu %llu %llu", &events, &reads, &bytes) != 3) {
+	fprintf(stderr, "Could not get read stats: %s\n",
+		gensio_err_to_str(rv));
+	goto out_err;
+    }
+    if (bytes != r.count) {
+	fprintf(stderr, "%s: read stats show %llu bytes, but %llu arrived\n",
+		desc, bytes, r.count);
+	errs++;
+    }
+
+    *events_per_mb = events * 1000000.0 / r.count;
+    *reads_per_mb = reads * 1000000.0 / r.count;
+    printf("%-8s %8.2f MB/sec, %8.1f events/MB, %8.1f reads/MB\n",
+	   desc, r.count / elapsed / 1000000, *events_per_mb, *reads_per_mb);
+
+    gensio_close_s(io);
+    gensio_free(io);
+    gensio_close_s(r.io);
+    gensio_free(r.io);
+    gensio_acc_shutdown_s(acc);
+    gensio_acc_free(acc);
+    return;
+
+ out_err:
+    exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct gensio_os_proc_data *proc_data;
+    gensiods wrsize = 65536, read_batch = 65536, i;
+    double single_events, single_reads, batch_events, batch_reads;
+    int rv;
+
+    while ((rv = bench_getopt(argc, argv, "cs:t:b:", usage)) != -1) {
+	switch (rv) {
+	case 's':
+	    wrsize = strtoul(optarg, NULL, 0);
+	    break;
+	case 'b':
+	    read_batch = strtoul(optarg, NULL, 0);
+	    break;
+	}
+    }
+    if (wrsize < 1 || read_batch < 1)
+	bench_help(argv[0], usage);
+
+    pattern = malloc(PATTERN_SIZE);
+    if (!pattern) {
+	fprintf(stderr, "Out of memory\n");
+	return 1;
+    }
+    for (i = 0; i < PATTERN_SIZE; i++)
+	pattern[i] = (i * 7) ^ (i >> 8);
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv) {
+	fprintf(stderr, "Could not allocate OS handler: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    rv = gensio_os_proc_setup(o, &proc_data);
+    if (rv) {
+	fprintf(stderr, "Could not setup process: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    waiter = gensio_os_funcs_alloc_waiter(o);
+    if (!waiter) {
+	fprintf(stderr, "Could not allocate waiter\n");
+	return 1;
+    }
+
+    bench("single", 0, seconds, wrsize, &single_events, &single_reads);
+    bench("batched", read_batch, seconds, wrsize, &batch_events, &batch_reads);
+
+    if (check_it) {
+	if (single_events != single_reads) {
+	    fprintf(stderr, "single: %.1f events/MB but %.1f reads/MB,"
+		    " should be the same\n", single_events, single_reads);
+	    errs++;
+	}
+    }
+
+    gensio_os_funcs_free_waiter(o, waiter);
+    gensio_os_proc_cleanup(proc_data);
+    gensio_os_funcs_free(o);
+    free(pattern);
+    return check_it ? bench_errs("readbatch errors") : 0;
+}
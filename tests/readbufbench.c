@@ -0,0 +1,348 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * A benchmark for adaptive read buffers.  It sends data as fast as it
+ * can over a loopback tcp connection for -t seconds in -s byte
+ * writes, first with the normal fixed read buffer on the receiver,
+ * then with readbuf-max set to -m with gensio_set_default().  For
+ * each it reports the MB/sec, the number of read callbacks per MB,
+ * the largest read buffer seen, and how many small messages, like an
+ * idle connection would get, it takes after the bulk data is done for
+ * the read buffer to get back to the normal size.
+ *
+ * With -c it is run as a test.  It then checks that the data arrives
+ * correctly, that the read buffer only grows when readbuf-max is set,
+ * that it grows all the way to readbuf-max, that one small message
+ * doesn't shrink it, and that it goes back to the normal size when
+ * the transfer is done.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gensio/gensio.h>
+#include <gensio/gensio_os_funcs.h>
+#include <gensio/gensio_class.h>
+#include "benchutil.h"
+
+static struct gensio_waiter *waiter;
+
+/* A prime, so the pattern doesn't line up with any buffer size. */
+#define PATTERN_SIZE 65521
+static unsigned char *pattern;
+
+struct rcv {
+    struct gensio *io;
+    unsigned long long count;
+    unsigned long long reads;
+    unsigned long long wait_for;
+    gensiods max_readbuf;
+    bool bad;
+};
+
+static const char *usage =
+    "[-c] [-s <writesize>] [-t <seconds>] [-m <readbuf-max>]";
+
+static gensiods
+get_readbuf(struct gensio *io)
+{
+    char str[30];
+    gensiods len = sizeof(str);
+
+    if (gensio_control(io, 0, GENSIO_CONTROL_GET, GENSIO_CONTROL_READBUF,
+		       str, &len))
+	return 0;
+    return strtoul(str, NULL, 0);
+}
+
+static int
+rcv_event(struct gensio *io, void *user_data, int event, int err,
+	  unsigned char *buf, gensiods *buflen,
+	  const char *const *auxdata)
+{
+    struct rcv *r = user_data;
+    gensiods size, pos, len;
+
+    if (err) {
+	if (err != GE_REMCLOSE) {
+	    fprintf(stderr, "Receive error: %s\n", gensio_err_to_str(err));
+	    r->bad = true;
+	}
+	gensio_set_read_callback_enable(io, false);
+	gensio_os_funcs_wake(o, waiter);
+	return 0;
+    }
+    if (event != GENSIO_EVENT_READ)
+	return GE_NOTSUP;
+
+    r->reads++;
+    size = get_readbuf(io);
+    if (size > r->max_readbuf)
+	r->max_readbuf = size;
+
+    for (pos = 0; !r->bad && pos < *buflen; pos += len) {
+	gensiods ppos = (r->count + pos) % PATTERN_SIZE;
+
+	len = *buflen - pos;
+	if (len > PATTERN_SIZE - ppos)
+	    len = PATTERN_SIZE - ppos;
+	if (memcmp(buf + pos, pattern + ppos, len) != 0) {
+	    fprintf(stderr, "Data mismatch at about %llu\n", r->count + pos);
+	    r->bad = true;
+	}
+    }
+    r->count += *buflen;
+    if (r->wait_for && r->count >= r->wait_for) {
+	r->wait_for = 0;
+	gensio_os_funcs_wake(o, waiter);
+    }
+    return 0;
+}
+
+static int
+acc_event(struct gensio_accepter *accepter, void *user_data,
+	  int event, void *data)
+{
+    struct rcv *r = user_data;
+
+    if (event != GENSIO_ACC_EVENT_NEW_CONNECTION)
+	return GE_NOTSUP;
+
+    r->io = data;
+    gensio_set_callback(r->io, rcv_event, r);
+    gensio_set_read_callback_enable(r->io, true);
+    gensio_os_funcs_wake(o, waiter);
+    return 0;
+}
+
+/* Send len bytes of the pattern starting at *pos. */
+static int
+send_data(struct gensio *io, unsigned long long *pos, gensiods len)
+{
+    gensio_time timeout = { 10, 0 };
+    gensiods ppos, wlen;
+    int rv = 0;
+
+    while (!rv && len > 0) {
+	ppos = *pos % PATTERN_SIZE;
+	wlen = len;
+	if (wlen > PATTERN_SIZE - ppos)
+	    wlen = PATTERN_SIZE - ppos;
+	rv = gensio_write_s(io, NULL, pattern + ppos, wlen, &timeout);
+	*pos += wlen;
+	len -= wlen;
+    }
+    if (rv)
+	fprintf(stderr, "Write failed: %s\n", gensio_err_to_str(rv));
+    return rv;
+}
+
+/* Wait for the receiver to get everything sent so far. */
+static int
+wait_rcv(struct rcv *r, unsigned long long sent)
+{
+    gensio_time timeout = { 10, 0 };
+    int rv = 0;
+
+    while (!rv && r->count < sent) {
+	r->wait_for = sent;
+	rv = gensio_os_funcs_wait(o, waiter, 1, &timeout);
+    }
+    if (rv)
+	fprintf(stderr, "Data never arrived, got %llu of %llu\n",
+		r->count, sent);
+    return rv;
+}
+
+static void
+bench(const char *desc, gensiods readbuf_max, unsigned int seconds,
+      gensiods wrsize)
+{
+    struct gensio_accepter *acc;
+    struct gensio *io;
+    struct rcv r;
+    gensio_time timeout = { 10, 0 }, start, now;
+    unsigned long long sent = 0;
+    gensiods readbuf_after_one, idle_readbuf;
+    unsigned int nsmall;
+    char port[30], str[100];
+    gensiods len;
+    double elapsed;
+    int rv;
+
+    memset(&r, 0, sizeof(r));
+
+    /* readbuf-max is a default, so it applies to accepted connections. */
+    rv = gensio_set_default(o, NULL, "readbuf-max", NULL, readbuf_max);
+    if (rv) {
+	fprintf(stderr, "Could not set readbuf-max default: %s\n",
+		gensio_err_to_str(rv));
+	exit(1);
+    }
+
+    rv = str_to_gensio_accepter("tcp,127.0.0.1,0", o, acc_event, &r, &acc);
+    if (!rv)
+	rv = gensio_acc_startup(acc);
+    if (rv) {
+	fprintf(stderr, "Could not start accepter: %s\n",
+		gensio_err_to_str(rv));
+	exit(1);
+    }
+    strcpy(port, "0");
+    len = sizeof(port);
+    rv = gensio_acc_control(acc, GENSIO_CONTROL_DEPTH_FIRST, true,
+			    GENSIO_ACC_CONTROL_LPORT, port, &len);
+    if (rv) {
+	fprintf(stderr, "Could not get accepter port: %s\n",
+		gensio_err_to_str(rv));
+	exit(1);
+    }
+
+    snprintf(str, sizeof(str), "tcp,127.0.0.1,%s", port);
+    rv = str_to_gensio(str, o, NULL, NULL, &io);
+    if (!rv)
+	rv = gensio_open_s(io);
+    if (!rv)
+	rv = gensio_set_sync(io);
+    /* Wait for the accept, it may have already happened. */
+    if (!rv)
+	rv = gensio_os_funcs_wait(o, waiter, 1, &timeout);
+    if (rv) {
+	fprintf(stderr, "Could not connect to %s: %s\n", str,
+		gensio_err_to_str(rv));
+	exit(1);
+    }
+
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    do {
+	if (send_data(io, &sent, wrsize) || r.bad)
+	    goto out_err;
+	gensio_os_funcs_get_monotonic_time(o, &now);
+    } while (now.secs - start.secs < seconds ||
+	     (now.secs - start.secs == seconds && now.nsecs < start.nsecs));
+    if (wait_rcv(&r, sent))
+	goto out_err;
+    gensio_os_funcs_get_monotonic_time(o, &now);
+    elapsed = tv_diff(&now, &start);
+
+    /*
+     * Small messages, like an idle connection would get, until the
+     * read buffer is back to normal.  Wait for each one so each is a
+     * separate read.
+     */
+    readbuf_after_one = 0;
+    idle_readbuf = get_readbuf(r.io);
+    for (nsmall = 0; nsmall < 1000 && idle_readbuf > GENSIO_DEFAULT_BUF_SIZE;
+	 nsmall++) {
+	if (send_data(io, &sent, 10) || wait_rcv(&r, sent))
+	    goto out_err;
+	idle_readbuf = get_readbuf(r.io);
+	if (nsmall == 0)
+	    readbuf_after_one = idle_readbuf;
+    }
+
+    printf("%-8s %8.2f MB/sec, %8.1f reads/MB, max readbuf %lu,"
+	   " idle readbuf %lu after %u small reads\n", desc,
+	   r.count / elapsed / 1000000, r.reads * 1000000.0 / r.count,
+	   (unsigned long) r.max_readbuf, (unsigned long) idle_readbuf,
+	   nsmall);
+
+    if (check_it) {
+	gensiods expect_max = GENSIO_DEFAULT_BUF_SIZE;
+
+	if (readbuf_max > expect_max)
+	    expect_max = readbuf_max;
+	if (r.max_readbuf != expect_max) {
+	    fprintf(stderr, "%s: read buffer got to %lu, expected %lu\n",
+		    desc, (unsigned long) r.max_readbuf,
+		    (unsigned long) expect_max);
+	    errs++;
+	}
+	if (nsmall > 0 && readbuf_after_one < r.max_readbuf) {
+	    fprintf(stderr, "%s: one small read shrank the read buffer"
+		    " from %lu to %lu\n", desc, (unsigned long) r.max_readbuf,
+		    (unsigned long) readbuf_after_one);
+	    errs++;
+	}
+	if (idle_readbuf != GENSIO_DEFAULT_BUF_SIZE) {
+	    fprintf(stderr, "%s: idle read buffer is %lu, expected %lu\n",
+		    desc, (unsigned long) idle_readbuf,
+		    (unsigned long) GENSIO_DEFAULT_BUF_SIZE);
+	    errs++;
+	}
+    }
+
+    gensio_close_s(io);
+    gensio_free(io);
+    gensio_close_s(r.io);
+    gensio_free(r.io);
+    gensio_acc_shutdown_s(acc);
+    gensio_acc_free(acc);
+    return;
+
+ out_err:
+    exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct gensio_os_proc_data *proc_data;
+    gensiods wrsize = 65536, readbuf_max = 65536, i;
+    int rv;
+
+    while ((rv = bench_getopt(argc, argv, "cs:t:m:", usage)) != -1) {
+	switch (rv) {
+	case 's':
+	    wrsize = strtoul(optarg, NULL, 0);
+	    break;
+	case 'm':
+	    readbuf_max = strtoul(optarg, NULL, 0);
+	    break;
+	}
+    }
+    if (wrsize < 1 || readbuf_max < GENSIO_DEFAULT_BUF_SIZE)
+	bench_help(argv[0], usage);
+
+    pattern = malloc(PATTERN_SIZE);
+    if (!pattern) {
+	fprintf(stderr, "Out of memory\n");
+	return 1;
+    }
+    for (i = 0; i < PATTERN_SIZE; i++)
+	pattern[i] = (i * 7) ^ (i >> 8);
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv) {
+	fprintf(stderr, "Could not allocate OS handler: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    rv = gensio_os_proc_setup(o, &proc_data);
+    if (rv) {
+	fprintf(stderr, "Could not setup process: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    waiter = gensio_os_funcs_alloc_waiter(o);
+    if (!waiter) {
+	fprintf(stderr, "Could not allocate waiter\n");
+	return 1;
+    }
+
+    bench("fixed", 0, seconds, wrsize);
+    bench("adaptive", readbuf_max, seconds, wrsize);
+
+    gensio_os_funcs_free_waiter(o, waiter);
+    gensio_os_proc_cleanup(proc_data);
+    gensio_os_funcs_free(o);
+    free(pattern);
+    return check_it ? bench_errs("readbuf errors") : 0;
+}
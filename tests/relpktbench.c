@@ -0,0 +1,489 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2024  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * A throughput benchmark for relpkt over UDP on an emulated link.  It
+ * starts a relpkt accepter that takes all the data sent to it, and
+ * connects a relpkt client to it through a link emulator that sits
+ * between them as a UDP relay.  The client sends as fast as it can.
+ * It reports the data rate received and the percentage of the link
+ * rate that is.
+ *
+ * The link emulator works like netem with a rate limit.  Each
+ * direction has a bandwidth (-r, bytes/sec), a one way delay (-d,
+ * milliseconds), a random loss rate (-l, percent) and a queue that
+ * holds at most -q milliseconds of data.  Packets that don't fit in
+ * the queue are dropped, so the sender has to do congestion control.
+ *
+ * Use -s and -w to set the relpkt max_pktsize and max_packets, and -x
+ * to add other relpkt options, like "extended=false" to compare the
+ * old protocol.
+ *
+ * It also reports how much data was retransmitted.  The relay looks
+ * at the relpkt headers for this, it counts the data bytes in all the
+ * data packets the client sends, and anything over what the client
+ * wrote was retransmitted.
+ *
+ * With -c it checks that the data was received intact and in order,
+ * and if there is loss and the extended protocol is in use, that the
+ * amount retransmitted is not much more than the amount lost.  The
+ * data rate depends on the machine, so it is only reported.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gensio/gensio.h>
+#include <gensio/gensio_os_funcs.h>
+#include <gensio/gensio_time.h>
+#include "benchutil.h"
+
+struct lpkt {
+    struct lpkt *next;
+    int64_t deliver; /* usecs */
+    gensiods len;
+    unsigned char data[];
+};
+
+/* One direction of the emulated link. */
+struct link {
+    struct gensio *dest;
+    struct gensio_timer *timer;
+    bool timer_running;
+    int64_t last_depart; /* When the last packet finishes sending. */
+    struct lpkt *head, *tail;
+    unsigned long long pkts, dropped;
+};
+
+static struct link to_srv, to_cli;
+static unsigned long rate = 10000000, delay = 20, queue = 80;
+static double loss;
+static struct gensio *cli_io, *srv_io, *relay_srv, *relay_cli;
+static unsigned long long sent, received, bad;
+static bool running;
+
+/*
+ * For counting retransmits.  The relpkt header is 5 bytes in the
+ * extended protocol, 3 in the old one, it's set from the version in
+ * the init response.
+ */
+static unsigned int hdrlen = 3, version;
+static unsigned long long xmit_data;
+
+static int64_t
+now_usecs(void)
+{
+    gensio_time t;
+
+    gensio_os_funcs_get_monotonic_time(o, &t);
+    return gensio_time_to_usecs(&t);
+}
+
+static void
+link_start_timer(struct link *l, int64_t now)
+{
+    gensio_time timeout;
+    int64_t wait = l->head->deliver - now;
+
+    if (wait < 0)
+	wait = 0;
+    gensio_usecs_to_time(&timeout, wait);
+    if (gensio_os_funcs_start_timer(o, l->timer, &timeout) == 0)
+	l->timer_running = true;
+}
+
+static void
+link_timeout(struct gensio_timer *t, void *cb_data)
+{
+    struct link *l = cb_data;
+    struct lpkt *p;
+    int64_t now = now_usecs();
+
+    l->timer_running = false;
+    while (l->head && l->head->deliver <= now) {
+	p = l->head;
+	l->head = p->next;
+	if (!l->head)
+	    l->tail = NULL;
+	if (l->dest)
+	    gensio_write(l->dest, NULL, p->data, p->len, NULL);
+	free(p);
+    }
+    if (l->head)
+	link_start_timer(l, now);
+}
+
+static void
+link_send(struct link *l, const unsigned char *buf, gensiods len)
+{
+    struct lpkt *p;
+    int64_t now = now_usecs();
+
+    l->pkts++;
+    if (l->last_depart < now)
+	l->last_depart = now;
+    if (l->last_depart - now > (int64_t) queue * 1000 ||
+		(loss > 0 && rand() < loss / 100 * RAND_MAX)) {
+	l->dropped++;
+	return;
+    }
+
+    p = malloc(sizeof(*p) + len);
+    if (!p) {
+	l->dropped++;
+	return;
+    }
+    l->last_depart += len * 1000000 / rate;
+    p->deliver = l->last_depart + delay * 1000;
+    p->len = len;
+    p->next = NULL;
+    memcpy(p->data, buf, len);
+    if (l->tail)
+	l->tail->next = p;
+    else
+	l->head = p;
+    l->tail = p;
+    if (!l->timer_running)
+	link_start_timer(l, now);
+}
+
+static void
+link_free(struct link *l)
+{
+    struct lpkt *p;
+
+    gensio_os_funcs_stop_timer(o, l->timer);
+    gensio_os_funcs_free_timer(o, l->timer);
+    while (l->head) {
+	p = l->head;
+	l->head = p->next;
+	free(p);
+    }
+}
+
+/* Packets from the client to the relay go toward the server. */
+static int
+relay_cli_event(struct gensio *io, void *user_data, int event, int err,
+		unsigned char *buf, gensiods *buflen,
+		const char *const *auxdata)
+{
+    if (event != GENSIO_EVENT_READ || err)
+	return GE_NOTSUP;
+    if (*buflen > hdrlen && buf[0] >> 4 == 2) /* Data */
+	xmit_data += *buflen - hdrlen;
+    link_send(&to_srv, buf, *buflen);
+    return 0;
+}
+
+/* Packets from the server to the relay go toward the client. */
+static int
+relay_srv_event(struct gensio *io, void *user_data, int event, int err,
+		unsigned char *buf, gensiods *buflen,
+		const char *const *auxdata)
+{
+    if (event != GENSIO_EVENT_READ || err)
+	return GE_NOTSUP;
+    if (*buflen >= 2 && buf[0] == (1 << 4 | 1)) { /* Init response */
+	version = buf[1];
+	hdrlen = version ? 5 : 3;
+    }
+    link_send(&to_cli, buf, *buflen);
+    return 0;
+}
+
+static int
+relay_acc_event(struct gensio_accepter *acc, void *user_data, int event,
+		void *data)
+{
+    struct gensio *io = data;
+
+    if (event != GENSIO_ACC_EVENT_NEW_CONNECTION)
+	return GE_NOTSUP;
+
+    if (relay_cli) {
+	gensio_free(io);
+	return 0;
+    }
+    relay_cli = io;
+    to_cli.dest = io;
+    gensio_set_callback(io, relay_cli_event, NULL);
+    gensio_set_read_callback_enable(io, true);
+    return 0;
+}
+
+static int
+srv_event(struct gensio *io, void *user_data, int event, int err,
+	  unsigned char *buf, gensiods *buflen, const char *const *auxdata)
+{
+    gensiods i;
+
+    if (event != GENSIO_EVENT_READ)
+	return GE_NOTSUP;
+    if (err) {
+	gensio_set_read_callback_enable(io, false);
+	return 0;
+    }
+
+    for (i = 0; i < *buflen; i++) {
+	if (buf[i] != (received + i) % 251) {
+	    bad++;
+	    break;
+	}
+    }
+    received += *buflen;
+    return 0;
+}
+
+static int
+srv_acc_event(struct gensio_accepter *acc, void *user_data, int event,
+	      void *data)
+{
+    struct gensio *io = data;
+
+    if (event != GENSIO_ACC_EVENT_NEW_CONNECTION)
+	return GE_NOTSUP;
+
+    if (srv_io) {
+	gensio_free(io);
+	return 0;
+    }
+    srv_io = io;
+    gensio_set_callback(io, srv_event, NULL);
+    gensio_set_read_callback_enable(io, true);
+    return 0;
+}
+
+static int
+cli_event(struct gensio *io, void *user_data, int event, int err,
+	  unsigned char *buf, gensiods *buflen, const char *const *auxdata)
+{
+    unsigned char data[16384];
+    gensiods i, count;
+
+    if (event != GENSIO_EVENT_WRITE_READY)
+	return GE_NOTSUP;
+
+    if (!running) {
+	gensio_set_write_callback_enable(io, false);
+	return 0;
+    }
+    for (i = 0; i < sizeof(data); i++)
+	data[i] = (sent + i) % 251;
+    if (gensio_write(io, &count, data, sizeof(data), NULL) == 0)
+	sent += count;
+    return 0;
+}
+
+static int
+start_accepter(const char *str, gensio_accepter_event cb,
+	       struct gensio_accepter **acc, char *port, gensiods portlen)
+{
+    int rv;
+
+    rv = str_to_gensio_accepter(str, o, cb, NULL, acc);
+    if (!rv)
+	rv = gensio_acc_startup(*acc);
+    if (rv) {
+	fprintf(stderr, "Could not start accepter %s: %s\n", str,
+		gensio_err_to_str(rv));
+	return rv;
+    }
+    strcpy(port, "0");
+    rv = gensio_acc_control(*acc, GENSIO_CONTROL_DEPTH_FIRST, true,
+			    GENSIO_ACC_CONTROL_LPORT, port, &portlen);
+    if (rv)
+	fprintf(stderr, "Could not get accepter port: %s\n",
+		gensio_err_to_str(rv));
+    return rv;
+}
+
+static const char *usage =
+    "[-c] [-r <bytes/sec>] [-d <msecs>] [-l <loss%>] [-q <msecs>]"
+    " [-s <pktsize>] [-w <packets>] [-x <options>] [-t <seconds>]";
+
+int
+main(int argc, char *argv[])
+{
+    unsigned int pktsize = 1400, window = 1000;
+    const char *extra = NULL;
+    struct gensio_os_proc_data *proc_data;
+    struct gensio_accepter *srv_acc, *relay_acc;
+    struct gensio_waiter *waiter;
+    struct gensio_timer *timer;
+    gensio_time start, now, timeout;
+    unsigned long long start_received;
+    char str[200], relpkt[100], srv_port[20], relay_port[20];
+    double secs, drate, lost, resent;
+    int rv;
+
+    seconds = 5;
+    while ((rv = bench_getopt(argc, argv, "cr:d:l:q:s:w:x:t:", usage)) != -1) {
+	switch (rv) {
+	case 'r':
+	    rate = strtoul(optarg, NULL, 0);
+	    break;
+	case 'd':
+	    delay = strtoul(optarg, NULL, 0);
+	    break;
+	case 'l':
+	    loss = strtod(optarg, NULL);
+	    break;
+	case 'q':
+	    queue = strtoul(optarg, NULL, 0);
+	    break;
+	case 's':
+	    pktsize = strtoul(optarg, NULL, 0);
+	    break;
+	case 'w':
+	    window = strtoul(optarg, NULL, 0);
+	    break;
+	case 'x':
+	    extra = optarg;
+	    break;
+	}
+    }
+    if (rate < 1000 || pktsize < 1 || window < 1)
+	bench_help(argv[0], usage);
+    srand(1);
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv) {
+	fprintf(stderr, "Could not allocate OS handler: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    rv = gensio_os_proc_setup(o, &proc_data);
+    if (rv) {
+	fprintf(stderr, "Could not setup process: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    waiter = gensio_os_funcs_alloc_waiter(o);
+    if (!waiter) {
+	fprintf(stderr, "Could not allocate waiter\n");
+	return 1;
+    }
+    /*
+     * Under load the wait never times out because there is always
+     * something to do, so use a timer to wake it up.
+     */
+    timer = gensio_os_funcs_alloc_timer(o, tick, waiter);
+    to_srv.timer = gensio_os_funcs_alloc_timer(o, link_timeout, &to_srv);
+    to_cli.timer = gensio_os_funcs_alloc_timer(o, link_timeout, &to_cli);
+    if (!timer || !to_srv.timer || !to_cli.timer) {
+	fprintf(stderr, "Could not allocate timer\n");
+	return 1;
+    }
+
+    snprintf(relpkt, sizeof(relpkt), "relpkt(max_pktsize=%u,max_packets=%u%s%s)",
+	     pktsize, window, extra ? "," : "", extra ? extra : "");
+
+    snprintf(str, sizeof(str), "%s,udp,127.0.0.1,0", relpkt);
+    if (start_accepter(str, srv_acc_event, &srv_acc,
+		       srv_port, sizeof(srv_port)))
+	return 1;
+    if (start_accepter("udp,127.0.0.1,0", relay_acc_event, &relay_acc,
+		       relay_port, sizeof(relay_port)))
+	return 1;
+
+    snprintf(str, sizeof(str), "udp,127.0.0.1,%s", srv_port);
+    rv = str_to_gensio(str, o, relay_srv_event, NULL, &relay_srv);
+    if (!rv)
+	rv = gensio_open_s(relay_srv);
+    if (rv) {
+	fprintf(stderr, "Could not open relay %s: %s\n", str,
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    to_srv.dest = relay_srv;
+    gensio_set_read_callback_enable(relay_srv, true);
+
+    snprintf(str, sizeof(str), "%s,udp,127.0.0.1,%s", relpkt, relay_port);
+    rv = str_to_gensio(str, o, cli_event, NULL, &cli_io);
+    if (!rv)
+	rv = gensio_open_s(cli_io);
+    if (rv) {
+	fprintf(stderr, "Could not open client %s: %s\n", str,
+		gensio_err_to_str(rv));
+	return 1;
+    }
+
+    running = true;
+    gensio_set_write_callback_enable(cli_io, true);
+
+    /* Give it a second to get up to speed before measuring. */
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    start_received = 0;
+    do {
+	timeout.secs = 0;
+	timeout.nsecs = 100000000;
+	gensio_os_funcs_start_timer(o, timer, &timeout);
+	gensio_os_funcs_wait(o, waiter, 1, NULL);
+	gensio_os_funcs_get_monotonic_time(o, &now);
+	if (!start_received && tv_diff(&now, &start) >= 1) {
+	    start_received = received ? received : 1;
+	    start = now;
+	}
+    } while (!start_received || tv_diff(&now, &start) < seconds);
+    running = false;
+
+    secs = tv_diff(&now, &start);
+    drate = (received - start_received) / secs;
+    printf("%s: %lu bytes/sec link, %lums delay, %g%% loss:"
+	   " %.0f bytes/sec, %.1f%% of link, %llu/%llu packets dropped\n",
+	   relpkt, rate, delay, loss, drate, drate * 100 / rate,
+	   to_srv.dropped + to_cli.dropped, to_srv.pkts + to_cli.pkts);
+
+    /* Closing waits for everything to be acked. */
+    gensio_set_write_callback_enable(cli_io, false);
+    gensio_close_s(cli_io);
+
+    lost = 0;
+    if (to_srv.pkts)
+	lost = to_srv.dropped * 100.0 / to_srv.pkts;
+    resent = 0;
+    if (sent && xmit_data > sent)
+	resent = (xmit_data - sent) * 100.0 / sent;
+    printf("%.2f%% of packets to the server lost, %.2f%% of data resent\n",
+	   lost, resent);
+
+    if (check_it) {
+	if (bad || received != sent) {
+	    fprintf(stderr, "Received data was corrupted\n");
+	    errs++;
+	}
+	if (!received) {
+	    fprintf(stderr, "No data received\n");
+	    errs++;
+	}
+	if (loss > 0 && version > 0 && resent > lost * 2 + 1) {
+	    fprintf(stderr, "Too much data resent\n");
+	    errs++;
+	}
+    }
+
+    gensio_free(cli_io);
+    if (srv_io)
+	gensio_free(srv_io);
+    gensio_free(relay_srv);
+    if (relay_cli)
+	gensio_free(relay_cli);
+    link_free(&to_srv);
+    link_free(&to_cli);
+    gensio_acc_shutdown_s(srv_acc);
+    gensio_acc_free(srv_acc);
+    gensio_acc_shutdown_s(relay_acc);
+    gensio_acc_free(relay_acc);
+    gensio_os_funcs_free_timer(o, timer);
+    gensio_os_funcs_free_waiter(o, waiter);
+    gensio_os_proc_cleanup(proc_data);
+    gensio_os_funcs_free(o);
+
+    return bench_errs("relpkt errors");
+}
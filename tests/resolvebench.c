@@ -0,0 +1,677 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2024  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * A benchmark for network address lookups.  It looks up the address
+ * given with -n ("localhost,1234" by default) over and over for -t
+ * seconds three ways: with gensio_os_scan_netaddr(), which blocks in
+ * the resolver, with gensio_scan_netaddr_async() and -o lookups
+ * outstanding at a time, and with gensio_scan_netaddr_cached().  A
+ * timer ticks every millisecond the whole time, and for each it
+ * reports the lookups per second and the longest time the event loop
+ * was held up, either by a blocking lookup or by the timer running
+ * late.  Point -n at a name on a slow DNS server to see the
+ * difference.
+ *
+ * With -c it is run as a test.  It then checks that cached and async
+ * lookups give the same address as a plain lookup, that the cache
+ * counts hits and misses, that the async done callback is not called
+ * from inside the call, that cancelling works, and that errors are
+ * reported.  Then it reopens a tcp gensio to a local accepter a few
+ * times with the cache off, so every reopen looks the name up again
+ * in the background, and checks that every open works.
+ *
+ * -S <msecs> says getaddrinfo() has been slowed down by that much
+ * (resolvecheck does it by preloading slowlookup.so).  It then only
+ * checks that allocating a tcp gensio by name blocks that long, and
+ * that with async-lookup allocating and opening one doesn't, and
+ * that the 1ms timer keeps running during the open.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gensio/gensio.h>
+#include <gensio/gensio_os_funcs.h>
+#include <gensio/gensio_osops.h>
+#include "benchutil.h"
+
+
+static struct gensio_waiter *waiter;
+static struct gensio_timer *timer;
+static gensio_time tick_due;
+static double max_stall;
+
+static const char *name = "localhost,1234";
+static unsigned int outstanding = 8;
+static unsigned int pending;
+static unsigned long long lookups;
+static bool in_start, called_inline;
+static int last_err;
+static struct gensio_addr *last_addr;
+
+static void
+start_tick(void)
+{
+    gensio_time timeout = { 0, 1000000 };
+
+    gensio_os_funcs_get_monotonic_time(o, &tick_due);
+    tick_due.nsecs += timeout.nsecs;
+    if (tick_due.nsecs >= 1000000000) {
+	tick_due.nsecs -= 1000000000;
+	tick_due.secs++;
+    }
+    gensio_os_funcs_start_timer(o, timer, &timeout);
+}
+
+static void
+stall_tick(struct gensio_timer *t, void *cb_data)
+{
+    gensio_time now;
+    double late;
+
+    gensio_os_funcs_get_monotonic_time(o, &now);
+    late = tv_diff(&now, &tick_due);
+    if (late > max_stall)
+	max_stall = late;
+    start_tick();
+}
+
+static void
+lookup_done(struct gensio_os_funcs *lo, int err, struct gensio_addr *addr,
+	    void *cb_data)
+{
+    if (in_start)
+	called_inline = true;
+    pending--;
+    lookups++;
+    last_err = err;
+    if (last_addr)
+	gensio_addr_free(last_addr);
+    last_addr = addr;
+    gensio_os_funcs_wake(o, waiter);
+}
+
+static int
+start_lookup(const char *str, struct gensio_netaddr_op **op)
+{
+    int rv;
+
+    in_start = true;
+    rv = gensio_scan_netaddr_async(o, str, false, GENSIO_NET_PROTOCOL_UNSPEC,
+				   lookup_done, NULL, op);
+    in_start = false;
+    if (!rv)
+	pending++;
+    return rv;
+}
+
+static void
+run_loop(unsigned int msecs)
+{
+    gensio_time timeout = { msecs / 1000, (msecs % 1000) * 1000000 };
+
+    while (gensio_os_funcs_wait(o, waiter, 1, &timeout) == 0)
+	;
+}
+
+static void
+check_addr(struct gensio_addr *addr, const char *what)
+{
+    struct gensio_addr *expected;
+    int rv;
+
+    rv = gensio_os_scan_netaddr(o, name, false, GENSIO_NET_PROTOCOL_UNSPEC,
+				&expected);
+    if (rv) {
+	fprintf(stderr, "Could not scan %s: %s\n", name,
+		gensio_err_to_str(rv));
+	errs++;
+	return;
+    }
+    if (!gensio_addr_equal(addr, expected, true, true)) {
+	fprintf(stderr, "%s address does not match\n", what);
+	errs++;
+    }
+    gensio_addr_free(expected);
+}
+
+static unsigned int srv_open;
+
+static void
+srv_closed(struct gensio *io, void *close_data)
+{
+    gensio_free(io);
+    srv_open--;
+    gensio_os_funcs_wake(o, waiter);
+}
+
+static int
+srv_event(struct gensio *io, void *user_data, int event, int err,
+	  unsigned char *buf, gensiods *buflen, const char *const *auxdata)
+{
+    if (event != GENSIO_EVENT_READ)
+	return GE_NOTSUP;
+    if (err) {
+	gensio_set_read_callback_enable(io, false);
+	if (gensio_close(io, srv_closed, NULL))
+	    srv_closed(io, NULL);
+    }
+    return 0;
+}
+
+static int
+acc_event(struct gensio_accepter *acc, void *user_data, int event,
+	  void *data)
+{
+    struct gensio *io = data;
+
+    if (event != GENSIO_ACC_EVENT_NEW_CONNECTION)
+	return GE_NOTSUP;
+    srv_open++;
+    gensio_set_callback(io, srv_event, NULL);
+    gensio_set_read_callback_enable(io, true);
+    return 0;
+}
+
+static void
+check_reopen(void)
+{
+    struct gensio_accepter *acc;
+    struct gensio *io;
+    char port[20], str[100];
+    gensiods len;
+    unsigned int i;
+    int rv;
+
+    rv = str_to_gensio_accepter("tcp,localhost,0", o, acc_event, NULL, &acc);
+    if (!rv)
+	rv = gensio_acc_startup(acc);
+    if (rv) {
+	fprintf(stderr, "Could not start accepter: %s\n",
+		gensio_err_to_str(rv));
+	errs++;
+	return;
+    }
+    strcpy(port, "0");
+    len = sizeof(port);
+    rv = gensio_acc_control(acc, GENSIO_CONTROL_DEPTH_FIRST, true,
+			    GENSIO_ACC_CONTROL_LPORT, port, &len);
+    if (rv) {
+	fprintf(stderr, "Could not get accepter port: %s\n",
+		gensio_err_to_str(rv));
+	errs++;
+	goto out_acc;
+    }
+
+    snprintf(str, sizeof(str), "tcp,localhost,%s", port);
+    rv = str_to_gensio(str, o, NULL, NULL, &io);
+    if (rv) {
+	fprintf(stderr, "Could not allocate %s: %s\n", str,
+		gensio_err_to_str(rv));
+	errs++;
+	goto out_acc;
+    }
+    for (i = 0; i < 5; i++) {
+	rv = gensio_open_s(io);
+	if (rv) {
+	    fprintf(stderr, "Reopen %u of %s failed: %s\n", i, str,
+		    gensio_err_to_str(rv));
+	    errs++;
+	    break;
+	}
+	gensio_close_s(io);
+	/* Let the background lookup finish on some of them. */
+	if (i % 2)
+	    run_loop(50);
+    }
+    /* Free with a lookup still running, too. */
+    gensio_free(io);
+
+    while (srv_open)
+	run_loop(100);
+ out_acc:
+    gensio_acc_shutdown_s(acc);
+    gensio_acc_free(acc);
+}
+
+static bool open_finished;
+static int open_err;
+
+static void
+open_done(struct gensio *io, int err, void *open_data)
+{
+    open_finished = true;
+    open_err = err;
+    gensio_os_funcs_wake(o, waiter);
+}
+
+static int
+async_open(const char *str, unsigned int slow_msecs)
+{
+    struct gensio *io;
+    gensio_time start, now;
+    double t;
+    int rv;
+
+    max_stall = 0;
+    start_tick();
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    rv = str_to_gensio(str, o, NULL, NULL, &io);
+    if (rv) {
+	fprintf(stderr, "Could not allocate %s: %s\n", str,
+		gensio_err_to_str(rv));
+	errs++;
+	goto out;
+    }
+    gensio_os_funcs_get_monotonic_time(o, &now);
+    t = tv_diff(&now, &start);
+    if (t * 1000 >= slow_msecs / 2) {
+	fprintf(stderr, "Allocating %s took %.3f ms\n", str, t * 1000);
+	errs++;
+    }
+
+    open_finished = false;
+    rv = gensio_open(io, open_done, NULL);
+    if (rv) {
+	fprintf(stderr, "Could not open %s: %s\n", str,
+		gensio_err_to_str(rv));
+	errs++;
+	gensio_free(io);
+	goto out;
+    }
+    while (!open_finished)
+	run_loop(100);
+    gensio_os_funcs_get_monotonic_time(o, &now);
+    printf("%s: open took %.3f ms, timer late by up to %.3f ms\n", str,
+	   tv_diff(&now, &start) * 1000, max_stall * 1000);
+    if (max_stall * 1000 >= slow_msecs / 2) {
+	fprintf(stderr, "The event loop was held up during the open\n");
+	errs++;
+    }
+    rv = open_err;
+    if (!rv)
+	gensio_close_s(io);
+    gensio_free(io);
+ out:
+    gensio_os_funcs_stop_timer(o, timer);
+    return rv;
+}
+
+static void
+check_slow(unsigned int slow_msecs)
+{
+    struct gensio_accepter *acc;
+    struct gensio *io;
+    gensio_time start, now;
+    char port[20], str[100];
+    gensiods len;
+    double t;
+    int rv;
+
+    rv = str_to_gensio_accepter("tcp,localhost,0", o, acc_event, NULL, &acc);
+    if (!rv)
+	rv = gensio_acc_startup(acc);
+    if (rv) {
+	fprintf(stderr, "Could not start accepter: %s\n",
+		gensio_err_to_str(rv));
+	errs++;
+	return;
+    }
+    strcpy(port, "0");
+    len = sizeof(port);
+    rv = gensio_acc_control(acc, GENSIO_CONTROL_DEPTH_FIRST, true,
+			    GENSIO_ACC_CONTROL_LPORT, port, &len);
+    if (rv) {
+	fprintf(stderr, "Could not get accepter port: %s\n",
+		gensio_err_to_str(rv));
+	errs++;
+	goto out_acc;
+    }
+
+    /* Make sure lookups really are slow. */
+    snprintf(str, sizeof(str), "tcp,localhost,%s", port);
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    rv = str_to_gensio(str, o, NULL, NULL, &io);
+    gensio_os_funcs_get_monotonic_time(o, &now);
+    if (rv) {
+	fprintf(stderr, "Could not allocate %s: %s\n", str,
+		gensio_err_to_str(rv));
+	errs++;
+	goto out_acc;
+    }
+    gensio_free(io);
+    t = tv_diff(&now, &start);
+    printf("%s: allocation blocked for %.3f ms\n", str, t * 1000);
+    if (t * 1000 < slow_msecs) {
+	fprintf(stderr, "Lookups are not slow, is slowlookup preloaded?\n");
+	errs++;
+	goto out_acc;
+    }
+
+    snprintf(str, sizeof(str), "tcp(async-lookup),localhost,%s", port);
+    rv = async_open(str, slow_msecs);
+    if (rv) {
+	fprintf(stderr, "Open of %s failed: %s\n", str,
+		gensio_err_to_str(rv));
+	errs++;
+    }
+
+    /* Lookup failures are reported by the open. */
+    rv = async_open("tcp(async-lookup),localhost,notaport", slow_msecs);
+    if (!rv) {
+	fprintf(stderr, "Open of a bad address worked\n");
+	errs++;
+    }
+
+    /* Close while the lookup is running, then open again. */
+    rv = str_to_gensio(str, o, NULL, NULL, &io);
+    if (!rv) {
+	open_finished = false;
+	rv = gensio_open(io, open_done, NULL);
+	if (!rv) {
+	    /* The close takes the place of the open callback. */
+	    gensio_close_s(io);
+	    if (open_finished) {
+		fprintf(stderr, "Open done called after close during lookup\n");
+		errs++;
+	    }
+	    rv = gensio_open(io, open_done, NULL);
+	}
+	if (!rv) {
+	    while (!open_finished)
+		run_loop(100);
+	    if (open_err) {
+		fprintf(stderr, "Reopen after close during lookup gave %s\n",
+			gensio_err_to_str(open_err));
+		errs++;
+	    } else {
+		gensio_close_s(io);
+	    }
+	}
+	gensio_free(io);
+    }
+    if (rv) {
+	fprintf(stderr, "Close during lookup failed: %s\n",
+		gensio_err_to_str(rv));
+	errs++;
+    }
+
+    /* Free with the lookup still running. */
+    rv = str_to_gensio(str, o, NULL, NULL, &io);
+    if (!rv) {
+	rv = gensio_open(io, open_done, NULL);
+	if (!rv)
+	    gensio_close_s(io);
+	gensio_free(io);
+	run_loop(slow_msecs * 2);
+    }
+
+    while (srv_open)
+	run_loop(100);
+ out_acc:
+    gensio_acc_shutdown_s(acc);
+    gensio_acc_free(acc);
+}
+
+static void
+check(void)
+{
+    struct gensio_netaddr_op *op;
+    struct gensio_addr *addr;
+    unsigned long hits, misses, hits2, misses2;
+    int rv;
+
+    gensio_set_default(o, NULL, "addr-cache-time", NULL, 30);
+
+    gensio_netaddr_cache_stats(&hits, &misses);
+    rv = gensio_scan_netaddr_cached(o, name, false,
+				    GENSIO_NET_PROTOCOL_UNSPEC, &addr);
+    if (rv) {
+	fprintf(stderr, "Cached scan failed: %s\n", gensio_err_to_str(rv));
+	errs++;
+	return;
+    }
+    check_addr(addr, "Cache miss");
+    gensio_addr_free(addr);
+    rv = gensio_scan_netaddr_cached(o, name, false,
+				    GENSIO_NET_PROTOCOL_UNSPEC, &addr);
+    if (rv) {
+	fprintf(stderr, "Cached scan failed: %s\n", gensio_err_to_str(rv));
+	errs++;
+	return;
+    }
+    check_addr(addr, "Cache hit");
+    gensio_addr_free(addr);
+    gensio_netaddr_cache_stats(&hits2, &misses2);
+    if (hits2 - hits != 1 || misses2 - misses != 1) {
+	fprintf(stderr, "Expected one cache hit and one miss, got %lu/%lu\n",
+		hits2 - hits, misses2 - misses);
+	errs++;
+    }
+
+    rv = start_lookup(name, NULL);
+    if (rv) {
+	fprintf(stderr, "Async scan failed: %s\n", gensio_err_to_str(rv));
+	errs++;
+	return;
+    }
+    while (pending)
+	run_loop(100);
+    if (called_inline) {
+	fprintf(stderr, "Async done called from inside the call\n");
+	errs++;
+    }
+    if (last_err || !last_addr) {
+	fprintf(stderr, "Async scan gave an error: %s\n",
+		gensio_err_to_str(last_err));
+	errs++;
+    } else {
+	check_addr(last_addr, "Async");
+    }
+
+    /* An address that can't be scanned is an error. */
+    rv = start_lookup("localhost,notaport", NULL);
+    if (!rv) {
+	while (pending)
+	    run_loop(100);
+	if (!last_err || last_addr) {
+	    fprintf(stderr, "Async scan of a bad address gave %s\n",
+		    gensio_err_to_str(last_err));
+	    errs++;
+	}
+    }
+
+    /* Cancel with the cache off so it really goes to a worker. */
+    gensio_set_default(o, NULL, "addr-cache-time", NULL, 0);
+    rv = start_lookup(name, &op);
+    if (!rv) {
+	rv = gensio_scan_netaddr_cancel(op);
+	if (rv) {
+	    fprintf(stderr, "Cancel failed: %s\n", gensio_err_to_str(rv));
+	    errs++;
+	} else {
+	    pending--;
+	}
+	run_loop(200);
+	if (pending || lookups != 2) {
+	    fprintf(stderr, "Done called after a cancel\n");
+	    errs++;
+	}
+    }
+
+    check_reopen();
+
+    if (last_addr)
+	gensio_addr_free(last_addr);
+    last_addr = NULL;
+}
+
+static void
+bench_sync(unsigned int seconds)
+{
+    struct gensio_addr *addr;
+    gensio_time start, before, now, zero;
+    unsigned long long count = 0;
+    double stall = 0, t;
+    int rv;
+
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    do {
+	gensio_os_funcs_get_monotonic_time(o, &before);
+	rv = gensio_os_scan_netaddr(o, name, false,
+				    GENSIO_NET_PROTOCOL_UNSPEC, &addr);
+	gensio_os_funcs_get_monotonic_time(o, &now);
+	if (rv) {
+	    fprintf(stderr, "Could not scan %s: %s\n", name,
+		    gensio_err_to_str(rv));
+	    errs++;
+	    return;
+	}
+	gensio_addr_free(addr);
+	count++;
+	t = tv_diff(&now, &before);
+	if (t > stall)
+	    stall = t;
+	/* Let the loop run between lookups, like a real program. */
+	zero.secs = 0;
+	zero.nsecs = 0;
+	gensio_os_funcs_service(o, &zero);
+    } while (tv_diff(&now, &start) < seconds);
+
+    printf("blocking: %.0f lookups/sec, loop blocked up to %.3f ms\n",
+	   count / tv_diff(&now, &start), stall * 1000);
+}
+
+static void
+bench_async(unsigned int seconds)
+{
+    gensio_time start, now;
+    unsigned long long count;
+
+    gensio_set_default(o, NULL, "addr-cache-time", NULL, 0);
+    lookups = 0;
+    max_stall = 0;
+    start_tick();
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    do {
+	while (pending < outstanding) {
+	    if (start_lookup(name, NULL)) {
+		errs++;
+		break;
+	    }
+	}
+	run_loop(1);
+	gensio_os_funcs_get_monotonic_time(o, &now);
+    } while (tv_diff(&now, &start) < seconds);
+    count = lookups;
+    while (pending)
+	run_loop(10);
+    gensio_os_funcs_stop_timer(o, timer);
+
+    printf("async: %.0f lookups/sec, timer late by up to %.3f ms\n",
+	   count / tv_diff(&now, &start), max_stall * 1000);
+}
+
+static void
+bench_cached(unsigned int seconds)
+{
+    struct gensio_addr *addr;
+    gensio_time start, now;
+    unsigned long long count = 0;
+    int rv;
+
+    gensio_set_default(o, NULL, "addr-cache-time", NULL, 30);
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    do {
+	rv = gensio_scan_netaddr_cached(o, name, false,
+					GENSIO_NET_PROTOCOL_UNSPEC, &addr);
+	if (rv) {
+	    fprintf(stderr, "Could not scan %s: %s\n", name,
+		    gensio_err_to_str(rv));
+	    errs++;
+	    return;
+	}
+	gensio_addr_free(addr);
+	count++;
+	gensio_os_funcs_get_monotonic_time(o, &now);
+    } while (tv_diff(&now, &start) < seconds);
+
+    printf("cached: %.0f lookups/sec\n", count / tv_diff(&now, &start));
+}
+
+static const char *usage =
+    "[-c] [-n <addr>] [-o <outstanding>] [-S <msecs>] [-t <seconds>]";
+
+int
+main(int argc, char *argv[])
+{
+    struct gensio_os_proc_data *proc_data;
+    unsigned int slow_msecs = 0;
+    int rv;
+
+    while ((rv = bench_getopt(argc, argv, "cn:o:S:t:", usage)) != -1) {
+	switch (rv) {
+	case 'S':
+	    slow_msecs = strtoul(optarg, NULL, 0);
+	    break;
+
+	case 'n':
+	    name = optarg;
+	    break;
+	case 'o':
+	    outstanding = strtoul(optarg, NULL, 0);
+	    break;
+	}
+    }
+    if (outstanding < 1)
+	bench_help(argv[0], usage);
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv) {
+	fprintf(stderr, "Could not allocate OS handler: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    rv = gensio_os_proc_setup(o, &proc_data);
+    if (rv) {
+	fprintf(stderr, "Could not setup process: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    waiter = gensio_os_funcs_alloc_waiter(o);
+    if (!waiter) {
+	fprintf(stderr, "Could not allocate waiter\n");
+	return 1;
+    }
+    timer = gensio_os_funcs_alloc_timer(o, stall_tick, NULL);
+    if (!timer) {
+	fprintf(stderr, "Could not allocate timer\n");
+	return 1;
+    }
+
+    if (slow_msecs) {
+	/* Every lookup is slow, don't bother with the rest. */
+	check_it = true;
+	check_slow(slow_msecs);
+    } else {
+	if (check_it)
+	    check();
+
+	bench_sync(seconds);
+	bench_async(seconds);
+	bench_cached(seconds);
+    }
+
+    gensio_os_funcs_free_timer(o, timer);
+    gensio_os_funcs_free_waiter(o, waiter);
+    gensio_os_proc_cleanup(proc_data);
+    gensio_os_funcs_free(o);
+    return check_it ? bench_errs("address lookup errors") : 0;
+}
@@ -0,0 +1,318 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2024  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * A microbenchmark for the selector.  It creates a number of socket
+ * pairs and keeps a byte in flight on each one.  When one end of a
+ * pair becomes readable, the byte is read and written back from the
+ * other end, so every fd is always active.  It reports the number of
+ * read events handled per second.
+ *
+ * The event mechanism is chosen with the GENSIO_SELECTOR environment
+ * variable, so you can run this with GENSIO_SELECTOR set to epoll,
+ * epoll_lt, io_uring, etc. to compare them.
+ *
+ * With -c it is run as a test.  It then checks that every pair saw
+ * events, which makes sure the selector can handle large numbers of
+ * fds and that none of them get lost.  If the process cannot open
+ * enough fds it exits with 77 so the test is skipped.
+ *
+ * With -T <timers> it benchmarks timers instead.  It allocates the
+ * given number of timers and keeps restarting random ones, like
+ * retransmit timers that are mostly stopped before they go off.  Most
+ * get a long timeout, some a short one so they expire.  It reports the
+ * number of stop/start operations per second.  Use the
+ * GENSIO_SELECTOR_TIMERS environment variable to compare the heap and
+ * the timer wheel.  With -c it also checks that no timer went off
+ * early and that timers all go off at the end.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <gensio/selector.h>
+#include "benchutil.h"
+
+struct pair {
+    int fd[2];
+    unsigned long long count;
+};
+
+static struct selector_s *sel;
+static unsigned long long events;
+
+static void
+read_handler(int fd, void *data)
+{
+    struct pair *p = data;
+    char c;
+
+    if (read(fd, &c, 1) != 1) {
+	perror("read");
+	exit(1);
+    }
+    if (write(p->fd[1], &c, 1) != 1) {
+	perror("write");
+	exit(1);
+    }
+    p->count++;
+    events++;
+}
+
+static double
+timeval_diff(struct timeval *end, struct timeval *start)
+{
+    return (end->tv_sec - start->tv_sec) +
+	(end->tv_usec - start->tv_usec) / 1000000.0;
+}
+
+struct tmr {
+    sel_timer_t *timer;
+    struct timeval expire;
+    int running;
+};
+
+static unsigned long long expired, early;
+
+static void
+timer_handler(struct selector_s *sel, sel_timer_t *timer, void *data)
+{
+    struct tmr *t = data;
+    struct timeval now;
+
+    sel_get_monotonic_time(&now);
+    if (timeval_diff(&now, &t->expire) < 0)
+	early++;
+    t->running = 0;
+    expired++;
+}
+
+static void
+tmr_start(struct tmr *t, unsigned int msecs)
+{
+    sel_get_monotonic_time(&t->expire);
+    t->expire.tv_sec += msecs / 1000;
+    t->expire.tv_usec += (msecs % 1000) * 1000;
+    if (t->expire.tv_usec >= 1000000) {
+	t->expire.tv_sec++;
+	t->expire.tv_usec -= 1000000;
+    }
+    if (sel_start_timer(t->timer, &t->expire)) {
+	fprintf(stderr, "Unable to start timer\n");
+	exit(1);
+    }
+    t->running = 1;
+}
+
+static int
+timer_bench(unsigned int ntimers, unsigned int seconds)
+{
+    struct tmr *tmrs;
+    struct timeval start, now, timeout;
+    unsigned long long ops = 0;
+    unsigned int i, j, nlast;
+    const char *mech;
+    int rv;
+
+    rv = sel_alloc_selector_nothread(&sel);
+    if (rv) {
+	fprintf(stderr, "Unable to allocate selector: %s\n", strerror(rv));
+	return 1;
+    }
+
+    tmrs = calloc(ntimers, sizeof(*tmrs));
+    if (!tmrs) {
+	fprintf(stderr, "Out of memory\n");
+	return 1;
+    }
+    srand(1);
+    for (i = 0; i < ntimers; i++) {
+	rv = sel_alloc_timer(sel, timer_handler, &tmrs[i], &tmrs[i].timer);
+	if (rv) {
+	    fprintf(stderr, "Unable to allocate timer: %s\n", strerror(rv));
+	    return 1;
+	}
+	tmr_start(&tmrs[i], 1000 + rand() % 9000);
+    }
+
+    sel_get_monotonic_time(&start);
+    do {
+	for (j = 0; j < 1000; j++) {
+	    struct tmr *t = &tmrs[rand() % ntimers];
+
+	    if (t->running)
+		sel_stop_timer(t->timer);
+	    /* 1 in 10 get a short timeout so they expire. */
+	    if (rand() % 10 == 0)
+		tmr_start(t, 1 + rand() % 20);
+	    else
+		tmr_start(t, 1000 + rand() % 9000);
+	    ops++;
+	}
+	timeout.tv_sec = 0;
+	timeout.tv_usec = 0;
+	sel_select(sel, NULL, 0, NULL, &timeout);
+	sel_get_monotonic_time(&now);
+    } while (timeval_diff(&now, &start) < seconds);
+
+    mech = getenv("GENSIO_SELECTOR_TIMERS");
+    printf("%s: %u timers, %llu restarts in %.3f seconds, %.0f restarts/sec,"
+	   " %llu expired\n", mech ? mech : "heap", ntimers, ops,
+	   timeval_diff(&now, &start), ops / timeval_diff(&now, &start), expired);
+
+    if (check_it) {
+	/* Make sure a set of short timers all go off. */
+	nlast = ntimers < 100 ? ntimers : 100;
+	for (i = 0; i < ntimers; i++) {
+	    if (tmrs[i].running)
+		sel_stop_timer(tmrs[i].timer);
+	    tmrs[i].running = 0;
+	}
+	for (i = 0; i < nlast; i++)
+	    tmr_start(&tmrs[i], 10 + i);
+	sel_get_monotonic_time(&start);
+	do {
+	    timeout.tv_sec = 0;
+	    timeout.tv_usec = 100000;
+	    sel_select(sel, NULL, 0, NULL, &timeout);
+	    for (i = 0; i < nlast; i++) {
+		if (tmrs[i].running)
+		    break;
+	    }
+	    sel_get_monotonic_time(&now);
+	} while (i < nlast && timeval_diff(&now, &start) < 5);
+	if (i < nlast) {
+	    fprintf(stderr, "Timer %u never went off\n", i);
+	    errs++;
+	}
+	if (early) {
+	    fprintf(stderr, "%llu timers went off early\n", early);
+	    errs++;
+	}
+    }
+
+    for (i = 0; i < ntimers; i++)
+	sel_free_timer(tmrs[i].timer);
+    free(tmrs);
+    sel_free_selector(sel);
+
+    return bench_errs("timer errors");
+}
+
+static const char *usage = "[-c] [-n <pairs>] [-T <timers>] [-t <seconds>]";
+
+int
+main(int argc, char *argv[])
+{
+    unsigned int npairs = 5000, ntimers = 0, i;
+    struct pair *pairs;
+    struct rlimit rl;
+    struct timeval start, now, timeout;
+    const char *mech;
+    int rv;
+
+    seconds = 5;
+    while ((rv = bench_getopt(argc, argv, "cn:T:t:", usage)) != -1) {
+	switch (rv) {
+	case 'n':
+	    npairs = strtoul(optarg, NULL, 0);
+	    break;
+	case 'T':
+	    ntimers = strtoul(optarg, NULL, 0);
+	    break;
+	}
+    }
+
+    if (ntimers)
+	return timer_bench(ntimers, seconds);
+
+    /* Two fds per pair plus some slack. */
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < npairs * 2 + 64) {
+	rl.rlim_cur = rl.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rl);
+	getrlimit(RLIMIT_NOFILE, &rl);
+	if (rl.rlim_cur < npairs * 2 + 64) {
+	    fprintf(stderr, "Not enough fds for %u pairs, limit is %lu\n",
+		    npairs, (unsigned long) rl.rlim_cur);
+	    return 77;
+	}
+    }
+
+    rv = sel_alloc_selector_nothread(&sel);
+    if (rv) {
+	fprintf(stderr, "Unable to allocate selector: %s\n", strerror(rv));
+	return 1;
+    }
+
+    pairs = calloc(npairs, sizeof(*pairs));
+    if (!pairs) {
+	fprintf(stderr, "Out of memory\n");
+	return 1;
+    }
+    for (i = 0; i < npairs; i++) {
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, pairs[i].fd)) {
+	    perror("socketpair");
+	    return 1;
+	}
+	fcntl(pairs[i].fd[0], F_SETFL, O_NONBLOCK);
+	rv = sel_set_fd_handlers(sel, pairs[i].fd[0], &pairs[i],
+				 read_handler, NULL, NULL, NULL);
+	if (rv) {
+	    fprintf(stderr, "Unable to set fd handlers: %s\n", strerror(rv));
+	    /* select() can't handle large fds, skip the test for it. */
+	    return rv == EMFILE ? 77 : 1;
+	}
+	sel_set_fd_read_handler(sel, pairs[i].fd[0], SEL_FD_HANDLER_ENABLED);
+	if (write(pairs[i].fd[1], "x", 1) != 1) {
+	    perror("write");
+	    return 1;
+	}
+    }
+
+    sel_get_monotonic_time(&start);
+    do {
+	timeout.tv_sec = 1;
+	timeout.tv_usec = 0;
+	rv = sel_select(sel, NULL, 0, NULL, &timeout);
+	if (rv < 0) {
+	    perror("sel_select");
+	    return 1;
+	}
+	sel_get_monotonic_time(&now);
+    } while (timeval_diff(&now, &start) < seconds);
+
+    mech = getenv("GENSIO_SELECTOR");
+    printf("%s: %u pairs, %llu events in %.3f seconds, %.0f events/sec\n",
+	   mech ? mech : "default", npairs, events, timeval_diff(&now, &start),
+	   events / timeval_diff(&now, &start));
+
+    if (check_it) {
+	for (i = 0; i < npairs; i++) {
+	    if (pairs[i].count == 0) {
+		fprintf(stderr, "Pair %u (fd %d) never got an event\n",
+			i, pairs[i].fd[0]);
+		errs++;
+	    }
+	}
+    }
+
+    for (i = 0; i < npairs; i++) {
+	sel_clear_fd_handlers_norpt(sel, pairs[i].fd[0]);
+	close(pairs[i].fd[0]);
+	close(pairs[i].fd[1]);
+    }
+    free(pairs);
+    sel_free_selector(sel);
+
+    return bench_errs("selector errors");
+}
@@ -0,0 +1,653 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * A benchmark for sharded os handlers and sharded tcp accepters.  It
+ * allocates -n shards with gensio_unix_funcs_alloc_shard(), runs a
+ * thread on each, and opens a tcp accepter with "shard" set so each
+ * shard has its own listen socket.  -C clients are spread across the
+ * shards and connect to it.  The server echoes everything back.
+ *
+ * It does two measurements, each for -t seconds.  First the clients
+ * connect, send -m bytes, wait for the echo and close, over and over,
+ * which gives connections per second.  Then each client connects once
+ * and streams data through the echo, which gives MB/sec.  Run it with
+ * -n 1, 2, 4, ... to see how it scales with cores.
+ *
+ * With -c it is run as a test.  Each client instead echoes -s bytes
+ * on one connection, and it checks the data, that every client's
+ * connection was accepted, and with more than one shard that the
+ * connections were accepted on more than one shard.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gensio/gensio.h>
+#include <gensio/gensio_os_funcs.h>
+#include <gensio/gensio_unix.h>
+#include "benchutil.h"
+
+/* A prime, so the pattern doesn't line up with any buffer size. */
+#define PATTERN_SIZE 65521
+static unsigned char pattern[PATTERN_SIZE];
+
+/* How much a client may have sent that hasn't come back yet. */
+#define CLIENT_WINDOW (256 * 1024)
+
+struct shard {
+    unsigned int num;
+    struct gensio_os_funcs *o;
+    struct gensio_thread *thread;
+    unsigned long long accepts;
+};
+
+struct client {
+    struct shard *sh;
+    struct gensio *io;
+    unsigned long long sent;
+    unsigned long long rcvd;
+    unsigned long long total; /* Close the connection after this much. */
+    unsigned long long bytes; /* Received over all connections. */
+    unsigned long long conns; /* Connections completed. */
+    bool reconnect;
+};
+
+static struct gensio_waiter *waiter;
+static struct gensio_lock *lock;
+static struct shard *shards;
+static unsigned int nshards;
+static struct client *clients;
+static unsigned int nclients;
+static char port[30];
+
+/* These are protected by lock. */
+static bool stopping, shutting_down;
+static unsigned int nr_active; /* Open client and server connections. */
+
+/*
+ * Which shard the current thread services.  Callbacks for a gensio
+ * only happen on the thread running its shard, this is how the server
+ * side finds out which shard accepted a connection.
+ */
+static __thread struct shard *curr_shard;
+
+static const char *usage =
+    "[-c] [-n <shards>] [-C <clients>] [-t <seconds>] [-m <msgsize>]"
+    " [-s <bytes>]";
+
+static bool
+is_stopping(void)
+{
+    bool rv;
+
+    gensio_os_funcs_lock(o, lock);
+    rv = stopping;
+    gensio_os_funcs_unlock(o, lock);
+    return rv;
+}
+
+static void
+add_err(void)
+{
+    gensio_os_funcs_lock(o, lock);
+    errs++;
+    gensio_os_funcs_unlock(o, lock);
+}
+
+static void
+conn_done(void)
+{
+    gensio_os_funcs_lock(o, lock);
+    assert(nr_active > 0);
+    nr_active--;
+    if (nr_active == 0)
+	gensio_os_funcs_wake(o, waiter);
+    gensio_os_funcs_unlock(o, lock);
+}
+
+static void
+srv_close_done(struct gensio *io, void *close_data)
+{
+    gensio_free(io);
+    conn_done();
+}
+
+static void
+srv_close(struct gensio *io)
+{
+    gensio_set_read_callback_enable(io, false);
+    gensio_set_write_callback_enable(io, false);
+    if (gensio_close(io, srv_close_done, NULL)) {
+	gensio_free(io);
+	conn_done();
+    }
+}
+
+static int
+srv_event(struct gensio *io, void *user_data, int event, int err,
+	  unsigned char *buf, gensiods *buflen,
+	  const char *const *auxdata)
+{
+    gensiods count;
+
+    if (err) {
+	if (err != GE_REMCLOSE) {
+	    fprintf(stderr, "Server error: %s\n", gensio_err_to_str(err));
+	    add_err();
+	}
+	srv_close(io);
+	return 0;
+    }
+
+    switch (event) {
+    case GENSIO_EVENT_READ:
+	err = gensio_write(io, &count, buf, *buflen, NULL);
+	if (err) {
+	    fprintf(stderr, "Server write error: %s\n",
+		    gensio_err_to_str(err));
+	    add_err();
+	    srv_close(io);
+	    return 0;
+	}
+	if (count < *buflen) {
+	    /* Wait for room, the rest will be delivered again. */
+	    *buflen = count;
+	    gensio_set_read_callback_enable(io, false);
+	    gensio_set_write_callback_enable(io, true);
+	}
+	return 0;
+
+    case GENSIO_EVENT_WRITE_READY:
+	gensio_set_write_callback_enable(io, false);
+	gensio_set_read_callback_enable(io, true);
+	return 0;
+
+    default:
+	return GE_NOTSUP;
+    }
+}
+
+static int
+acc_event(struct gensio_accepter *accepter, void *user_data,
+	  int event, void *data)
+{
+    struct gensio *io = data;
+
+    if (event != GENSIO_ACC_EVENT_NEW_CONNECTION)
+	return GE_NOTSUP;
+
+    gensio_os_funcs_lock(o, lock);
+    nr_active++;
+    if (curr_shard)
+	curr_shard->accepts++;
+    else
+	errs++;
+    gensio_os_funcs_unlock(o, lock);
+    if (!curr_shard)
+	fprintf(stderr, "Connection accepted outside a shard thread\n");
+
+    gensio_set_callback(io, srv_event, NULL);
+    gensio_set_read_callback_enable(io, true);
+    return 0;
+}
+
+static void client_open(struct client *c);
+
+static void
+client_close_done(struct gensio *io, void *close_data)
+{
+    struct client *c = close_data;
+
+    gensio_free(io);
+    c->io = NULL;
+    c->conns++;
+    if (c->reconnect && !is_stopping())
+	client_open(c);
+    else
+	conn_done();
+}
+
+static void
+client_close(struct client *c)
+{
+    gensio_set_read_callback_enable(c->io, false);
+    gensio_set_write_callback_enable(c->io, false);
+    if (gensio_close(c->io, client_close_done, c))
+	client_close_done(c->io, c);
+}
+
+/* Send what we can, up to the window and the total. */
+static void
+client_send(struct client *c)
+{
+    gensiods len, count, ppos;
+    int err;
+
+    len = CLIENT_WINDOW - (c->sent - c->rcvd);
+    if (c->total && len > c->total - c->sent)
+	len = c->total - c->sent;
+    ppos = c->sent % PATTERN_SIZE;
+    if (len > PATTERN_SIZE - ppos)
+	len = PATTERN_SIZE - ppos;
+    if (!c->total && is_stopping()) {
+	if (c->rcvd == c->sent)
+	    client_close(c);
+	else
+	    gensio_set_write_callback_enable(c->io, false);
+	return;
+    }
+    if (len == 0) {
+	gensio_set_write_callback_enable(c->io, false);
+	return;
+    }
+    err = gensio_write(c->io, &count, pattern + ppos, len, NULL);
+    if (err) {
+	fprintf(stderr, "Client write error: %s\n", gensio_err_to_str(err));
+	add_err();
+	client_close(c);
+	return;
+    }
+    c->sent += count;
+}
+
+static int
+client_event(struct gensio *io, void *user_data, int event, int err,
+	     unsigned char *buf, gensiods *buflen,
+	     const char *const *auxdata)
+{
+    struct client *c = user_data;
+    gensiods pos, len;
+
+    if (err) {
+	fprintf(stderr, "Client error: %s\n", gensio_err_to_str(err));
+	add_err();
+	client_close(c);
+	return 0;
+    }
+
+    switch (event) {
+    case GENSIO_EVENT_READ:
+	if (c->rcvd + *buflen > c->sent) {
+	    fprintf(stderr, "Client got more data than it sent\n");
+	    add_err();
+	    client_close(c);
+	    return 0;
+	}
+	for (pos = 0; pos < *buflen; pos += len) {
+	    gensiods ppos = (c->rcvd + pos) % PATTERN_SIZE;
+
+	    len = *buflen - pos;
+	    if (len > PATTERN_SIZE - ppos)
+		len = PATTERN_SIZE - ppos;
+	    if (memcmp(buf + pos, pattern + ppos, len) != 0) {
+		fprintf(stderr, "Data mismatch at about %llu\n",
+			c->rcvd + pos);
+		add_err();
+		client_close(c);
+		return 0;
+	    }
+	}
+	c->rcvd += *buflen;
+	c->bytes += *buflen;
+	if (c->rcvd == c->sent &&
+		((c->total && c->rcvd == c->total) || is_stopping()))
+	    client_close(c);
+	else
+	    gensio_set_write_callback_enable(io, true);
+	return 0;
+
+    case GENSIO_EVENT_WRITE_READY:
+	client_send(c);
+	return 0;
+
+    default:
+	return GE_NOTSUP;
+    }
+}
+
+static void
+client_open_done(struct gensio *io, int err, void *open_data)
+{
+    struct client *c = open_data;
+
+    if (err) {
+	fprintf(stderr, "Could not connect: %s\n", gensio_err_to_str(err));
+	add_err();
+	gensio_free(io);
+	c->io = NULL;
+	conn_done();
+	return;
+    }
+    gensio_set_read_callback_enable(io, true);
+    gensio_set_write_callback_enable(io, true);
+}
+
+static void
+client_open(struct client *c)
+{
+    char str[100];
+    int err;
+
+    c->sent = 0;
+    c->rcvd = 0;
+    snprintf(str, sizeof(str), "tcp,127.0.0.1,%s", port);
+    err = str_to_gensio(str, c->sh->o, client_event, c, &c->io);
+    if (!err) {
+	err = gensio_open(c->io, client_open_done, c);
+	if (err)
+	    gensio_free(c->io);
+    }
+    if (err) {
+	fprintf(stderr, "Could not open %s: %s\n", str,
+		gensio_err_to_str(err));
+	c->io = NULL;
+	add_err();
+	conn_done();
+    }
+}
+
+static void
+shard_thread(void *data)
+{
+    struct shard *sh = data;
+    gensio_time timeout;
+    bool done = false;
+
+    curr_shard = sh;
+    while (!done) {
+	timeout.secs = 0;
+	timeout.nsecs = 100000000;
+	gensio_os_funcs_service(sh->o, &timeout);
+	gensio_os_funcs_lock(o, lock);
+	done = shutting_down;
+	gensio_os_funcs_unlock(o, lock);
+    }
+}
+
+/*
+ * Tell the clients to stop.  This is done from a timer and not with a
+ * timeout on the wait, a wait doesn't time out while there is always
+ * something to do.
+ */
+static void
+stop_timeout(struct gensio_timer *t, void *cb_data)
+{
+    gensio_time *stop_time = cb_data;
+
+    gensio_os_funcs_get_monotonic_time(o, stop_time);
+    gensio_os_funcs_lock(o, lock);
+    stopping = true;
+    gensio_os_funcs_unlock(o, lock);
+}
+
+/*
+ * Start all the clients and wait for them to finish.  If seconds is
+ * not zero, tell them to stop after that long.  Returns the time it
+ * took.
+ */
+static double
+run_clients(unsigned int seconds, unsigned long long total, bool reconnect)
+{
+    struct gensio_timer *timer = NULL;
+    gensio_time start, now, timeout;
+    unsigned int i;
+    int rv;
+
+    gensio_os_funcs_lock(o, lock);
+    stopping = false;
+    nr_active += nclients;
+    gensio_os_funcs_unlock(o, lock);
+
+    if (seconds) {
+	timer = gensio_os_funcs_alloc_timer(o, stop_timeout, &now);
+	if (!timer) {
+	    fprintf(stderr, "Could not allocate timer\n");
+	    exit(1);
+	}
+    }
+
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    for (i = 0; i < nclients; i++) {
+	clients[i].total = total;
+	clients[i].reconnect = reconnect;
+	clients[i].bytes = 0;
+	clients[i].conns = 0;
+	client_open(&clients[i]);
+    }
+
+    if (timer) {
+	timeout.secs = seconds;
+	timeout.nsecs = 0;
+	gensio_os_funcs_start_timer(o, timer, &timeout);
+    }
+
+    /* Wait for every client and server connection to close. */
+    timeout.secs = seconds + 60;
+    timeout.nsecs = 0;
+    rv = gensio_os_funcs_wait(o, waiter, 1, &timeout);
+    if (rv) {
+	fprintf(stderr, "Connections didn't finish: %s\n",
+		gensio_err_to_str(rv));
+	exit(1);
+    }
+    if (timer)
+	gensio_os_funcs_free_timer(o, timer);
+    else
+	gensio_os_funcs_get_monotonic_time(o, &now);
+
+    return tv_diff(&now, &start);
+}
+
+static void
+print_accepts(void)
+{
+    unsigned int i;
+
+    printf("  accepted per shard:");
+    for (i = 0; i < nshards; i++)
+	printf(" %llu", shards[i].accepts);
+    printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct gensio_os_proc_data *proc_data;
+    struct gensio_accepter *acc;
+    unsigned int i, used;
+    unsigned long long size = 1000000, msgsize = 100, conns, bytes;
+    gensiods len;
+    double secs;
+    char str[100];
+    int rv;
+
+    nshards = 4;
+    nclients = 16;
+    seconds = 2;
+    while ((rv = bench_getopt(argc, argv, "cn:C:t:m:s:", usage)) != -1) {
+	switch (rv) {
+	case 'n':
+	    nshards = strtoul(optarg, NULL, 0);
+	    break;
+	case 'C':
+	    nclients = strtoul(optarg, NULL, 0);
+	    break;
+	case 'm':
+	    msgsize = strtoull(optarg, NULL, 0);
+	    break;
+	case 's':
+	    size = strtoull(optarg, NULL, 0);
+	    break;
+	}
+    }
+    if (nshards < 1 || nclients < 1 || seconds < 1 || msgsize < 1 ||
+		size < 1)
+	bench_help(argv[0], usage);
+
+    for (i = 0; i < PATTERN_SIZE; i++)
+	pattern[i] = (i * 7) ^ (i >> 8);
+
+    rv = gensio_default_os_hnd(GENSIO_DEF_WAKE_SIG, &o);
+    if (rv) {
+	fprintf(stderr, "Could not allocate OS handler: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    rv = gensio_os_proc_setup(o, &proc_data);
+    if (rv) {
+	fprintf(stderr, "Could not setup process: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    waiter = gensio_os_funcs_alloc_waiter(o);
+    lock = gensio_os_funcs_alloc_lock(o);
+    shards = calloc(nshards, sizeof(*shards));
+    clients = calloc(nclients, sizeof(*clients));
+    if (!waiter || !lock || !shards || !clients) {
+	fprintf(stderr, "Out of memory\n");
+	return 1;
+    }
+
+    /*
+     * The main thread services the first shard, the original os
+     * handler, through its waits.
+     */
+    shards[0].o = o;
+    curr_shard = &shards[0];
+    for (i = 1; i < nshards; i++) {
+	shards[i].num = i;
+	rv = gensio_unix_funcs_alloc_shard(o, &shards[i].o);
+	if (rv) {
+	    fprintf(stderr, "Could not allocate shard: %s\n",
+		    gensio_err_to_str(rv));
+	    return 1;
+	}
+    }
+    if (nshards > 1) {
+	len = 0;
+	rv = o->control(o, GENSIO_CONTROL_GET_SHARDS, NULL, &len);
+	if (rv || len != nshards) {
+	    fprintf(stderr, "GENSIO_CONTROL_GET_SHARDS returned %lu shards,"
+		    " expected %u: %s\n", (unsigned long) len, nshards,
+		    gensio_err_to_str(rv));
+	    return 1;
+	}
+    }
+    for (i = 1; i < nshards; i++) {
+	rv = gensio_os_new_thread(o, shard_thread, &shards[i],
+				  &shards[i].thread);
+	if (rv) {
+	    fprintf(stderr, "Could not start thread: %s\n",
+		    gensio_err_to_str(rv));
+	    return 1;
+	}
+    }
+    for (i = 0; i < nclients; i++)
+	clients[i].sh = &shards[i % nshards];
+
+    /*
+     * Sharding needs a fixed port, so get a free one from a normal
+     * accepter first.
+     */
+    rv = str_to_gensio_accepter("tcp,127.0.0.1,0", o, acc_event, NULL, &acc);
+    if (!rv)
+	rv = gensio_acc_startup(acc);
+    if (!rv) {
+	strcpy(port, "0");
+	len = sizeof(port);
+	rv = gensio_acc_control(acc, GENSIO_CONTROL_DEPTH_FIRST, true,
+				GENSIO_ACC_CONTROL_LPORT, port, &len);
+	gensio_acc_shutdown_s(acc);
+	gensio_acc_free(acc);
+    }
+    if (rv) {
+	fprintf(stderr, "Could not get a free port: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+
+    snprintf(str, sizeof(str), "tcp(shard),127.0.0.1,%s", port);
+    rv = str_to_gensio_accepter(str, o, acc_event, NULL, &acc);
+    if (!rv)
+	rv = gensio_acc_startup(acc);
+    if (rv) {
+	fprintf(stderr, "Could not start accepter %s: %s\n", str,
+		gensio_err_to_str(rv));
+	return 1;
+    }
+
+    if (check_it) {
+	secs = run_clients(0, size, false);
+	bytes = 0;
+	for (i = 0; i < nclients; i++) {
+	    bytes += clients[i].bytes;
+	    if (clients[i].conns != 1 || clients[i].bytes != size) {
+		fprintf(stderr, "Client %u echoed %llu of %llu bytes\n",
+			i, clients[i].bytes, size);
+		errs++;
+	    }
+	}
+	printf("%u shards, %u clients: %.2f MB/sec echoed\n", nshards,
+	       nclients, bytes / secs / 1000000);
+	print_accepts();
+	conns = 0;
+	used = 0;
+	for (i = 0; i < nshards; i++) {
+	    conns += shards[i].accepts;
+	    if (shards[i].accepts)
+		used++;
+	}
+	if (conns != nclients) {
+	    fprintf(stderr, "%llu connections accepted, expected %u\n",
+		    conns, nclients);
+	    errs++;
+	}
+	if (nshards > 1 && nclients > 1 && used < 2) {
+	    fprintf(stderr, "All connections were accepted on one shard\n");
+	    errs++;
+	}
+    } else {
+	secs = run_clients(seconds, msgsize, true);
+	conns = 0;
+	for (i = 0; i < nclients; i++)
+	    conns += clients[i].conns;
+	printf("%u shards, %u clients: %.0f connections/sec\n", nshards,
+	       nclients, conns / secs);
+	print_accepts();
+
+	secs = run_clients(seconds, 0, false);
+	bytes = 0;
+	for (i = 0; i < nclients; i++)
+	    bytes += clients[i].bytes;
+	printf("%u shards, %u clients: %.2f MB/sec echoed\n", nshards,
+	       nclients, bytes / secs / 1000000);
+    }
+
+    gensio_acc_shutdown_s(acc);
+    gensio_acc_free(acc);
+
+    gensio_os_funcs_lock(o, lock);
+    shutting_down = true;
+    gensio_os_funcs_unlock(o, lock);
+    for (i = 1; i < nshards; i++) {
+	gensio_os_wait_thread(shards[i].thread);
+	gensio_os_funcs_free(shards[i].o);
+    }
+
+    gensio_os_funcs_free_lock(o, lock);
+    gensio_os_funcs_free_waiter(o, waiter);
+    gensio_os_proc_cleanup(proc_data);
+    gensio_os_funcs_free(o);
+    free(shards);
+    free(clients);
+
+    return check_it ? bench_errs("shard errors") : 0;
+}
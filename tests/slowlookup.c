@@ -0,0 +1,34 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2024  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * LD_PRELOAD this to make getaddrinfo() take SLOWLOOKUP_MSECS
+ * milliseconds longer, like it does with a slow name server.
+ * resolvecheck uses it.
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+int
+getaddrinfo(const char *node, const char *service,
+	    const struct addrinfo *hints, struct addrinfo **res)
+{
+    static int (*real_getaddrinfo)(const char *node, const char *service,
+				   const struct addrinfo *hints,
+				   struct addrinfo **res);
+    const char *s = getenv("SLOWLOOKUP_MSECS");
+
+    if (!real_getaddrinfo)
+	real_getaddrinfo = dlsym(RTLD_NEXT, "getaddrinfo");
+    if (s)
+	usleep(strtoul(s, NULL, 0) * 1000);
+    return real_getaddrinfo(node, service, hints, res);
+}
@@ -0,0 +1,302 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2024  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * A benchmark for the sound gensio sample format conversions in
+ * lib/gensio_sound_conv.h.  For each of the format pairs that have a
+ * vector conversion, it converts a buffer of -s samples over and
+ * over for -t seconds in each direction, first with the whole buffer
+ * (vector) conversion and then a sample at a time.  It reports
+ * samples per second for both.
+ *
+ * With -c it is run as a test.  It then converts random buffers of
+ * all lengths up to a few vectors at every alignment, with values
+ * that are out of range, right on the rounding points, and NaNs and
+ * infinities, and checks that the whole buffer and sample at a time
+ * conversions give exactly the same bytes.  It also checks some
+ * known values.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "../lib/gensio_sound_conv.h"
+#include "benchutil.h"
+
+static struct {
+    const char *ufmt;
+    const char *pfmt;
+} pairs[] = {
+    { "float", "s16" },
+    { "float", "int16_be" },
+    { "float", "s32" },
+    { "float", "int32_be" },
+    { "float", "float64" },
+    { "float", "float_be" },
+    { "float64", "float" },
+    { NULL }
+};
+
+
+static void
+setup_pair(struct sound_cnv_info *info, unsigned int n)
+{
+    memset(info, 0, sizeof(*info));
+    info->ufmt = sound_fmt_lookup(pairs[n].ufmt);
+    sound_cnv_setup(info, sound_fmt_lookup(pairs[n].pfmt));
+}
+
+/*
+ * Random values around the -1.0 - 1.0 range, with some that are
+ * right on the edges and some that are not numbers.
+ */
+static double
+rand_sample(void)
+{
+    switch (rand() % 16) {
+    case 0: return 1.0;
+    case 1: return -1.0;
+    case 2: return 0;
+    case 3: return (rand() % 65536 - 32768 + .5) / 32768;
+    case 4: return (rand() % 200 - 100 + .5) / 2147483648.;
+    case 5: return NAN;
+    case 6: return rand() % 2 ? INFINITY : -INFINITY;
+    case 7: return (rand() % 2 ? 1 : -1) * (1 + rand() % 100 / 32768.);
+    default: return (rand() / (double) RAND_MAX) * 2.4 - 1.2;
+    }
+}
+
+/* Fill buf with n samples of the given format. */
+static void
+fill_samples(unsigned char *buf, enum gensio_sound_fmt_type fmt,
+	     gensiods n)
+{
+    struct sound_fmt_info *f = &sound_fmt_info[fmt];
+    unsigned char *p = buf;
+    gensiods i;
+
+    for (i = 0; i < n; i++) {
+	if (f->isfloat) {
+	    put_float(rand_sample(), &p, f->size, f->host_bswap);
+	} else {
+	    uint32_t v = rand();
+
+	    v ^= (uint32_t) rand() << 16;
+
+	    put_int(v, &p, f->size, 0, f->host_bswap);
+	}
+    }
+}
+
+static void
+check_one(struct sound_cnv_info *info, bool in, gensiods n,
+	  unsigned int ialign, unsigned int oalign)
+{
+    unsigned char ibuf[512 + 8], obuf[2][512 + 8];
+    unsigned int isize, osize;
+
+    if (in) {
+	isize = info->psize;
+	osize = info->usize;
+	fill_samples(ibuf + ialign, info->pfmt, n);
+    } else {
+	isize = info->usize;
+	osize = info->psize;
+	fill_samples(ibuf + ialign, info->ufmt, n);
+    }
+    if (n * isize > 512 || n * osize > 512)
+	abort();
+    memset(obuf, 0x55, sizeof(obuf));
+    if (in) {
+	info->convin_buf(ibuf + ialign, obuf[0] + oalign, n, info);
+	conv_buf_in(ibuf + ialign, obuf[1] + oalign, n, info);
+    } else {
+	info->convout_buf(ibuf + ialign, obuf[0] + oalign, n, info);
+	conv_buf_out(ibuf + ialign, obuf[1] + oalign, n, info);
+    }
+    if (memcmp(obuf[0], obuf[1], sizeof(obuf[0])) != 0) {
+	if (errs < 10)
+	    fprintf(stderr, "%s mismatch, user %u bytes, pcm %u bytes,"
+		    " %lu samples, align %u/%u\n", in ? "In" : "Out",
+		    info->usize, info->psize, (unsigned long) n, ialign,
+		    oalign);
+	errs++;
+    }
+}
+
+static void
+check_val(const char *ufmt, const char *pfmt, bool in, const void *ival,
+	  const void *expected)
+{
+    struct sound_cnv_info info;
+    unsigned char out[8];
+    unsigned int osize;
+
+    memset(&info, 0, sizeof(info));
+    info.ufmt = sound_fmt_lookup(ufmt);
+    sound_cnv_setup(&info, sound_fmt_lookup(pfmt));
+    osize = in ? info.usize : info.psize;
+    if (in)
+	info.convin_buf(ival, out, 1, &info);
+    else
+	info.convout_buf(ival, out, 1, &info);
+    if (memcmp(out, expected, osize) != 0) {
+	fprintf(stderr, "%s to %s (%s) gave the wrong value\n", ufmt, pfmt,
+		in ? "in" : "out");
+	errs++;
+    }
+}
+
+static void
+check_values(void)
+{
+    float f;
+    double d;
+    int32_t i32;
+    int16_t i16;
+    uint16_t u16;
+    uint8_t u8;
+
+    if (sound_fmt_lookup("int24_be") != GENSIO_SOUND_FMT_S24_BE ||
+		sound_fmt_lookup("U16_LE") != GENSIO_SOUND_FMT_U16_LE ||
+		sound_fmt_lookup("bogus") != GENSIO_SOUND_FMT_UNKNOWN) {
+	fprintf(stderr, "Format name lookup failed\n");
+	errs++;
+    }
+
+    /* Full scale clips instead of wrapping around. */
+    f = 1.0; i16 = 32767;
+    check_val("float", "s16", false, &f, &i16);
+    f = -1.0; i16 = -32768;
+    check_val("float", "s16", false, &f, &i16);
+    f = 1.0; i32 = 2147483647;
+    check_val("float", "s32", false, &f, &i32);
+    /* Rounds to nearest, not toward zero. */
+    f = -1.4 / 32768; i16 = -1;
+    check_val("float", "s16", false, &f, &i16);
+    f = -1.6 / 32768; i16 = -2;
+    check_val("float", "s16", false, &f, &i16);
+    i16 = -32768; f = -1.0;
+    check_val("float", "s16", true, &i16, &f);
+    /* Unsigned is offset, not sign extended. */
+    u16 = 0xffff; f = 32767. / 32768.;
+    check_val("float", "u16", true, &u16, &f);
+    u8 = 0; i16 = -32768;
+    check_val("s16", "u8", true, &u8, &i16);
+    u8 = 0xc0; i16 = 64 << 8;
+    check_val("s16", "u8", true, &u8, &i16);
+    /* An integer user format with a float PCM format. */
+    f = .5; i16 = 16384;
+    check_val("s16", "float", true, &f, &i16);
+    i16 = -16384; f = -.5;
+    check_val("s16", "float", false, &i16, &f);
+    d = .25; i32 = 1 << 29;
+    check_val("s32", "float64", true, &d, &i32);
+}
+
+static void
+check(void)
+{
+    struct sound_cnv_info info;
+    unsigned int n, loop, ialign, oalign;
+    gensiods len;
+
+    check_values();
+    for (loop = 0; loop < 20; loop++) {
+	for (n = 0; pairs[n].ufmt; n++) {
+	    setup_pair(&info, n);
+	    for (ialign = 0; ialign < 8; ialign += 3) {
+		for (oalign = 0; oalign < 8; oalign += 2) {
+		    for (len = 0; len <= SOUND_CNV_VLANES * 4 + 1; len++) {
+			check_one(&info, true, len, ialign, oalign);
+			check_one(&info, false, len, ialign, oalign);
+		    }
+		}
+	    }
+	}
+    }
+}
+
+typedef void (*convfn)(const unsigned char *in, unsigned char *out,
+		       gensiods nsamples, struct sound_cnv_info *info);
+
+static double
+bench(convfn fn, struct sound_cnv_info *info, const unsigned char *in,
+      unsigned char *out, gensiods size, unsigned int seconds)
+{
+    unsigned long long samples = 0;
+    unsigned int i;
+    clock_t start, now;
+    double secs;
+
+    start = clock();
+    do {
+	for (i = 0; i < 100; i++)
+	    fn(in, out, size, info);
+	samples += 100ULL * size;
+	now = clock();
+	secs = (double) (now - start) / CLOCKS_PER_SEC;
+    } while (secs < seconds);
+
+    return samples / secs;
+}
+
+static const char *usage = "[-c] [-s <samples>] [-t <seconds>]";
+
+int
+main(int argc, char *argv[])
+{
+    struct sound_cnv_info info;
+    unsigned int n;
+    gensiods size = 4096;
+    unsigned char *ibuf, *obuf;
+    double vin, sin, vout, sout;
+    int rv;
+
+    while ((rv = bench_getopt(argc, argv, "cs:t:", usage)) != -1) {
+	switch (rv) {
+	case 's':
+	    size = strtoul(optarg, NULL, 0);
+	    break;
+	}
+    }
+    if (size < 1)
+	bench_help(argv[0], usage);
+
+    ibuf = malloc(size * 8);
+    obuf = malloc(size * 8);
+    if (!ibuf || !obuf) {
+	fprintf(stderr, "Out of memory\n");
+	return 1;
+    }
+
+    if (check_it)
+	check();
+
+    for (n = 0; pairs[n].ufmt; n++) {
+	setup_pair(&info, n);
+	fill_samples(ibuf, info.pfmt, size);
+	vin = bench(info.convin_buf, &info, ibuf, obuf, size, seconds);
+	sin = bench(conv_buf_in, &info, ibuf, obuf, size, seconds);
+	fill_samples(ibuf, info.ufmt, size);
+	vout = bench(info.convout_buf, &info, ibuf, obuf, size, seconds);
+	sout = bench(conv_buf_out, &info, ibuf, obuf, size, seconds);
+	printf("%s/%s: in %.0f/%.0f Msamples/sec %.2fx,"
+	       " out %.0f/%.0f Msamples/sec %.2fx\n",
+	       pairs[n].ufmt, pairs[n].pfmt,
+	       vin / 1000000, sin / 1000000, vin / sin,
+	       vout / 1000000, sout / 1000000, vout / sout);
+    }
+
+    free(ibuf);
+    free(obuf);
+    return bench_errs("conversion mismatches");
+}
@@ -0,0 +1,377 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * A benchmark for the splice mode of the ioinfo relay used by
+ * gensiot.  A source thread sends -s megabytes over a TCP socket, the
+ * relay takes that from a tcp gensio and sends it out another tcp
+ * gensio to a sink thread that checks the data.  This is done first
+ * with the relay copying the data through the gensios, then with
+ * splice enabled, and the MB/sec is reported for each.
+ *
+ * With -c it is run as a test.  It then also relays through a trace
+ * gensio on top of tcp, which can't be spliced and must fall back to
+ * copying, and checks that the data arrives correctly in all cases
+ * and that splice was used only when it should have been.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gensio/gensio.h>
+#include <gensio/gensio_os_funcs.h>
+
+#ifdef HAVE_SPLICE
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "ioinfo.h"
+#include "benchutil.h"
+
+/* A prime, so the pattern doesn't line up with any buffer size. */
+#define PATTERN_SIZE 65521
+static unsigned char pattern[PATTERN_SIZE * 2];
+
+static const char *usage = "[-c] [-s <megabytes>]";
+
+/*
+ * One end of the test, a thread with a plain socket that either
+ * sends the pattern or receives and checks it.
+ */
+struct endpoint {
+    int lfd;
+    unsigned int port;
+    bool is_source;
+    unsigned long long total;
+    unsigned long long count;
+    bool bad;
+    gensio_time end;
+    struct gensio_thread *thread;
+};
+
+static void
+endpoint_thread(void *data)
+{
+    struct endpoint *ep = data;
+    unsigned long long pos = 0;
+    unsigned char buf[PATTERN_SIZE];
+    ssize_t rv;
+    size_t len;
+    int fd;
+
+    fd = accept(ep->lfd, NULL, NULL);
+    if (fd < 0) {
+	perror("accept");
+	ep->bad = true;
+	return;
+    }
+
+    while (ep->is_source && pos < ep->total) {
+	len = ep->total - pos;
+	if (len > PATTERN_SIZE)
+	    len = PATTERN_SIZE;
+	rv = write(fd, pattern + pos % PATTERN_SIZE, len);
+	if (rv <= 0) {
+	    perror("source write");
+	    ep->bad = true;
+	    break;
+	}
+	pos += rv;
+    }
+
+    while (!ep->is_source) {
+	rv = read(fd, buf, sizeof(buf));
+	if (rv < 0) {
+	    perror("sink read");
+	    ep->bad = true;
+	}
+	if (rv <= 0)
+	    break;
+	if (!ep->bad && memcmp(buf, pattern + pos % PATTERN_SIZE, rv) != 0) {
+	    fprintf(stderr, "Data mismatch at about %llu\n", pos);
+	    ep->bad = true;
+	}
+	pos += rv;
+    }
+
+    ep->count = pos;
+    gensio_os_funcs_get_monotonic_time(o, &ep->end);
+    close(fd);
+}
+
+static int
+endpoint_start(struct endpoint *ep, bool is_source, unsigned long long total)
+{
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    int rv;
+
+    memset(ep, 0, sizeof(*ep));
+    ep->is_source = is_source;
+    ep->total = total;
+    ep->lfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (ep->lfd < 0) {
+	perror("socket");
+	return GE_OSERR;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(ep->lfd, (struct sockaddr *) &addr, sizeof(addr)) ||
+		listen(ep->lfd, 1) ||
+		getsockname(ep->lfd, (struct sockaddr *) &addr, &addrlen)) {
+	perror("listen socket");
+	close(ep->lfd);
+	return GE_OSERR;
+    }
+    ep->port = ntohs(addr.sin_port);
+
+    rv = gensio_os_new_thread(o, endpoint_thread, ep, &ep->thread);
+    if (rv) {
+	fprintf(stderr, "Could not start thread: %s\n", gensio_err_to_str(rv));
+	close(ep->lfd);
+    }
+    return rv;
+}
+
+static void
+endpoint_finish(struct endpoint *ep)
+{
+    gensio_os_wait_thread(ep->thread);
+    close(ep->lfd);
+}
+
+/* The relay, two gensios tied together with ioinfos. */
+struct relay {
+    struct gensio *io[2];
+    struct ioinfo *ioinfo[2];
+    struct gensio_waiter *waiter;
+    struct gensio_lock *lock;
+    bool shutdown;
+};
+
+static void
+relay_closed(struct gensio *io, void *close_data)
+{
+    struct relay *r = close_data;
+
+    gensio_os_funcs_wake(o, r->waiter);
+}
+
+static void
+relay_shutdown(struct ioinfo *ioinfo, enum ioinfo_shutdown_reason reason)
+{
+    struct relay *r = ioinfo_userdata(ioinfo);
+    unsigned int i;
+    bool shutdown;
+
+    gensio_os_funcs_lock(o, r->lock);
+    shutdown = r->shutdown;
+    r->shutdown = true;
+    gensio_os_funcs_unlock(o, r->lock);
+    if (shutdown)
+	return;
+
+    if (reason == IOINFO_SHUTDOWN_ERR)
+	errs++;
+    for (i = 0; i < 2; i++)
+	ioinfo_set_not_ready(r->ioinfo[i]);
+    for (i = 0; i < 2; i++) {
+	if (gensio_close(r->io[i], relay_closed, r))
+	    gensio_os_funcs_wake(o, r->waiter);
+    }
+}
+
+static void
+relay_err(struct ioinfo *ioinfo, char *fmt, va_list va)
+{
+    fprintf(stderr, "Relay error: ");
+    vfprintf(stderr, fmt, va);
+    fprintf(stderr, "\n");
+}
+
+static struct ioinfo_user_handlers relay_uh = {
+    .shutdown = relay_shutdown,
+    .err = relay_err
+};
+
+/*
+ * Relay total bytes through the given gensio stack, which should end
+ * in tcp, and return the MB/sec.  The number of bytes that were
+ * spliced is returned in spliced.
+ */
+static double
+run_relay(const char *stack, bool splice, unsigned long long total,
+	  unsigned long long *spliced)
+{
+    struct endpoint src, sink;
+    struct relay r;
+    gensio_time start;
+    char str[200];
+    double rate = 0;
+    unsigned int i;
+    int rv;
+
+    *spliced = 0;
+    memset(&r, 0, sizeof(r));
+    r.waiter = gensio_os_funcs_alloc_waiter(o);
+    r.lock = gensio_os_funcs_alloc_lock(o);
+    if (!r.waiter || !r.lock) {
+	fprintf(stderr, "Out of memory\n");
+	exit(1);
+    }
+
+    if (endpoint_start(&src, true, total))
+	exit(1);
+    if (endpoint_start(&sink, false, 0))
+	exit(1);
+
+    for (i = 0; i < 2; i++) {
+	snprintf(str, sizeof(str), "%s127.0.0.1,%u", stack,
+		 i == 0 ? src.port : sink.port);
+	rv = str_to_gensio(str, o, NULL, NULL, &r.io[i]);
+	if (!rv) {
+	    rv = gensio_open_s(r.io[i]);
+	    if (rv)
+		gensio_free(r.io[i]);
+	}
+	if (rv) {
+	    fprintf(stderr, "Could not open %s: %s\n", str,
+		    gensio_err_to_str(rv));
+	    exit(1);
+	}
+	r.ioinfo[i] = alloc_ioinfo(o, -1, NULL, NULL, &relay_uh, &r);
+	if (!r.ioinfo[i]) {
+	    fprintf(stderr, "Out of memory\n");
+	    exit(1);
+	}
+	if (splice) {
+	    rv = ioinfo_set_splice(r.ioinfo[i], true);
+	    if (rv) {
+		fprintf(stderr, "Could not enable splice: %s\n",
+			gensio_err_to_str(rv));
+		exit(1);
+	    }
+	}
+    }
+    ioinfo_set_otherioinfo(r.ioinfo[0], r.ioinfo[1]);
+
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    for (i = 0; i < 2; i++)
+	ioinfo_set_ready(r.ioinfo[i], r.io[i]);
+
+    /* Wait for both gensios to close. */
+    gensio_os_funcs_wait(o, r.waiter, 2, NULL);
+
+    endpoint_finish(&src);
+    endpoint_finish(&sink);
+
+    if (src.bad || sink.bad) {
+	errs++;
+    } else if (sink.count != total) {
+	fprintf(stderr, "Sent %llu bytes, but %llu were received\n",
+		total, sink.count);
+	errs++;
+    } else {
+	rate = total / tv_diff(&sink.end, &start) / 1000000;
+    }
+    *spliced = ioinfo_splice_count(r.ioinfo[0]) +
+	ioinfo_splice_count(r.ioinfo[1]);
+
+    for (i = 0; i < 2; i++) {
+	gensio_free(r.io[i]);
+	free_ioinfo(r.ioinfo[i]);
+    }
+    gensio_os_funcs_free_waiter(o, r.waiter);
+    gensio_os_funcs_free_lock(o, r.lock);
+    return rate;
+}
+
+/*
+ * Run the relay and print the result.  With -c, make sure that
+ * splice was used only if want_splice is set.
+ */
+static void
+bench(const char *desc, const char *stack, bool splice,
+      unsigned long long total, bool want_splice)
+{
+    unsigned long long spliced;
+    double rate;
+
+    rate = run_relay(stack, splice, total, &spliced);
+    printf("%-8s %10.2f MB/sec, %llu bytes spliced\n", desc, rate, spliced);
+    if (!check_it)
+	return;
+    if (want_splice && spliced == 0) {
+	fprintf(stderr, "%s: splice was not used\n", desc);
+	errs++;
+    } else if (!want_splice && spliced != 0) {
+	fprintf(stderr, "%s: splice was used but shouldn't have been\n",
+		desc);
+	errs++;
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct gensio_os_proc_data *proc_data;
+    unsigned long long total = 100;
+    unsigned int i;
+    int rv;
+
+    while ((rv = bench_getopt(argc, argv, "cs:", usage)) != -1) {
+	switch (rv) {
+	case 's':
+	    total = strtoull(optarg, NULL, 0);
+	    break;
+	}
+    }
+    if (total < 1)
+	bench_help(argv[0], usage);
+    total *= 1000000;
+
+    for (i = 0; i < sizeof(pattern); i++)
+	pattern[i] = ((i % PATTERN_SIZE) * 7) ^ ((i % PATTERN_SIZE) >> 8);
+
+    /* The splice thread must be able to wake the main loop. */
+    rv = gensio_default_os_hnd(GENSIO_DEF_WAKE_SIG, &o);
+    if (rv) {
+	fprintf(stderr, "Could not allocate OS handler: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    rv = gensio_os_proc_setup(o, &proc_data);
+    if (rv) {
+	fprintf(stderr, "Could not setup process: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+
+    bench("copy", "tcp,", false, total, false);
+    bench("splice", "tcp,", true, total, true);
+    if (check_it)
+	/* A filter on top means the fd can't be used directly. */
+	bench("filtered", "trace,tcp,", true, total, false);
+
+    gensio_os_proc_cleanup(proc_data);
+    gensio_os_funcs_free(o);
+    return check_it ? bench_errs("splice errors") : 0;
+}
+
+#else
+
+int
+main(int argc, char *argv[])
+{
+    printf("splice() is not available\n");
+    return 77;
+}
+
+#endif
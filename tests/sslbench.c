@@ -0,0 +1,474 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2024  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * A bulk transfer benchmark for ssl over TCP.  It starts an
+ * ssl,tcp accepter, connects to it, and sends a counting sequence
+ * as fast as it can for -t seconds in -w byte writes, first with
+ * each SSL record sent to TCP on its own (coalesce=1) and then with
+ * the default record coalescing.  It reports the bytes per second
+ * received for each.
+ *
+ * Then it opens and closes connections one after the other for -t
+ * seconds, like a lot of short lived clients would, first with
+ * session resumption off and then on.  Each connection sends a byte
+ * and waits for the server to echo it before closing, so it also gets
+ * the session tickets that come after the handshake.  It reports the
+ * connections per second, the time to open a connection, and the CPU
+ * time (client and server) per connection.
+ *
+ * The keys come from the directory given with -k, "ca" by default,
+ * which is where make_keys puts them.
+ *
+ * With -c it is run as a test.  It then checks that the data
+ * received is correct and that some data got through each time, and
+ * that with resumption on most connections resume a session and with
+ * it off none do.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <gensio/gensio.h>
+#include <gensio/gensio_os_funcs.h>
+#include "benchutil.h"
+
+
+static struct gensio_waiter *waiter;
+static unsigned char wseq, rseq;
+static unsigned long long rbytes, bad;
+static unsigned int wsize = 65536;
+static struct gensio *srv_io;
+static bool echo_mode;
+static unsigned int echo_open;
+
+static int
+srv_event(struct gensio *io, void *user_data, int event, int err,
+	  unsigned char *buf, gensiods *buflen, const char *const *auxdata)
+{
+    gensiods i;
+
+    switch (event) {
+    case GENSIO_EVENT_READ:
+	if (err) {
+	    gensio_set_read_callback_enable(io, false);
+	    return 0;
+	}
+	for (i = 0; i < *buflen; i++) {
+	    if (buf[i] != rseq++) {
+		bad++;
+		rseq = buf[i] + 1;
+	    }
+	}
+	rbytes += *buflen;
+	return 0;
+
+    default:
+	return GE_NOTSUP;
+    }
+}
+
+static void
+echo_closed(struct gensio *io, void *close_data)
+{
+    gensio_free(io);
+    echo_open--;
+    gensio_os_funcs_wake(o, waiter);
+}
+
+static int
+echo_event(struct gensio *io, void *user_data, int event, int err,
+	   unsigned char *buf, gensiods *buflen, const char *const *auxdata)
+{
+    switch (event) {
+    case GENSIO_EVENT_READ:
+	if (err) {
+	    gensio_set_read_callback_enable(io, false);
+	    if (gensio_close(io, echo_closed, NULL))
+		echo_closed(io, NULL);
+	    return 0;
+	}
+	gensio_write(io, NULL, buf, *buflen, NULL);
+	return 0;
+
+    default:
+	return GE_NOTSUP;
+    }
+}
+
+static int
+acc_event(struct gensio_accepter *acc, void *user_data, int event,
+	  void *data)
+{
+    struct gensio *io = data;
+
+    if (event != GENSIO_ACC_EVENT_NEW_CONNECTION)
+	return GE_NOTSUP;
+
+    if (echo_mode) {
+	echo_open++;
+	gensio_set_callback(io, echo_event, NULL);
+	gensio_set_read_callback_enable(io, true);
+	return 0;
+    }
+
+    srv_io = io;
+    gensio_set_callback(io, srv_event, NULL);
+    gensio_set_read_callback_enable(io, true);
+    gensio_os_funcs_wake(o, waiter);
+    return 0;
+}
+
+static int
+cl_event(struct gensio *io, void *user_data, int event, int err,
+	 unsigned char *buf, gensiods *buflen, const char *const *auxdata)
+{
+    static unsigned char data[65536];
+    gensiods i, count;
+
+    switch (event) {
+    case GENSIO_EVENT_READ:
+	return 0;
+
+    case GENSIO_EVENT_WRITE_READY:
+	do {
+	    for (i = 0; i < wsize; i++)
+		data[i] = wseq + i;
+	    if (gensio_write(io, &count, data, wsize, NULL)) {
+		gensio_set_write_callback_enable(io, false);
+		return 0;
+	    }
+	    wseq += count;
+	} while (count == wsize);
+	return 0;
+
+    default:
+	return GE_NOTSUP;
+    }
+}
+
+/*
+ * Run one transfer with the given coalesce value and return the
+ * bytes per second received in rate.  Returns true on failure.
+ */
+static bool
+transfer(const char *keydir, unsigned int coalesce, unsigned int seconds,
+	 struct gensio_timer *timer, double *rate)
+{
+    struct gensio_accepter *acc;
+    struct gensio *io;
+    gensio_time start, now, timeout;
+    char str[400], port[20];
+    gensiods len;
+    int rv;
+
+    srv_io = NULL;
+    rbytes = 0;
+    bad = 0;
+    wseq = 0;
+    rseq = 0;
+
+    snprintf(str, sizeof(str),
+	     "ssl(key=%s/key.pem,cert=%s/cert.pem,coalesce=%u),"
+	     "tcp(nodelay),127.0.0.1,0", keydir, keydir, coalesce);
+    rv = str_to_gensio_accepter(str, o, acc_event, NULL, &acc);
+    if (!rv)
+	rv = gensio_acc_startup(acc);
+    if (rv) {
+	fprintf(stderr, "Could not start accepter %s: %s\n", str,
+		gensio_err_to_str(rv));
+	return true;
+    }
+    strcpy(port, "0");
+    len = sizeof(port);
+    rv = gensio_acc_control(acc, GENSIO_CONTROL_DEPTH_FIRST, true,
+			    GENSIO_ACC_CONTROL_LPORT, port, &len);
+    if (rv) {
+	fprintf(stderr, "Could not get accepter port: %s\n",
+		gensio_err_to_str(rv));
+	return true;
+    }
+
+    snprintf(str, sizeof(str),
+	     "ssl(CA=%s/CA.pem,coalesce=%u),tcp(nodelay),127.0.0.1,%s",
+	     keydir, coalesce, port);
+    rv = str_to_gensio(str, o, cl_event, NULL, &io);
+    if (!rv)
+	rv = gensio_open_s(io);
+    if (rv) {
+	fprintf(stderr, "Could not open %s: %s\n", str,
+		gensio_err_to_str(rv));
+	return true;
+    }
+    timeout.secs = 5;
+    timeout.nsecs = 0;
+    if (!srv_io)
+	gensio_os_funcs_wait(o, waiter, 1, &timeout);
+    if (!srv_io) {
+	fprintf(stderr, "Server never got the connection\n");
+	return true;
+    }
+
+    gensio_set_write_callback_enable(io, true);
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    do {
+	timeout.secs = 0;
+	timeout.nsecs = 100000000;
+	gensio_os_funcs_start_timer(o, timer, &timeout);
+	gensio_os_funcs_wait(o, waiter, 1, NULL);
+	gensio_os_funcs_get_monotonic_time(o, &now);
+    } while (tv_diff(&now, &start) < seconds);
+    gensio_set_write_callback_enable(io, false);
+
+    *rate = rbytes / tv_diff(&now, &start);
+    printf("ssl over TCP, coalesce=%u: %llu bytes in %.3f seconds,"
+	   " %.2f MB/sec\n", coalesce, rbytes, tv_diff(&now, &start),
+	   *rate / 1000000.0);
+    if (bad) {
+	fprintf(stderr, "%llu bad bytes received\n", bad);
+	errs++;
+    }
+    if (rbytes == 0) {
+	fprintf(stderr, "No data received\n");
+	errs++;
+    }
+
+    gensio_close_s(io);
+    gensio_free(io);
+    gensio_close_s(srv_io);
+    gensio_free(srv_io);
+    gensio_acc_shutdown_s(acc);
+    gensio_acc_free(acc);
+    return false;
+}
+
+/*
+ * Open a connection, send a byte, wait for it to come back, and
+ * close.  The time the open took is added to open_time.  Returns true
+ * on failure.
+ */
+static bool
+connect_once(const char *str, double *open_time, bool *reused)
+{
+    struct gensio *io;
+    gensio_time start, now, timeout;
+    unsigned char c = 'x';
+    char val[20];
+    gensiods len = 0;
+    int rv;
+
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    rv = str_to_gensio(str, o, NULL, NULL, &io);
+    if (!rv)
+	rv = gensio_open_s(io);
+    if (rv) {
+	fprintf(stderr, "Could not open %s: %s\n", str,
+		gensio_err_to_str(rv));
+	return true;
+    }
+    gensio_os_funcs_get_monotonic_time(o, &now);
+    *open_time += tv_diff(&now, &start);
+
+    timeout.secs = 5;
+    timeout.nsecs = 0;
+    rv = gensio_set_sync(io);
+    if (!rv)
+	rv = gensio_write_s(io, NULL, &c, 1, &timeout);
+    while (!rv && len == 0)
+	rv = gensio_read_s(io, &len, &c, 1, &timeout);
+    if (rv) {
+	fprintf(stderr, "Echo failed: %s\n", gensio_err_to_str(rv));
+	gensio_free(io);
+	return true;
+    }
+
+    len = sizeof(val);
+    rv = gensio_control(io, GENSIO_CONTROL_DEPTH_FIRST, GENSIO_CONTROL_GET,
+			GENSIO_CONTROL_SESSION_REUSED, val, &len);
+    *reused = !rv && strcmp(val, "1") == 0;
+
+    gensio_close_s(io);
+    gensio_free(io);
+    return false;
+}
+
+/*
+ * Open and close connections for the given time with resume on or
+ * off.  Returns true on failure.
+ */
+static bool
+connections(const char *keydir, bool resume, unsigned int seconds)
+{
+    struct gensio_accepter *acc;
+    gensio_time start, now, timeout;
+    char str[400], port[20], stats[40];
+    unsigned long count = 0, reused_count = 0, hits = 0, misses = 0;
+    double open_time = 0, secs;
+    clock_t cpu_start;
+    gensiods len;
+    bool reused;
+    int rv;
+
+    echo_mode = true;
+    snprintf(str, sizeof(str),
+	     "ssl(key=%s/key.pem,cert=%s/cert.pem,resume=%s),"
+	     "tcp,127.0.0.1,0", keydir, keydir, resume ? "true" : "false");
+    rv = str_to_gensio_accepter(str, o, acc_event, NULL, &acc);
+    if (!rv)
+	rv = gensio_acc_startup(acc);
+    if (rv) {
+	fprintf(stderr, "Could not start accepter %s: %s\n", str,
+		gensio_err_to_str(rv));
+	return true;
+    }
+    strcpy(port, "0");
+    len = sizeof(port);
+    rv = gensio_acc_control(acc, GENSIO_CONTROL_DEPTH_FIRST, true,
+			    GENSIO_ACC_CONTROL_LPORT, port, &len);
+    if (rv) {
+	fprintf(stderr, "Could not get accepter port: %s\n",
+		gensio_err_to_str(rv));
+	return true;
+    }
+
+    snprintf(str, sizeof(str), "ssl(CA=%s/CA.pem,resume=%s),tcp,127.0.0.1,%s",
+	     keydir, resume ? "true" : "false", port);
+    cpu_start = clock();
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    do {
+	if (connect_once(str, &open_time, &reused))
+	    return true;
+	count++;
+	if (reused)
+	    reused_count++;
+	gensio_os_funcs_get_monotonic_time(o, &now);
+	secs = tv_diff(&now, &start);
+    } while (secs < seconds);
+
+    /* Let the server side finish closing. */
+    timeout.secs = 5;
+    timeout.nsecs = 0;
+    while (echo_open > 0) {
+	if (gensio_os_funcs_wait(o, waiter, 1, &timeout))
+	    break;
+    }
+
+    len = sizeof(stats);
+    rv = gensio_acc_control(acc, GENSIO_CONTROL_DEPTH_FIRST, true,
+			    GENSIO_ACC_CONTROL_SESSION_STATS, stats, &len);
+    if (rv == GE_NOTSUP)
+	strcpy(stats, "not counted");
+    else if (rv || sscanf(stats, "%lu %lu", &hits, &misses) != 2)
+	strcpy(stats, "unavailable");
+    else
+	snprintf(stats, sizeof(stats), "resumed %lu full %lu", hits, misses);
+
+    printf("ssl over TCP connections, resume=%s: %lu in %.3f seconds,"
+	   " %.0f/sec, open %.0f usec, %.0f usec CPU each, server %s\n",
+	   resume ? "true" : "false", count, secs, count / secs,
+	   open_time / count * 1000000.0,
+	   (double) (clock() - cpu_start) / CLOCKS_PER_SEC / count * 1000000.0,
+	   stats);
+
+    if (resume && rv) {
+	fprintf(stderr, "Could not get session stats: %s\n",
+		gensio_err_to_str(rv));
+	errs++;
+    }
+    if (!resume && rv != GE_NOTSUP) {
+	fprintf(stderr, "Session stats supported with resume off\n");
+	errs++;
+    }
+
+    if (resume && (reused_count < count / 2 || hits != reused_count)) {
+	fprintf(stderr, "Only %lu of %lu connections resumed, server says"
+		" %lu\n", reused_count, count, hits);
+	errs++;
+    }
+    if (!resume && (reused_count || hits)) {
+	fprintf(stderr, "Connections resumed with resume off\n");
+	errs++;
+    }
+
+    gensio_acc_shutdown_s(acc);
+    gensio_acc_free(acc);
+    echo_mode = false;
+    return false;
+}
+
+static const char *usage =
+    "[-c] [-k <keydir>] [-w <writesize>] [-t <seconds>]";
+
+int
+main(int argc, char *argv[])
+{
+    struct gensio_os_proc_data *proc_data;
+    struct gensio_timer *timer;
+    const char *keydir = "ca";
+    double single, coalesced;
+    int rv;
+
+    while ((rv = bench_getopt(argc, argv, "ck:w:t:", usage)) != -1) {
+	switch (rv) {
+	case 'k':
+	    keydir = optarg;
+	    break;
+	case 'w':
+	    wsize = strtoul(optarg, NULL, 0);
+	    break;
+	}
+    }
+    if (wsize < 1 || wsize > 65536)
+	bench_help(argv[0], usage);
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv) {
+	fprintf(stderr, "Could not allocate OS handler: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    rv = gensio_os_proc_setup(o, &proc_data);
+    if (rv) {
+	fprintf(stderr, "Could not setup process: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    waiter = gensio_os_funcs_alloc_waiter(o);
+    if (!waiter) {
+	fprintf(stderr, "Could not allocate waiter\n");
+	return 1;
+    }
+    /*
+     * Under load the wait never times out because there is always
+     * something to do, so use a timer to wake it up.
+     */
+    timer = gensio_os_funcs_alloc_timer(o, tick, waiter);
+    if (!timer) {
+	fprintf(stderr, "Could not allocate timer\n");
+	return 1;
+    }
+
+    if (transfer(keydir, 1, seconds, timer, &single))
+	return 1;
+    if (transfer(keydir, 4, seconds, timer, &coalesced))
+	return 1;
+    printf("%u byte writes: coalescing %.2fx\n", wsize, coalesced / single);
+
+    if (connections(keydir, false, seconds))
+	return 1;
+    if (connections(keydir, true, seconds))
+	return 1;
+
+    gensio_os_funcs_free_timer(o, timer);
+    gensio_os_funcs_free_waiter(o, waiter);
+    gensio_os_proc_cleanup(proc_data);
+    gensio_os_funcs_free(o);
+    return check_it ? bench_errs("ssl transfer errors") : 0;
+}
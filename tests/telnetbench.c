@@ -0,0 +1,646 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2024  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * A benchmark for the telnet data processing in lib/telnet.c.  It
+ * has copies of the old byte at a time process_telnet_data() and
+ * process_telnet_xmit() and reports the bytes per second of each and
+ * of the current versions on a buffer of -s bytes for -t seconds.
+ * The data is a counting sequence, so one byte in 256 is an IAC.
+ * Then it starts a telnet(rfc2217) over TCP accepter, connects to
+ * it, and sends the sequence as fast as it can for -t seconds and
+ * reports the bytes per second received.
+ *
+ * With -c it is run as a test.  It then runs random telnet streams,
+ * with data, doubled IACs, commands, suboptions (including ones that
+ * are too long), and garbage, through the old and current code in
+ * random sized pieces with random output space, and checks that they
+ * give the same data, use the same input, and make the same command
+ * callbacks.  It does the same for transmit.  It also checks that the
+ * data received over TCP is correct.
+ *
+ * telnet.c is included so the old code can use its command handling.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gensio/gensio.h>
+#include <gensio/gensio_os_funcs.h>
+#include "../lib/telnet.c"
+#include "benchutil.h"
+
+
+/* The old byte at a time versions. */
+static unsigned int
+ref_process_telnet_data(unsigned char *outdata, unsigned int outlen,
+			unsigned char **r_indata, unsigned int *inlen,
+			telnet_data_t *td)
+{
+    unsigned int i, j;
+    unsigned char *indata = *r_indata;
+    int done = 0;
+
+    for (i = 0, j = 0; !done && i < *inlen && j < outlen; i++) {
+	if (td->telnet_cmd_pos != 0) {
+	    unsigned char tn_byte;
+
+	    tn_byte = indata[i];
+
+	    if ((td->telnet_cmd_pos == 1) && (tn_byte == TN_IAC)) {
+		outdata[j++] = tn_byte;
+		td->telnet_cmd_pos = 0;
+		continue;
+	    }
+
+	    if (td->telnet_cmd_pos == 1) {
+		td->telnet_cmd[td->telnet_cmd_pos++] = tn_byte;
+		if (tn_byte < TN_SB) {
+		    handle_telnet_cmd(td, td->telnet_cmd_pos);
+		    td->telnet_cmd_pos = 0;
+		    done = 1;
+		}
+	    } else if (td->telnet_cmd_pos == 2) {
+		td->telnet_cmd[td->telnet_cmd_pos++] = tn_byte;
+		if (td->telnet_cmd[1] == TN_SE) {
+		    td->telnet_cmd_pos = 0;
+		    continue;
+		}
+		if (td->telnet_cmd[1] != TN_SB) {
+		    handle_telnet_cmd(td, td->telnet_cmd_pos);
+		    td->telnet_cmd_pos = 0;
+		    done = 1;
+		}
+	    } else {
+		if (td->suboption_iac) {
+		    if (tn_byte == TN_SE) {
+			td->telnet_cmd_pos--;
+			handle_telnet_cmd(td, td->telnet_cmd_pos);
+			td->telnet_cmd_pos = 0;
+			done = 1;
+		    } else if (tn_byte == TN_IAC) {
+		    } else {
+			td->telnet_cmd_pos--;
+		    }
+		    td->suboption_iac = 0;
+		} else {
+		    if (td->telnet_cmd_pos > MAX_TELNET_CMD_SIZE)
+			td->telnet_cmd_pos = MAX_TELNET_CMD_SIZE;
+
+		    td->telnet_cmd[td->telnet_cmd_pos++] = tn_byte;
+		    if (tn_byte == TN_IAC)
+			td->suboption_iac = 1;
+		}
+	    }
+	} else if (indata[i] == TN_IAC) {
+	    td->telnet_cmd[td->telnet_cmd_pos++] = TN_IAC;
+	    td->suboption_iac = 0;
+	} else {
+	    outdata[j++] = indata[i];
+	}
+    }
+
+    *inlen -= i;
+    *r_indata = indata + i;
+
+    return j;
+}
+
+static unsigned int
+ref_process_telnet_xmit(unsigned char *outdata, unsigned int outlen,
+			const unsigned char **indata, size_t *r_inlen)
+{
+    unsigned int i, j = 0;
+    unsigned int inlen = *r_inlen;
+    const unsigned char *ibuf = *indata;
+
+    for (i = 0; i < inlen; i++) {
+	if (ibuf[i] == TN_IAC) {
+	    if (outlen < 2)
+		    break;
+	    outdata[j++] = TN_IAC;
+	    outdata[j++] = TN_IAC;
+	    outlen -= 2;
+	} else {
+	    if (outlen < 1)
+		break;
+	    outdata[j++] = ibuf[i];
+	    outlen--;
+	}
+    }
+
+    *indata = ibuf + i;
+    *r_inlen = inlen - i;
+
+    return j;
+}
+
+/* A record of the command callbacks. */
+struct cmdlog {
+    unsigned char buf[65536];
+    unsigned int len;
+    struct telnet_cmd cmds[3];
+};
+
+static void
+log_bytes(struct cmdlog *l, unsigned char type, const unsigned char *data,
+	  unsigned int len)
+{
+    if (l->len + len + 2 > sizeof(l->buf))
+	return;
+    l->buf[l->len++] = type;
+    l->buf[l->len++] = len;
+    memcpy(l->buf + l->len, data, len);
+    l->len += len;
+}
+
+static void
+log_output_ready(void *cb_data)
+{
+}
+
+static void
+log_cmd(void *cb_data, unsigned char cmd)
+{
+    log_bytes(cb_data, 'C', &cmd, 1);
+}
+
+static void
+log_option(void *cb_data, unsigned char *option, int len)
+{
+    log_bytes(cb_data, 'O', option, len);
+}
+
+static int
+log_will_do(void *cb_data, unsigned char cmd)
+{
+    log_bytes(cb_data, 'W', &cmd, 1);
+    return cmd == TN_WILL;
+}
+
+static void
+log_init(struct cmdlog *l, telnet_data_t *td)
+{
+    memset(l, 0, sizeof(*l));
+    l->cmds[0].option = TN_OPT_COM_PORT;
+    l->cmds[0].option_handler = log_option;
+    l->cmds[0].will_do_handler = log_will_do;
+    l->cmds[1].option = TN_OPT_BINARY_TRANSMISSION;
+    l->cmds[1].i_will = 1;
+    l->cmds[1].i_do = 1;
+    l->cmds[2].option = TELNET_CMD_END_OPTION;
+    telnet_init(td, l, log_output_ready, log_cmd, l->cmds, NULL, 0);
+}
+
+/* Make a random telnet stream, returns the length. */
+static unsigned int
+make_stream(unsigned char *buf, unsigned int size)
+{
+    static const unsigned char opts[] = { TN_OPT_COM_PORT,
+					  TN_OPT_BINARY_TRANSMISSION, 99 };
+    unsigned int len = 0, n, i;
+
+    while (len + 200 < size) {
+	switch (rand() % 10) {
+	case 0: case 1: case 2: case 3:
+	    n = rand() % 64;
+	    for (i = 0; i < n; i++)
+		buf[len++] = rand() % 255;
+	    break;
+	case 4:
+	    buf[len++] = TN_IAC;
+	    buf[len++] = TN_IAC;
+	    break;
+	case 5:
+	    /* A two byte command (or SE, which is ignored). */
+	    buf[len++] = TN_IAC;
+	    buf[len++] = TN_SE + rand() % (TN_SB - TN_SE);
+	    break;
+	case 6:
+	    buf[len++] = TN_IAC;
+	    buf[len++] = TN_WILL + rand() % 4;
+	    buf[len++] = opts[rand() % sizeof(opts)];
+	    break;
+	case 7:
+	    /* A suboption, sometimes longer than the maximum. */
+	    buf[len++] = TN_IAC;
+	    buf[len++] = TN_SB;
+	    buf[len++] = opts[rand() % sizeof(opts)];
+	    n = rand() % 2 ? rand() % 8 : rand() % 60;
+	    for (i = 0; i < n; i++) {
+		buf[len++] = rand();
+		if (buf[len - 1] == TN_IAC)
+		    buf[len++] = TN_IAC;
+	    }
+	    buf[len++] = TN_IAC;
+	    buf[len++] = TN_SE;
+	    break;
+	default:
+	    /* Garbage, anything goes. */
+	    n = rand() % 8;
+	    for (i = 0; i < n; i++)
+		buf[len++] = rand() % 4 ? TN_IAC : rand();
+	    break;
+	}
+    }
+    return len;
+}
+
+static void
+check_rx(void)
+{
+    static struct cmdlog l[2];
+    telnet_data_t td[2];
+    unsigned char in[16384], out[2][64];
+    unsigned char *p[2];
+    unsigned int len, pos = 0, inlen[2], outlen, olen[2], chunk;
+
+    log_init(&l[0], &td[0]);
+    log_init(&l[1], &td[1]);
+    len = make_stream(in, sizeof(in));
+    while (pos < len) {
+	chunk = 1 + rand() % 64;
+	if (chunk > len - pos)
+	    chunk = len - pos;
+	outlen = 1 + rand() % sizeof(out[0]);
+	p[0] = p[1] = in + pos;
+	inlen[0] = inlen[1] = chunk;
+	olen[0] = process_telnet_data(out[0], outlen, &p[0], &inlen[0],
+				      &td[0]);
+	olen[1] = ref_process_telnet_data(out[1], outlen, &p[1], &inlen[1],
+					  &td[1]);
+	if (olen[0] != olen[1] || inlen[0] != inlen[1] ||
+		memcmp(out[0], out[1], olen[0]) != 0 ||
+		l[0].len != l[1].len ||
+		memcmp(l[0].buf, l[1].buf, l[0].len) != 0) {
+	    if (errs < 10)
+		fprintf(stderr, "Receive mismatch at %u: out %u/%u,"
+			" left %u/%u\n", pos, olen[0], olen[1], inlen[0],
+			inlen[1]);
+	    errs++;
+	    return;
+	}
+	pos += chunk - inlen[0];
+	/* Throw away any responses, they are the same for both. */
+	gensio_buffer_init(&td[0].out_telnet_cmd, td[0].out_telnet_cmdbuf,
+			   sizeof(td[0].out_telnet_cmdbuf));
+	gensio_buffer_init(&td[1].out_telnet_cmd, td[1].out_telnet_cmdbuf,
+			   sizeof(td[1].out_telnet_cmdbuf));
+    }
+}
+
+static void
+check_tx(void)
+{
+    unsigned char in[4096], out[2][130];
+    const unsigned char *p[2];
+    unsigned int pos = 0, outlen, olen[2], chunk, i;
+    size_t inlen[2];
+
+    for (i = 0; i < sizeof(in); i++)
+	in[i] = rand() % 8 ? rand() : TN_IAC;
+    while (pos < sizeof(in)) {
+	chunk = 1 + rand() % 64;
+	if (chunk > sizeof(in) - pos)
+	    chunk = sizeof(in) - pos;
+	outlen = rand() % sizeof(out[0]);
+	p[0] = p[1] = in + pos;
+	inlen[0] = inlen[1] = chunk;
+	olen[0] = process_telnet_xmit(out[0], outlen, &p[0], &inlen[0]);
+	olen[1] = ref_process_telnet_xmit(out[1], outlen, &p[1], &inlen[1]);
+	if (olen[0] != olen[1] || inlen[0] != inlen[1] ||
+		memcmp(out[0], out[1], olen[0]) != 0) {
+	    if (errs < 10)
+		fprintf(stderr, "Transmit mismatch at %u: out %u/%u,"
+			" left %u/%u\n", pos, olen[0], olen[1],
+			(unsigned int) inlen[0], (unsigned int) inlen[1]);
+	    errs++;
+	    return;
+	}
+	pos += chunk - inlen[0];
+    }
+}
+
+static void
+check(void)
+{
+    unsigned int loop;
+
+    for (loop = 0; loop < 1000; loop++) {
+	check_rx();
+	check_tx();
+    }
+}
+
+typedef unsigned int (*rxfn)(unsigned char *outdata, unsigned int outlen,
+			     unsigned char **r_indata, unsigned int *inlen,
+			     telnet_data_t *td);
+typedef unsigned int (*txfn)(unsigned char *outdata, unsigned int outlen,
+			     const unsigned char **indata, size_t *r_inlen);
+
+/*
+ * Transmit then receive the buffer for the given time, returns the
+ * bytes per second for each in txrate and rxrate.
+ */
+static void
+bench(txfn tx, rxfn rx, const unsigned char *buf, unsigned int size,
+      unsigned int seconds, double *txrate, double *rxrate)
+{
+    static struct cmdlog l;
+    unsigned char *enc, *dec, *p;
+    const unsigned char *cp;
+    unsigned long long bytes = 0;
+    unsigned int enclen = 0, inlen, declen;
+    gensio_time start, now;
+    telnet_data_t td;
+    size_t left;
+
+    enc = malloc(size * 2);
+    dec = malloc(size);
+    if (!enc || !dec) {
+	fprintf(stderr, "Out of memory\n");
+	exit(1);
+    }
+    log_init(&l, &td);
+
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    do {
+	cp = buf;
+	left = size;
+	enclen = tx(enc, size * 2, &cp, &left);
+	bytes += size;
+	gensio_os_funcs_get_monotonic_time(o, &now);
+    } while (tv_diff(&now, &start) < seconds);
+    *txrate = bytes / tv_diff(&now, &start);
+
+    bytes = 0;
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    do {
+	p = enc;
+	inlen = enclen;
+	declen = 0;
+	while (inlen > 0)
+	    declen += rx(dec + declen, size - declen, &p, &inlen, &td);
+	bytes += size;
+	gensio_os_funcs_get_monotonic_time(o, &now);
+    } while (tv_diff(&now, &start) < seconds);
+    *rxrate = bytes / tv_diff(&now, &start);
+
+    if (memcmp(dec, buf, size) != 0) {
+	fprintf(stderr, "Data did not make it through the telnet code\n");
+	errs++;
+    }
+    free(enc);
+    free(dec);
+}
+
+static struct gensio_waiter *waiter;
+static unsigned char wseq, rseq;
+static unsigned long long rbytes, bad;
+static unsigned int wsize = 65536;
+
+static int
+srv_event(struct gensio *io, void *user_data, int event, int err,
+	  unsigned char *buf, gensiods *buflen, const char *const *auxdata)
+{
+    gensiods i;
+
+    switch (event) {
+    case GENSIO_EVENT_READ:
+	if (err) {
+	    gensio_set_read_callback_enable(io, false);
+	    return 0;
+	}
+	for (i = 0; i < *buflen; i++) {
+	    if (buf[i] != rseq++) {
+		bad++;
+		rseq = buf[i] + 1;
+	    }
+	}
+	rbytes += *buflen;
+	return 0;
+
+    default:
+	return GE_NOTSUP;
+    }
+}
+
+static struct gensio *srv_io;
+
+static int
+acc_event(struct gensio_accepter *acc, void *user_data, int event,
+	  void *data)
+{
+    struct gensio *io = data;
+
+    if (event != GENSIO_ACC_EVENT_NEW_CONNECTION)
+	return GE_NOTSUP;
+
+    srv_io = io;
+    gensio_set_callback(io, srv_event, NULL);
+    gensio_set_read_callback_enable(io, true);
+    gensio_os_funcs_wake(o, waiter);
+    return 0;
+}
+
+static int
+cl_event(struct gensio *io, void *user_data, int event, int err,
+	 unsigned char *buf, gensiods *buflen, const char *const *auxdata)
+{
+    static unsigned char data[65536];
+    gensiods i, count;
+
+    switch (event) {
+    case GENSIO_EVENT_READ:
+	return 0;
+
+    case GENSIO_EVENT_WRITE_READY:
+	do {
+	    for (i = 0; i < wsize; i++)
+		data[i] = wseq + i;
+	    if (gensio_write(io, &count, data, wsize, NULL)) {
+		gensio_set_write_callback_enable(io, false);
+		return 0;
+	    }
+	    wseq += count;
+	} while (count == wsize);
+	return 0;
+
+    default:
+	return GE_NOTSUP;
+    }
+}
+
+static int
+loopback(unsigned int seconds)
+{
+    struct gensio_os_proc_data *proc_data;
+    struct gensio_accepter *acc;
+    struct gensio *io;
+    struct gensio_timer *timer;
+    gensio_time start, now, timeout;
+    char str[200], port[20];
+    gensiods len;
+    int rv;
+
+    rv = gensio_os_proc_setup(o, &proc_data);
+    if (rv) {
+	fprintf(stderr, "Could not setup process: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    waiter = gensio_os_funcs_alloc_waiter(o);
+    if (!waiter) {
+	fprintf(stderr, "Could not allocate waiter\n");
+	return 1;
+    }
+    /*
+     * Under load the wait never times out because there is always
+     * something to do, so use a timer to wake it up.
+     */
+    timer = gensio_os_funcs_alloc_timer(o, tick, waiter);
+    if (!timer) {
+	fprintf(stderr, "Could not allocate timer\n");
+	return 1;
+    }
+
+    strcpy(str, "telnet(rfc2217),tcp(nodelay),127.0.0.1,0");
+    rv = str_to_gensio_accepter(str, o, acc_event, NULL, &acc);
+    if (!rv)
+	rv = gensio_acc_startup(acc);
+    if (rv) {
+	fprintf(stderr, "Could not start accepter %s: %s\n", str,
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    strcpy(port, "0");
+    len = sizeof(port);
+    rv = gensio_acc_control(acc, GENSIO_CONTROL_DEPTH_FIRST, true,
+			    GENSIO_ACC_CONTROL_LPORT, port, &len);
+    if (rv) {
+	fprintf(stderr, "Could not get accepter port: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+
+    snprintf(str, sizeof(str), "telnet(rfc2217),tcp(nodelay),127.0.0.1,%s",
+	     port);
+    rv = str_to_gensio(str, o, cl_event, NULL, &io);
+    if (!rv)
+	rv = gensio_open_s(io);
+    if (rv) {
+	fprintf(stderr, "Could not open %s: %s\n", str,
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    timeout.secs = 5;
+    timeout.nsecs = 0;
+    if (!srv_io)
+	gensio_os_funcs_wait(o, waiter, 1, &timeout);
+    if (!srv_io) {
+	fprintf(stderr, "Server never got the connection\n");
+	return 1;
+    }
+
+    gensio_set_write_callback_enable(io, true);
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    do {
+	timeout.secs = 0;
+	timeout.nsecs = 100000000;
+	gensio_os_funcs_start_timer(o, timer, &timeout);
+	gensio_os_funcs_wait(o, waiter, 1, NULL);
+	gensio_os_funcs_get_monotonic_time(o, &now);
+    } while (tv_diff(&now, &start) < seconds);
+    gensio_set_write_callback_enable(io, false);
+
+    printf("telnet(rfc2217) over TCP: %llu bytes in %.3f seconds,"
+	   " %.2f MB/sec\n", rbytes, tv_diff(&now, &start),
+	   rbytes / tv_diff(&now, &start) / 1000000.0);
+
+    if (check_it) {
+	if (bad) {
+	    fprintf(stderr, "%llu bad bytes received\n", bad);
+	    errs++;
+	}
+	if (rbytes == 0) {
+	    fprintf(stderr, "No data received\n");
+	    errs++;
+	}
+    }
+
+    gensio_close_s(io);
+    gensio_free(io);
+    gensio_close_s(srv_io);
+    gensio_free(srv_io);
+    gensio_acc_shutdown_s(acc);
+    gensio_acc_free(acc);
+    gensio_os_funcs_free_timer(o, timer);
+    gensio_os_funcs_free_waiter(o, waiter);
+    gensio_os_proc_cleanup(proc_data);
+    return 0;
+}
+
+static const char *usage = "[-c] [-s <size>] [-w <writesize>] [-t <seconds>]";
+
+int
+main(int argc, char *argv[])
+{
+    unsigned int size = 65536, i;
+    double tx, rx, ref_tx, ref_rx;
+    unsigned char *buf;
+    int rv;
+
+    while ((rv = bench_getopt(argc, argv, "cs:w:t:", usage)) != -1) {
+	switch (rv) {
+	case 's':
+	    size = strtoul(optarg, NULL, 0);
+	    break;
+	case 'w':
+	    wsize = strtoul(optarg, NULL, 0);
+	    break;
+	}
+    }
+    if (size < 1 || wsize < 1 || wsize > 65536)
+	bench_help(argv[0], usage);
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv) {
+	fprintf(stderr, "Could not allocate OS handler: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+
+    if (check_it)
+	check();
+
+    buf = malloc(size);
+    if (!buf) {
+	fprintf(stderr, "Out of memory\n");
+	return 1;
+    }
+    for (i = 0; i < size; i++)
+	buf[i] = i;
+    bench(ref_process_telnet_xmit, ref_process_telnet_data, buf, size,
+	  seconds, &ref_tx, &ref_rx);
+    bench(process_telnet_xmit, process_telnet_data, buf, size,
+	  seconds, &tx, &rx);
+    printf("%u byte buffers: transmit bytewise %.0f MB/sec, bulk %.0f"
+	   " MB/sec, %.2fx\n", size, ref_tx / 1000000, tx / 1000000,
+	   tx / ref_tx);
+    printf("%u byte buffers: receive bytewise %.0f MB/sec, bulk %.0f"
+	   " MB/sec, %.2fx\n", size, ref_rx / 1000000, rx / 1000000,
+	   rx / ref_rx);
+    free(buf);
+
+    if (loopback(seconds))
+	return 1;
+
+    gensio_os_funcs_free(o);
+    return bench_errs("telnet mismatches");
+}
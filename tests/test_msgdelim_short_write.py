@@ -0,0 +1,38 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+# msgdelim writes a message straight from the user's buffer, with the
+# escapes and trailer as separate pieces.  The ratelimit gensio under
+# it only takes 7 bytes at a time, so most writes to the child stop in
+# the middle of a message and msgdelim has to save the rest.
+
+from utils import *
+import gensio
+
+def do_short_write_test(io1, io2, timeout = 10000):
+    # Messages can't be bigger than msgdelim's writebuf, the accepted
+    # side doesn't get the chunksize from TestAccept.
+    io2.handler.chunksize = 128
+    rb = os.urandom(512)
+    print("  testing io1 to io2")
+    test_dataxfer(io1, io2, rb, timeout = timeout)
+    print("  testing io2 to io1")
+    test_dataxfer(io2, io1, rb, timeout = timeout)
+    # Messages with more than 15 pieces are copied instead.
+    rb = bytes([254, 1, 254, 254, 2, 3]) * 100
+    print("  testing io1 to io2 with lots of 254s")
+    test_dataxfer(io1, io2, rb, timeout = timeout)
+    print("  testing bidirection between io1 and io2 with lots of 254s")
+    test_dataxfer_simul(io1, io2, rb, timeout = timeout)
+    print("  Success!")
+
+print("Test msgdelim with short writes")
+TestAccept(o, "msgdelim,ratelimit(xmit_len=7,xmit_delay=1m),tcp,localhost,",
+           "msgdelim,ratelimit(xmit_len=7,xmit_delay=1m),tcp,localhost,0",
+           do_short_write_test, chunksize = 128)
+del o
+test_shutdown()
@@ -0,0 +1,58 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+# Open a lot of mux channels and send data over the last few opened
+# while the rest sit idle, so every message has to be found among
+# them.
+
+from utils import *
+import gensio
+
+nchans = 500
+nactive = 4
+
+class MuxChanHandler(HandleData):
+    """Keep the channels the remote end opens, by service."""
+    def __init__(self, o, iostr, name = None, io = None):
+        HandleData.__init__(self, o, iostr, name = name, io = io)
+        self.o = o
+        self.chans = {}
+
+    def new_channel(self, io1, io2, auxdata):
+        i = int(io2.control(0, gensio.GENSIO_CONTROL_GET,
+                            gensio.GENSIO_CONTROL_SERVICE, None))
+        if i in self.chans:
+            raise Exception("Got channel %d, but it already exists" % i)
+        HandleData(self.o, None, io = io2, name = "server channel %d" % i)
+        self.chans[i] = io2
+        return 0
+
+def do_idle_test(io1, io2):
+    h = MuxChanHandler(o, None, io = io2, name = "mux server")
+    print("  opening %d channels" % nchans)
+    chans = {}
+    for i in range(1, nchans + 1):
+        ch = io1.alloc_channel(["service=%d" % i], None)
+        ch.open_s()
+        HandleData(o, None, io = ch, name = "client channel %d" % i)
+        chans[i] = ch
+    if len(h.chans) != nchans:
+        raise Exception("Got %d channels, expected %d" %
+                        (len(h.chans), nchans))
+    for i in range(nchans - nactive + 1, nchans + 1):
+        print("  testing channel %d" % i)
+        test_dataxfer(chans[i], h.chans[i], os.urandom(10000))
+        test_dataxfer(h.chans[i], chans[i], os.urandom(10000))
+    io_close(tuple(chans.values()) + tuple(h.chans.values()))
+
+print("Test mux with many idle channels")
+TestAccept(o, "mux(max_channels=%d),tcp,localhost," % (nchans + 1),
+           "mux(max_channels=%d),tcp,localhost,0" % (nchans + 1),
+           do_idle_test)
+del o
+test_shutdown()
+print("  Success!")
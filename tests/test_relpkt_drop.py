@@ -0,0 +1,144 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+# Drop random data packets between a relpkt client and server and
+# check that relpkt only resends about what was lost, not whole
+# windows.  The data goes through a UDP relay in the test that does
+# the dropping and counts what the client sends.
+
+from utils import *
+import gensio
+import random
+import socket
+
+class RelayEnd:
+    """One side of the relay, sends what it reads out the other side."""
+    def __init__(self, relay, name):
+        self.relay = relay
+        self.name = name
+        self.io = None
+        self.peer = None
+
+    def read_callback(self, io, err, buf, auxdata):
+        if err:
+            return 0
+        if self.peer and self.peer.io:
+            if not self.relay.filter(self, buf):
+                self.peer.io.write(buf, None)
+        return len(buf)
+
+    def write_callback(self, io):
+        return
+
+    def open_done(self, io, err):
+        if err:
+            raise Exception("Relay open failed: %s" % err)
+        self.peer.io.read_cb_enable(True)
+        io.read_cb_enable(True)
+
+class LossyRelay:
+    """Relay UDP packets from an accepter to a server, dropping the
+    given percentage of relpkt data packets going to the server."""
+    def __init__(self, o, srvport, loss):
+        self.o = o
+        self.srvport = srvport
+        self.loss = loss
+        self.hdrlen = 3
+        self.pkts = 0
+        self.dropped = 0
+        self.xmit_data = 0
+        self.cli = RelayEnd(self, "client")
+        self.srv = RelayEnd(self, "server")
+        self.cli.peer = self.srv
+        self.srv.peer = self.cli
+        self.acc = gensio.gensio_accepter(o, "udp,ipv4,127.0.0.1,0", self)
+        self.acc.startup()
+        self.port = self.acc.control(gensio.GENSIO_CONTROL_DEPTH_FIRST,
+                                     gensio.GENSIO_CONTROL_GET,
+                                     gensio.GENSIO_ACC_CONTROL_LPORT, "0")
+
+    def new_connection(self, acc, io):
+        if self.cli.io:
+            raise Exception("Relay got a second connection")
+        self.cli.io = io
+        io.set_cbs(self.cli)
+        self.srv.io = gensio.gensio(self.o, "udp,ipv4,127.0.0.1,%d" %
+                                    self.srvport, self.srv)
+        self.srv.io.open(self.srv)
+
+    def accepter_log(self, acc, level, logstr):
+        print("***%s LOG: relay: %s" % (level, logstr))
+
+    def filter(self, end, buf):
+        """Return True if the packet should be dropped."""
+        if end is self.srv:
+            if len(buf) >= 2 and buf[0] == (1 << 4 | 1): # Init response
+                if buf[1] > 0:
+                    self.hdrlen = 5
+            return False
+        if len(buf) <= self.hdrlen or buf[0] >> 4 != 2: # Not data
+            return False
+        self.pkts += 1
+        self.xmit_data += len(buf) - self.hdrlen
+        if random.random() * 100 < self.loss:
+            self.dropped += 1
+            return True
+        return False
+
+    def shutdown(self):
+        self.acc.shutdown_s()
+        for end in (self.cli, self.srv):
+            if end.io:
+                end.io.read_cb_enable(False)
+        for end in (self.cli, self.srv):
+            if end.io:
+                end.io.close_s()
+                end.io = None
+            # Break the reference loops so the os funcs get freed.
+            end.relay = None
+            end.peer = None
+        self.acc = None
+
+def get_free_udp_port():
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.bind(("127.0.0.1", 0))
+    port = s.getsockname()[1]
+    s.close()
+    return port
+
+def do_drop_test(loss, size, pktopts = ""):
+    print("Test relpkt with %d%% loss, %d bytes %s" % (loss, size, pktopts))
+    srvport = get_free_udp_port()
+    relay = LossyRelay(o, srvport, loss)
+    data = os.urandom(size)
+
+    def tester(io1, io2):
+        test_dataxfer(io1, io2, data, timeout = 30000)
+
+    TestAccept(o, "relpkt%s,udp,ipv4,127.0.0.1,%s" % (pktopts, relay.port),
+               "relpkt%s,udp,ipv4,127.0.0.1,%d" % (pktopts, srvport),
+               tester, get_port = False, close_timeout = 5000)
+    relay.shutdown()
+
+    lost = relay.dropped * 100.0 / relay.pkts
+    resent = 0.0
+    if relay.xmit_data > size:
+        resent = (relay.xmit_data - size) * 100.0 / size
+    print("  %.2f%% of data packets lost, %.2f%% of data resent" %
+          (lost, resent))
+    if relay.dropped == 0:
+        raise Exception("No packets were dropped")
+    if resent > lost * 2 + 1:
+        raise Exception("Too much data resent")
+    print("  Success!")
+
+do_drop_test(2, 1000000)
+do_drop_test(5, 1000000)
+do_drop_test(2, 200000, "(max_pktsize=200)")
+
+del o
+test_shutdown()
@@ -0,0 +1,102 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+# Sample format conversions in the sound gensio, checked against known
+# values through the file sound type.
+
+import utils
+import gensio
+import os
+import struct
+
+print("Test sound format conversion")
+
+pcmfile = "sound_conv_pcm"
+
+def sound_in(opts, pcm, expected):
+    f = open(pcmfile, "wb")
+    f.write(pcm)
+    f.close()
+    g = gensio.gensio(utils.o,
+                      "sound(type=file,inchans=1,inrate=8000,inbufsize=1,%s),%s"
+                      % (opts, pcmfile), None)
+    g.set_sync()
+    g.open_s()
+    data = b""
+    while len(data) < len(expected):
+        s = g.read_s(len(expected) - len(data), 1000)
+        if len(s[0]) == 0:
+            break
+        data += s[0]
+    g.close_s()
+    del g
+    return data
+
+def sound_out(opts, data, expected):
+    try:
+        os.remove(pcmfile)
+    except:
+        pass
+    g = gensio.gensio(utils.o,
+                      "sound(type=file,outchans=1,outrate=8000,outbufsize=1,%s),%s"
+                      % (opts, pcmfile), None)
+    g.set_sync()
+    g.open_s()
+    g.write_s(data, 1000)
+    g.close_s()
+    del g
+    f = open(pcmfile, "rb")
+    pcm = f.read()
+    f.close()
+    return pcm
+
+def check(name, op, opts, data, expected):
+    print("  " + name)
+    got = op(opts, data, expected)
+    if got != expected:
+        raise Exception("%s: expected %s, got %s" %
+                        (name, expected.hex(), got.hex()))
+
+# Unsigned PCM formats are offset, not sign extended.
+check("u8 to s16", sound_in, "informat=s16,inpformat=u8",
+      bytes([0x00, 0x40, 0x80, 0xc0, 0xff]),
+      struct.pack("=5h", -32768, -16384, 0, 16384, 32512))
+check("u16 to float", sound_in, "informat=float,inpformat=u16",
+      struct.pack("=2H", 0xffff, 0), struct.pack("=2f", 32767 / 32768, -1))
+check("s16 to u8", sound_out, "outformat=s16,outpformat=u8",
+      struct.pack("=2h", -32768, 16384), bytes([0x00, 0xc0]))
+
+# Integer user formats with a float PCM format are scaled.
+check("float to s16", sound_in, "informat=s16,inpformat=float",
+      struct.pack("=2f", .5, -.25), struct.pack("=2h", 16384, -8192))
+check("s16 to float", sound_out, "outformat=s16,outpformat=float",
+      struct.pack("=2h", -16384, 8192), struct.pack("=2f", -.5, .25))
+
+# Integers of different sizes are scaled.
+check("s32 to s16", sound_in, "informat=s16,inpformat=s32",
+      struct.pack("=2i", 1 << 30, -(1 << 30)),
+      struct.pack("=2h", 16384, -16384))
+
+# Float to integer clips at full scale and rounds to nearest.
+check("float to s16 full scale", sound_out, "outformat=float,outpformat=s16",
+      struct.pack("=2f", 1, -1), struct.pack("=2h", 32767, -32768))
+check("float to s16 rounding", sound_out, "outformat=float,outpformat=s16",
+      struct.pack("=2f", -1.4 / 32768, -1.6 / 32768),
+      struct.pack("=2h", -1, -2))
+
+# PCM format names with a byte order, in either case.
+check("int16_be to s16", sound_in, "informat=s16,inpformat=int16_be",
+      bytes([0x12, 0x34]), struct.pack("=h", 0x1234))
+check("INT16_BE to s16", sound_in, "informat=s16,inpformat=INT16_BE",
+      bytes([0x12, 0x34]), struct.pack("=h", 0x1234))
+check("int24_be to s32", sound_in, "informat=s32,inpformat=int24_be",
+      bytes([0x12, 0x34, 0x56]), struct.pack("=i", 0x12345600))
+
+os.remove(pcmfile)
+
+utils.test_shutdown()
+print("  Success!")
@@ -0,0 +1,22 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+# ssl record coalescing.  The data has to get through the same with
+# one record per lower layer write as with several.
+
+from utils import *
+import gensio
+
+for coalesce in (1, 4, 64):
+    print("Test ssl with coalesce=%d" % coalesce)
+    TestAccept(o, "ssl(CA=%s/CA.pem,coalesce=%d),tcp,localhost,"
+               % (keydir, coalesce),
+               "ssl(key=%s/key.pem,cert=%s/cert.pem,coalesce=%d),"
+               "tcp,localhost,0" % (keydir, keydir, coalesce),
+               do_medium_test)
+del o
+test_shutdown()
@@ -0,0 +1,78 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+# ssl session resumption.  With resume on, a client connecting to the
+# same accepter again should resume its session and the accepter's
+# stats should agree, with it off nothing resumes.
+
+from utils import *
+import gensio
+
+class SSLAccepter:
+    def __init__(self, o, resume):
+        self.o = o
+        self.name = "ssl resume=%s" % resume
+        self.waiter = gensio.waiter(o)
+        self.io2 = None
+        h = AccHandler(self, self.name)
+        self.acc = gensio.gensio_accepter(o,
+                        "ssl(key=%s/key.pem,cert=%s/cert.pem,resume=%s),"
+                        "tcp,localhost,0" % (keydir, keydir, resume), h)
+        self.acc.startup()
+        self.port = self.acc.control(gensio.GENSIO_CONTROL_DEPTH_FIRST,
+                                     gensio.GENSIO_CONTROL_GET,
+                                     gensio.GENSIO_ACC_CONTROL_LPORT, "0")
+
+def do_resume_test(resume, count = 10):
+    print("Test ssl connections with resume=%s" % resume)
+    a = SSLAccepter(o, resume)
+    reused = 0
+    for i in range(0, count):
+        io1 = alloc_io(o, "ssl(CA=%s/CA.pem,resume=%s),tcp,localhost,%s"
+                       % (keydir, resume, a.port))
+        if a.waiter.wait_timeout(1, 1000) == 0:
+            raise Exception("Timed out waiting for connection %d" % i)
+        io2 = a.io2
+        a.io2 = None
+        # Data both ways, so the client gets the session tickets that
+        # come after the handshake.
+        test_dataxfer(io1, io2, "ping")
+        test_dataxfer(io2, io1, "pong")
+        if io1.control(gensio.GENSIO_CONTROL_DEPTH_FIRST,
+                       gensio.GENSIO_CONTROL_GET,
+                       gensio.GENSIO_CONTROL_SESSION_REUSED, None) == "1":
+            reused += 1
+        io_close((io1, io2))
+
+    try:
+        stats = a.acc.control(gensio.GENSIO_CONTROL_DEPTH_FIRST,
+                              gensio.GENSIO_CONTROL_GET,
+                              gensio.GENSIO_ACC_CONTROL_SESSION_STATS, "")
+    except Exception as e:
+        stats = None
+    a.acc.shutdown_s()
+    del a.acc
+    print("  %d of %d connections resumed, server stats: %s" %
+          (reused, count, stats))
+
+    if resume == "true":
+        if stats is None:
+            raise Exception("Could not get session stats")
+        if reused < count // 2 or int(stats.split()[0]) != reused:
+            raise Exception("Only %d of %d connections resumed, server"
+                            " says %s" % (reused, count, stats))
+    else:
+        if stats is not None:
+            raise Exception("Session stats supported with resume off")
+        if reused:
+            raise Exception("Connections resumed with resume off")
+    print("  Success!")
+
+do_resume_test("false")
+do_resume_test("true")
+del o
+test_shutdown()
@@ -0,0 +1,31 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+from utils import *
+import gensio
+
+# ssl encrypts straight from the user's buffer.  The ratelimit gensio
+# under it only takes 7 bytes at a time, so the records it writes
+# mostly go out in pieces.
+print("Test ssl with short writes")
+TestAccept(o, ("ssl(CA=%s/CA.pem),ratelimit(xmit_len=7,xmit_delay=1m),"
+               "tcp,localhost," % keydir),
+           ("ssl(key=%s/key.pem,cert=%s/cert.pem),"
+            "ratelimit(xmit_len=7,xmit_delay=1m),tcp,localhost,0"
+            % (keydir, keydir)),
+           do_small_test)
+
+# With readbuf=1024 the BIO is 4096 bytes, a full 16384 byte record
+# doesn't fit so SSL_write() has to be retried, from a copy of the
+# data.
+print("Test ssl with SSL_write() retries")
+TestAccept(o, "ssl(CA=%s/CA.pem,readbuf=1024),tcp,localhost," % keydir,
+           ("ssl(key=%s/key.pem,cert=%s/cert.pem,readbuf=1024),"
+            "tcp,localhost,0" % (keydir, keydir)),
+           do_medium_test, chunksize = 16384)
+del o
+test_shutdown()
@@ -0,0 +1,48 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+# tcp read batching.  Without it there is one read each time the
+# socket is readable, with it there can be more.  The read stats have
+# to account for all the data either way.  readbatch is in bytes.
+
+from utils import *
+import gensio
+
+size = 1000000
+
+def read_stats(io):
+    s = io.control(0, gensio.GENSIO_CONTROL_GET,
+                   gensio.GENSIO_CONTROL_READ_STATS, None)
+    return [int(x) for x in s.split()]
+
+def do_readbatch_test(batch):
+    def tester(io1, io2):
+        test_dataxfer(io1, io2, os.urandom(size), timeout = 10000)
+        (events, reads, nbytes) = read_stats(io2)
+        print("  %d read events, %d reads, %d bytes" % (events, reads, nbytes))
+        if nbytes != size:
+            raise Exception("Read stats show %d bytes, %d arrived" %
+                            (nbytes, size))
+        if batch == 0 and events != reads:
+            raise Exception("%d reads for %d events without batching" %
+                            (reads, events))
+        if reads < events:
+            raise Exception("Only %d reads for %d events" % (reads, events))
+        # The sender writes much more at a time than fits in the read
+        # buffer, so some reads have to fill it and go again.
+        if batch > 0 and reads == events:
+            raise Exception("No reads were batched")
+
+    print("Test tcp with readbatch=%d" % batch)
+    TestAccept(o, "tcp,localhost,", "tcp(readbatch=%d),localhost,0" % batch,
+               tester)
+    print("  Success!")
+
+do_readbatch_test(0)
+do_readbatch_test(65536)
+del o
+test_shutdown()
@@ -0,0 +1,71 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+# Binary tracing in the trace gensio.  A text trace sits on top of a
+# binary trace on an echo gensio, so both see the same records, and
+# gtracedump has to turn the binary trace into the same text, ignoring
+# the timestamps.
+
+import utils
+import gensio
+import os
+import re
+import subprocess
+import sys
+
+textfile = "trace_binary.txt"
+binfile = "trace_binary.bin"
+
+gtracedump = os.getenv("GTRACEDUMP")
+if not gtracedump:
+    print("GTRACEDUMP is not set, skipping")
+    sys.exit(77)
+
+print("Test binary trace")
+
+# The ring is big enough to never drop here since the writer thread
+# keeps up with the sync writes, but small enough to wrap.
+g = gensio.gensio(utils.o,
+                  "trace(dir=both,delold,file=%s),"
+                  "trace(dir=both,delold,binary,ringsize=65536,file=%s),"
+                  "echo(readbuf=4096)" % (textfile, binfile), None)
+g.set_sync()
+g.open_s()
+size = 1
+while size <= 4096:
+    for i in range(0, 20):
+        data = os.urandom(size)
+        g.write_s(data, 1000)
+        rdata = b""
+        while len(rdata) < size:
+            s = g.read_s(size - len(rdata), 1000)
+            if len(s[0]) == 0:
+                raise Exception("Timed out reading %d bytes" % size)
+            rdata += s[0]
+        if rdata != data:
+            raise Exception("Data mismatch on %d bytes" % size)
+    size = size * 3 + 1
+g.close_s()
+del g
+
+def strip_times(s):
+    return re.sub("(?m)^[0-9]*:[0-9]* ", "", s)
+
+p = subprocess.run([gtracedump, binfile], stdout = subprocess.PIPE,
+                   universal_newlines = True)
+if p.returncode != 0:
+    raise Exception("gtracedump failed: %d" % p.returncode)
+f = open(textfile)
+text = f.read()
+f.close()
+if strip_times(p.stdout) != strip_times(text):
+    raise Exception("gtracedump output does not match the text trace")
+
+os.remove(textfile)
+os.remove(binfile)
+utils.test_shutdown()
+print("  Success!")
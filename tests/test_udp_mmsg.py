@@ -0,0 +1,92 @@
+#
+#  gensio - A library for abstracting stream I/O
+#  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+#
+#  SPDX-License-Identifier: GPL-2.0-only
+#
+
+# UDP accepters with recvmmsg/sendmmsg batching.  Each client has to
+# get its own connection on the accepter and its own data back, with
+# one packet per wakeup and with batching.
+
+from utils import *
+import gensio
+
+nclients = 20
+
+class UDPHandleData(HandleData):
+    """A udp accepter stops reading its socket if any of its
+    connections has read disabled, and HandleData disables read when
+    a compare finishes.  Keep them all reading."""
+    def read_callback(self, io, err, buf, auxdata):
+        rv = HandleData.read_callback(self, io, err, buf, auxdata)
+        io.read_cb_enable(True)
+        return rv
+
+class UDPAccHandler(AccHandler):
+    def new_connection(self, acc, io):
+        UDPHandleData(self.opobj.o, None, io = io, name = self.name)
+        self.opobj.io2 = io
+        self.opobj.waiter.wake()
+
+class UDPAccepter:
+    def __init__(self, o, mmsg):
+        self.o = o
+        self.name = "udp(mmsg=%d)" % mmsg
+        self.waiter = gensio.waiter(o)
+        self.io2 = None
+        h = UDPAccHandler(self, self.name)
+        self.acc = gensio.gensio_accepter(o, "udp(mmsg=%d),127.0.0.1,0" % mmsg,
+                                          h)
+        self.acc.startup()
+        self.port = self.acc.control(gensio.GENSIO_CONTROL_DEPTH_FIRST,
+                                     gensio.GENSIO_CONTROL_GET,
+                                     gensio.GENSIO_ACC_CONTROL_LPORT, "0")
+
+def do_mmsg_test(mmsg):
+    print("Test udp with mmsg=%d and %d clients" % (mmsg, nclients))
+    a = UDPAccepter(o, mmsg)
+    pairs = []
+    for i in range(0, nclients):
+        io1 = alloc_io(o, "udp,127.0.0.1," + a.port)
+        io1.write("%d" % i, None)
+        if a.waiter.wait_timeout(1, 1000) == 0:
+            raise Exception("Timed out waiting for client %d connection" % i)
+        io2 = a.io2
+        a.io2 = None
+        io2.handler.set_compare("%d" % i)
+        if io2.handler.wait_timeout(1000) == 0:
+            raise Exception("Timed out waiting for client %d first packet"
+                            % i)
+        pairs.append((io1, io2))
+
+    # Send both ways on all of them at once so the packets get batched.
+    for (io1, io2) in pairs:
+        data = os.urandom(100)
+        io1.handler.set_write_data(data)
+        io2.handler.set_compare(data)
+    for (io1, io2) in pairs:
+        for io in (io1, io2):
+            if io.handler.wait_timeout(1000) == 0:
+                raise Exception("%s: Timed out waiting for data" %
+                                io.handler.name)
+    for (io1, io2) in pairs:
+        data = os.urandom(100)
+        io2.handler.set_write_data(data)
+        io1.handler.set_compare(data)
+    for (io1, io2) in pairs:
+        for io in (io1, io2):
+            if io.handler.wait_timeout(1000) == 0:
+                raise Exception("%s: Timed out waiting for data" %
+                                io.handler.name)
+
+    a.acc.shutdown_s()
+    for (io1, io2) in pairs:
+        io_close((io1, io2))
+    del a.acc
+    print("  Success!")
+
+do_mmsg_test(1)
+do_mmsg_test(16)
+del o
+test_shutdown()
@@ -0,0 +1,357 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2025  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * A benchmark for the trace gensio.  It writes -s byte blocks through
+ * an echo gensio and reads them back for -t seconds, first with no
+ * tracing, then tracing both directions as text, then tracing both
+ * directions in binary mode, and reports the blocks per second and
+ * the size of the trace for each.  The traces go to files in the
+ * current directory that are removed at the end.
+ *
+ * With -c it is run as a test.  It then puts a text trace on top of a
+ * binary trace on an echo gensio, so both see the same records, and
+ * sends blocks of many sizes through it.  It checks that the data
+ * comes back right, then reads the binary trace and checks that it
+ * holds all the data written and read, in order, and that nothing was
+ * dropped.  The two traces are left in the files given with -T and -B
+ * so the caller can check that gtracedump turns the binary one into
+ * the text one.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gensio/gensio.h>
+#include <gensio/gensio_os_funcs.h>
+#include <gensio/gensio_trace.h>
+#include "benchutil.h"
+
+
+static const char *textfile = "tracebench.txt";
+static const char *binfile = "tracebench.bin";
+
+static const char *usage =
+    "[-c] [-s <blocksize>] [-t <seconds>] [-T <file>] [-B <file>]";
+
+static struct gensio *
+open_echo(const char *str)
+{
+    struct gensio *io;
+    int rv;
+
+    rv = str_to_gensio(str, o, NULL, NULL, &io);
+    if (!rv) {
+	rv = gensio_open_s(io);
+	if (rv)
+	    gensio_free(io);
+    }
+    if (!rv) {
+	rv = gensio_set_sync(io);
+	if (rv) {
+	    gensio_close_s(io);
+	    gensio_free(io);
+	}
+    }
+    if (rv) {
+	fprintf(stderr, "Could not open %s: %s\n", str,
+		gensio_err_to_str(rv));
+	return NULL;
+    }
+    return io;
+}
+
+static void
+close_echo(struct gensio *io)
+{
+    gensio_close_s(io);
+    gensio_free(io);
+}
+
+/* Send a block through the echo and make sure it comes back. */
+static int
+echo_block(struct gensio *io, unsigned char *out, unsigned char *in,
+	   gensiods len)
+{
+    gensio_time timeout = { 5, 0 };
+    gensiods got = 0, count;
+    int rv;
+
+    rv = gensio_write_s(io, NULL, out, len, &timeout);
+    while (!rv && got < len) {
+	rv = gensio_read_s(io, &count, in + got, len - got, &timeout);
+	got += count;
+    }
+    if (rv) {
+	fprintf(stderr, "Echo failed: %s\n", gensio_err_to_str(rv));
+	return rv;
+    }
+    if (memcmp(out, in, len) != 0) {
+	fprintf(stderr, "Echo data mismatch\n");
+	return GE_DATAMISSING;
+    }
+    return 0;
+}
+
+static long
+file_size(const char *name)
+{
+    FILE *f = fopen(name, "rb");
+    long size;
+
+    if (!f)
+	return 0;
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+static void
+bench(const char *desc, const char *tracefile, const char *tracestr,
+      unsigned int seconds, gensiods blocksize)
+{
+    struct gensio *io;
+    unsigned char *out, *in;
+    gensio_time start, now;
+    unsigned long long blocks = 0;
+    char str[200];
+    double elapsed;
+    gensiods i;
+
+    /* The echo must be able to hold a whole block. */
+    if (tracefile)
+	snprintf(str, sizeof(str),
+		 "trace(dir=both,delold,file=%s%s),echo(readbuf=%lu)",
+		 tracefile, tracestr, (unsigned long) blocksize);
+    else
+	snprintf(str, sizeof(str), "echo(readbuf=%lu)",
+		 (unsigned long) blocksize);
+
+    out = malloc(blocksize);
+    in = malloc(blocksize);
+    if (!out || !in) {
+	fprintf(stderr, "Out of memory\n");
+	exit(1);
+    }
+    for (i = 0; i < blocksize; i++)
+	out[i] = i;
+
+    io = open_echo(str);
+    if (!io)
+	exit(1);
+
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    do {
+	if (echo_block(io, out, in, blocksize))
+	    exit(1);
+	blocks++;
+	gensio_os_funcs_get_monotonic_time(o, &now);
+    } while (now.secs - start.secs < seconds ||
+	     (now.secs - start.secs == seconds && now.nsecs < start.nsecs));
+    close_echo(io);
+    gensio_os_funcs_get_monotonic_time(o, &now);
+
+    elapsed = tv_diff(&now, &start);
+    printf("%-8s %10.0f blocks/sec, %8.2f MB/sec, trace %ld bytes\n",
+	   desc, blocks / elapsed, blocks * blocksize / elapsed / 1000000,
+	   tracefile ? file_size(tracefile) : 0L);
+    if (tracefile)
+	remove(tracefile);
+    free(out);
+    free(in);
+}
+
+static unsigned long
+get_le(const unsigned char *d, unsigned int len)
+{
+    unsigned long v = 0;
+
+    while (len > 0)
+	v = (v << 8) | d[--len];
+    return v;
+}
+
+/*
+ * Go through the binary trace and make sure it has what was sent.
+ * Writes and reads must each come out as the exact bytes sent, in
+ * order.
+ */
+static void
+check_bin_trace(const unsigned char *data, gensiods total)
+{
+    unsigned char hdr[GENSIO_TRACE_HDR_SIZE];
+    gensiods pos[2] = { 0, 0 }, len;
+    unsigned char *buf = NULL;
+    unsigned int op, records = 0;
+    FILE *f;
+
+    f = fopen(binfile, "rb");
+    if (!f) {
+	fprintf(stderr, "Could not open %s\n", binfile);
+	errs++;
+	return;
+    }
+    if (fread(hdr, 1, GENSIO_TRACE_MAGIC_LEN, f) != GENSIO_TRACE_MAGIC_LEN ||
+		memcmp(hdr, GENSIO_TRACE_MAGIC, GENSIO_TRACE_MAGIC_LEN) != 0) {
+	fprintf(stderr, "Binary trace has a bad magic\n");
+	errs++;
+	goto out;
+    }
+    while (fread(hdr, 1, sizeof(hdr), f) == sizeof(hdr)) {
+	records++;
+	len = get_le(hdr, 4);
+	op = hdr[4];
+	if (op == GENSIO_TRACE_OP_DROPPED) {
+	    fprintf(stderr, "Binary trace dropped %lu records\n",
+		    get_le(hdr + 20, 4));
+	    errs++;
+	    continue;
+	}
+	if (op != GENSIO_TRACE_OP_READ && op != GENSIO_TRACE_OP_WRITE) {
+	    fprintf(stderr, "Binary trace has bad op %u\n", op);
+	    errs++;
+	    goto out;
+	}
+	if (get_le(hdr + 20, 4) != 0 || pos[op] + len > total) {
+	    fprintf(stderr, "Binary trace has a bad record\n");
+	    errs++;
+	    goto out;
+	}
+	buf = realloc(buf, len);
+	if (!buf || fread(buf, 1, len, f) != len) {
+	    fprintf(stderr, "Binary trace is truncated\n");
+	    errs++;
+	    goto out;
+	}
+	if (memcmp(buf, data + pos[op], len) != 0) {
+	    fprintf(stderr, "Binary trace %s data is wrong at %lu\n",
+		    op == GENSIO_TRACE_OP_READ ? "read" : "write",
+		    (unsigned long) pos[op]);
+	    errs++;
+	    goto out;
+	}
+	pos[op] += len;
+    }
+    if (pos[GENSIO_TRACE_OP_READ] != total ||
+		pos[GENSIO_TRACE_OP_WRITE] != total) {
+	fprintf(stderr, "Binary trace has %lu bytes read and %lu written,"
+		" expected %lu\n", (unsigned long) pos[GENSIO_TRACE_OP_READ],
+		(unsigned long) pos[GENSIO_TRACE_OP_WRITE],
+		(unsigned long) total);
+	errs++;
+    }
+    printf("Binary trace has %u records of %lu bytes each way\n", records,
+	   (unsigned long) total);
+ out:
+    free(buf);
+    fclose(f);
+}
+
+static void
+check(void)
+{
+    struct gensio *io;
+    unsigned char *data, *in;
+    gensiods total = 0, len, i;
+    char str[400];
+
+    /* Sizes 1 to 4096, enough blocks to wrap a small ring many times. */
+    for (len = 1; len <= 4096; len = len * 3 + 1)
+	total += len * 20;
+    data = malloc(total);
+    in = malloc(4096);
+    if (!data || !in) {
+	fprintf(stderr, "Out of memory\n");
+	exit(1);
+    }
+    for (i = 0; i < total; i++)
+	data[i] = (i * 7) ^ (i >> 8);
+
+    /*
+     * The ring is big enough to never drop here since the writer
+     * thread keeps up with the sync writes, but small enough to wrap.
+     */
+    snprintf(str, sizeof(str),
+	     "trace(dir=both,delold,file=%s),"
+	     "trace(dir=both,delold,binary,ringsize=65536,file=%s),"
+	     "echo(readbuf=4096)",
+	     textfile, binfile);
+    io = open_echo(str);
+    if (!io) {
+	errs++;
+	goto out;
+    }
+    for (i = 0, len = 1; len <= 4096; len = len * 3 + 1) {
+	unsigned int j;
+
+	for (j = 0; j < 20; j++, i += len) {
+	    if (echo_block(io, data + i, in, len)) {
+		errs++;
+		close_echo(io);
+		goto out;
+	    }
+	}
+    }
+    close_echo(io);
+
+    check_bin_trace(data, total);
+
+ out:
+    free(data);
+    free(in);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct gensio_os_proc_data *proc_data;
+    gensiods blocksize = 1024;
+    int rv;
+
+    while ((rv = bench_getopt(argc, argv, "cs:t:T:B:", usage)) != -1) {
+	switch (rv) {
+	case 's':
+	    blocksize = strtoul(optarg, NULL, 0);
+	    break;
+	case 'T':
+	    textfile = optarg;
+	    break;
+	case 'B':
+	    binfile = optarg;
+	    break;
+	}
+    }
+    if (blocksize < 1)
+	bench_help(argv[0], usage);
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv) {
+	fprintf(stderr, "Could not allocate OS handler: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    rv = gensio_os_proc_setup(o, &proc_data);
+    if (rv) {
+	fprintf(stderr, "Could not setup process: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+
+    if (check_it)
+	check();
+
+    bench("none", NULL, "", seconds, blocksize);
+    bench("text", "tracebench-bench.txt", "", seconds, blocksize);
+    bench("binary", "tracebench-bench.bin", ",binary", seconds, blocksize);
+
+    gensio_os_proc_cleanup(proc_data);
+    gensio_os_funcs_free(o);
+    return check_it ? bench_errs("trace errors") : 0;
+}
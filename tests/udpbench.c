@@ -0,0 +1,345 @@
+/*
+ *  gensio - A library for abstracting stream I/O
+ *  Copyright (C) 2024  Corey Minyard <minyard@acm.org>
+ *
+ *  SPDX-License-Identifier: GPL-2.0-only
+ */
+
+/*
+ * A packets per second benchmark for the UDP gensio.  It starts a UDP
+ * accepter that echoes every packet back, then creates a number of
+ * UDP client gensios and keeps a window of packets (-w) in flight to
+ * it.  When a packet comes back, the next client in turn sends a new
+ * one, so all the clients are used evenly.  It reports the number of
+ * packets echoed per second.
+ *
+ * Use -m to set the mmsg option on the accepter, so you can compare
+ * handling one packet per wakeup (-m 1) with batching them using
+ * recvmmsg/sendmmsg.  The clients use a small read buffer and no
+ * batching so lots of them don't take much memory.
+ *
+ * Use -n to set the number of clients.  With a large number of
+ * clients this measures how well the accepter finds the connection
+ * for each packet.
+ *
+ * With -c it is run as a test.  It then checks that every packet
+ * echoed has the right contents, that each client got its own
+ * connection on the accepter, and that every client got packets back.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <gensio/gensio.h>
+#include <gensio/gensio_os_funcs.h>
+#include "benchutil.h"
+
+struct client {
+    unsigned int idx;
+    struct gensio *io;
+    unsigned int seq;
+    unsigned long long count;
+};
+
+static struct client *clients;
+static struct gensio **srv_ios;
+static unsigned int nclients = 4, nsrv_ios;
+static unsigned int pktsize = 64, window = 128;
+static unsigned int in_flight, next_client;
+static unsigned long long echoed, bad, total;
+static bool running;
+
+static int
+srv_event(struct gensio *io, void *user_data, int event, int err,
+	  unsigned char *buf, gensiods *buflen, const char *const *auxdata)
+{
+    if (event != GENSIO_EVENT_READ || err)
+	return GE_NOTSUP;
+
+    gensio_write(io, NULL, buf, *buflen, NULL);
+    echoed++;
+    return 0;
+}
+
+static int
+acc_event(struct gensio_accepter *acc, void *user_data, int event,
+	  void *data)
+{
+    struct gensio *io = data;
+
+    if (event != GENSIO_ACC_EVENT_NEW_CONNECTION)
+	return GE_NOTSUP;
+
+    if (nsrv_ios >= nclients) {
+	gensio_free(io);
+	return 0;
+    }
+    srv_ios[nsrv_ios++] = io;
+    gensio_set_callback(io, srv_event, NULL);
+    gensio_set_read_callback_enable(io, true);
+    return 0;
+}
+
+static void
+client_send(struct client *c)
+{
+    unsigned char buf[65536];
+    unsigned int i;
+
+    memcpy(buf, &c->idx, sizeof(c->idx));
+    memcpy(buf + 4, &c->seq, sizeof(c->seq));
+    for (i = 8; i < pktsize; i++)
+	buf[i] = (c->seq + i) & 0xff;
+    c->seq++;
+    if (gensio_write(c->io, NULL, buf, pktsize, NULL) == 0)
+	in_flight++;
+}
+
+static int
+client_event(struct gensio *io, void *user_data, int event, int err,
+	     unsigned char *buf, gensiods *buflen, const char *const *auxdata)
+{
+    struct client *c = user_data;
+    unsigned int i, idx, seq;
+
+    if (event != GENSIO_EVENT_READ || err)
+	return GE_NOTSUP;
+
+    if (*buflen != pktsize) {
+	bad++;
+	return 0;
+    }
+    memcpy(&idx, buf, sizeof(idx));
+    memcpy(&seq, buf + 4, sizeof(seq));
+    if (idx != c->idx)
+	bad++;
+    for (i = 8; i < pktsize; i++) {
+	if (buf[i] != ((seq + i) & 0xff)) {
+	    bad++;
+	    break;
+	}
+    }
+
+    c->count++;
+    total++;
+    if (in_flight > 0)
+	in_flight--;
+    if (running) {
+	client_send(&clients[next_client]);
+	next_client = (next_client + 1) % nclients;
+    }
+    return 0;
+}
+
+static const char *usage =
+    "[-c] [-m <mmsg>] [-n <clients>] [-s <size>] [-w <window>] [-t <seconds>]";
+
+int
+main(int argc, char *argv[])
+{
+    unsigned int mmsg = 1, i, left;
+    unsigned long long last_total;
+    struct gensio_os_proc_data *proc_data;
+    struct rlimit rl;
+    struct gensio_accepter *acc;
+    struct gensio_waiter *waiter;
+    struct gensio_timer *timer;
+    gensio_time start, now, timeout;
+    char str[100], port[20];
+    gensiods len;
+    int rv;
+
+    seconds = 5;
+    while ((rv = bench_getopt(argc, argv, "cm:n:s:w:t:", usage)) != -1) {
+	switch (rv) {
+	case 'm':
+	    mmsg = strtoul(optarg, NULL, 0);
+	    break;
+	case 'n':
+	    nclients = strtoul(optarg, NULL, 0);
+	    break;
+	case 's':
+	    pktsize = strtoul(optarg, NULL, 0);
+	    break;
+	case 'w':
+	    window = strtoul(optarg, NULL, 0);
+	    break;
+	}
+    }
+    if (nclients < 1 || pktsize < 8 || pktsize > 65507 || window < 1)
+	bench_help(argv[0], usage);
+
+    /* One fd per client plus some slack. */
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < nclients + 64) {
+	rl.rlim_cur = rl.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rl);
+	getrlimit(RLIMIT_NOFILE, &rl);
+	if (rl.rlim_cur < nclients + 64) {
+	    fprintf(stderr, "Not enough fds for %u clients, limit is %lu\n",
+		    nclients, (unsigned long) rl.rlim_cur);
+	    return 77;
+	}
+    }
+
+    clients = calloc(nclients, sizeof(*clients));
+    srv_ios = calloc(nclients, sizeof(*srv_ios));
+    if (!clients || !srv_ios) {
+	fprintf(stderr, "Out of memory\n");
+	return 1;
+    }
+
+    rv = gensio_default_os_hnd(0, &o);
+    if (rv) {
+	fprintf(stderr, "Could not allocate OS handler: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    rv = gensio_os_proc_setup(o, &proc_data);
+    if (rv) {
+	fprintf(stderr, "Could not setup process: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    waiter = gensio_os_funcs_alloc_waiter(o);
+    if (!waiter) {
+	fprintf(stderr, "Could not allocate waiter\n");
+	return 1;
+    }
+    /*
+     * Under load the wait never times out because there is always
+     * something to do, so use a timer to wake it up.
+     */
+    timer = gensio_os_funcs_alloc_timer(o, tick, waiter);
+    if (!timer) {
+	fprintf(stderr, "Could not allocate timer\n");
+	return 1;
+    }
+
+    snprintf(str, sizeof(str), "udp(mmsg=%u),127.0.0.1,0", mmsg);
+    rv = str_to_gensio_accepter(str, o, acc_event, NULL, &acc);
+    if (!rv)
+	rv = gensio_acc_startup(acc);
+    if (rv) {
+	fprintf(stderr, "Could not start accepter %s: %s\n", str,
+		gensio_err_to_str(rv));
+	return 1;
+    }
+    strcpy(port, "0");
+    len = sizeof(port);
+    rv = gensio_acc_control(acc, GENSIO_CONTROL_DEPTH_FIRST, true,
+			    GENSIO_ACC_CONTROL_LPORT, port, &len);
+    if (rv) {
+	fprintf(stderr, "Could not get accepter port: %s\n",
+		gensio_err_to_str(rv));
+	return 1;
+    }
+
+    snprintf(str, sizeof(str), "udp(readbuf=%u),127.0.0.1,%s", pktsize, port);
+    for (i = 0; i < nclients; i++) {
+	clients[i].idx = i;
+	rv = str_to_gensio(str, o, client_event, &clients[i], &clients[i].io);
+	if (!rv)
+	    rv = gensio_open_s(clients[i].io);
+	if (rv) {
+	    fprintf(stderr, "Could not open client %s: %s\n", str,
+		    gensio_err_to_str(rv));
+	    return 1;
+	}
+	gensio_set_read_callback_enable(clients[i].io, true);
+    }
+
+    /*
+     * Get each client's connection set up before loading things up,
+     * otherwise the first packets of later clients may keep getting
+     * dropped because the accepter's socket is full.  Do a limited
+     * number at a time for the same reason.
+     */
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    do {
+	for (i = 0, left = 0; i < nclients; i++) {
+	    if (clients[i].count)
+		continue;
+	    if (left++ < 100)
+		client_send(&clients[i]);
+	}
+	if (!left)
+	    break;
+	timeout.secs = 0;
+	timeout.nsecs = 10000000;
+	gensio_os_funcs_start_timer(o, timer, &timeout);
+	gensio_os_funcs_wait(o, waiter, 1, NULL);
+	gensio_os_funcs_get_monotonic_time(o, &now);
+    } while (tv_diff(&now, &start) < 10);
+    for (i = 0; i < nclients; i++)
+	clients[i].count = 0;
+    total = 0;
+    last_total = 0;
+    in_flight = 0;
+
+    running = true;
+    gensio_os_funcs_get_monotonic_time(o, &start);
+    do {
+	/*
+	 * Keep the window full.  UDP may drop packets, so if nothing
+	 * came back in the last interval assume what is in flight is
+	 * lost.
+	 */
+	if (total == last_total)
+	    in_flight = 0;
+	last_total = total;
+	while (in_flight < window) {
+	    client_send(&clients[next_client]);
+	    next_client = (next_client + 1) % nclients;
+	}
+	timeout.secs = 0;
+	timeout.nsecs = 100000000;
+	gensio_os_funcs_start_timer(o, timer, &timeout);
+	gensio_os_funcs_wait(o, waiter, 1, NULL);
+	gensio_os_funcs_get_monotonic_time(o, &now);
+    } while (tv_diff(&now, &start) < seconds);
+    running = false;
+
+    printf("mmsg=%u: %u clients, %llu packets in %.3f seconds,"
+	   " %.0f packets/sec\n", mmsg, nclients, total,
+	   tv_diff(&now, &start), total / tv_diff(&now, &start));
+
+    if (check_it) {
+	if (bad) {
+	    fprintf(stderr, "%llu bad packets received\n", bad);
+	    errs++;
+	}
+	if (nsrv_ios != nclients) {
+	    fprintf(stderr, "Got %u connections for %u clients\n",
+		    nsrv_ios, nclients);
+	    errs++;
+	}
+	for (i = 0, left = 0; i < nclients; i++) {
+	    if (clients[i].count == 0)
+		left++;
+	}
+	if (left) {
+	    fprintf(stderr, "%u clients never got a packet back\n", left);
+	    errs++;
+	}
+    }
+
+    for (i = 0; i < nclients; i++) {
+	gensio_close_s(clients[i].io);
+	gensio_free(clients[i].io);
+    }
+    for (i = 0; i < nsrv_ios; i++)
+	gensio_free(srv_ios[i]);
+    gensio_acc_shutdown_s(acc);
+    gensio_acc_free(acc);
+    gensio_os_funcs_free_timer(o, timer);
+    gensio_os_funcs_free_waiter(o, waiter);
+    gensio_os_proc_cleanup(proc_data);
+    gensio_os_funcs_free(o);
+    free(clients);
+    free(srv_ios);
+
+    return bench_errs("udp errors");
+}
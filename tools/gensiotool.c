@@ -357,6 +357,7 @@ struct gtinfo {
     const char *signature;
     bool print_laddr;
     bool print_raddr;
+    bool splice;
 
     int err;
 
@@ -811,6 +812,17 @@ add_io(struct gtinfo *g, struct gensio *io, bool open_finished)
 
     ioinfo_set_otherioinfo(ioinfo1, ioinfo2);
 
+    if (g->splice) {
+	err = ioinfo_set_splice(ioinfo1, true);
+	if (!err)
+	    err = ioinfo_set_splice(ioinfo2, true);
+	if (err) {
+	    report_err(g, "Could not enable splice: %s",
+		       gensio_err_to_str(err));
+	    goto out_err;
+	}
+    }
+
     err = str_to_gensio(g->ios1, o, parmlog_eventh, &g, &gtconn1->io);
     if (err) {
 	report_err(g, "Could not allocate %s: %s",
@@ -879,6 +891,9 @@ i_handle_term(struct gtinfo *g)
 
 	closed_one = true;
 	if (gtconn->io) {
+	    /* Make sure the splice thread is done with the fd. */
+	    if (g->splice)
+		ioinfo_set_not_ready(gensio_get_user_data(gtconn->io));
 	    gtconn->close_io = gtconn->io;
 	    gtconn->io = NULL;
 	    err = gensio_close(gtconn->close_io, io_closed, NULL);
@@ -1005,6 +1020,8 @@ help(int err)
     printf("  -r, --printremaddr - When the connection opens, print out all"
 	   " the remote addresses.\n");
     printf("  -v, --verbose - Print all gensio logs\n");
+    printf("  --splice - Move data between the gensios with splice() when\n"
+	   "    they are both directly on a file descriptor.\n");
     printf("  --signature <sig> - Set the RFC2217 server signature to <sig>\n");
 #ifndef _WIN32
     printf("  -P, --pidfile <file> - Create a pid file.\n");
@@ -1175,6 +1192,8 @@ main(int argc, char *argv[])
 	    g.print_raddr = true;
 	else if ((rv = cmparg(argc, argv, &arg, "-v", "--verbose", NULL)))
 	    gensio_set_log_mask(GENSIO_LOG_MASK_ALL);
+	else if ((rv = cmparg(argc, argv, &arg, NULL, "--splice", NULL)))
+	    g.splice = true;
 	else if ((rv = cmparg_int(argc, argv, &arg, "-e", "--escchar",
 				  &g.escape_char)))
 	    esc_set = true;
@@ -1225,6 +1244,12 @@ main(int argc, char *argv[])
     if (io1_set && !esc_set)
 	g.escape_char = -1; /* disable */
 
+    if (g.splice && num_extra_threads > 0) {
+	fprintf(stderr, "--splice cannot be used with extra threads\n");
+	rv = GE_INVAL;
+	goto out_err;
+    }
+
     if (arg >= argc) {
 	fprintf(stderr, "No gensio string given to connect to\n");
 	help(1);
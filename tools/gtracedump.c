@@ -0,0 +1,162 @@
+/*
+ * Copyright 2025 Corey Minyard
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Convert a binary trace from the trace gensio (binary=yes) into the
+ * same text the trace gensio writes in its normal mode.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <gensio/gensio.h>
+#include <gensio/gensio_trace.h>
+#include "utils.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+static const char *progname;
+
+static const char *op_str[] = {
+    [GENSIO_TRACE_OP_READ] = "Read",
+    [GENSIO_TRACE_OP_WRITE] = "Write",
+    [GENSIO_TRACE_OP_B4READ] = "b4Read",
+    [GENSIO_TRACE_OP_B4WRITE] = "b4Write",
+};
+
+static void
+help(int err)
+{
+    printf("%s [options] [file]\n", progname);
+    printf("\nA program to print binary trace gensio output as text.\n");
+    printf("The trace is read from stdin if a file isn't given.\n");
+    printf("\noptions are:\n");
+    printf("  -h, --help - This help\n");
+    exit(err);
+}
+
+static uint64_t
+get_le(const unsigned char *d, unsigned int len)
+{
+    uint64_t v = 0;
+
+    while (len > 0)
+	v = (v << 8) | d[--len];
+    return v;
+}
+
+static int
+dump_trace(FILE *in, const char *name)
+{
+    unsigned char hdr[GENSIO_TRACE_HDR_SIZE];
+    unsigned char buf[4096];
+    struct gensio_fdump h;
+    uint32_t len, n;
+    unsigned int op;
+    long long secs;
+    int usecs, err;
+
+    if (fread(hdr, 1, GENSIO_TRACE_MAGIC_LEN, in) != GENSIO_TRACE_MAGIC_LEN ||
+		memcmp(hdr, GENSIO_TRACE_MAGIC, GENSIO_TRACE_MAGIC_LEN) != 0) {
+	fprintf(stderr, "%s: Not a binary gensio trace\n", name);
+	return 1;
+    }
+
+    while ((n = fread(hdr, 1, sizeof(hdr), in)) == sizeof(hdr)) {
+	len = get_le(hdr, 4);
+	op = hdr[4];
+	secs = get_le(hdr + 8, 8);
+	usecs = (get_le(hdr + 16, 4) + 500) / 1000;
+	err = (int32_t) get_le(hdr + 20, 4);
+
+	if (op == GENSIO_TRACE_OP_DROPPED) {
+	    printf("%lld:%6.6d trace dropped %d records\n", secs, usecs, err);
+	    continue;
+	}
+	if (op > GENSIO_TRACE_OP_B4WRITE) {
+	    fprintf(stderr, "%s: Unknown trace record type %u\n", name, op);
+	    return 1;
+	}
+	if (err) {
+	    printf("%lld:%6.6d %s error: %d %s\n", secs, usecs, op_str[op],
+		   err, gensio_err_to_str(err));
+	    continue;
+	}
+
+	printf("%lld:%6.6d %s (%lu):\n", secs, usecs, op_str[op],
+	       (unsigned long) len);
+	gensio_fdump_init(&h, 1);
+	while (len > 0) {
+	    n = len > sizeof(buf) ? sizeof(buf) : len;
+	    if (fread(buf, 1, n, in) != n) {
+		gensio_fdump_buf_finish(stdout, &h);
+		fprintf(stderr, "%s: Trace truncated\n", name);
+		return 1;
+	    }
+	    gensio_fdump_buf(stdout, buf, n, &h);
+	    len -= n;
+	}
+	gensio_fdump_buf_finish(stdout, &h);
+    }
+    if (n != 0) {
+	fprintf(stderr, "%s: Trace truncated\n", name);
+	return 1;
+    }
+
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    int rv, arg;
+    FILE *in = stdin;
+    const char *name = "stdin";
+
+    progname = argv[0];
+
+    for (arg = 1; arg < argc; arg++) {
+	if (argv[arg][0] != '-')
+	    break;
+	if (strcmp(argv[arg], "--") == 0) {
+	    arg++;
+	    break;
+	}
+	if (cmparg(argc, argv, &arg, NULL, "--version", NULL)) {
+	    printf("Version %s\n", gensio_version_string);
+	    exit(0);
+	} else if (cmparg(argc, argv, &arg, "-h", "--help", NULL)) {
+	    help(0);
+	} else {
+	    fprintf(stderr, "Unknown argument: %s, us -h for help\n",
+		    argv[arg]);
+	    return 1;
+	}
+    }
+
+    if (arg < argc) {
+	name = argv[arg];
+	in = fopen(name, "rb");
+	if (!in) {
+	    fprintf(stderr, "Unable to open %s\n", name);
+	    return 1;
+	}
+    } else {
+#ifdef _WIN32
+	_setmode(_fileno(stdin), _O_BINARY);
+#endif
+    }
+
+    rv = dump_trace(in, name);
+    if (in != stdin)
+	fclose(in);
+
+    return rv;
+}
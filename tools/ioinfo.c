@@ -24,13 +24,56 @@
  */
 
 #include "config.h"
+#ifdef HAVE_SPLICE
+#define _GNU_SOURCE /* Get splice(). */
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
 #include <stdlib.h>
 #include <ctype.h>
 #include <errno.h>
 #include <string.h>
+#include <gensio/gensio_os_funcs.h>
 
 #include "ioinfo.h"
 
+#ifdef HAVE_SPLICE
+/*
+ * When both gensios talk straight to a file descriptor, the data
+ * between them is moved with splice() through a pipe for each
+ * direction by a separate thread, so it never gets copied into user
+ * space.  The gensios have their read callbacks disabled while that
+ * runs.  On end of file or an error the thread stops and the
+ * gensios take over again, so they see the end of file or error
+ * themselves and the normal shutdown happens.
+ */
+#define SPLICE_PIPE_SIZE 65536
+
+struct ioinfo_splice {
+    struct gensio_os_funcs *o;
+    struct gensio_lock *lock;
+    unsigned int refcount;
+
+    /* Direction d reads from ioinfo[d]'s gensio, writes the other. */
+    struct ioinfo *ioinfo[2];
+    int infd[2];
+    int outfd[2];
+    int pipe[2][2];
+    gensiods inpipe[2];
+    gensiods count[2];
+
+    /* Written to tell the thread to stop. */
+    int stopfd[2];
+    bool unsupported;
+    bool joined;
+    bool detached;
+
+    struct gensio_thread *thread;
+    struct gensio_runner *done_runner;
+};
+#endif
+
 struct ioinfo {
     struct gensio *io;
     struct ioinfo *otherio;
@@ -53,6 +96,18 @@ struct ioinfo {
 
     struct ioinfo_oob *oob_head;
     struct ioinfo_oob *oob_tail;
+
+    /*
+     * Set if the last read data was not all taken, so the gensio
+     * may be holding read data.
+     */
+    bool read_partial;
+
+    bool splice_ok;
+    bool splice_pending;
+    struct gensio_runner *splice_runner;
+    struct ioinfo_splice *sp;
+    gensiods spliced;
 };
 
 void
@@ -185,6 +240,375 @@ handle_escapechar(struct ioinfo *ioinfo, char c)
     return rv;
 }
 
+#ifdef HAVE_SPLICE
+static void
+splice_free(struct ioinfo_splice *sp)
+{
+    struct gensio_os_funcs *o = sp->o;
+    unsigned int i;
+
+    for (i = 0; i < 2; i++) {
+	if (sp->pipe[i][0] >= 0)
+	    close(sp->pipe[i][0]);
+	if (sp->pipe[i][1] >= 0)
+	    close(sp->pipe[i][1]);
+	if (sp->stopfd[i] >= 0)
+	    close(sp->stopfd[i]);
+    }
+    if (sp->done_runner)
+	gensio_os_funcs_free_runner(o, sp->done_runner);
+    if (sp->lock)
+	gensio_os_funcs_free_lock(o, sp->lock);
+    gensio_os_funcs_zfree(o, sp);
+}
+
+static void
+splice_deref(struct ioinfo_splice *sp)
+{
+    struct gensio_os_funcs *o = sp->o;
+    unsigned int count;
+
+    gensio_os_funcs_lock(o, sp->lock);
+    count = --sp->refcount;
+    gensio_os_funcs_unlock(o, sp->lock);
+    if (count == 0)
+	splice_free(sp);
+}
+
+static void
+splice_thread(void *data)
+{
+    struct ioinfo_splice *sp = data;
+    struct pollfd fds[5];
+    int inidx[2], outidx[2];
+    bool stopping = false;
+    unsigned int d, n;
+    ssize_t rv;
+
+    for (;;) {
+	fds[0].fd = sp->stopfd[0];
+	fds[0].events = POLLIN;
+	n = 1;
+	for (d = 0; d < 2; d++) {
+	    inidx[d] = -1;
+	    outidx[d] = -1;
+	    if (!stopping && sp->inpipe[d] < SPLICE_PIPE_SIZE) {
+		inidx[d] = n;
+		fds[n].fd = sp->infd[d];
+		fds[n++].events = POLLIN;
+	    }
+	    if (sp->inpipe[d] > 0) {
+		outidx[d] = n;
+		fds[n].fd = sp->outfd[d];
+		fds[n++].events = POLLOUT;
+	    }
+	}
+	/* Stop only after what's in the pipes has been written. */
+	if (stopping && n == 1)
+	    break;
+
+	if (poll(fds, n, -1) < 0)
+	    continue;
+	/*
+	 * The gensios are being closed, what's in the pipes is lost
+	 * but waiting for it to be written might hang.
+	 */
+	if (fds[0].revents)
+	    break;
+
+	for (d = 0; d < 2; d++) {
+	    if (inidx[d] >= 0 && fds[inidx[d]].revents) {
+		rv = splice(sp->infd[d], NULL, sp->pipe[d][1], NULL,
+			    SPLICE_PIPE_SIZE - sp->inpipe[d],
+			    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (rv > 0) {
+		    sp->inpipe[d] += rv;
+		} else if (rv == 0) {
+		    /* End of file, leave it for the gensio to see. */
+		    stopping = true;
+		} else if (errno != EAGAIN && errno != EINTR) {
+		    /* EINVAL means splice can't be used on this fd. */
+		    if (errno == EINVAL)
+			sp->unsupported = true;
+		    stopping = true;
+		}
+	    }
+	    if (outidx[d] >= 0 && fds[outidx[d]].revents) {
+		rv = splice(sp->pipe[d][0], NULL, sp->outfd[d], NULL,
+			    sp->inpipe[d], SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (rv > 0) {
+		    sp->inpipe[d] -= rv;
+		    sp->count[d] += rv;
+		} else if (rv < 0 && errno != EAGAIN && errno != EINTR) {
+		    /* The output is broken, what's in the pipe is lost. */
+		    sp->inpipe[d] = 0;
+		    stopping = true;
+		}
+	    }
+	}
+    }
+
+    gensio_os_funcs_run(sp->o, sp->done_runner);
+}
+
+/* Stop the thread and wait for it, it's safe to call this twice. */
+static void
+splice_join(struct ioinfo_splice *sp)
+{
+    struct gensio_os_funcs *o = sp->o;
+    bool joined;
+
+    gensio_os_funcs_lock(o, sp->lock);
+    joined = sp->joined;
+    sp->joined = true;
+    gensio_os_funcs_unlock(o, sp->lock);
+    if (joined)
+	return;
+    if (write(sp->stopfd[1], "", 1) != 1)
+	; /* The pipe is empty, this can't fail.  Keep gcc quiet. */
+    gensio_os_wait_thread(sp->thread);
+}
+
+/*
+ * Give the data transfer back to the gensios.  The thread must have
+ * been stopped.
+ */
+static void
+splice_detach(struct ioinfo_splice *sp, bool restart)
+{
+    struct gensio_os_funcs *o = sp->o;
+    struct ioinfo *ioinfo;
+    bool detached;
+    unsigned int i;
+
+    gensio_os_funcs_lock(o, sp->lock);
+    detached = sp->detached;
+    sp->detached = true;
+    gensio_os_funcs_unlock(o, sp->lock);
+    if (detached)
+	return;
+
+    for (i = 0; i < 2; i++) {
+	ioinfo = sp->ioinfo[i];
+	gensio_os_funcs_lock(o, ioinfo->lock);
+	ioinfo->sp = NULL;
+	ioinfo->spliced += sp->count[i];
+	if (sp->unsupported)
+	    ioinfo->splice_ok = false;
+	if (restart && ioinfo->ready)
+	    gensio_set_read_callback_enable(ioinfo->io, true);
+	gensio_os_funcs_unlock(o, ioinfo->lock);
+    }
+    splice_deref(sp);
+}
+
+static void
+splice_done(struct gensio_runner *r, void *cb_data)
+{
+    struct ioinfo_splice *sp = cb_data;
+
+    splice_join(sp);
+    splice_detach(sp, true);
+    splice_deref(sp);
+}
+
+static void
+splice_stop(struct ioinfo *ioinfo)
+{
+    struct gensio_os_funcs *o = ioinfo->o;
+    struct ioinfo_splice *sp;
+
+    gensio_os_funcs_lock(o, ioinfo->lock);
+    sp = ioinfo->sp;
+    if (sp) {
+	gensio_os_funcs_lock(o, sp->lock);
+	sp->refcount++;
+	gensio_os_funcs_unlock(o, sp->lock);
+    }
+    gensio_os_funcs_unlock(o, ioinfo->lock);
+    if (!sp)
+	return;
+
+    splice_join(sp);
+    splice_detach(sp, false);
+    splice_deref(sp);
+}
+
+static int
+splice_get_fd(struct ioinfo *ioinfo, const char *which)
+{
+    struct gensio_iod *iod;
+    gensiods len = sizeof(iod);
+    int rv;
+
+    /* Passes in which one as a string, the iod comes back in its place. */
+    memcpy(&iod, which, 2);
+    rv = gensio_control(ioinfo->io, 0, GENSIO_CONTROL_GET,
+			GENSIO_CONTROL_RAW_IOD, (char *) &iod, &len);
+    if (rv)
+	return -1;
+    return ioinfo->o->iod_get_fd(iod);
+}
+
+/*
+ * Called when the read callbacks for the gensios are disabled and no
+ * read data is held in them to start moving data with splice.
+ * Returns false if that can't be done.
+ */
+static bool
+splice_start(struct ioinfo *ioinfo)
+{
+    struct gensio_os_funcs *o = ioinfo->o;
+    struct ioinfo *rioinfo = ioinfo->otherio;
+    struct ioinfo_splice *sp;
+    unsigned int i;
+    int rv;
+
+    sp = gensio_os_funcs_zalloc(o, sizeof(*sp));
+    if (!sp)
+	return false;
+    sp->o = o;
+    sp->ioinfo[0] = ioinfo;
+    sp->ioinfo[1] = rioinfo;
+    for (i = 0; i < 2; i++) {
+	sp->pipe[i][0] = -1;
+	sp->pipe[i][1] = -1;
+	sp->stopfd[i] = -1;
+    }
+
+    /* splice() would lose the message boundaries. */
+    if (gensio_is_packet(ioinfo->io) || gensio_is_packet(rioinfo->io)) {
+	ioinfo->splice_ok = false;
+	rioinfo->splice_ok = false;
+	goto out_err;
+    }
+
+    for (i = 0; i < 2; i++) {
+	sp->infd[i] = splice_get_fd(sp->ioinfo[i], "0");
+	sp->outfd[!i] = splice_get_fd(sp->ioinfo[i], "1");
+	if (sp->infd[i] < 0 || sp->outfd[!i] < 0) {
+	    /* Not an fd, or there's a filter.  Don't try again. */
+	    ioinfo->splice_ok = false;
+	    rioinfo->splice_ok = false;
+	    goto out_err;
+	}
+    }
+
+    sp->lock = gensio_os_funcs_alloc_lock(o);
+    if (!sp->lock)
+	goto out_err;
+    sp->done_runner = gensio_os_funcs_alloc_runner(o, splice_done, sp);
+    if (!sp->done_runner)
+	goto out_err;
+    if (pipe2(sp->pipe[0], O_NONBLOCK | O_CLOEXEC) ||
+		pipe2(sp->pipe[1], O_NONBLOCK | O_CLOEXEC) ||
+		pipe2(sp->stopfd, O_NONBLOCK | O_CLOEXEC))
+	goto out_err;
+
+    /* One ref for the ioinfos, one for the thread. */
+    sp->refcount = 2;
+    rv = gensio_os_new_thread(o, splice_thread, sp, &sp->thread);
+    if (rv) {
+	if (rv == GE_NOTSUP) {
+	    ioinfo->splice_ok = false;
+	    rioinfo->splice_ok = false;
+	}
+	goto out_err;
+    }
+    for (i = 0; i < 2; i++) {
+	gensio_os_funcs_lock(o, sp->ioinfo[i]->lock);
+	sp->ioinfo[i]->sp = sp;
+	gensio_os_funcs_unlock(o, sp->ioinfo[i]->lock);
+    }
+    return true;
+
+ out_err:
+    splice_free(sp);
+    return false;
+}
+
+/*
+ * Run from a runner after a read where all the data was taken, the
+ * gensio that read it has its read callback disabled.  Since only one
+ * thread runs callbacks (see ioinfo_set_splice()), no read callback
+ * can be running on the other gensio here.
+ */
+static void
+splice_try(struct gensio_runner *r, void *cb_data)
+{
+    struct ioinfo *ioinfo = cb_data;
+    struct gensio_os_funcs *o = ioinfo->o;
+    struct ioinfo *rioinfo = ioinfo->otherio;
+    bool ok, started = false;
+
+    gensio_os_funcs_lock(o, ioinfo->lock);
+    ioinfo->splice_pending = false;
+    ok = ioinfo->ready && ioinfo->splice_ok && !ioinfo->sp &&
+	!ioinfo->oob_head;
+    gensio_os_funcs_unlock(o, ioinfo->lock);
+
+    if (ok) {
+	gensio_os_funcs_lock(o, rioinfo->lock);
+	ok = rioinfo->ready && rioinfo->splice_ok && !rioinfo->read_partial &&
+	    !rioinfo->oob_head;
+	if (ok)
+	    gensio_set_read_callback_enable(rioinfo->io, false);
+	gensio_os_funcs_unlock(o, rioinfo->lock);
+    }
+
+    if (ok) {
+	started = splice_start(ioinfo);
+	if (!started) {
+	    gensio_os_funcs_lock(o, rioinfo->lock);
+	    if (rioinfo->ready)
+		gensio_set_read_callback_enable(rioinfo->io, true);
+	    gensio_os_funcs_unlock(o, rioinfo->lock);
+	}
+    }
+
+    if (!started) {
+	gensio_os_funcs_lock(o, ioinfo->lock);
+	if (ioinfo->ready)
+	    gensio_set_read_callback_enable(ioinfo->io, true);
+	gensio_os_funcs_unlock(o, ioinfo->lock);
+    }
+}
+#endif
+
+int
+ioinfo_set_splice(struct ioinfo *ioinfo, bool enable)
+{
+#ifdef HAVE_SPLICE
+    struct gensio_os_funcs *o = ioinfo->o;
+
+    if (enable && !ioinfo->splice_runner) {
+	ioinfo->splice_runner = gensio_os_funcs_alloc_runner(o, splice_try,
+							     ioinfo);
+	if (!ioinfo->splice_runner)
+	    return GE_NOMEM;
+    }
+    gensio_os_funcs_lock(o, ioinfo->lock);
+    ioinfo->splice_ok = enable;
+    gensio_os_funcs_unlock(o, ioinfo->lock);
+    return 0;
+#else
+    if (enable)
+	return GE_NOTSUP;
+    return 0;
+#endif
+}
+
+gensiods
+ioinfo_splice_count(struct ioinfo *ioinfo)
+{
+    gensiods count;
+
+    gensio_os_funcs_lock(ioinfo->o, ioinfo->lock);
+    count = ioinfo->spliced;
+    gensio_os_funcs_unlock(ioinfo->o, ioinfo->lock);
+    return count;
+}
+
 static int
 io_event(struct gensio *io, void *user_data, int event, int err,
 	 unsigned char *buf, gensiods *buflen,
@@ -276,6 +700,7 @@ io_event(struct gensio *io, void *user_data, int event, int err,
 		gensio_set_read_callback_enable(ioinfo->io, false);
 	    icount = 0;
 	}
+	ioinfo->read_partial = icount < *buflen;
 	if (icount < *buflen) {
 	    *buflen = icount;
 	    if (ioinfo->ready)
@@ -290,6 +715,19 @@ io_event(struct gensio *io, void *user_data, int event, int err,
 	    (*buflen)++;
 	    ioinfo->in_escape = true;
 	    ioinfo->escape_pos = 0;
+#ifdef HAVE_SPLICE
+	} else if (ioinfo->splice_ok && rioinfo->splice_ok &&
+		   ioinfo->escape_char < 0 && !ioinfo->splice_pending &&
+		   !rioinfo->read_partial) {
+	    /*
+	     * Everything was taken, so nothing is held in the gensio.
+	     * Stop reading and try to switch to splice once this
+	     * returns.
+	     */
+	    gensio_set_read_callback_enable(ioinfo->io, false);
+	    ioinfo->splice_pending = true;
+	    gensio_os_funcs_run(o, ioinfo->splice_runner);
+#endif
 	}
 	gensio_os_funcs_unlock(o, rioinfo->lock);
 	return 0;
@@ -337,7 +775,8 @@ io_event(struct gensio *io, void *user_data, int event, int err,
 	gensio_os_funcs_unlock(o, ioinfo->lock);
 
 	gensio_os_funcs_lock(o, rioinfo->lock);
-	if (rioinfo->ready)
+	/* If splicing, the reads are done there. */
+	if (rioinfo->ready && !rioinfo->sp)
 	    gensio_set_read_callback_enable(rioinfo->io, true);
 	gensio_os_funcs_unlock(o, rioinfo->lock);
 	return 0;
@@ -423,6 +862,10 @@ ioinfo_set_ready(struct ioinfo *ioinfo, struct gensio *io)
 void
 ioinfo_set_not_ready(struct ioinfo *ioinfo)
 {
+#ifdef HAVE_SPLICE
+    /* Make sure nothing is using the fds after this. */
+    splice_stop(ioinfo);
+#endif
     gensio_os_funcs_lock(ioinfo->o, ioinfo->lock);
     if (ioinfo->io) {
 	gensio_set_read_callback_enable(ioinfo->io, false);
@@ -469,6 +912,11 @@ alloc_ioinfo(struct gensio_os_funcs *o,
 void
 free_ioinfo(struct ioinfo *ioinfo)
 {
+#ifdef HAVE_SPLICE
+    splice_stop(ioinfo);
+#endif
+    if (ioinfo->splice_runner)
+	gensio_os_funcs_free_runner(ioinfo->o, ioinfo->splice_runner);
     gensio_os_funcs_free_lock(ioinfo->o, ioinfo->lock);
     gensio_os_funcs_zfree(ioinfo->o, ioinfo);
 }
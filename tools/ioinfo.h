@@ -201,6 +201,22 @@ struct ioinfo_oob
  */
 void ioinfo_sendoob(struct ioinfo *ioinfo, struct ioinfo_oob *oobinfo);
 
+/*
+ * Allow data to be moved with splice() instead of being copied
+ * through the gensios.  This must be set on both ioinfos, and is only
+ * used if both gensios are directly on top of a file descriptor (see
+ * GENSIO_CONTROL_RAW_IOD), there is no escape character, and they are
+ * not packet gensios.  Otherwise the data is copied as normal.  A
+ * thread is started to do the splicing, the callbacks for the gensios
+ * must only be run from one thread, and the os funcs must have a wake
+ * signal so the thread can wake it when it's done.  Returns GE_NOTSUP if splice()
+ * is not available.
+ */
+int ioinfo_set_splice(struct ioinfo *ioinfo, bool enable);
+
+/* Return the number of bytes read from the ioinfo's gensio by splice. */
+gensiods ioinfo_splice_count(struct ioinfo *ioinfo);
+
 /*
  * Allocate an ioinfo.
  *